@@ -159,169 +159,1735 @@ internal b8 LoadAnimation(AnimationPlayer *player, AS_Handle handle)
     }
     return result;
 }
-internal void StartLoopedAnimation(AnimationPlayer *player, AS_Handle handle)
+
+// The remap is cached on the skeleton, keyed by the handle of the animation. Bone names are hashed once per pair, and
+// compared on a SID match in case of collisions. The table grows with the animations played on the skeleton, the
+// remaps of animations that were unloaded are rebuilt in place for new ones.
+internal AnimationRemap *GetAnimationRemap(Arena *arena, LoadedSkeleton *skeleton, AS_Handle handle,
+                                           KeyframedAnimation *animation)
+{
+    AnimationRemap *remap = 0;
+    AnimationRemap *stale = 0;
+    for (AnimationRemapChunk *chunk = skeleton->firstRemapChunk; chunk && !remap; chunk = chunk->next)
+    {
+        for (u32 i = 0; i < chunk->count; i++)
+        {
+            AnimationRemap *candidate = &chunk->remaps[i];
+            if (candidate->handle.i64[0] == handle.i64[0])
+            {
+                if (candidate->animation == animation)
+                {
+                    return candidate;
+                }
+                // Built while the animation was still loading
+                remap = candidate;
+                break;
+            }
+            if (!stale && AS_GetSlotAsset(candidate->handle) == 0)
+            {
+                stale = candidate;
+            }
+        }
+    }
+
+    remap = remap ? remap : stale;
+    if (!remap)
+    {
+        AnimationRemapChunk *chunk = skeleton->lastRemapChunk;
+        if (!chunk || chunk->count == SKELETON_ANIMATION_REMAP_CHUNK_SIZE)
+        {
+            chunk = PushStruct(arena, AnimationRemapChunk);
+            QueuePush(skeleton->firstRemapChunk, skeleton->lastRemapChunk, chunk);
+        }
+        remap = &chunk->remaps[chunk->count++];
+    }
+    // A rebuilt remap keeps its arrays when they are large enough
+    if (remap->channelCapacity < Max(animation->numNodes, 1u))
+    {
+        remap->channelCapacity = Max(animation->numNodes, 1u);
+        remap->channelToBone   = PushArrayNoZero(arena, i32, remap->channelCapacity);
+    }
+    if (!remap->boneToChannel)
+    {
+        remap->boneToChannel = PushArrayNoZero(arena, i32, Max(skeleton->count, 1u));
+    }
+    remap->handle    = handle;
+    remap->animation = animation;
+    MemorySet(remap->boneToChannel, 0xff, sizeof(i32) * skeleton->count);
+
+    TempArena temp = ScratchStart(&arena, 1);
+    u32 hashSize   = (u32)GetNextPowerOfTwo(Max(skeleton->count * 2, 1u));
+    i32 *hashSlots = PushArrayNoZero(temp.arena, i32, hashSize);
+    MemorySet(hashSlots, 0xff, sizeof(i32) * hashSize);
+    for (u32 boneIndex = 0; boneIndex < skeleton->count; boneIndex++)
+    {
+        u32 slot = GetSID(skeleton->names[boneIndex]) & (hashSize - 1);
+        while (hashSlots[slot] != -1)
+        {
+            slot = (slot + 1) & (hashSize - 1);
+        }
+        hashSlots[slot] = boneIndex;
+    }
+    for (u32 channelIndex = 0; channelIndex < animation->numNodes; channelIndex++)
+    {
+        string name                        = animation->boneChannels[channelIndex].name;
+        remap->channelToBone[channelIndex] = -1;
+        for (u32 slot = GetSID(name) & (hashSize - 1); hashSlots[slot] != -1; slot = (slot + 1) & (hashSize - 1))
+        {
+            i32 boneIndex = hashSlots[slot];
+            if (skeleton->names[boneIndex] == name)
+            {
+                remap->channelToBone[channelIndex] = boneIndex;
+                remap->boneToChannel[boneIndex]    = channelIndex;
+                break;
+            }
+        }
+    }
+    ScratchEnd(temp);
+    return remap;
+}
+
+// Decodes one component of a track for the four lanes of a group
+inline __m128 DecodeAnimationTrack(const u8 *data, u32 bits, const f32 *min, const f32 *extent)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i packed;
+    __m128 result;
+    switch (bits)
+    {
+        case 0:
+        {
+            result = _mm_loadu_ps(min);
+        }
+        break;
+        case 8:
+        {
+            i32 bytes;
+            MemoryCopy(&bytes, data, sizeof(bytes));
+            packed = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+            packed = _mm_unpacklo_epi16(packed, zero);
+            result = _mm_mul_ps(_mm_cvtepi32_ps(packed), _mm_set1_ps(1.f / 255.f));
+            result = _mm_madd_ps(result, _mm_loadu_ps(extent), _mm_loadu_ps(min));
+        }
+        break;
+        case 16:
+        {
+            packed = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)data), zero);
+            result = _mm_mul_ps(_mm_cvtepi32_ps(packed), _mm_set1_ps(1.f / 65535.f));
+            result = _mm_madd_ps(result, _mm_loadu_ps(extent), _mm_loadu_ps(min));
+        }
+        break;
+        default:
+        {
+            Assert(bits == 32);
+            result = _mm_loadu_ps((const f32 *)data);
+        }
+        break;
+    }
+    return result;
+}
+
+inline __m128 SelectGroup(__m128 mask, __m128 a, __m128 b)
+{
+    __m128 result = _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    return result;
+}
+
+// Decodes one sample of a group, translation xyz, rotation xyzw, scale xyz
+internal void DecodeAnimationGroup(const AnimationGroupFormat *format, const u8 *data, __m128 *out)
+{
+    u32 translationSize = 4 * (format->translationBits / 8);
+    u32 rotationSize    = 4 * (format->rotationBits / 8);
+    u32 scaleSize       = 4 * (format->scaleBits / 8);
+    for (u32 i = 0; i < 3; i++)
+    {
+        out[i] = DecodeAnimationTrack(data, format->translationBits, format->translationMin[i],
+                                      format->translationExtent[i]);
+        data += translationSize;
+    }
+
+    u32 indices = format->rotationIndices;
+    if (format->rotationBits)
+    {
+        indices = *data++;
+    }
+    __m128 smallest[3];
+    __m128 length = _mm_setzero_ps();
+    for (u32 i = 0; i < 3; i++)
+    {
+        smallest[i] = DecodeAnimationTrack(data, format->rotationBits, format->rotationMin[i],
+                                           format->rotationExtent[i]);
+        length      = _mm_madd_ps(smallest[i], smallest[i], length);
+        data += rotationSize;
+    }
+    __m128 largest = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.f), length), _mm_setzero_ps()));
+
+    // Component k is the largest one when it was dropped, otherwise the stored component k or k - 1 depending on
+    // whether it comes before the dropped one
+    __m128i dropped = _mm_setr_epi32(indices & 3, (indices >> 2) & 3, (indices >> 4) & 3, (indices >> 6) & 3);
+    for (i32 k = 0; k < 4; k++)
+    {
+        __m128i index      = _mm_set1_epi32(k);
+        __m128 isDropped   = _mm_castsi128_ps(_mm_cmpeq_epi32(dropped, index));
+        __m128 beforeIndex = _mm_castsi128_ps(_mm_cmpgt_epi32(dropped, index));
+        __m128 stored      = SelectGroup(beforeIndex, smallest[Min(k, 2)], smallest[Max(k - 1, 0)]);
+        out[3 + k]         = SelectGroup(isDropped, largest, stored);
+    }
+
+    for (u32 i = 0; i < 3; i++)
+    {
+        out[7 + i] = DecodeAnimationTrack(data, format->scaleBits, format->scaleMin[i], format->scaleExtent[i]);
+        data += scaleSize;
+    }
+}
+
+// Samples every channel at time, four at a time. The two closest samples are found directly from the sample rate,
+// decoded and interpolated, rotations with a normalized lerp along the shortest path. Groups without any active bone
+// are skipped when there are activeBones.
+internal void SampleAnimation(const KeyframedAnimation *animation, const AnimationRemap *remap, f32 time,
+                              AnimationPose *pose, const b8 *activeBones = 0)
+{
+    if (animation->numSamples == 0)
+    {
+        return;
+    }
+    f32 sample   = Clamp(time * animation->sampleRate, 0.f, (f32)(animation->numSamples - 1));
+    u32 sample0  = (u32)sample;
+    u32 sample1  = Min(sample0 + 1, animation->numSamples - 1);
+    f32 fraction = sample - (f32)sample0;
+
+    const u8 *data0 = animation->sampleData + sample0 * animation->sampleStride;
+    const u8 *data1 = animation->sampleData + sample1 * animation->sampleStride;
+
+    __m128 t        = _mm_set1_ps(fraction);
+    __m128 one      = _mm_set1_ps(1.f);
+    __m128 signMask = _mm_set1_ps(-0.f);
+
+    for (u32 groupIndex = 0; groupIndex < animation->numGroups; groupIndex++)
+    {
+        u32 laneMask  = 0;
+        u32 laneCount = Min((u32)ANIMATION_GROUP_SIZE, animation->numNodes - groupIndex * ANIMATION_GROUP_SIZE);
+        for (u32 lane = 0; lane < laneCount; lane++)
+        {
+            i32 boneIndex = remap->channelToBone[groupIndex * ANIMATION_GROUP_SIZE + lane];
+            if (boneIndex != -1 && (!activeBones || activeBones[boneIndex]))
+            {
+                laneMask |= 1u << lane;
+            }
+        }
+        if (!laneMask)
+        {
+            continue;
+        }
+
+        const AnimationGroupFormat *format = &animation->groups[groupIndex];
+        __m128 a[10];
+        __m128 b[10];
+        DecodeAnimationGroup(format, data0 + format->offset, a);
+        DecodeAnimationGroup(format, data1 + format->offset, b);
+
+        // translation xyz, rotation xyzw, scale xyz
+        __m128 result[10];
+        for (u32 i = 0; i < 3; i++)
+        {
+            result[i]     = _mm_madd_ps(_mm_sub_ps(b[i], a[i]), t, a[i]);
+            result[7 + i] = _mm_madd_ps(_mm_sub_ps(b[7 + i], a[7 + i]), t, a[7 + i]);
+        }
+
+        __m128 dot = _mm_setzero_ps();
+        for (u32 i = 3; i < 7; i++)
+        {
+            dot = _mm_madd_ps(a[i], b[i], dot);
+        }
+        // Flips b into the same hemisphere as a
+        __m128 flip   = _mm_and_ps(dot, signMask);
+        __m128 length = _mm_setzero_ps();
+        for (u32 i = 3; i < 7; i++)
+        {
+            __m128 rotationBFlipped = _mm_xor_ps(b[i], flip);
+            result[i]               = _mm_madd_ps(_mm_sub_ps(rotationBFlipped, a[i]), t, a[i]);
+            length                  = _mm_madd_ps(result[i], result[i], length);
+        }
+        __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(length));
+        for (u32 i = 3; i < 7; i++)
+        {
+            result[i] = _mm_mul_ps(result[i], invLength);
+        }
+
+        alignas(16) f32 lanes[10][ANIMATION_GROUP_SIZE];
+        for (u32 i = 0; i < 10; i++)
+        {
+            _mm_store_ps(lanes[i], result[i]);
+        }
+        for (u32 lane = 0; lane < laneCount; lane++)
+        {
+            if (!(laneMask & (1u << lane)))
+            {
+                continue;
+            }
+            i32 boneIndex                 = remap->channelToBone[groupIndex * ANIMATION_GROUP_SIZE + lane];
+            pose->translations[boneIndex] = {lanes[0][lane], lanes[1][lane], lanes[2][lane]};
+            pose->rotations[boneIndex]    = {lanes[3][lane], lanes[4][lane], lanes[5][lane], lanes[6][lane]};
+            pose->scales[boneIndex]       = {lanes[7][lane], lanes[8][lane], lanes[9][lane]};
+        }
+    }
+}
+
+// Bones that the animation doesn't move are left untouched in the pose. The remap has to be built for the current
+// animation, so the player is loaded beforehand.
+internal void PlayCurrentAnimation(AnimationPlayer *player, const AnimationRemap *remap, f32 dT, AnimationPose *pose,
+                                   const b8 *activeBones = 0)
+{
+    if (!player->loaded)
+    {
+        return;
+    }
+    KeyframedAnimation *animation = player->currentAnimation;
+    Assert(remap->animation == animation);
+    SampleAnimation(animation, remap, player->currentTime, pose, activeBones);
+
+    player->previousTime = player->currentTime;
+    player->loopCount    = 0;
+    player->currentTime += dT * player->playbackRate;
+    if (player->currentTime > player->duration)
+    {
+        if (player->isLooping && player->duration > 0.f)
+        {
+            player->loopCount = (u32)(player->currentTime / player->duration);
+            player->currentTime -= player->loopCount * player->duration;
+        }
+        else
+        {
+            // Holds the last sample
+            player->currentTime = player->duration;
+        }
+    }
+}
+
+// out = a * b, out may alias b
+internal void MultiplyBoneMatrices(const Mat4 *a, const Mat4 *b, Mat4 *out)
+{
+    __m128 a0 = _mm_loadu_ps(a->elements[0]);
+    __m128 a1 = _mm_loadu_ps(a->elements[1]);
+    __m128 a2 = _mm_loadu_ps(a->elements[2]);
+    __m128 a3 = _mm_loadu_ps(a->elements[3]);
+    for (u32 i = 0; i < 4; i++)
+    {
+        __m128 column = _mm_mul_ps(a0, _mm_set1_ps(b->elements[i][0]));
+        column        = _mm_madd_ps(a1, _mm_set1_ps(b->elements[i][1]), column);
+        column        = _mm_madd_ps(a2, _mm_set1_ps(b->elements[i][2]), column);
+        column        = _mm_madd_ps(a3, _mm_set1_ps(b->elements[i][3]), column);
+        _mm_storeu_ps(out->elements[i], column);
+    }
+}
+
+// Same as ConvertToMatrix, four bones at a time. out holds count rounded up to 4 matrices, the lanes past count
+// repeat the last bone.
+internal void ConvertPoseToMatrices(const AnimationPose *pose, u32 count, Mat4 *out)
+{
+    __m128 one = _mm_set1_ps(1.f);
+    __m128 two = _mm_set1_ps(2.f);
+    for (u32 bone = 0; bone < count; bone += 4)
+    {
+        u32 b[4];
+        for (u32 lane = 0; lane < 4; lane++)
+        {
+            b[lane] = Min(bone + lane, count - 1);
+        }
+
+        __m128 x = _mm_loadu_ps(pose->rotations[b[0]].elements);
+        __m128 y = _mm_loadu_ps(pose->rotations[b[1]].elements);
+        __m128 z = _mm_loadu_ps(pose->rotations[b[2]].elements);
+        __m128 w = _mm_loadu_ps(pose->rotations[b[3]].elements);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128 invLength = _mm_madd_ps(x, x, _mm_mul_ps(y, y));
+        invLength        = _mm_madd_ps(z, z, invLength);
+        invLength        = _mm_madd_ps(w, w, invLength);
+        invLength        = _mm_div_ps(one, _mm_sqrt_ps(invLength));
+        x                = _mm_mul_ps(x, invLength);
+        y                = _mm_mul_ps(y, invLength);
+        z                = _mm_mul_ps(z, invLength);
+        w                = _mm_mul_ps(w, invLength);
+
+        __m128 xx = _mm_mul_ps(x, x);
+        __m128 yy = _mm_mul_ps(y, y);
+        __m128 zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y);
+        __m128 xz = _mm_mul_ps(x, z);
+        __m128 yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x);
+        __m128 wy = _mm_mul_ps(w, y);
+        __m128 wz = _mm_mul_ps(w, z);
+
+        __m128 scaleX = _mm_setr_ps(pose->scales[b[0]].x, pose->scales[b[1]].x, pose->scales[b[2]].x,
+                                     pose->scales[b[3]].x);
+        __m128 scaleY = _mm_setr_ps(pose->scales[b[0]].y, pose->scales[b[1]].y, pose->scales[b[2]].y,
+                                     pose->scales[b[3]].y);
+        __m128 scaleZ = _mm_setr_ps(pose->scales[b[0]].z, pose->scales[b[1]].z, pose->scales[b[2]].z,
+                                     pose->scales[b[3]].z);
+
+        // Rows of the rotation and scale columns, one bone per lane
+        __m128 columns[4][4];
+        columns[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scaleX);
+        columns[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scaleX);
+        columns[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scaleX);
+        columns[0][3] = _mm_setzero_ps();
+        columns[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scaleY);
+        columns[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scaleY);
+        columns[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scaleY);
+        columns[1][3] = _mm_setzero_ps();
+        columns[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scaleZ);
+        columns[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scaleZ);
+        columns[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scaleZ);
+        columns[2][3] = _mm_setzero_ps();
+        columns[3][0] = _mm_setr_ps(pose->translations[b[0]].x, pose->translations[b[1]].x,
+                                    pose->translations[b[2]].x, pose->translations[b[3]].x);
+        columns[3][1] = _mm_setr_ps(pose->translations[b[0]].y, pose->translations[b[1]].y,
+                                    pose->translations[b[2]].y, pose->translations[b[3]].y);
+        columns[3][2] = _mm_setr_ps(pose->translations[b[0]].z, pose->translations[b[1]].z,
+                                    pose->translations[b[2]].z, pose->translations[b[3]].z);
+        columns[3][3] = one;
+
+        for (u32 column = 0; column < 4; column++)
+        {
+            _MM_TRANSPOSE4_PS(columns[column][0], columns[column][1], columns[column][2], columns[column][3]);
+            for (u32 lane = 0; lane < 4; lane++)
+            {
+                _mm_storeu_ps(out[bone + lane].elements[column], columns[column][lane]);
+            }
+        }
+    }
+}
+
+// Boxes of LoadedSkeleton::boneBounds moved by the model space bone transforms. The skinned vertices are weighted
+// averages of points in these boxes, so they are inside.
+internal Rect3 GetSkinnedBounds(const LoadedSkeleton *skeleton, const Mat4 *modelTransforms)
+{
+    __m128 half     = _mm_set1_ps(0.5f);
+    __m128 signMask = _mm_set1_ps(-0.f);
+    __m128 minP     = _mm_set1_ps(FLT_MAX);
+    __m128 maxP     = _mm_set1_ps(-FLT_MAX);
+    for (u32 i = 0; i < skeleton->count; i++)
+    {
+        const Rect3 *box = &skeleton->boneBounds[i];
+        if (box->minX > box->maxX)
+        {
+            continue;
+        }
+        __m128 boxMin = _mm_setr_ps(box->minX, box->minY, box->minZ, 0.f);
+        __m128 boxMax = _mm_setr_ps(box->maxX, box->maxY, box->maxZ, 0.f);
+        __m128 center = _mm_mul_ps(_mm_add_ps(boxMin, boxMax), half);
+        __m128 extent = _mm_mul_ps(_mm_sub_ps(boxMax, boxMin), half);
+
+        // The center moves with the transform, the extent with its absolute value
+        __m128 newCenter = _mm_loadu_ps(modelTransforms[i].elements[3]);
+        __m128 newExtent = _mm_setzero_ps();
+        for (u32 axis = 0; axis < 3; axis++)
+        {
+            __m128 column = _mm_loadu_ps(modelTransforms[i].elements[axis]);
+            __m128 c      = _mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0));
+            __m128 e      = _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 0, 0, 0));
+            newCenter     = _mm_madd_ps(column, c, newCenter);
+            newExtent     = _mm_madd_ps(_mm_andnot_ps(signMask, column), e, newExtent);
+            center        = _mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 3, 2, 1));
+            extent        = _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 3, 2, 1));
+        }
+        minP = _mm_min_ps(minP, _mm_sub_ps(newCenter, newExtent));
+        maxP = _mm_max_ps(maxP, _mm_add_ps(newCenter, newExtent));
+    }
+
+    f32 lanes[2][4];
+    _mm_storeu_ps(lanes[0], minP);
+    _mm_storeu_ps(lanes[1], maxP);
+    Rect3 result;
+    result.minP = V3{lanes[0][0], lanes[0][1], lanes[0][2]};
+    result.maxP = V3{lanes[1][0], lanes[1][1], lanes[1][2]};
+    return result;
+}
+
+// Bones are stored parents first (checked when the skeleton is loaded), so the model space transforms are built in
+// one pass over the local ones. outBounds gets the mesh space bounds of the skinned vertices, empty (min > max) when
+// no bone moves any.
+internal void SkinModelToAnimation(const LoadedSkeleton *skeleton, const AnimationPose *pose, Mat4 *outFinalTransforms,
+                                   Rect3 *outBounds = 0)
+{
+    TempArena temp       = ScratchStart(0, 0);
+    Mat4 *modelTransform = PushArrayNoZero(temp.arena, Mat4, (skeleton->count + 3) & ~3u);
+    ConvertPoseToMatrices(pose, skeleton->count, modelTransform);
+
+    for (u32 id = 0; id < skeleton->count; id++)
+    {
+        i32 parentId = skeleton->parents[id];
+        if (parentId != -1)
+        {
+            MultiplyBoneMatrices(&modelTransform[parentId], &modelTransform[id], &modelTransform[id]);
+        }
+        MultiplyBoneMatrices(&modelTransform[id], &skeleton->inverseBindPoses[id], &outFinalTransforms[id]);
+    }
+    if (outBounds)
+    {
+        *outBounds = GetSkinnedBounds(skeleton, modelTransform);
+    }
+    ScratchEnd(temp);
+}
+
+//////////////////////////////
+// CPU skinning
+//
+// Inputs of vertex i, decoded the way skinning_cs.hlsl reads them
+internal void GetSkinningVertex(const Mesh *mesh, b32 quantized, V3 minP, V3 extent, u32 i, V3 *position,
+                                V3 *normal, V3 *tangent, u32 *boneIds, f32 *boneWeights)
+{
+    if (quantized)
+    {
+        const U16V4 *q = &mesh->quantizedPositions[i];
+        position->x    = minP.x + (q->elements[0] / 65535.f) * extent.x;
+        position->y    = minP.y + (q->elements[1] / 65535.f) * extent.y;
+        position->z    = minP.z + (q->elements[2] / 65535.f) * extent.z;
+        *normal        = DecodeOctahedral(mesh->octNormals[i]);
+        *tangent       = DecodeOctahedral(mesh->octTangents[i]);
+        for (u32 j = 0; j < MAX_MATRICES_PER_VERTEX; j++)
+        {
+            boneIds[j]     = (mesh->packedBoneIds[i] >> (8 * j)) & 0xff;
+            boneWeights[j] = ((mesh->packedBoneWeights[i] >> (8 * j)) & 0xff) / 255.f;
+        }
+    }
+    else
+    {
+        *position = mesh->positions[i];
+        *normal   = mesh->normals[i];
+        *tangent  = mesh->tangents[i];
+        for (u32 j = 0; j < MAX_MATRICES_PER_VERTEX; j++)
+        {
+            boneIds[j]     = mesh->boneIds[i].elements[j];
+            boneWeights[j] = mesh->boneWeights[i].elements[j];
+        }
+    }
+}
+
+internal void StoreSkinnedVector(V3 *out, __m128 v)
+{
+    _mm_storel_pi((__m64 *)out, v);
+    _mm_store_ss(&out->z, _mm_movehl_ps(v, v));
+}
+
+// w must be 0
+internal __m128 NormalizeSkinnedVector(__m128 v)
+{
+    __m128 squared = _mm_mul_ps(v, v);
+    __m128 length  = _mm_add_ps(_mm_shuffle_ps(squared, squared, _MM_SHUFFLE(0, 0, 0, 0)),
+                                _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(1, 1, 1, 1)));
+    length         = _mm_add_ps(length, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 2, 2, 2)));
+    return _mm_mul_ps(v, _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(length)));
+}
+
+// xyz only, w is a.w * b.w - a.w * b.w
+internal __m128 CrossSkinnedVector(__m128 a, __m128 b)
+{
+    __m128 aYzx   = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYzx   = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 result = _mm_sub_ps(_mm_mul_ps(a, bYzx), _mm_mul_ps(aYzx, b));
+    return _mm_shuffle_ps(result, result, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// Blends the four bone matrices and transforms with them, in the same order of operations as skinning_cs.hlsl. The
+// results agree with the GPU up to the multiply-adds the shader compiler fuses.
+internal void SkinVerticesLinear(const Mesh *mesh, const Mat4 *skinningTransforms, u32 start, u32 end,
+                                 SkinnedVertices *out)
+{
+    b32 quantized = HasFlags(mesh->flags, MeshFlags_Quantized);
+    V3 minP       = mesh->bounds.minP;
+    V3 extent     = mesh->bounds.maxP - mesh->bounds.minP;
+    for (u32 i = start; i < end; i++)
+    {
+        V3 position, normal, tangent;
+        u32 boneIds[MAX_MATRICES_PER_VERTEX];
+        f32 boneWeights[MAX_MATRICES_PER_VERTEX];
+        GetSkinningVertex(mesh, quantized, minP, extent, i, &position, &normal, &tangent, boneIds, boneWeights);
+
+        __m128 columns[4];
+        __m128 weight = _mm_set1_ps(boneWeights[0]);
+        for (u32 column = 0; column < 4; column++)
+        {
+            columns[column] = _mm_mul_ps(_mm_loadu_ps(skinningTransforms[boneIds[0]].elements[column]), weight);
+        }
+        for (u32 j = 1; j < MAX_MATRICES_PER_VERTEX; j++)
+        {
+            weight = _mm_set1_ps(boneWeights[j]);
+            for (u32 column = 0; column < 4; column++)
+            {
+                __m128 boneColumn = _mm_loadu_ps(skinningTransforms[boneIds[j]].elements[column]);
+                columns[column]   = _mm_madd_ps(boneColumn, weight, columns[column]);
+            }
+        }
+
+        __m128 p = _mm_mul_ps(columns[0], _mm_set1_ps(position.x));
+        p        = _mm_madd_ps(columns[1], _mm_set1_ps(position.y), p);
+        p        = _mm_madd_ps(columns[2], _mm_set1_ps(position.z), p);
+        p        = _mm_add_ps(columns[3], p);
+
+        __m128 n = _mm_mul_ps(columns[0], _mm_set1_ps(normal.x));
+        n        = _mm_madd_ps(columns[1], _mm_set1_ps(normal.y), n);
+        n        = _mm_madd_ps(columns[2], _mm_set1_ps(normal.z), n);
+
+        __m128 t = _mm_mul_ps(columns[0], _mm_set1_ps(tangent.x));
+        t        = _mm_madd_ps(columns[1], _mm_set1_ps(tangent.y), t);
+        t        = _mm_madd_ps(columns[2], _mm_set1_ps(tangent.z), t);
+
+        StoreSkinnedVector(&out->positions[i], p);
+        StoreSkinnedVector(&out->normals[i], NormalizeSkinnedVector(n));
+        StoreSkinnedVector(&out->tangents[i], NormalizeSkinnedVector(t));
+    }
+}
+
+// The scale of the transforms is dropped
+internal void ConvertToDualQuats(const Mat4 *skinningTransforms, u32 count, DualQuat *out)
+{
+    for (u32 i = 0; i < count; i++)
+    {
+        Mat4 m = skinningTransforms[i];
+        for (u32 axis = 0; axis < 3; axis++)
+        {
+            f32 scale       = Length(m.columns[axis].xyz);
+            m.columns[axis] = scale == 0.f ? m.columns[axis] : m.columns[axis] / scale;
+        }
+        V3 translation = GetTranslation(m);
+        out[i].real    = MatrixToQuat(m);
+        out[i].dual    = 0.5f * (MakeQuat(translation.x, translation.y, translation.z, 0.f) * out[i].real);
+    }
+}
+
+internal void SkinVerticesDualQuat(const Mesh *mesh, const DualQuat *dualQuats, u32 start, u32 end,
+                                   SkinnedVertices *out)
+{
+    b32 quantized = HasFlags(mesh->flags, MeshFlags_Quantized);
+    V3 minP       = mesh->bounds.minP;
+    V3 extent     = mesh->bounds.maxP - mesh->bounds.minP;
+    __m128 two    = _mm_set1_ps(2.f);
+    for (u32 i = start; i < end; i++)
+    {
+        V3 position, normal, tangent;
+        u32 boneIds[MAX_MATRICES_PER_VERTEX];
+        f32 boneWeights[MAX_MATRICES_PER_VERTEX];
+        GetSkinningVertex(mesh, quantized, minP, extent, i, &position, &normal, &tangent, boneIds, boneWeights);
+
+        const DualQuat *first = &dualQuats[boneIds[0]];
+        __m128 weight         = _mm_set1_ps(boneWeights[0]);
+        __m128 real           = _mm_mul_ps(_mm_loadu_ps(first->real.elements), weight);
+        __m128 dual           = _mm_mul_ps(_mm_loadu_ps(first->dual.elements), weight);
+        for (u32 j = 1; j < MAX_MATRICES_PER_VERTEX; j++)
+        {
+            // q and -q are the same rotation, blend along the shorter arc
+            const DualQuat *bone = &dualQuats[boneIds[j]];
+            f32 signedWeight     = Dot(bone->real, first->real) < 0.f ? -boneWeights[j] : boneWeights[j];
+            weight               = _mm_set1_ps(signedWeight);
+            real                 = _mm_madd_ps(_mm_loadu_ps(bone->real.elements), weight, real);
+            dual                 = _mm_madd_ps(_mm_loadu_ps(bone->dual.elements), weight, dual);
+        }
+
+        __m128 length = _mm_mul_ps(real, real);
+        length        = _mm_add_ps(length, _mm_shuffle_ps(length, length, _MM_SHUFFLE(2, 3, 0, 1)));
+        length        = _mm_add_ps(length, _mm_shuffle_ps(length, length, _MM_SHUFFLE(1, 0, 3, 2)));
+        __m128 scale  = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(length));
+        real          = _mm_mul_ps(real, scale);
+        dual          = _mm_mul_ps(dual, scale);
+
+        // v + 2 * cross(r, cross(r, v) + r.w * v)
+        __m128 realW = _mm_shuffle_ps(real, real, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128 dualW = _mm_shuffle_ps(dual, dual, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128 v[3]  = {_mm_setr_ps(position.x, position.y, position.z, 0.f),
+                        _mm_setr_ps(normal.x, normal.y, normal.z, 0.f),
+                        _mm_setr_ps(tangent.x, tangent.y, tangent.z, 0.f)};
+        for (u32 j = 0; j < 3; j++)
+        {
+            __m128 inner = _mm_madd_ps(realW, v[j], CrossSkinnedVector(real, v[j]));
+            v[j]         = _mm_madd_ps(two, CrossSkinnedVector(real, inner), v[j]);
+        }
+
+        // Translation is 2 * (r.w * d.xyz - d.w * r.xyz + cross(r, d))
+        __m128 translation = _mm_sub_ps(_mm_mul_ps(realW, dual), _mm_mul_ps(dualW, real));
+        translation        = _mm_add_ps(translation, CrossSkinnedVector(real, dual));
+        v[0]               = _mm_madd_ps(two, translation, v[0]);
+
+        StoreSkinnedVector(&out->positions[i], v[0]);
+        StoreSkinnedVector(&out->normals[i], NormalizeSkinnedVector(v[1]));
+        StoreSkinnedVector(&out->tangents[i], NormalizeSkinnedVector(v[2]));
+    }
+}
+
+// Skins every vertex of the mesh with the matrices SkinModelToAnimation wrote, for bounds, picking and machines
+// without the compute pass. Main thread only, waits for its jobs.
+internal void SkinMesh(Arena *arena, const Mesh *mesh, const Mat4 *skinningTransforms, u32 boneCount,
+                       SkinningMode mode, SkinnedVertices *out)
+{
+    Assert(HasFlags(mesh->flags, MeshFlags_Skinned));
+    out->count     = mesh->vertexCount;
+    out->positions = PushArrayNoZero(arena, V3, out->count);
+    out->normals   = PushArrayNoZero(arena, V3, out->count);
+    out->tangents  = PushArrayNoZero(arena, V3, out->count);
+
+    TempArena temp      = ScratchStart(&arena, 1);
+    DualQuat *dualQuats = 0;
+    if (mode == SkinningMode_DualQuaternion)
+    {
+        dualQuats = PushArrayNoZero(temp.arena, DualQuat, boneCount);
+        ConvertToDualQuats(skinningTransforms, boneCount, dualQuats);
+    }
+
+    u32 batchCount             = (out->count + SKINNING_CPU_BATCH_SIZE - 1) / SKINNING_CPU_BATCH_SIZE;
+    jobsystem::Counter counter = {};
+    // Batches are grouped so that large meshes don't need more queue spots than there are
+    jobsystem::KickJobs(&counter, batchCount, Max(1u, (batchCount + 63) / 64), [&](jobsystem::JobArgs args) {
+        u32 start = args.jobId * SKINNING_CPU_BATCH_SIZE;
+        u32 end   = Min(start + SKINNING_CPU_BATCH_SIZE, out->count);
+        if (mode == SkinningMode_DualQuaternion)
+        {
+            SkinVerticesDualQuat(mesh, dualQuats, start, end, out);
+        }
+        else
+        {
+            SkinVerticesLinear(mesh, skinningTransforms, start, end, out);
+        }
+    });
+    jobsystem::WaitJobs(&counter);
+    ScratchEnd(temp);
+}
+
+#if SKINNING_BENCHMARK
+// Line by line copy of skinning_cs.hlsl
+internal void SkinVertexReference(const Mat4 *skinningTransforms, V3 position, V3 normal, const u32 *boneIds,
+                                  const f32 *boneWeights, V3 *outPosition, V3 *outNormal)
+{
+    Mat4 boneTransform = skinningTransforms[boneIds[0]] * boneWeights[0];
+    for (u32 j = 1; j < MAX_MATRICES_PER_VERTEX; j++)
+    {
+        Mat4 weighted = skinningTransforms[boneIds[j]] * boneWeights[j];
+        for (u32 column = 0; column < 4; column++)
+        {
+            boneTransform.columns[column] = weighted.columns[column] + boneTransform.columns[column];
+        }
+    }
+
+    V3 n;
+    for (u32 row = 0; row < 3; row++)
+    {
+        (*outPosition)[row] = boneTransform.elements[0][row] * position.x +
+                              boneTransform.elements[1][row] * position.y +
+                              boneTransform.elements[2][row] * position.z + boneTransform.elements[3][row];
+        n[row] = boneTransform.elements[0][row] * normal.x + boneTransform.elements[1][row] * normal.y +
+                 boneTransform.elements[2][row] * normal.z;
+    }
+    *outNormal = n * (1.f / SquareRoot(n.x * n.x + n.y * n.y + n.z * n.z));
+}
+
+// Skins a synthetic mesh on this thread with both kernels, then with every core. A quarter of the vertices follow a
+// single bone, where linear and dual quaternion skinning must agree.
+internal void SkinningBenchmark()
+{
+    const u32 vertexCount = 200000;
+    const u32 boneCount   = 64;
+
+    TempArena temp = ScratchStart(0, 0);
+    u32 seed       = 0x1234567;
+    auto Random    = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (f32)(seed >> 8) / (f32)(1 << 24);
+    };
+    auto RandomUnit = [&Random]() { return Normalize(V3{Random() - 0.5f, Random() - 0.5f, Random() - 0.5f}); };
+
+    Mat4 *transforms = PushArrayNoZero(temp.arena, Mat4, boneCount);
+    for (u32 i = 0; i < boneCount; i++)
+    {
+        Quat rotation = Normalize(MakeQuat(Random() - 0.5f, Random() - 0.5f, Random() - 0.5f, Random() - 0.5f));
+        transforms[i] = Translate4(V3{Random() * 4.f - 2.f, Random() * 4.f - 2.f, Random() * 4.f - 2.f}) *
+                        QuatToMatrix(rotation);
+    }
+
+    Mesh mesh        = {};
+    mesh.flags       = MeshFlags_Skinned;
+    mesh.vertexCount = vertexCount;
+    mesh.positions   = PushArrayNoZero(temp.arena, V3, vertexCount);
+    mesh.normals     = PushArrayNoZero(temp.arena, V3, vertexCount);
+    mesh.tangents    = PushArrayNoZero(temp.arena, V3, vertexCount);
+    mesh.boneIds     = PushArrayNoZero(temp.arena, UV4, vertexCount);
+    mesh.boneWeights = PushArrayNoZero(temp.arena, V4, vertexCount);
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        mesh.positions[i] = V3{Random() * 2.f - 1.f, Random() * 2.f - 1.f, Random() * 2.f - 1.f};
+        mesh.normals[i]   = RandomUnit();
+        mesh.tangents[i]  = RandomUnit();
+        f32 total         = 0.f;
+        for (u32 j = 0; j < MAX_MATRICES_PER_VERTEX; j++)
+        {
+            mesh.boneIds[i].elements[j]     = (u32)(Random() * boneCount) % boneCount;
+            mesh.boneWeights[i].elements[j] = i < vertexCount / 4 ? (j == 0 ? 1.f : 0.f) : Random();
+            total += mesh.boneWeights[i].elements[j];
+        }
+        for (u32 j = 0; j < MAX_MATRICES_PER_VERTEX; j++)
+        {
+            mesh.boneWeights[i].elements[j] /= total;
+        }
+    }
+
+    DualQuat *dualQuats = PushArrayNoZero(temp.arena, DualQuat, boneCount);
+    ConvertToDualQuats(transforms, boneCount, dualQuats);
+
+    SkinnedVertices linear  = {};
+    SkinnedVertices dq      = {};
+    SkinnedVertices *outs[] = {&linear, &dq};
+    for (u32 i = 0; i < ArrayLength(outs); i++)
+    {
+        outs[i]->count     = vertexCount;
+        outs[i]->positions = PushArrayNoZero(temp.arena, V3, vertexCount);
+        outs[i]->normals   = PushArrayNoZero(temp.arena, V3, vertexCount);
+        outs[i]->tangents  = PushArrayNoZero(temp.arena, V3, vertexCount);
+    }
+
+    PerformanceCounter counter = platform.StartCounter();
+    SkinVerticesLinear(&mesh, transforms, 0, vertexCount, &linear);
+    f32 linearTime = platform.GetMilliseconds(counter);
+
+    counter = platform.StartCounter();
+    SkinVerticesDualQuat(&mesh, dualQuats, 0, vertexCount, &dq);
+    f32 dqTime = platform.GetMilliseconds(counter);
+
+    SkinnedVertices parallel;
+    counter = platform.StartCounter();
+    SkinMesh(temp.arena, &mesh, transforms, boneCount, SkinningMode_Linear, &parallel);
+    f32 parallelTime = platform.GetMilliseconds(counter);
+
+    f32 referenceError = 0.f;
+    f32 dqError        = 0.f;
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        V3 position, normal;
+        SkinVertexReference(transforms, mesh.positions[i], mesh.normals[i], mesh.boneIds[i].elements,
+                            mesh.boneWeights[i].elements, &position, &normal);
+        referenceError = Max(referenceError, Length(position - linear.positions[i]));
+        referenceError = Max(referenceError, Length(normal - linear.normals[i]));
+        referenceError = Max(referenceError, Length(parallel.positions[i] - linear.positions[i]));
+        if (i < vertexCount / 4)
+        {
+            dqError = Max(dqError, Length(dq.positions[i] - linear.positions[i]));
+            dqError = Max(dqError, Length(dq.normals[i] - linear.normals[i]));
+        }
+    }
+
+    Printf("CPU skinning, %u vertices with %u bones: linear %.3fms (%.0f vertices/ms per core), dual quaternion "
+           "%.3fms (%.0f vertices/ms per core), linear on %u threads %.3fms (%.0f vertices/ms). Max error against "
+           "the shader %f, dual quaternion against linear on rigid vertices %f\n",
+           vertexCount, boneCount, linearTime, vertexCount / linearTime, dqTime, vertexCount / dqTime,
+           jobsystem::jobSystem.threadCount, parallelTime, vertexCount / parallelTime, referenceError, dqError);
+    ScratchEnd(temp);
+}
+#endif
+
+//////////////////////////////
+// Root motion and events
+//
+inline V3 RotateAboutY(V3 v, f32 angle)
+{
+    f32 c     = Cos(angle);
+    f32 s     = Sin(angle);
+    V3 result = {c * v.x + s * v.z, v.y, c * v.z - s * v.x};
+    return result;
+}
+
+// Motion b, relative to where a ends, applied after a
+inline AnimationRootMotion CombineRootMotion(AnimationRootMotion a, AnimationRootMotion b)
+{
+    AnimationRootMotion result;
+    result.translation = a.translation + RotateAboutY(b.translation, a.yaw);
+    result.yaw         = a.yaw + b.yaw;
+    return result;
+}
+
+inline AnimationRootMotion BlendRootMotion(AnimationRootMotion a, AnimationRootMotion b, f32 t)
+{
+    AnimationRootMotion result;
+    result.translation = Lerp(a.translation, b.translation, t);
+    result.yaw         = a.yaw + (b.yaw - a.yaw) * t;
+    return result;
+}
+
+// Relative to the first sample of the clip. The yaw is unwrapped offline, so the samples interpolate linearly.
+internal AnimationRootMotion SampleRootMotion(const KeyframedAnimation *animation, f32 time)
+{
+    AnimationRootMotion result = {};
+    u32 count                  = animation->numRootMotionSamples;
+    if (count == 0)
+    {
+        return result;
+    }
+    f32 position = Clamp(time * animation->rootMotionSampleRate, 0.f, (f32)(count - 1));
+    u32 index    = Min((u32)position, count - 1);
+    u32 next     = Min(index + 1, count - 1);
+    result       = BlendRootMotion(animation->rootMotion[index], animation->rootMotion[next], position - index);
+    return result;
+}
+
+// Motion from t0 to t1 of the clip, in the frame that the root faces at t0
+internal AnimationRootMotion GetRootMotionDelta(const KeyframedAnimation *animation, f32 t0, f32 t1)
+{
+    AnimationRootMotion start = SampleRootMotion(animation, t0);
+    AnimationRootMotion end   = SampleRootMotion(animation, t1);
+    AnimationRootMotion result;
+    result.translation = RotateAboutY(end.translation - start.translation, -start.yaw);
+    result.yaw         = end.yaw - start.yaw;
+    return result;
+}
+
+// Motion of the last advance of the player. Doesn't depend on the length of the clip, only on how many times the
+// advance looped it.
+internal AnimationRootMotion GetPlayerRootMotion(const AnimationPlayer *player)
+{
+    AnimationRootMotion result = {};
+    if (!player->loaded || player->currentAnimation->numRootMotionSamples == 0)
+    {
+        return result;
+    }
+    const KeyframedAnimation *animation = player->currentAnimation;
+    if (player->loopCount == 0)
+    {
+        result = GetRootMotionDelta(animation, player->previousTime, player->currentTime);
+        return result;
+    }
+    result                    = GetRootMotionDelta(animation, player->previousTime, player->duration);
+    AnimationRootMotion cycle = GetRootMotionDelta(animation, 0.f, player->duration);
+    for (u32 i = 1; i < player->loopCount; i++)
+    {
+        result = CombineRootMotion(result, cycle);
+    }
+    result = CombineRootMotion(result, GetRootMotionDelta(animation, 0.f, player->currentTime));
+    return result;
+}
+
+// Index of the first event at or after time
+internal u32 FindAnimationEvent(const KeyframedAnimation *animation, f32 time)
+{
+    u32 low  = 0;
+    u32 high = animation->numEvents;
+    while (low < high)
+    {
+        u32 mid = (low + high) / 2;
+        if (animation->events[mid].time < time)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Events in [t0, t1), or [t0, t1] when includeEnd is set. Returns how many were written to out, at most maxCount.
+internal u32 GetAnimationEvents(const KeyframedAnimation *animation, f32 t0, f32 t1, b32 includeEnd,
+                                const AnimationEvent **out, u32 maxCount)
 {
-    LoadAnimation(player, handle);
+    u32 count = 0;
+    for (u32 i = FindAnimationEvent(animation, t0); i < animation->numEvents && count < maxCount; i++)
+    {
+        f32 time = animation->events[i].time;
+        if (time > t1 || (time == t1 && !includeEnd))
+        {
+            break;
+        }
+        out[count++] = &animation->events[i];
+    }
+    return count;
 }
 
-internal void PlayCurrentAnimation(AnimationPlayer *player, f32 dT, AnimationTransform *transforms)
+// Events that the last advance of the player passed, in the order they fired. The end of the clip is passed when the
+// playback wraps around, or when it stops there.
+internal u32 GetPlayerEvents(const AnimationPlayer *player, const AnimationEvent **out, u32 maxCount)
 {
     if (!player->loaded)
     {
-        LoadAnimation(player, player->anim);
-        if (IsAnimNil(player->currentAnimation))
+        return 0;
+    }
+    const KeyframedAnimation *animation = player->currentAnimation;
+    f32 duration                        = player->duration;
+    if (player->loopCount == 0)
+    {
+        b32 stopped = !player->isLooping && player->currentTime == duration && player->previousTime < duration;
+        return GetAnimationEvents(animation, player->previousTime, player->currentTime, stopped, out, maxCount);
+    }
+    u32 count = GetAnimationEvents(animation, player->previousTime, duration, 1, out, maxCount);
+    for (u32 i = 1; i < player->loopCount; i++)
+    {
+        count += GetAnimationEvents(animation, 0.f, duration, 1, out + count, maxCount - count);
+    }
+    count += GetAnimationEvents(animation, 0.f, player->currentTime, 0, out + count, maxCount - count);
+    return count;
+}
+
+//////////////////////////////
+// Pose blending
+//
+internal AnimationPose PushPose(Arena *arena, u32 count)
+{
+    AnimationPose pose;
+    pose.translations = PushArrayNoZero(arena, V3, count);
+    pose.rotations    = PushArrayNoZero(arena, Quat, count);
+    pose.scales       = PushArrayNoZero(arena, V3, count);
+    pose.count        = count;
+    return pose;
+}
+
+internal void CopyPose(AnimationPose *dst, const AnimationPose *src)
+{
+    Assert(dst->count == src->count);
+    MemoryCopy(dst->translations, src->translations, sizeof(V3) * src->count);
+    MemoryCopy(dst->rotations, src->rotations, sizeof(Quat) * src->count);
+    MemoryCopy(dst->scales, src->scales, sizeof(V3) * src->count);
+}
+
+// Moves pose towards target by weight, scaled per bone by mask when there is one. Inactive bones are left as they are.
+internal void BlendPose(AnimationPose *pose, const AnimationPose *target, f32 weight, const f32 *mask,
+                        const b8 *activeBones = 0)
+{
+    for (u32 i = 0; i < pose->count; i++)
+    {
+        f32 t = mask ? weight * mask[i] : weight;
+        if (t == 0.f || (activeBones && !activeBones[i]))
         {
-            return;
+            continue;
         }
+        pose->translations[i] = Lerp(pose->translations[i], target->translations[i], t);
+        pose->rotations[i]    = Lerp(pose->rotations[i], target->rotations[i], t);
+        pose->scales[i]       = Lerp(pose->scales[i], target->scales[i], t);
     }
-    KeyframedAnimation *animation = player->currentAnimation;
+}
 
-    for (u32 boneIndex = 0; boneIndex < animation->numNodes; boneIndex++)
+// Applies the difference between additive and reference on top of pose
+internal void AddPose(AnimationPose *pose, const AnimationPose *additive, const AnimationPose *reference, f32 weight,
+                      const f32 *mask, const b8 *activeBones = 0)
+{
+    Quat identity = MakeQuat(0.f, 0.f, 0.f, 1.f);
+    for (u32 i = 0; i < pose->count; i++)
+    {
+        f32 t = mask ? weight * mask[i] : weight;
+        if (t == 0.f || (activeBones && !activeBones[i]))
+        {
+            continue;
+        }
+        V3 additiveScale   = additive->scales[i];
+        V3 referenceScale  = reference->scales[i];
+        Quat deltaRotation = additive->rotations[i] * Conjugate(reference->rotations[i]);
+        V3 deltaScale      = {additiveScale.x / referenceScale.x, additiveScale.y / referenceScale.y,
+                              additiveScale.z / referenceScale.z};
+
+        pose->translations[i] += t * (additive->translations[i] - reference->translations[i]);
+        pose->rotations[i] = Normalize(Lerp(identity, deltaRotation, t) * pose->rotations[i]);
+        pose->scales[i]    = Hadamard(pose->scales[i], Lerp(V3{1.f, 1.f, 1.f}, deltaScale, t));
+    }
+}
+
+internal void BuildRestPose(Arena *arena, LoadedSkeleton *skeleton)
+{
+    AnimationPose *pose = &skeleton->restPose;
+    *pose               = PushPose(arena, skeleton->count);
+    for (u32 i = 0; i < skeleton->count; i++)
     {
-        BoneChannel *boneChannel = animation->boneChannels + boneIndex;
+        Mat4 m                = skeleton->transformsToParent[i];
+        pose->translations[i] = GetTranslation(m);
+        for (u32 axis = 0; axis < 3; axis++)
+        {
+            f32 scale             = Length(m.columns[axis].xyz);
+            pose->scales[i][axis] = scale;
+            m.columns[axis]       = scale == 0.f ? m.columns[axis] : m.columns[axis] / scale;
+        }
+        pose->rotations[i] = MatrixToQuat(m);
+    }
+}
 
-        // Move to next key if you've passed it
-        // TODO: this seems like just too much overhead
-        if (boneChannel->positions[player->currentPositionKey[boneIndex]].time < player->currentTime)
+internal void BuildBoneExtents(Arena *arena, LoadedSkeleton *skeleton)
+{
+    TempArena temp        = ScratchStart(&arena, 1);
+    V3 *positions         = PushArrayNoZero(temp.arena, V3, skeleton->count);
+    Mat4 *transforms      = PushArrayNoZero(temp.arena, Mat4, skeleton->count);
+    skeleton->boneExtents = PushArray(arena, f32, Max(skeleton->count, 1u));
+    for (u32 i = 0; i < skeleton->count; i++)
+    {
+        i32 parent    = skeleton->parents[i];
+        transforms[i] = parent == -1 ? skeleton->transformsToParent[i]
+                                     : transforms[parent] * skeleton->transformsToParent[i];
+        positions[i]  = GetTranslation(transforms[i]);
+        if (parent != -1)
         {
-            player->currentPositionKey[boneIndex] =
-                (player->currentPositionKey[boneIndex] + 1) % boneChannel->numPositionKeys;
+            skeleton->boneExtents[i] = Length(positions[i] - positions[parent]);
         }
-        if (boneChannel->scales[player->currentScaleKey[boneIndex]].time < player->currentTime)
+    }
+    for (u32 i = 0; i < skeleton->count; i++)
+    {
+        for (i32 parent = skeleton->parents[i]; parent != -1; parent = skeleton->parents[parent])
         {
-            player->currentScaleKey[boneIndex] =
-                (player->currentScaleKey[boneIndex] + 1) % boneChannel->numScalingKeys;
+            f32 distance                  = Length(positions[i] - positions[parent]);
+            skeleton->boneExtents[parent] = Max(skeleton->boneExtents[parent], distance);
         }
-        if (boneChannel->rotations[player->currentRotationKey[boneIndex]].time < player->currentTime)
+    }
+    // Skipping a bone then always skips the bones below it
+    for (u32 i = 0; i < skeleton->count; i++)
+    {
+        i32 parent = skeleton->parents[i];
+        if (parent != -1)
         {
-            player->currentRotationKey[boneIndex] =
-                (player->currentRotationKey[boneIndex] + 1) % boneChannel->numRotationKeys;
+            skeleton->boneExtents[i] = Min(skeleton->boneExtents[i], skeleton->boneExtents[parent]);
         }
-        AnimationTransform *transform = transforms + boneIndex;
-        u32 positionKey               = player->currentPositionKey[boneIndex];
-        u32 scaleKey                  = player->currentScaleKey[boneIndex];
-        u32 rotationKey               = player->currentRotationKey[boneIndex];
+    }
+    ScratchEnd(temp);
+}
+
+// A mask covering the root bone and all of its descendants. Parents come before their children in a skeleton.
+internal f32 *BuildBoneMask(Arena *arena, const LoadedSkeleton *skeleton, string root)
+{
+    f32 *mask = PushArray(arena, f32, Max(skeleton->count, 1u));
+    for (u32 i = 0; i < skeleton->count; i++)
+    {
+        i32 parent = skeleton->parents[i];
+        mask[i]    = (skeleton->names[i] == root || (parent != -1 && mask[parent] != 0.f)) ? 1.f : 0.f;
+    }
+    return mask;
+}
 
-        Assert(boneChannel->numPositionKeys != 0);
-        Assert(boneChannel->numScalingKeys != 0);
-        Assert(boneChannel->numRotationKeys != 0);
+// Cross-fades from the clips playing on the layer to handle. A fade time of 0 switches immediately.
+internal void PlayAnimation(AnimationLayer *layer, AS_Handle handle, f32 fadeTime, b32 looping)
+{
+    u32 slot = layer->clipCount;
+    for (u32 i = 0; i < layer->clipCount; i++)
+    {
+        AnimationBlendClip *clip = &layer->clips[i];
+        clip->targetWeight       = 0.f;
+        clip->fadeRate           = fadeTime > 0.f ? clip->weight / fadeTime : 0.f;
+        if (fadeTime == 0.f)
+        {
+            clip->weight = 0.f;
+        }
+    }
+    if (slot == ANIMATION_MAX_LAYER_CLIPS)
+    {
+        // Replaces the clip with the least weight
+        slot = 0;
+        for (u32 i = 1; i < layer->clipCount; i++)
+        {
+            slot = layer->clips[i].weight < layer->clips[slot].weight ? i : slot;
+        }
+    }
+    else
+    {
+        layer->clipCount++;
+    }
 
-        AnimationPosition position = boneChannel->positions[positionKey];
-        AnimationPosition pastPosition =
-            boneChannel
-                ->positions[(boneChannel->numPositionKeys + positionKey - 1) % boneChannel->numPositionKeys];
+    AnimationBlendClip *clip  = &layer->clips[slot];
+    *clip                     = {};
+    clip->player.anim         = handle;
+    clip->player.playbackRate = 1.f;
+    clip->player.isLooping    = looping;
+    clip->targetWeight        = 1.f;
+    clip->weight              = fadeTime > 0.f ? 0.f : 1.f;
+    clip->fadeRate            = fadeTime > 0.f ? 1.f / fadeTime : 0.f;
+}
 
-        AnimationScale scale = boneChannel->scales[scaleKey];
-        AnimationScale pastScale =
-            boneChannel->scales[(boneChannel->numScalingKeys + scaleKey - 1) % boneChannel->numScalingKeys];
+// Adds a clip that is blended with the others on the layer by a fixed weight
+internal void AddBlendAnimation(AnimationLayer *layer, AS_Handle handle, f32 weight)
+{
+    Assert(layer->clipCount < ANIMATION_MAX_LAYER_CLIPS);
+    AnimationBlendClip *clip  = &layer->clips[layer->clipCount++];
+    *clip                     = {};
+    clip->player.anim         = handle;
+    clip->player.playbackRate = 1.f;
+    clip->player.isLooping    = true;
+    clip->weight              = weight;
+    clip->targetWeight        = weight;
+}
 
-        AnimationRotation rotation = boneChannel->rotations[rotationKey];
-        Quat uncompressedRot;
-        uncompressedRot.x = DecompressRotationChannel(rotation.rotation[0]);
-        uncompressedRot.y = DecompressRotationChannel(rotation.rotation[1]);
-        uncompressedRot.z = DecompressRotationChannel(rotation.rotation[2]);
-        uncompressedRot.w = DecompressRotationChannel(rotation.rotation[3]);
-        AnimationRotation pastRotation =
-            boneChannel
-                ->rotations[(boneChannel->numRotationKeys + rotationKey - 1) % boneChannel->numRotationKeys];
+internal void StartLoopedAnimation(AnimationLayer *layer, AS_Handle handle)
+{
+    PlayAnimation(layer, handle, 0.f, true);
+}
 
-        Quat uncompressedPastRot;
-        uncompressedPastRot.x = DecompressRotationChannel(pastRotation.rotation[0]);
-        uncompressedPastRot.y = DecompressRotationChannel(pastRotation.rotation[1]);
-        uncompressedPastRot.z = DecompressRotationChannel(pastRotation.rotation[2]);
-        uncompressedPastRot.w = DecompressRotationChannel(pastRotation.rotation[3]);
+// Builds the rest pose and bone extents the first time a skeleton is seen. Every skeleton needs them, animated or not,
+// since meshes outside of an animated instance are skinned in the rest pose.
+internal void PrepareSkeleton(Arena *arena, LoadedSkeleton *skeleton)
+{
+    if (skeleton->restPose.count != skeleton->count)
+    {
+        BuildRestPose(arena, skeleton);
+        BuildBoneExtents(arena, skeleton);
+    }
+}
 
-        f32 fraction = (player->currentTime - pastPosition.time) / (position.time - pastPosition.time);
-        if (position.time == pastPosition.time)
+// Loads the clips, builds their remaps and bone masks, and drops clips that have faded out. Allocates from the scene
+// arena, so it runs on the main thread before EvaluateAnimationLayers.
+internal void PrepareAnimationLayers(Arena *arena, LoadedSkeleton *skeleton, AnimationLayer *layers, u32 layerCount)
+{
+    PrepareSkeleton(arena, skeleton);
+    for (u32 layerIndex = 0; layerIndex < layerCount; layerIndex++)
+    {
+        AnimationLayer *layer = &layers[layerIndex];
+        if (layer->maskRoot.size && !layer->boneMask)
         {
-            fraction = 0;
+            layer->boneMask = BuildBoneMask(arena, skeleton, layer->maskRoot);
         }
-        transform->translation = Lerp(pastPosition.position, position.position, fraction);
+        for (u32 i = 0; i < layer->clipCount;)
+        {
+            AnimationBlendClip *clip = &layer->clips[i];
+            // Clips of unloaded animations are dropped too, their remaps get reused
+            if ((clip->weight == 0.f && clip->targetWeight == 0.f) || AS_GetSlotAsset(clip->player.anim) == 0)
+            {
+                layer->clips[i] = layer->clips[--layer->clipCount];
+                continue;
+            }
+            if (!clip->player.loaded)
+            {
+                b32 looping = clip->player.isLooping;
+                LoadAnimation(&clip->player, clip->player.anim);
+                clip->player.isLooping = looping;
+            }
+            clip->remap = GetAnimationRemap(arena, skeleton, clip->player.anim, clip->player.currentAnimation);
+            i++;
+        }
+    }
+}
 
-        fraction = (player->currentTime - pastRotation.time) / (rotation.time - pastRotation.time);
-        if (rotation.time == pastRotation.time)
+// Evaluates the layers bottom to top on top of the rest pose. Only the poses used while blending are allocated, from
+// the thread's scratch arena, so this can run in a job. Bones that aren't in activeBones keep their rest pose. The root
+// motion of the clips is blended like their poses, additive and masked layers don't move the root.
+internal void EvaluateAnimationLayers(const LoadedSkeleton *skeleton, AnimationLayer *layers, u32 layerCount, f32 dT,
+                                      AnimationPose *outPose, const b8 *activeBones = 0,
+                                      AnimationRootMotion *outRootMotion = 0)
+{
+    TempArena temp              = ScratchStart(0, 0);
+    AnimationPose layerPose     = PushPose(temp.arena, skeleton->count);
+    AnimationPose clipPose      = PushPose(temp.arena, skeleton->count);
+    AnimationPose referencePose = PushPose(temp.arena, skeleton->count);
+
+    AnimationRootMotion rootMotion = {};
+    CopyPose(outPose, &skeleton->restPose);
+    for (u32 layerIndex = 0; layerIndex < layerCount; layerIndex++)
+    {
+        AnimationLayer *layer           = &layers[layerIndex];
+        b32 additive                    = layer->flags & AnimationLayerFlag_Additive;
+        AnimationRootMotion layerMotion = {};
+
+        // Each clip is blended in by its share of the weight so far, which normalizes the weights
+        f32 totalWeight = 0.f;
+        for (u32 i = 0; i < layer->clipCount; i++)
+        {
+            AnimationBlendClip *clip = &layer->clips[i];
+            f32 step                 = clip->fadeRate * dT;
+            clip->weight             = clip->weight < clip->targetWeight ? Min(clip->weight + step, clip->targetWeight)
+                                                                          : Max(clip->weight - step, clip->targetWeight);
+            if (clip->weight <= 0.f || !clip->player.loaded)
+            {
+                continue;
+            }
+
+            CopyPose(&clipPose, &skeleton->restPose);
+            if (additive)
+            {
+                // The first sample of an additive clip is its reference
+                CopyPose(&referencePose, &skeleton->restPose);
+                SampleAnimation(clip->player.currentAnimation, clip->remap, 0.f, &referencePose, activeBones);
+            }
+            PlayCurrentAnimation(&clip->player, clip->remap, dT, &clipPose, activeBones);
+            AnimationRootMotion clipMotion = GetPlayerRootMotion(&clip->player);
+
+            totalWeight += clip->weight;
+            if (additive)
+            {
+                AddPose(outPose, &clipPose, &referencePose, clip->weight * layer->weight, layer->boneMask,
+                        activeBones);
+            }
+            else if (totalWeight == clip->weight)
+            {
+                CopyPose(&layerPose, &clipPose);
+                layerMotion = clipMotion;
+            }
+            else
+            {
+                BlendPose(&layerPose, &clipPose, clip->weight / totalWeight, 0, activeBones);
+                layerMotion = BlendRootMotion(layerMotion, clipMotion, clip->weight / totalWeight);
+            }
+        }
+        if (!additive && totalWeight > 0.f)
         {
-            fraction = 0;
+            BlendPose(outPose, &layerPose, layer->weight, layer->boneMask, activeBones);
+            if (!layer->boneMask)
+            {
+                rootMotion = BlendRootMotion(rootMotion, layerMotion, layer->weight);
+            }
         }
-        transform->rotation = Lerp(uncompressedPastRot, uncompressedRot, fraction);
+    }
+    if (outRootMotion)
+    {
+        *outRootMotion = rootMotion;
+    }
+    ScratchEnd(temp);
+}
+
+//////////////////////////////
+// Animation LOD
+//
+// Projected size in pixels below which instances are updated less often, and bones aren't sampled
+const f32 animationLodFullRateSize = 256.f;
+const f32 animationLodBoneSize     = 2.f;
+
+// Picks the update interval and the active bones from the projected size, and whether the instance is due. Allocates
+// the poses on first use, so it runs on the main thread.
+internal void UpdateAnimationLod(Arena *arena, AnimationLod *lod, const LoadedSkeleton *skeleton, f32 dT)
+{
+    if (lod->boneCount != skeleton->count)
+    {
+        lod->boneCount    = skeleton->count;
+        lod->previousPose = PushPose(arena, skeleton->count);
+        lod->currentPose  = PushPose(arena, skeleton->count);
+        lod->activeBones  = PushArrayNoZero(arena, b8, Max(skeleton->count, 1u));
+        CopyPose(&lod->previousPose, &skeleton->restPose);
+        CopyPose(&lod->currentPose, &skeleton->restPose);
+        lod->framesSinceUpdate = ANIMATION_LOD_MAX_INTERVAL;
+    }
+
+    f32 radius           = 0.f;
+    lod->activeBoneCount = 0;
+    for (u32 i = 0; i < skeleton->count; i++)
+    {
+        b32 isRoot          = skeleton->parents[i] == -1;
+        radius              = isRoot ? Max(radius, skeleton->boneExtents[i]) : radius;
+        lod->activeBones[i] = isRoot || skeleton->boneExtents[i] * lod->pixelsPerUnit >= animationLodBoneSize;
+        lod->activeBoneCount += lod->activeBones[i];
+    }
+    lod->screenSize     = 2.f * radius * lod->pixelsPerUnit;
+    lod->updateInterval = ANIMATION_LOD_MAX_INTERVAL;
+    if (lod->screenSize > 0.f)
+    {
+        u32 interval        = (u32)(animationLodFullRateSize / lod->screenSize);
+        lod->updateInterval = Clamp(interval, 1u, (u32)ANIMATION_LOD_MAX_INTERVAL);
+    }
 
-        fraction = (player->currentTime - pastScale.time) / (scale.time - pastScale.time);
-        if (scale.time == pastScale.time)
+    lod->pendingTime += dT;
+    lod->framesSinceUpdate++;
+    lod->evaluate = lod->framesSinceUpdate >= lod->updateInterval;
+}
+
+// Once the due instances sample more bones than the budget, the ones with the least priority wait for a later frame.
+// The priority grows with the projected size and the time since the last update. A budget of 0 is unlimited.
+internal void ScheduleAnimationLods(AnimationLod **lods, u32 count, u32 boneBudget, AnimationLodStats *stats)
+{
+    TempArena temp = ScratchStart(0, 0);
+    u32 *due       = PushArrayNoZero(temp.arena, u32, Max(count, 1u));
+    f32 *priority  = PushArrayNoZero(temp.arena, f32, Max(count, 1u));
+    u32 dueCount   = 0;
+    u32 dueBones   = 0;
+
+    *stats           = {};
+    stats->instances = count;
+    for (u32 i = 0; i < count; i++)
+    {
+        AnimationLod *lod = lods[i];
+        stats->bonesTotal += lod->boneCount;
+        if (!lod->evaluate)
         {
-            fraction = 0;
+            stats->throttled++;
+            continue;
         }
-        transform->scale = Lerp(pastScale.scale, scale.scale, fraction);
+        priority[i]     = lod->screenSize * lod->framesSinceUpdate / lod->updateInterval;
+        due[dueCount++] = i;
+        dueBones += lod->activeBoneCount;
     }
 
-    player->currentTime += dT;
-    if (player->currentTime > player->duration)
+    if (boneBudget && dueBones > boneBudget)
     {
-        if (player->isLooping)
+        // Few instances are due in a frame
+        for (u32 i = 1; i < dueCount; i++)
         {
-            player->currentTime -= player->duration;
-            for (u32 i = 0; i < animation->numNodes; i++)
+            for (u32 j = i; j > 0 && priority[due[j - 1]] < priority[due[j]]; j--)
             {
-                player->currentPositionKey[i] = 0;
-                player->currentScaleKey[i]    = 0;
-                player->currentRotationKey[i] = 0;
+                Swap(u32, due[j - 1], due[j]);
             }
         }
-        else
+        u32 bones = 0;
+        for (u32 i = 0; i < dueCount; i++)
+        {
+            AnimationLod *lod = lods[due[i]];
+            if (i > 0 && bones + lod->activeBoneCount > boneBudget)
+            {
+                lod->evaluate = 0;
+                stats->deferred++;
+                continue;
+            }
+            bones += lod->activeBoneCount;
+        }
+    }
+
+    for (u32 i = 0; i < dueCount; i++)
+    {
+        AnimationLod *lod = lods[due[i]];
+        if (lod->evaluate)
+        {
+            stats->evaluated++;
+            stats->bonesSampled += lod->activeBoneCount;
+        }
+    }
+    ScratchEnd(temp);
+}
+
+// Runs in a job. Evaluates the layers when the instance is due, and blends towards the current pose otherwise. The
+// root motion of the frames in between is returned all at once when the instance is evaluated.
+internal void EvaluateAnimationLod(const LoadedSkeleton *skeleton, AnimationLayer *layers, u32 layerCount,
+                                   AnimationLod *lod, AnimationPose *outPose, AnimationRootMotion *outRootMotion = 0)
+{
+    if (outRootMotion)
+    {
+        *outRootMotion = {};
+    }
+    if (lod->evaluate)
+    {
+        Swap(AnimationPose, lod->previousPose, lod->currentPose);
+        EvaluateAnimationLayers(skeleton, layers, layerCount, lod->pendingTime, &lod->currentPose, lod->activeBones,
+                                outRootMotion);
+        lod->pendingTime       = 0.f;
+        lod->framesSinceUpdate = 0;
+        if (!lod->hasPose)
         {
-            // TODO: handle this case for non looping animations
+            // Doesn't blend in from the rest pose
+            CopyPose(&lod->previousPose, &lod->currentPose);
+            lod->hasPose = 1;
         }
     }
+    f32 t = Min((lod->framesSinceUpdate + 1) / (f32)lod->updateInterval, 1.f);
+    if (t == 1.f)
+    {
+        CopyPose(outPose, &lod->currentPose);
+    }
+    else
+    {
+        CopyPose(outPose, &lod->previousPose);
+        BlendPose(outPose, &lod->currentPose, t, 0);
+    }
 }
 
-internal void SkinModelToAnimation(const AnimationPlayer *inPlayer, const LoadedSkeleton *skeleton,
-                                   const AnimationTransform *transforms, Mat4 *outFinalTransforms)
+#if ANIMATION_REMAP_BENCHMARK
+// Compares matching bones to channels by name every frame against building the remap, and against looking up the
+// cached one. The channels are shuffled so that the name search doesn't get lucky.
+internal void AnimationRemapBenchmark()
 {
-    TIMED_FUNCTION();
+    const u32 boneCount      = 200;
+    const u32 characterCount = 300;
+    const u32 frameCount     = 10;
 
     TempArena temp          = ScratchStart(0, 0);
-    Mat4 *transformToParent = PushArray(temp.arena, Mat4, skeleton->count);
-    i32 previousId          = -1;
+    LoadedSkeleton skeleton = {};
+    skeleton.count          = boneCount;
+    skeleton.names          = PushArray(temp.arena, string, boneCount);
+    loopi(0, boneCount)
+    {
+        skeleton.names[i] = PushStr8F(temp.arena, "mixamorig:Bone_%u", i);
+    }
 
-    loopi(0, skeleton->count)
+    KeyframedAnimation animation = {};
+    animation.numNodes           = boneCount;
+    animation.boneChannels       = PushArray(temp.arena, BoneChannel, boneCount);
+    u32 *order                   = PushArrayNoZero(temp.arena, u32, boneCount);
+    loopi(0, boneCount)
+    {
+        order[i] = i;
+    }
+    u32 seed = 0x1234567;
+    for (u32 i = boneCount - 1; i > 0; i--)
+    {
+        seed  = seed * 1664525u + 1013904223u;
+        u32 j = (seed >> 8) % (i + 1);
+        Swap(u32, order[i], order[j]);
+    }
+    loopi(0, boneCount)
     {
-        const string name = skeleton->names[i];
-        i32 id            = i;
+        animation.boneChannels[i].name = skeleton.names[order[i]];
+    }
 
-        i32 animationId = -1;
-        for (u32 index = 0; index < inPlayer->currentAnimation->numNodes; index++)
+    u64 nameChecksum           = 0;
+    PerformanceCounter counter = platform.StartCounter();
+    for (u32 frame = 0; frame < frameCount; frame++)
+    {
+        for (u32 character = 0; character < characterCount; character++)
         {
-            if (inPlayer->currentAnimation->boneChannels[index].name == name)
+            loopi(0, boneCount)
             {
-                animationId = index;
-                break;
+                for (u32 index = 0; index < animation.numNodes; index++)
+                {
+                    if (animation.boneChannels[index].name == skeleton.names[i])
+                    {
+                        nameChecksum += index;
+                        break;
+                    }
+                }
             }
         }
-        Mat4 lerpedMatrix;
-        if (animationId == -1)
+    }
+    f32 nameTime = platform.GetMilliseconds(counter);
+
+    // What a character pays once when it starts a clip. The cache is cleared so that every call builds the remap.
+    u64 buildChecksum = 0;
+    counter           = platform.StartCounter();
+    for (u32 frame = 0; frame < frameCount; frame++)
+    {
+        for (u32 character = 0; character < characterCount; character++)
         {
-            lerpedMatrix = skeleton->transformsToParent[id];
+            TempArena buildTemp      = TempBegin(temp.arena);
+            skeleton.firstRemapChunk = 0;
+            skeleton.lastRemapChunk  = 0;
+            AnimationRemap *remap    = GetAnimationRemap(buildTemp.arena, &skeleton, {}, &animation);
+            loopi(0, boneCount)
+            {
+                buildChecksum += remap->boneToChannel[i];
+            }
+            TempEnd(buildTemp);
         }
-        else
+    }
+    f32 buildTime = platform.GetMilliseconds(counter);
+
+    // What every frame pays once the remap is cached
+    skeleton.firstRemapChunk = 0;
+    skeleton.lastRemapChunk  = 0;
+    GetAnimationRemap(temp.arena, &skeleton, {}, &animation);
+    u64 lookupChecksum = 0;
+    counter            = platform.StartCounter();
+    for (u32 frame = 0; frame < frameCount; frame++)
+    {
+        for (u32 character = 0; character < characterCount; character++)
         {
-            lerpedMatrix = ConvertToMatrix(&transforms[animationId]);
+            AnimationRemap *remap = GetAnimationRemap(temp.arena, &skeleton, {}, &animation);
+            loopi(0, boneCount)
+            {
+                lookupChecksum += remap->boneToChannel[i];
+            }
         }
-        i32 parentId = skeleton->parents[id];
-        if (parentId == -1)
+    }
+    f32 lookupTime = platform.GetMilliseconds(counter);
+
+    Assert(nameChecksum == buildChecksum && nameChecksum == lookupChecksum);
+    Printf("Animation remap, %u characters with %u bones over %u frames: names %.3fms, remap build %.3fms, cached "
+           "remap %.3fms\n",
+           characterCount, boneCount, frameCount, nameTime, buildTime, lookupTime);
+    ScratchEnd(temp);
+}
+#endif
+
+#if ANIMATION_SAMPLE_BENCHMARK
+internal f32 DecodeAnimationComponent(const u8 *data, u32 bits, u32 lane, f32 min, f32 extent)
+{
+    f32 result = min;
+    if (bits == 8)
+    {
+        result = data[lane] / 255.f * extent + min;
+    }
+    else if (bits == 16)
+    {
+        u16 value;
+        MemoryCopy(&value, data + lane * sizeof(u16), sizeof(u16));
+        result = value / 65535.f * extent + min;
+    }
+    else if (bits == 32)
+    {
+        MemoryCopy(&result, data + lane * sizeof(f32), sizeof(f32));
+    }
+    return result;
+}
+
+internal AnimationTransform DecodeAnimationChannelScalar(const AnimationGroupFormat *format, const u8 *data, u32 lane)
+{
+    AnimationTransform result;
+    u32 translationSize = 4 * (format->translationBits / 8);
+    u32 rotationSize    = 4 * (format->rotationBits / 8);
+    u32 scaleSize       = 4 * (format->scaleBits / 8);
+    for (u32 i = 0; i < 3; i++)
+    {
+        result.translation.elements[i] = DecodeAnimationComponent(
+            data, format->translationBits, lane, format->translationMin[i][lane], format->translationExtent[i][lane]);
+        data += translationSize;
+    }
+
+    u32 indices = format->rotationBits ? *data++ : format->rotationIndices;
+    u32 dropped = (indices >> (2 * lane)) & 3;
+    f32 length  = 0.f;
+    u32 stored  = 0;
+    for (u32 i = 0; i < 4; i++)
+    {
+        if (i == dropped)
         {
-            transformToParent[id] = lerpedMatrix;
+            continue;
         }
-        else
+        f32 value = DecodeAnimationComponent(data, format->rotationBits, lane, format->rotationMin[stored][lane],
+                                             format->rotationExtent[stored][lane]);
+        result.rotation.xyzw[i] = value;
+        length += value * value;
+        data += rotationSize;
+        stored++;
+    }
+    result.rotation.xyzw[dropped] = SquareRoot(Max(1.f - length, 0.f));
+
+    for (u32 i = 0; i < 3; i++)
+    {
+        result.scale.elements[i] = DecodeAnimationComponent(data, format->scaleBits, lane, format->scaleMin[i][lane],
+                                                            format->scaleExtent[i][lane]);
+        data += scaleSize;
+    }
+    return result;
+}
+
+// Reference for the sampler, one channel at a time
+internal void SampleAnimationScalar(const KeyframedAnimation *animation, f32 time, AnimationTransform *transforms)
+{
+    f32 sample   = Clamp(time * animation->sampleRate, 0.f, (f32)(animation->numSamples - 1));
+    u32 sample0  = (u32)sample;
+    u32 sample1  = Min(sample0 + 1, animation->numSamples - 1);
+    f32 fraction = sample - (f32)sample0;
+    for (u32 channel = 0; channel < animation->numNodes; channel++)
+    {
+        u32 lane                           = channel % ANIMATION_GROUP_SIZE;
+        const AnimationGroupFormat *format = &animation->groups[channel / ANIMATION_GROUP_SIZE];
+        const u8 *data0                    = animation->sampleData + sample0 * animation->sampleStride + format->offset;
+        const u8 *data1                    = animation->sampleData + sample1 * animation->sampleStride + format->offset;
+        AnimationTransform a               = DecodeAnimationChannelScalar(format, data0, lane);
+        AnimationTransform b               = DecodeAnimationChannelScalar(format, data1, lane);
+        transforms[channel]                = Lerp(a, b, fraction);
+    }
+}
+
+// Samples a synthetic 200 channel animation for a number of characters on this thread, and checks the sampler against
+// the scalar reference. The groups cycle through every bit rate.
+internal void AnimationSampleBenchmark()
+{
+    const u32 boneCount      = 200;
+    const u32 sampleCount    = 300;
+    const u32 characterCount = 1000;
+    const u8 bitRates[]      = {0, 8, 16, 32};
+    const u32 bitRateCount   = ArrayLength(bitRates);
+
+    TempArena temp               = ScratchStart(0, 0);
+    KeyframedAnimation animation = {};
+    animation.numNodes           = boneCount;
+    animation.numGroups          = (boneCount + ANIMATION_GROUP_SIZE - 1) / ANIMATION_GROUP_SIZE;
+    animation.numSamples         = sampleCount;
+    animation.sampleRate         = 30.f;
+    animation.duration           = (sampleCount - 1) / animation.sampleRate;
+    animation.groups             = PushArray(temp.arena, AnimationGroupFormat, animation.numGroups);
+
+    u32 seed = 0x1234567;
+    auto Random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (f32)(seed >> 8) / (f32)(1 << 24);
+    };
+    for (u32 groupIndex = 0; groupIndex < animation.numGroups; groupIndex++)
+    {
+        AnimationGroupFormat *format = &animation.groups[groupIndex];
+        format->translationBits      = bitRates[groupIndex % bitRateCount];
+        format->rotationBits         = bitRates[(groupIndex + 1) % bitRateCount];
+        format->scaleBits            = bitRates[(groupIndex + 2) % bitRateCount];
+        format->rotationIndices      = (u8)(Random() * 256.f);
+        format->offset               = animation.sampleStride;
+        for (u32 i = 0; i < 3; i++)
         {
-            Assert(!IsZero(transformToParent[parentId]));
-            transformToParent[id] = transformToParent[parentId] * lerpedMatrix;
+            for (u32 lane = 0; lane < ANIMATION_GROUP_SIZE; lane++)
+            {
+                format->translationMin[i][lane]    = Random() * 10.f - 5.f;
+                format->translationExtent[i][lane] = Random() * 10.f;
+                format->rotationMin[i][lane]       = Random() * 0.1f - 0.5f;
+                format->rotationExtent[i][lane]    = Random() * 0.9f;
+                format->scaleMin[i][lane]          = 0.9f + Random() * 0.1f;
+                format->scaleExtent[i][lane]       = Random() * 0.1f;
+            }
         }
+        animation.sampleStride += GetAnimationTrackSize(format->translationBits) +
+                                  GetAnimationTrackSize(format->rotationBits) +
+                                  GetAnimationTrackSize(format->scaleBits) + (format->rotationBits ? 1 : 0);
+    }
 
-        Assert(id > previousId);
-        previousId             = id;
-        outFinalTransforms[id] = transformToParent[id] * skeleton->inverseBindPoses[id];
+    // Quantized values are random bits, raw values random floats in the ranges above
+    animation.sampleData = PushArrayNoZero(temp.arena, u8, sampleCount * animation.sampleStride);
+    for (u32 sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++)
+    {
+        for (u32 groupIndex = 0; groupIndex < animation.numGroups; groupIndex++)
+        {
+            AnimationGroupFormat *format = &animation.groups[groupIndex];
+            u8 *data                     = animation.sampleData + sampleIndex * animation.sampleStride + format->offset;
+            u32 bits[]                   = {format->translationBits, format->rotationBits, format->scaleBits};
+            f32 *mins[]                  = {format->translationMin[0], format->rotationMin[0], format->scaleMin[0]};
+            f32 *extents[] = {format->translationExtent[0], format->rotationExtent[0], format->scaleExtent[0]};
+            for (u32 track = 0; track < 3; track++)
+            {
+                if (track == 1 && bits[track])
+                {
+                    *data++ = (u8)(Random() * 256.f);
+                }
+                for (u32 i = 0; i < 3 * ANIMATION_GROUP_SIZE && bits[track]; i++)
+                {
+                    if (bits[track] == 32)
+                    {
+                        f32 value = mins[track][i] + Random() * extents[track][i];
+                        MemoryCopy(data, &value, sizeof(value));
+                        data += sizeof(value);
+                    }
+                    else
+                    {
+                        for (u32 byte = 0; byte < bits[track] / 8u; byte++)
+                        {
+                            *data++ = (u8)(Random() * 256.f);
+                        }
+                    }
+                }
+            }
+        }
     }
+
+    AnimationRemap remap = {};
+    remap.animation      = &animation;
+    remap.channelToBone  = PushArrayNoZero(temp.arena, i32, boneCount);
+    loopi(0, boneCount)
+    {
+        remap.channelToBone[i] = i;
+    }
+    AnimationPose pose            = PushPose(temp.arena, boneCount);
+    AnimationTransform *reference = PushArray(temp.arena, AnimationTransform, boneCount);
+
+    f32 maxError = 0.f;
+    for (u32 i = 0; i < 64; i++)
+    {
+        f32 time = animation.duration * i / 63.f;
+        SampleAnimation(&animation, &remap, time, &pose);
+        SampleAnimationScalar(&animation, time, reference);
+        loopi(0, boneCount)
+        {
+            maxError = Max(maxError, Length(pose.translations[i] - reference[i].translation));
+            maxError = Max(maxError, Length(pose.scales[i] - reference[i].scale));
+            maxError = Max(maxError, 1.f - Abs(Dot(pose.rotations[i], reference[i].rotation)));
+        }
+    }
+
+    PerformanceCounter counter = platform.StartCounter();
+    for (u32 character = 0; character < characterCount; character++)
+    {
+        SampleAnimationScalar(&animation, character * 0.0137f, reference);
+    }
+    f32 scalarTime = platform.GetMilliseconds(counter);
+
+    counter = platform.StartCounter();
+    for (u32 character = 0; character < characterCount; character++)
+    {
+        SampleAnimation(&animation, &remap, character * 0.0137f, &pose);
+    }
+    f32 simdTime = platform.GetMilliseconds(counter);
+
+    f32 bones = (f32)(boneCount * characterCount);
+    Printf("Animation sampling, %u characters with %u bones: scalar %.3fms (%.0f bones/ms), sampler %.3fms (%.0f "
+           "bones/ms), max error %f\n",
+           characterCount, boneCount, scalarTime, bones / scalarTime, simdTime, bones / simdTime, maxError);
     ScratchEnd(temp);
 }
+#endif
 
 internal AnimationTransform operator*(AnimationTransform p, AnimationTransform c)
 {
@@ -52,16 +52,77 @@ struct MeshVertex
     f32 boneWeights[MAX_MATRICES_PER_VERTEX];
 };
 
+// Runs the animation remap benchmark on startup
+#ifndef ANIMATION_REMAP_BENCHMARK
+#define ANIMATION_REMAP_BENCHMARK 0
+#endif
+// Runs the animation sampling benchmark on startup
+#ifndef ANIMATION_SAMPLE_BENCHMARK
+#define ANIMATION_SAMPLE_BENCHMARK 0
+#endif
+// Runs the CPU skinning benchmark on startup
+#ifndef SKINNING_BENCHMARK
+#define SKINNING_BENCHMARK 0
+#endif
+
+#define SKELETON_ANIMATION_REMAP_CHUNK_SIZE 8
+
+struct KeyframedAnimation;
+
+// Matches the channels of an animation to the bones of a skeleton by SID. Built the first time the pair is used, see
+// GetAnimationRemap.
+struct AnimationRemap
+{
+    // Includes the generation of the slot, so a different animation loaded into the same slot gets its own remap
+    AS_Handle handle;
+    KeyframedAnimation *animation;
+    // -1 when the skeleton has no such bone
+    i32 *channelToBone;
+    u32 channelCapacity;
+    // -1 when the animation doesn't move the bone, which stays in its bind pose
+    i32 *boneToChannel;
+};
+
+// Remaps never move once built, clips hold on to them
+struct AnimationRemapChunk
+{
+    AnimationRemap remaps[SKELETON_ANIMATION_REMAP_CHUNK_SIZE];
+    u32 count;
+    AnimationRemapChunk *next;
+};
+
+// Local transforms of every bone of a skeleton, one array per component
+struct AnimationPose
+{
+    V3 *translations;
+    Quat *rotations;
+    V3 *scales;
+    u32 count;
+};
+
 struct LoadedSkeleton
 {
     u32 sid;
     u32 count;
     u32 skinningOffset;
+    // Mesh space bounds of the rest pose skinned vertices this frame, see SkinModelToAnimation
     Rect3 aabb;
     string *names;
+    // -1 for roots, parents always come before their children
     i32 *parents;
     Mat4 *inverseBindPoses;
     Mat4 *transformsToParent;
+    // Bone space bounds of the vertices each bone moves, empty (min > max) when it moves none
+    Rect3 *boneBounds;
+
+    AnimationRemapChunk *firstRemapChunk;
+    AnimationRemapChunk *lastRemapChunk;
+
+    // transformsToParent decomposed, built on first use
+    AnimationPose restPose;
+    // Distance from each bone to the farthest bone below it in the rest pose, at least the length of the bone and
+    // never more than the extent of its parent. Built with restPose.
+    f32 *boneExtents;
 };
 
 struct AnimationTransform
@@ -115,23 +176,58 @@ struct AnimationScale
     f32 time;
 };
 
-struct AnimationRotation
+struct BoneChannel
 {
-    // Quat rotation;
-    u16 rotation[4];
-    f32 time;
+    string name;
 };
 
-struct BoneChannel
+#define ANIMATION_GROUP_SIZE 4
+
+// Every track of a group of four channels, its translation, rotation or scale, is quantized to one bit rate chosen
+// offline against the error bound. 0 bits is constant over the clip and decodes to min, 8 and 16 bits are fixed point
+// between min and min + extent, and 32 bits are raw floats. Rotations keep their three smallest components, the
+// largest is rebuilt from their length.
+//
+// In each sample a group is stored at offset as translation x, y, z, then the dropped rotation component of each lane
+// packed 2 bits per lane in one byte followed by the three rotation components, then scale x, y, z. Each component
+// holds the four lanes. Tracks with 0 bits take no space, a constant rotation keeps its dropped components in
+// rotationIndices.
+struct AnimationGroupFormat
+{
+    u8 translationBits;
+    u8 rotationBits;
+    u8 scaleBits;
+    u8 rotationIndices;
+    u32 offset;
+
+    f32 translationMin[3][ANIMATION_GROUP_SIZE];
+    f32 translationExtent[3][ANIMATION_GROUP_SIZE];
+    f32 rotationMin[3][ANIMATION_GROUP_SIZE];
+    f32 rotationExtent[3][ANIMATION_GROUP_SIZE];
+    f32 scaleMin[3][ANIMATION_GROUP_SIZE];
+    f32 scaleExtent[3][ANIMATION_GROUP_SIZE];
+};
+
+inline u32 GetAnimationTrackSize(u32 bits)
 {
-    string name;
-    AnimationPosition *positions;
-    AnimationScale *scales;
-    AnimationRotation *rotations;
+    u32 result = 3 * ANIMATION_GROUP_SIZE * (bits / 8);
+    return result;
+}
 
-    u32 numPositionKeys;
-    u32 numScalingKeys;
-    u32 numRotationKeys;
+// Movement of the root along the ground and its turn about +Y, in model space. Samples of a clip are relative to its
+// first sample, deltas to the frame the root faces at their start.
+struct AnimationRootMotion
+{
+    V3 translation;
+    f32 yaw;
+};
+
+// Notify authored in the extras of the gltf animation, fired when the playback passes its time
+struct AnimationEvent
+{
+    f32 time;
+    u32 sid;
+    string name;
 };
 
 struct KeyframedAnimation
@@ -140,6 +236,24 @@ struct KeyframedAnimation
     u32 numNodes;
 
     f32 duration;
+
+    // Sampled at a fixed rate, the first sample is at time 0 and the last at duration. Sample i starts at
+    // sampleData + i * sampleStride. Channels past numNodes in the last group are padding.
+    AnimationGroupFormat *groups;
+    u8 *sampleData;
+    u32 sampleStride;
+    u32 numSamples;
+    u32 numGroups;
+    f32 sampleRate;
+
+    // Taken out of the root bone offline, which plays in place. Empty unless the clip opts in.
+    AnimationRootMotion *rootMotion;
+    u32 numRootMotionSamples;
+    f32 rootMotionSampleRate;
+
+    // Sorted by time
+    AnimationEvent *events;
+    u32 numEvents;
 };
 
 struct AnimationPlayer
@@ -148,19 +262,95 @@ struct AnimationPlayer
     KeyframedAnimation *currentAnimation;
     f32 currentTime;
     f32 duration;
-
-    u32 currentPositionKey[300];
-    u32 currentScaleKey[300];
-    u32 currentRotationKey[300];
-
-    // u32 *currentPositionKey;
-    // u32 *currentScaleKey;
-    // u32 *currentRotationKey;
+    f32 playbackRate;
+    // The last advance went from previousTime to currentTime, wrapping around loopCount times
+    f32 previousTime;
+    u32 loopCount;
 
     b32 isLooping;
     b8 loaded;
 };
 
+//////////////////////////////
+// Pose blending
+//
+#define ANIMATION_MAX_LAYERS      4
+#define ANIMATION_MAX_LAYER_CLIPS 4
+
+struct AnimationBlendClip
+{
+    AnimationPlayer player;
+    AnimationRemap *remap;
+    f32 weight;
+    f32 targetWeight;
+    // Change in weight per second while fading towards targetWeight
+    f32 fadeRate;
+};
+
+enum AnimationLayerFlags
+{
+    // Adds the difference between the clips and their first sample on top of the layers below
+    AnimationLayerFlag_Additive = 1 << 0,
+};
+
+// Clips of a layer are blended by their normalized weights. Fading clips out and a new one in cross-fades between
+// them.
+struct AnimationLayer
+{
+    AnimationBlendClip clips[ANIMATION_MAX_LAYER_CLIPS];
+    u32 clipCount;
+    f32 weight;
+    u32 flags;
+
+    // Only this bone and its descendants are affected, the whole skeleton when empty. Resolved into per bone weights
+    // the first time the layer is evaluated.
+    string maskRoot;
+    f32 *boneMask;
+};
+
+//////////////////////////////
+// Animation LOD
+//
+#define ANIMATION_LOD_MAX_INTERVAL 4
+
+// Throttling of one animated instance. Small instances are evaluated every updateInterval frames, the frames in between
+// blend from the previous evaluated pose to the current one, which delays them by up to an interval. Bones smaller than
+// a few pixels on screen aren't sampled and keep their rest pose.
+struct AnimationLod
+{
+    AnimationPose previousPose;
+    AnimationPose currentPose;
+    b8 *activeBones;
+    u32 activeBoneCount;
+    u32 boneCount;
+
+    u32 updateInterval;
+    u32 framesSinceUpdate;
+    // Time that the layers haven't been advanced by yet
+    f32 pendingTime;
+    // Pixels per unit of the skeleton, and the projected size of the skeleton in pixels
+    f32 pixelsPerUnit;
+    f32 screenSize;
+    // Evaluated this frame, decided on the main thread
+    b8 evaluate;
+    b8 hasPose;
+};
+
+struct AnimationLodStats
+{
+    u32 instances;
+    u32 evaluated;
+    // Waiting for their next update
+    u32 throttled;
+    // Due, but over the bone budget
+    u32 deferred;
+    u32 bonesSampled;
+    // Bones sampled if every instance was evaluated at full detail every frame
+    u32 bonesTotal;
+};
+
+#define MESH_MAX_LODS 4
+
 struct Mesh
 {
     MeshFlags flags;
@@ -173,6 +363,16 @@ struct Mesh
     V4 *boneWeights;
     u32 *indices;
 
+    // Used instead of the streams above when flags has MeshFlags_Quantized. Positions are unorm16 in bounds (w is
+    // unused), normals and tangents are octahedral snorm16, uvs are halfs, bone ids and weights are one byte each.
+    // See EncodeOctahedral and FloatToHalf.
+    U16V4 *quantizedPositions;
+    u32 *octNormals;
+    u32 *octTangents;
+    u32 *halfUvs;
+    u32 *packedBoneIds;
+    u32 *packedBoneWeights;
+
     struct MeshSubset
     {
         u32 indexStart;
@@ -182,10 +382,65 @@ struct Mesh
     MeshSubset *subsets;
     u32 numSubsets;
 
+    // Spatially coherent groups of at most CLUSTER_SIZE triangles, built offline (see BuildCluster). The triangles
+    // of a cluster are contiguous in the index buffer. Everything is in mesh space.
+    struct Cluster
+    {
+        Rect3 bounds;
+        V3 sphereCenter;
+        f32 sphereRadius;
+
+        // The cluster is back facing when dot(normalize(coneApex - cameraPos), coneAxis) >= coneCutoff.
+        // coneCutoff is 1 when the normals are too spread out for the test to reject anything.
+        V3 coneApex;
+        f32 coneCutoff;
+        V3 coneAxis;
+
+        u32 subsetIndex;
+        u32 indexStart;
+        u32 indexCount;
+    };
+    Cluster *clusters;
+    u32 numClusters;
+
+    // Simplified levels of detail, built offline (see BuildLods). They share the vertices of the mesh, and each one
+    // is a contiguous range of clusters. Level 0 is the full mesh.
+    struct Lod
+    {
+        u32 clusterStart;
+        u32 clusterCount;
+        // Mesh space distance from the full mesh, projected to the screen to select the level
+        f32 error;
+    };
+    Lod lods[MESH_MAX_LODS];
+    u32 numLods;
+
+    // Cluster DAG for continuous level of detail, built offline (see BuildClusterDag). The leaves are the clusters of
+    // level 0, every other node is a cluster simplified from a group of nodes below it. A node belongs to the cut when
+    // its own error is small enough and its parent's isn't (see SelectDagCut).
+    struct DagNode
+    {
+        // Into clusters
+        u32 clusterIndex;
+
+        // Bounds and error of the group simplification that made this node. 0 error for leaves.
+        V3 lodCenter;
+        f32 lodRadius;
+        f32 lodError;
+
+        // Bounds and error of the group simplification this node is part of. FLT_MAX error for roots.
+        V3 parentCenter;
+        f32 parentRadius;
+        f32 parentError;
+    };
+    DagNode *dagNodes;
+    u32 numDagNodes;
+
     Rect3 bounds;
 
     // these are valid for one frame only
     i32 meshIndex;
+    u32 lodIndex;
     u32 clusterOffset;
     u32 clusterCount;
     u32 vertexCount;
@@ -251,12 +506,78 @@ struct Mesh
     inline b32 IsRenderable();
 };
 
+// Screen space error of a dag node simplification seen from viewPos, in pixels. projectionScale is
+// screenHeight / (2 * tan(fov / 2)).
+inline f32 ProjectDagError(V3 center, f32 radius, f32 error, V3 viewPos, f32 projectionScale)
+{
+    if (error == FLT_MAX)
+    {
+        return FLT_MAX;
+    }
+    f32 distance = Length(center - viewPos) - radius;
+    // Inside of the bounds
+    if (distance <= 0.f)
+    {
+        return error == 0.f ? 0.f : FLT_MAX;
+    }
+    return error * projectionScale / distance;
+}
+
+// CPU reference for the cut of a cluster DAG. Every node is tested on its own: the bounds of a parent contain the
+// bounds of its children and its error is at least theirs, so the cut can't overlap itself or leave holes. Returns the
+// number of nodes written to outNodes.
+inline u32 SelectDagCut(Mesh::DagNode *nodes, u32 count, V3 viewPos, f32 projectionScale, f32 threshold, u32 *outNodes)
+{
+    u32 result = 0;
+    for (u32 i = 0; i < count; i++)
+    {
+        Mesh::DagNode *node = &nodes[i];
+        f32 error           = ProjectDagError(node->lodCenter, node->lodRadius, node->lodError, viewPos, projectionScale);
+        f32 parentError     = ProjectDagError(node->parentCenter, node->parentRadius, node->parentError, viewPos, projectionScale);
+        if (error <= threshold && parentError > threshold)
+        {
+            outNodes[result++] = i;
+        }
+    }
+    return result;
+}
+
 struct LoadedModel
 {
     u32 numMeshes;
     Rect3 bounds;
 };
 
+//////////////////////////////
+// CPU skinning
+//
+// Vertices per job of SkinMesh
+#define SKINNING_CPU_BATCH_SIZE 4096
+
+enum SkinningMode
+{
+    // Same result as skinning_cs.hlsl
+    SkinningMode_Linear,
+    // Keeps the volume around twisting joints, the scale of the bones is ignored
+    SkinningMode_DualQuaternion,
+};
+
+// Rigid transform, the dual part holds the translation
+struct DualQuat
+{
+    Quat real;
+    Quat dual;
+};
+
+// Mesh space streams, the CPU copy of what the skinning shader writes
+struct SkinnedVertices
+{
+    V3 *positions;
+    V3 *normals;
+    V3 *tangents;
+    u32 count;
+};
+
 // NOTE: Temporary hash
 struct FaceVertex
 {
@@ -294,17 +615,6 @@ struct TGAResult
 //////////////////////////////
 // Function
 //
-inline u16 CompressRotationChannel(f32 q)
-{
-    u16 result = (u16)CompressFloat(q, -1.f, 1.f, 16u);
-    return result;
-}
-
-inline f32 DecompressRotationChannel(u16 q)
-{
-    f32 result = DecompressFloat((u32)q, -1.f, 1.f, 16u);
-    return result;
-}
 internal Heightmap CreateHeightmap(string filename);
 
 //////////////////////////////
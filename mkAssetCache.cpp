@@ -43,20 +43,14 @@ internal void AS_Init()
     engine->SetAssetCacheState(as_state);
     as_state->arena = arena;
 
-    // as_state->numSlots   = 1024;
-    // as_state->assetSlots = PushArray(arena, AS_Slot, as_state->numSlots);
-
-    as_state->assetCapacity = 1024;
-    as_state->assets        = PushArray(arena, AS_Asset *, as_state->assetCapacity);
     // Reserve null slot
-    as_state->assets[0] = PushStruct(arena, AS_Asset);
-    as_state->assetCount++;
-    as_state->assetEndOfList++;
-    as_state->freeAssetList = PushArray(arena, i32, as_state->assetCapacity);
+    i32 nullSlot = AS_AllocSlot();
+    Assert(nullSlot == 0);
 
     // Hash table
     {
-        as_state->fileHash.Init(1024, 1024);
+        as_state->fileHash.Init(1024, AS_MAX_ASSETS);
+        as_state->contentHash.Init(1024, AS_MAX_ASSETS);
     }
 
     as_state->ringBufferSize = kilobytes(64);
@@ -73,6 +67,11 @@ internal void AS_Init()
     {
         as_state->threads[i].handle = platform.ThreadStart(AS_EntryPoint, (void *)i);
     }
+    as_state->hotloadThread = platform.ThreadStart(AS_HotloadEntryPoint, 0);
+
+#if AS_SLOT_MAP_STRESS_TEST
+    AS_SlotMapStressTest();
+#endif
 
     // Asset tag trees
     as_state->tagMap.maxSlots = AS_TagKey_Count;
@@ -96,6 +95,8 @@ internal void AS_Flush()
     {
         platform.ThreadJoin(as_state->threads[i].handle);
     }
+    // NOTE: the hotload thread wakes up periodically to check for termination
+    platform.ThreadJoin(as_state->hotloadThread);
 }
 
 internal void AS_Restart()
@@ -106,6 +107,7 @@ internal void AS_Restart()
     {
         as_state->threads[i].handle = platform.ThreadStart(AS_EntryPoint, (void *)i);
     }
+    as_state->hotloadThread = platform.ThreadStart(AS_HotloadEntryPoint, 0);
 }
 
 internal u64 RingRead(u8 *base, u64 ringSize, u64 readPos, void *dest, u64 destSize)
@@ -219,26 +221,15 @@ THREAD_ENTRY_POINT(AS_EntryPoint)
             {
                 continue;
             }
-            AS_Asset *asset = 0;
-
-            i32 hash = HashFromString(path);
-            Assert(((as_state->assetCapacity) & (as_state->assetCapacity - 1)) == 0);
-
             // The asset should've been added to the cache already.
-            for (i32 i = as_state->fileHash.FirstInHash(hash); i != -1; i = as_state->fileHash.NextInHash(i))
-            {
-                AS_Asset *nextAsset = as_state->assets[i];
-                if (nextAsset->path == path)
-                {
-                    asset = nextAsset;
-                    break;
-                }
-            }
+            i32 assetId     = AS_FindAssetId(path);
+            AS_Asset *asset = assetId > 0 ? AS_GetAssetFromId(assetId) : 0;
 
             if (asset == 0)
             {
                 Assert(!"Space for asset not made");
             }
+            AS_EndPhase(asset, AS_LoadPhase_Queued);
 
             // Freed/new assets have a "lastModified" timestamp of 0. Assets to be hotloaded have a timestamp != 0.
             if (asset->lastModified != 0)
@@ -246,17 +237,50 @@ THREAD_ENTRY_POINT(AS_EntryPoint)
                 u32 loaded = AS_Status_Loaded;
                 if (!asset->status.compare_exchange_strong(loaded, AS_Status_Unloaded))
                 {
+                    // Still loading, or being moved by AS_Compact. lastModified was already updated so the change
+                    // wouldn't be seen again, instead the reload is requeued once the asset is loaded. Nothing to
+                    // reload if it's being freed.
+                    platform.CloseFile(handle);
+                    if (loaded != AS_Status_Freeing)
+                    {
+                        asset->reloadPending.store(true);
+                        // The load could have finished before the flag was set
+                        if (asset->status.load() == AS_Status_Loaded && asset->reloadPending.exchange(false))
+                        {
+                            AS_EnqueueFile(path);
+                        }
+                    }
+                    ScratchEnd(scratch);
                     continue;
                 }
 
-                AS_Free(asset);
+                if (asset->canonicalId)
+                {
+                    AS_ReleaseAlias(asset);
+                }
+                else
+                {
+                    // Assets sharing this payload have to be loaded from their own files again
+                    AS_ReleaseAliases(asset);
+                    AS_Free(asset);
+                }
                 Printf("Asset freed");
             }
             asset->lastModified = attributes.lastModified;
-            asset->memoryBlock  = AS_Alloc((i32)attributes.size);
+            asset->memoryBlock  = AS_Alloc(attributes.size, asset);
 
+            AS_BeginPhase(asset, AS_LoadPhase_Read);
             asset->size = platform.ReadFileHandle(handle, AS_GetMemory(asset));
             platform.CloseFile(handle);
+            AS_EndPhase(asset, AS_LoadPhase_Read);
+            asset->trace.bytes = asset->size;
+
+            if (AS_DedupeAsset(asset))
+            {
+                AS_FinishLoadTrace(asset);
+                ScratchEnd(scratch);
+                continue;
+            }
 
             // Process the raw asset data
             // JS_Kick(AS_LoadAsset, asset, 0, Priority_Low);
@@ -274,33 +298,113 @@ THREAD_ENTRY_POINT(AS_EntryPoint)
     }
 }
 
-internal void AS_HotloadEntryPoint(void *p)
+// Looks up the asset using the path -> asset hash. Returns -1 if the file isn't tracked.
+internal i32 AS_FindAssetId(string path)
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    i32 result              = -1;
+    i32 hash                = HashFromString(path);
+    BeginMutex(&as_state->lock);
+    for (i32 i = as_state->fileHash.FirstInHash(hash); i != -1; i = as_state->fileHash.NextInHash(i))
+    {
+        if (AS_GetAssetFromId(i)->path == path)
+        {
+            result = i;
+            break;
+        }
+    }
+    EndMutex(&as_state->lock);
+    return result;
+}
+
+internal void AS_HotloadAsset(i32 assetId)
+{
+    AS_Asset *asset = assetId > 0 ? AS_GetAssetFromId(assetId) : 0;
+
+    // Assets that haven't finished loading for the first time have a timestamp of 0
+    u64 lastModified = asset ? asset->lastModified : 0;
+    if (lastModified == 0) return;
+
+    // If the asset was modified, its write time changes. Need to hotload.
+    OS_FileAttributes attributes = platform.AttributesFromPath(asset->path);
+    if (attributes.lastModified != 0 && attributes.lastModified != lastModified)
+    {
+        if (AtomicCompareExchangeU64(&asset->lastModified, attributes.lastModified, lastModified) == lastModified)
+        {
+            AS_BeginLoadTrace(asset);
+            AS_EnqueueFile(asset->path);
+        }
+    }
+}
+
+THREAD_ENTRY_POINT(AS_HotloadEntryPoint)
 {
+    ThreadContextSet(ctx);
     AS_CacheState *as_state = engine->GetAssetCacheState();
-    SetThreadName("[AS] Hotload");
+    SetThreadName(Str8Lit("[AS] Hotload"));
+
+    OS_Handle watch = platform.WatchDirectory(Str8Lit("data/"));
+    if (watch.handle == 0) return;
+
+    AS_HotloadRequest pending[AS_HOTLOAD_MAX_PENDING];
+    u32 pendingCount = 0;
 
     for (; !gTerminateThreads;)
     {
-        for (i32 i = 0; i < as_state->assetEndOfList; i++)
+        TempArena scratch = ScratchStart(0, 0);
+
+        // Wake up often enough to respect the debounce window while there are pending changes
+        u32 timeout            = pendingCount ? (u32)(AS_HOTLOAD_DEBOUNCE_SECONDS * 1000.f) / 2 : 250;
+        OS_FileChanges changes = platform.WaitFileChanges(scratch.arena, watch, timeout);
+        f32 now                = platform.NowSeconds();
+
+        // Notifications were lost, so every loaded asset has to be checked once
+        if (changes.overflow)
         {
-            AS_Asset *asset = as_state->assets[i];
-            if (asset->lastModified)
+            i32 endOfList = as_state->slots.endOfList.load();
+            for (i32 i = 1; i < endOfList; i++)
             {
-                // If the asset was modified, its write time changes. Need to hotload.
-                OS_FileAttributes attributes = platform.AttributesFromPath(asset->path);
-                u64 lastModified             = asset->lastModified;
-                if (attributes.lastModified != 0 && attributes.lastModified != lastModified)
-                {
-                    // Printf("Old last modified: %u\nNew last modified: %u\n\n", node->lastModified,
-                    //        attributes.lastModified);
-                    AtomicCompareExchangeU64(&asset->lastModified, attributes.lastModified, lastModified);
+                AS_HotloadAsset(i);
+            }
+        }
+
+        for (OS_FileChange *change = changes.first; change != 0; change = change->next)
+        {
+            i32 assetId = AS_FindAssetId(change->path);
+            if (assetId <= 0) continue;
 
-                    AS_EnqueueFile(asset->path);
+            u32 index = 0;
+            for (; index < pendingCount; index++)
+            {
+                if (pending[index].assetId == assetId) break;
+            }
+            if (index == pendingCount)
+            {
+                if (pendingCount == AS_HOTLOAD_MAX_PENDING)
+                {
+                    AS_HotloadAsset(assetId);
+                    continue;
                 }
+                pending[pendingCount++].assetId = assetId;
+            }
+            pending[index].deadline = now + AS_HOTLOAD_DEBOUNCE_SECONDS;
+        }
+
+        for (u32 i = 0; i < pendingCount;)
+        {
+            if (now >= pending[i].deadline)
+            {
+                AS_HotloadAsset(pending[i].assetId);
+                pending[i] = pending[--pendingCount];
+            }
+            else
+            {
+                i++;
             }
         }
-        platform.Sleep(100);
+        ScratchEnd(scratch);
     }
+    platform.CloseDirectoryWatch(watch);
 }
 
 //////////////////////////////
@@ -312,6 +416,30 @@ internal void AS_HotloadEntryPoint(void *p)
 // JOB_CALLBACK(AS_LoadAsset)
 
 using namespace graphics;
+
+// Textures are block compressed by the asset build. The source image is only decoded if it hasn't been built.
+internal AS_Handle AS_GetTextureAsset(Arena *arena, string textureName)
+{
+    string ddsPath = PushStr8F(arena, "%S%S.dds", ddsDirectory, PathSkipLastSlash(RemoveFileExtension(textureName)));
+    if (platform.FileExists(ddsPath))
+    {
+        return AS_GetAsset(ddsPath);
+    }
+    Printf("Missing block compressed texture %S, falling back to %S\n", ddsPath, textureName);
+    return AS_GetAsset(StrConcat(arena, textureDirectory, textureName));
+}
+
+// Every path that finishes loading or moving an asset goes through here, so a hotload that arrived in the meantime
+// isn't lost
+internal void AS_SetLoaded(AS_Asset *asset)
+{
+    asset->status.store(AS_Status_Loaded);
+    if (asset->reloadPending.exchange(false))
+    {
+        AS_EnqueueFile(asset->path);
+    }
+}
+
 internal void AS_LoadAsset(AS_Asset *asset)
 {
     TempArena temp          = ScratchStart(0, 0);
@@ -321,6 +449,7 @@ internal void AS_LoadAsset(AS_Asset *asset)
     {
         return;
     }
+    AS_BeginPhase(asset, AS_LoadPhase_Decode);
     string extension = GetFileExtension(asset->path);
     if (extension == Str8Lit("model"))
     {
@@ -372,17 +501,8 @@ internal void AS_LoadAsset(AS_Asset *asset)
             b32 result = Advance(&materialTokenizer, "\tDiffuse: ");
             if (result)
             {
-                line           = ReadLine(&materialTokenizer);
-                string ddsPath = PushStr8F(temp.arena, "%S%S.dds", ddsDirectory, PathSkipLastSlash(RemoveFileExtension(line)));
-
-                if (platform.FileExists(ddsPath))
-                {
-                    component->textures[TextureType_Diffuse] = AS_GetAsset(ddsPath);
-                }
-                else
-                {
-                    component->textures[TextureType_Diffuse] = AS_GetAsset(StrConcat(temp.arena, textureDirectory, line));
-                }
+                line                                     = ReadLine(&materialTokenizer);
+                component->textures[TextureType_Diffuse] = AS_GetTextureAsset(temp.arena, line);
             }
             result = Advance(&materialTokenizer, "\tColor: ");
             if (result)
@@ -396,13 +516,13 @@ internal void AS_LoadAsset(AS_Asset *asset)
             if (result)
             {
                 line                                    = ReadLine(&materialTokenizer);
-                component->textures[TextureType_Normal] = AS_GetAsset(StrConcat(temp.arena, textureDirectory, line));
+                component->textures[TextureType_Normal] = AS_GetTextureAsset(temp.arena, line);
             }
             result = Advance(&materialTokenizer, "\tMR Map: ");
             if (result)
             {
                 line                                = ReadLine(&materialTokenizer);
-                component->textures[TextureType_MR] = AS_GetAsset(StrConcat(temp.arena, textureDirectory, line));
+                component->textures[TextureType_MR] = AS_GetTextureAsset(temp.arena, line);
             }
             result = Advance(&materialTokenizer, "\tMetallic Factor: ");
             if (result)
@@ -455,24 +575,50 @@ internal void AS_LoadAsset(AS_Asset *asset)
                 }
             }
 
-            mesh->positions = GetTokenCursor(&tokenizer, V3);
-            Advance(&tokenizer, sizeof(mesh->positions[0]) * vertexCount);
-            mesh->normals = GetTokenCursor(&tokenizer, V3);
-            Advance(&tokenizer, sizeof(mesh->normals[0]) * vertexCount);
-            mesh->tangents = GetTokenCursor(&tokenizer, V3);
-            Advance(&tokenizer, sizeof(mesh->tangents[0]) * vertexCount);
-            if (flags & MeshFlags_Uvs)
+            mesh->flags |= flags;
+            if (flags & MeshFlags_Quantized)
             {
-                mesh->uvs = GetTokenCursor(&tokenizer, V2);
-                Advance(&tokenizer, sizeof(mesh->uvs[0]) * vertexCount);
+                mesh->quantizedPositions = GetTokenCursor(&tokenizer, U16V4);
+                Advance(&tokenizer, sizeof(mesh->quantizedPositions[0]) * vertexCount);
+                mesh->octNormals = GetTokenCursor(&tokenizer, u32);
+                Advance(&tokenizer, sizeof(mesh->octNormals[0]) * vertexCount);
+                mesh->octTangents = GetTokenCursor(&tokenizer, u32);
+                Advance(&tokenizer, sizeof(mesh->octTangents[0]) * vertexCount);
+                if (flags & MeshFlags_Uvs)
+                {
+                    mesh->halfUvs = GetTokenCursor(&tokenizer, u32);
+                    Advance(&tokenizer, sizeof(mesh->halfUvs[0]) * vertexCount);
+                }
+                if (flags & MeshFlags_Skinned)
+                {
+                    mesh->packedBoneIds = GetTokenCursor(&tokenizer, u32);
+                    Advance(&tokenizer, sizeof(mesh->packedBoneIds[0]) * vertexCount);
+
+                    mesh->packedBoneWeights = GetTokenCursor(&tokenizer, u32);
+                    Advance(&tokenizer, sizeof(mesh->packedBoneWeights[0]) * vertexCount);
+                }
             }
-            if (flags & MeshFlags_Skinned)
+            else
             {
-                mesh->boneIds = GetTokenCursor(&tokenizer, UV4);
-                Advance(&tokenizer, sizeof(mesh->boneIds[0]) * vertexCount);
+                mesh->positions = GetTokenCursor(&tokenizer, V3);
+                Advance(&tokenizer, sizeof(mesh->positions[0]) * vertexCount);
+                mesh->normals = GetTokenCursor(&tokenizer, V3);
+                Advance(&tokenizer, sizeof(mesh->normals[0]) * vertexCount);
+                mesh->tangents = GetTokenCursor(&tokenizer, V3);
+                Advance(&tokenizer, sizeof(mesh->tangents[0]) * vertexCount);
+                if (flags & MeshFlags_Uvs)
+                {
+                    mesh->uvs = GetTokenCursor(&tokenizer, V2);
+                    Advance(&tokenizer, sizeof(mesh->uvs[0]) * vertexCount);
+                }
+                if (flags & MeshFlags_Skinned)
+                {
+                    mesh->boneIds = GetTokenCursor(&tokenizer, UV4);
+                    Advance(&tokenizer, sizeof(mesh->boneIds[0]) * vertexCount);
 
-                mesh->boneWeights = GetTokenCursor(&tokenizer, V4);
-                Advance(&tokenizer, sizeof(mesh->boneWeights[0]) * vertexCount);
+                    mesh->boneWeights = GetTokenCursor(&tokenizer, V4);
+                    Advance(&tokenizer, sizeof(mesh->boneWeights[0]) * vertexCount);
+                }
             }
             u32 indexCount;
             GetPointerValue(&tokenizer, &indexCount);
@@ -481,6 +627,18 @@ internal void AS_LoadAsset(AS_Asset *asset)
             mesh->indices = GetTokenCursor(&tokenizer, u32);
             Advance(&tokenizer, sizeof(mesh->indices[0]) * indexCount);
 
+            GetPointerValue(&tokenizer, &mesh->numClusters);
+            mesh->clusters = GetTokenCursor(&tokenizer, Mesh::Cluster);
+            Advance(&tokenizer, sizeof(mesh->clusters[0]) * mesh->numClusters);
+
+            GetPointerValue(&tokenizer, &mesh->numLods);
+            Assert(mesh->numLods >= 1 && mesh->numLods <= MESH_MAX_LODS);
+            Get(&tokenizer, mesh->lods, sizeof(mesh->lods[0]) * mesh->numLods);
+
+            GetPointerValue(&tokenizer, &mesh->numDagNodes);
+            mesh->dagNodes = GetTokenCursor(&tokenizer, Mesh::DagNode);
+            Advance(&tokenizer, sizeof(mesh->dagNodes[0]) * mesh->numDagNodes);
+
             GetPointerValue(&tokenizer, &mesh->bounds);
 
             Mat4 transform;
@@ -519,7 +677,7 @@ internal void AS_LoadAsset(AS_Asset *asset)
                 if (attributes.lastModified != 0 || attributes.size != 0)
                 {
                     skelAsset->lastModified = attributes.lastModified;
-                    skelAsset->memoryBlock  = AS_Alloc((i32)attributes.size);
+                    skelAsset->memoryBlock  = AS_Alloc(attributes.size, skelAsset);
 
                     skelAsset->size = platform.ReadFileHandle(handle, AS_GetMemory(skelAsset));
                     platform.CloseFile(handle);
@@ -536,7 +694,10 @@ internal void AS_LoadAsset(AS_Asset *asset)
                     GetPointerValue(&skeletonTokenizer, &count);
                     skeleton->count = count;
 
-                    if (version == 1)
+                    // Version 2 sorts the bones so that parents come before their children, version 3 adds the
+                    // bounds of the vertices every bone moves
+                    Assert(version == 3);
+                    if (version == 3)
                     {
                         skeleton->names = GetTokenCursor(&skeletonTokenizer, string);
                         Advance(&skeletonTokenizer, sizeof(skeleton->names[0]) * count);
@@ -548,10 +709,16 @@ internal void AS_LoadAsset(AS_Asset *asset)
                         }
                         skeleton->parents = GetTokenCursor(&skeletonTokenizer, i32);
                         Advance(&skeletonTokenizer, sizeof(skeleton->parents[0]) * count);
+                        for (u32 i = 0; i < count; i++)
+                        {
+                            Assert(skeleton->parents[i] >= -1 && skeleton->parents[i] < (i32)i);
+                        }
                         skeleton->inverseBindPoses = GetTokenCursor(&skeletonTokenizer, Mat4);
                         Advance(&skeletonTokenizer, sizeof(skeleton->inverseBindPoses[0]) * count);
                         skeleton->transformsToParent = GetTokenCursor(&skeletonTokenizer, Mat4);
                         Advance(&skeletonTokenizer, sizeof(skeleton->transformsToParent[0]) * count);
+                        skeleton->boneBounds = GetTokenCursor(&skeletonTokenizer, Rect3);
+                        Advance(&skeletonTokenizer, sizeof(skeleton->boneBounds[0]) * count);
 
                         Assert(EndOfBuffer(&skeletonTokenizer));
                     }
@@ -582,103 +749,88 @@ internal void AS_LoadAsset(AS_Asset *asset)
             u64 alignment      = device->GetMinAlignment(&desc);
 
             Assert(IsPow2(alignment));
-            desc.size = AlignPow2(sizeof(mesh->positions[0]) * vertexCount, alignment) + Align(sizeof(mesh->normals[0]) * vertexCount, alignment) + Align(sizeof(mesh->tangents[0]) * vertexCount, alignment);
-            if (mesh->uvs)
+
+            // Vertex streams, then the indices
+            struct VertexStream
             {
-                desc.size += AlignPow2(sizeof(mesh->uvs[0]) * vertexCount, alignment);
-            }
-            if (mesh->boneIds)
+                void *data;
+                u64 size;
+                Format format;
+                Mesh::BufferView *view;
+            };
+            VertexStream streams[6];
+            u32 streamCount = 0;
+            if (HasFlags(mesh->flags, MeshFlags_Quantized))
             {
-                desc.size += AlignPow2(sizeof(mesh->boneIds[0]) * vertexCount, alignment);
-                desc.size += AlignPow2(sizeof(mesh->boneWeights[0]) * vertexCount, alignment);
+                streams[streamCount++] = {mesh->quantizedPositions, sizeof(mesh->quantizedPositions[0]), Format::R16G16B16A16_UNORM, &mesh->vertexPosView};
+                streams[streamCount++] = {mesh->octNormals, sizeof(mesh->octNormals[0]), Format::R16G16_SNORM, &mesh->vertexNorView};
+                streams[streamCount++] = {mesh->octTangents, sizeof(mesh->octTangents[0]), Format::R16G16_SNORM, &mesh->vertexTanView};
+                if (mesh->halfUvs)
+                {
+                    streams[streamCount++] = {mesh->halfUvs, sizeof(mesh->halfUvs[0]), Format::R16G16_SFLOAT, &mesh->vertexUvView};
+                }
+                if (mesh->packedBoneIds)
+                {
+                    Assert(mesh->packedBoneWeights);
+                    streams[streamCount++] = {mesh->packedBoneIds, sizeof(mesh->packedBoneIds[0]), Format::R8G8B8A8_UINT, &mesh->vertexBoneIdView};
+                    streams[streamCount++] = {mesh->packedBoneWeights, sizeof(mesh->packedBoneWeights[0]), Format::R8G8B8A8_UNORM, &mesh->vertexBoneWeightView};
+                }
             }
-            desc.size += AlignPow2(sizeof(mesh->indices[0]) * indexCount, alignment);
-
-            auto initCallback = [&](void *dest) {
-                u64 currentOffset = 0;
-                u8 *bufferDest    = (u8 *)dest;
-
-                // Load positions
-                mesh->vertexPosView.offset = currentOffset;
-                mesh->vertexPosView.size   = sizeof(mesh->positions[0]) * vertexCount;
-                MemoryCopy(bufferDest + currentOffset, mesh->positions, mesh->vertexPosView.size);
-                currentOffset += AlignPow2(mesh->vertexPosView.size, alignment);
-
-                // Load normals
-                mesh->vertexNorView.offset = currentOffset;
-                mesh->vertexNorView.size   = sizeof(mesh->normals[0]) * vertexCount;
-                MemoryCopy(bufferDest + currentOffset, mesh->normals, mesh->vertexNorView.size);
-                currentOffset += AlignPow2(mesh->vertexNorView.size, alignment);
-
-                // Load tangents
-                mesh->vertexTanView.offset = currentOffset;
-                mesh->vertexTanView.size   = sizeof(mesh->tangents[0]) * vertexCount;
-                MemoryCopy(bufferDest + currentOffset, mesh->tangents, mesh->vertexTanView.size);
-                currentOffset += AlignPow2(mesh->vertexTanView.size, alignment);
-
-                // Load uvs if they exist
+            else
+            {
+                Assert(mesh->positions && mesh->normals && mesh->tangents);
+                streams[streamCount++] = {mesh->positions, sizeof(mesh->positions[0]), Format::R32G32B32_SFLOAT, &mesh->vertexPosView};
+                streams[streamCount++] = {mesh->normals, sizeof(mesh->normals[0]), Format::R32G32B32_SFLOAT, &mesh->vertexNorView};
+                streams[streamCount++] = {mesh->tangents, sizeof(mesh->tangents[0]), Format::R32G32B32_SFLOAT, &mesh->vertexTanView};
                 if (mesh->uvs)
                 {
-                    mesh->vertexUvView.offset = currentOffset;
-                    mesh->vertexUvView.size   = sizeof(mesh->uvs[0]) * vertexCount;
-                    MemoryCopy(bufferDest + currentOffset, mesh->uvs, mesh->vertexUvView.size);
-                    currentOffset += AlignPow2(mesh->vertexUvView.size, alignment);
+                    streams[streamCount++] = {mesh->uvs, sizeof(mesh->uvs[0]), Format::R32G32_SFLOAT, &mesh->vertexUvView};
                 }
                 if (mesh->boneIds)
                 {
                     Assert(mesh->boneWeights);
-                    mesh->vertexBoneIdView.offset = currentOffset;
-                    mesh->vertexBoneIdView.size   = sizeof(mesh->boneIds[0]) * vertexCount;
-                    MemoryCopy(bufferDest + currentOffset, mesh->boneIds, mesh->vertexBoneIdView.size);
-                    currentOffset += AlignPow2(mesh->vertexBoneIdView.size, alignment);
-
-                    mesh->vertexBoneWeightView.offset = currentOffset;
-                    mesh->vertexBoneWeightView.size   = sizeof(mesh->boneWeights[0]) * vertexCount;
-                    MemoryCopy(bufferDest + currentOffset, mesh->boneWeights, mesh->vertexBoneWeightView.size);
-                    currentOffset += AlignPow2(mesh->vertexBoneWeightView.size, alignment);
+                    streams[streamCount++] = {mesh->boneIds, sizeof(mesh->boneIds[0]), Format::R32G32B32A32_UINT, &mesh->vertexBoneIdView};
+                    streams[streamCount++] = {mesh->boneWeights, sizeof(mesh->boneWeights[0]), Format::R32G32B32A32_SFLOAT, &mesh->vertexBoneWeightView};
                 }
+            }
+
+            desc.size = 0;
+            for (u32 streamIndex = 0; streamIndex < streamCount; streamIndex++)
+            {
+                VertexStream *stream = &streams[streamIndex];
+                stream->view->offset = desc.size;
+                stream->view->size   = stream->size * vertexCount;
+                desc.size += AlignPow2(stream->view->size, alignment);
+            }
+            mesh->indexView.offset = desc.size;
+            mesh->indexView.size   = sizeof(mesh->indices[0]) * indexCount;
+            desc.size += AlignPow2(mesh->indexView.size, alignment);
 
-                mesh->indexView.offset = currentOffset;
-                mesh->indexView.size   = sizeof(mesh->indices[0]) * mesh->indexCount;
-                MemoryCopy(bufferDest + currentOffset, mesh->indices, mesh->indexView.size);
-                currentOffset += AlignPow2(mesh->indexView.size, alignment);
+            auto initCallback = [&](void *dest) {
+                u8 *bufferDest = (u8 *)dest;
+                for (u32 streamIndex = 0; streamIndex < streamCount; streamIndex++)
+                {
+                    VertexStream *stream = &streams[streamIndex];
+                    MemoryCopy(bufferDest + stream->view->offset, stream->data, stream->view->size);
+                }
+                MemoryCopy(bufferDest + mesh->indexView.offset, mesh->indices, mesh->indexView.size);
             };
 
             device->CreateBufferCopy(&mesh->buffer, desc, initCallback);
             device->SetName(&mesh->buffer, "Mesh buffer");
 
-            Assert(mesh->positions);
-            mesh->vertexPosView.srvIndex      = device->CreateSubresource(&mesh->buffer, ResourceViewType::SRV, mesh->vertexPosView.offset, mesh->vertexPosView.size, Format::R32G32B32_SFLOAT);
-            mesh->vertexPosView.srvDescriptor = device->GetDescriptorIndex(&mesh->buffer, ResourceViewType::SRV, mesh->vertexPosView.srvIndex);
-
-            Assert(mesh->normals);
-            mesh->vertexNorView.srvIndex      = device->CreateSubresource(&mesh->buffer, ResourceViewType::SRV, mesh->vertexNorView.offset, mesh->vertexNorView.size, Format::R32G32B32_SFLOAT);
-            mesh->vertexNorView.srvDescriptor = device->GetDescriptorIndex(&mesh->buffer, ResourceViewType::SRV, mesh->vertexNorView.srvIndex);
-
-            Assert(mesh->tangents);
-            mesh->vertexTanView.srvIndex      = device->CreateSubresource(&mesh->buffer, ResourceViewType::SRV, mesh->vertexTanView.offset, mesh->vertexTanView.size, Format::R32G32B32_SFLOAT);
-            mesh->vertexTanView.srvDescriptor = device->GetDescriptorIndex(&mesh->buffer, ResourceViewType::SRV, mesh->vertexTanView.srvIndex);
-
-            if (mesh->uvs)
-            {
-                mesh->vertexUvView.srvIndex      = device->CreateSubresource(&mesh->buffer, ResourceViewType::SRV, mesh->vertexUvView.offset, mesh->vertexUvView.size, Format::R32G32_SFLOAT);
-                mesh->vertexUvView.srvDescriptor = device->GetDescriptorIndex(&mesh->buffer, ResourceViewType::SRV, mesh->vertexUvView.srvIndex);
-            }
-            if (mesh->boneIds)
+            for (u32 streamIndex = 0; streamIndex < streamCount; streamIndex++)
             {
-                mesh->vertexBoneIdView.srvIndex      = device->CreateSubresource(&mesh->buffer, ResourceViewType::SRV, mesh->vertexBoneIdView.offset, mesh->vertexBoneIdView.size, Format::R32G32B32A32_UINT);
-                mesh->vertexBoneIdView.srvDescriptor = device->GetDescriptorIndex(&mesh->buffer, ResourceViewType::SRV, mesh->vertexBoneIdView.srvIndex);
-
-                Assert(mesh->boneWeights);
-                mesh->vertexBoneWeightView.srvIndex      = device->CreateSubresource(&mesh->buffer, ResourceViewType::SRV, mesh->vertexBoneWeightView.offset, mesh->vertexBoneWeightView.size, Format::R32G32B32A32_SFLOAT);
-                mesh->vertexBoneWeightView.srvDescriptor = device->GetDescriptorIndex(&mesh->buffer, ResourceViewType::SRV, mesh->vertexBoneWeightView.srvIndex);
+                Mesh::BufferView *view = streams[streamIndex].view;
+                view->srvIndex         = device->CreateSubresource(&mesh->buffer, ResourceViewType::SRV, view->offset, view->size, streams[streamIndex].format);
+                view->srvDescriptor    = device->GetDescriptorIndex(&mesh->buffer, ResourceViewType::SRV, view->srvIndex);
             }
 
             mesh->indexView.srvIndex      = device->CreateSubresource(&mesh->buffer, ResourceViewType::SRV, mesh->indexView.offset, mesh->indexView.size);
             mesh->indexView.srvDescriptor = device->GetDescriptorIndex(&mesh->buffer, ResourceViewType::SRV, mesh->indexView.srvIndex);
 
-            // Create skinning uavs
-            if (mesh->boneIds)
+            // Create skinning uavs. The skinned output is always full floats.
+            if (mesh->vertexBoneIdView.IsValid())
             {
                 GPUBufferDesc streamDesc;
                 streamDesc.resourceUsage = ResourceUsage_Bindless | ResourceUsage_StorageBuffer | ResourceUsage_UniformTexel;
@@ -743,17 +895,38 @@ internal void AS_LoadAsset(AS_Asset *asset)
         tokenizer.input.size = asset->size;
         tokenizer.cursor     = tokenizer.input.str;
 
+        u64 groupsOffset;
+        u64 sampleDataOffset;
+        u64 rootMotionOffset;
+        u64 eventsOffset;
         GetPointerValue(&tokenizer, &asset->anim.numNodes);
         GetPointerValue(&tokenizer, &asset->anim.duration);
+        GetPointerValue(&tokenizer, &asset->anim.numSamples);
+        GetPointerValue(&tokenizer, &asset->anim.numGroups);
+        GetPointerValue(&tokenizer, &asset->anim.sampleRate);
+        GetPointerValue(&tokenizer, &asset->anim.sampleStride);
+        GetPointerValue(&tokenizer, &asset->anim.numRootMotionSamples);
+        GetPointerValue(&tokenizer, &asset->anim.rootMotionSampleRate);
+        GetPointerValue(&tokenizer, &asset->anim.numEvents);
+        GetPointerValue(&tokenizer, &groupsOffset);
+        GetPointerValue(&tokenizer, &sampleDataOffset);
+        GetPointerValue(&tokenizer, &rootMotionOffset);
+        GetPointerValue(&tokenizer, &eventsOffset);
+        asset->anim.groups     = (AnimationGroupFormat *)ConvertOffsetToPointer(buffer, groupsOffset);
+        asset->anim.sampleData = ConvertOffsetToPointer(buffer, sampleDataOffset);
+        asset->anim.rootMotion = (AnimationRootMotion *)ConvertOffsetToPointer(buffer, rootMotionOffset);
+        asset->anim.events     = (AnimationEvent *)ConvertOffsetToPointer(buffer, eventsOffset);
+        for (u32 i = 0; i < asset->anim.numEvents; i++)
+        {
+            AnimationEvent *event = &asset->anim.events[i];
+            event->name.str       = (u8 *)ConvertOffsetToPointer(buffer, (u64)event->name.str);
+        }
 
         asset->anim.boneChannels = GetTokenCursor(&tokenizer, BoneChannel);
         for (u32 i = 0; i < asset->anim.numNodes; i++)
         {
             BoneChannel *boneChannel = &asset->anim.boneChannels[i];
             boneChannel->name.str    = (u8 *)ConvertOffsetToPointer(buffer, (u64)boneChannel->name.str);
-            boneChannel->positions   = (AnimationPosition *)ConvertOffsetToPointer(buffer, (u64)boneChannel->positions);
-            boneChannel->scales      = (AnimationScale *)ConvertOffsetToPointer(buffer, (u64)boneChannel->scales);
-            boneChannel->rotations   = (AnimationRotation *)ConvertOffsetToPointer(buffer, (u64)boneChannel->rotations);
         }
 
         // Advance(&tokenizer, sizeof(BoneChannel) * asset->anim.numNodes);
@@ -833,8 +1006,7 @@ internal void AS_LoadAsset(AS_Asset *asset)
         Format format   = Format::R8G8B8A8_UNORM;
         Format bcFormat = Format::Null;
 
-        if (FindSubstring(asset->path, Str8Lit("diffuse"), 0, MatchFlag_CaseInsensitive) != asset->path.size ||
-            FindSubstring(asset->path, Str8Lit("basecolor"), 0, MatchFlag_CaseInsensitive) != asset->path.size)
+        if (AS_IsSRGBTexture(asset->path))
         {
             format   = Format::R8G8B8A8_SRGB;
             bcFormat = Format::BC1_RGB_UNORM;
@@ -875,185 +1047,871 @@ internal void AS_LoadAsset(AS_Asset *asset)
     {
         Assert(!"Asset type not supported");
     }
-    asset->status.store(AS_Status_Loaded);
+    AS_EndPhase(asset, AS_LoadPhase_Decode);
+    AS_SetLoaded(asset);
+    if (asset->type == AS_Texture)
+    {
+        AS_BeginUploadTrace(asset);
+    }
+    else
+    {
+        AS_FinishLoadTrace(asset);
+    }
     ScratchEnd(temp);
 }
 
+internal b32 AS_IsSRGBTexture(string path)
+{
+    b32 result = FindSubstring(path, Str8Lit("diffuse"), 0, MatchFlag_CaseInsensitive) != path.size ||
+                 FindSubstring(path, Str8Lit("basecolor"), 0, MatchFlag_CaseInsensitive) != path.size;
+    return result;
+}
+
 //////////////////////////////
-// DDS loading
+// Deduplication
 //
 
-internal void LoadDDS(AS_Asset *asset)
+// Files with identical contents (e.g. gltf exports that copy the same texture next to every model) are only
+// loaded/uploaded once. The asset for the duplicate path becomes an alias whose handles resolve to the asset that
+// owns the payload. Returns true if the asset was deduplicated.
+internal b32 AS_DedupeAsset(AS_Asset *asset)
 {
-    Format format = Format::Null;
-
-    u8 *memory    = AS_GetMemory(asset);
-    DDSFile *file = (DDSFile *)memory;
-    Assert(file->magic == MakeFourCC('D', 'D', 'S', ' '));
+    AS_CacheState *as_state = engine->GetAssetCacheState();
 
-    b8 usesDXT10Header = false;
-    if ((file->header.format.flags & PixelFormatFlagBits_FourCC) && (file->header.format.fourCC == MakeFourCC('D', 'X', '1', '0')))
+    // Only for types where the loaded result depends on nothing but the file. Models create scene entities per path.
+    string extension = GetFileExtension(asset->path);
+    u64 variant      = 0;
+    if (extension == Str8Lit("png") || extension == Str8Lit("jpeg"))
     {
-        usesDXT10Header = true;
+        // The texture format is decided by the path
+        variant = AS_IsSRGBTexture(asset->path) ? 1 : 2;
     }
+    else if (extension == Str8Lit("dds")) variant = 3;
+    else if (extension == Str8Lit("anim")) variant = 4;
+    else if (extension == Str8Lit("ttf")) variant = 5;
+    else return false;
 
-    // TODO: support all dds header types
-    Assert(!usesDXT10Header);
-    Assert(file->header.mipMapCount == 1);
-
-    u64 offset = sizeof(DDSFile) + (usesDXT10Header ? sizeof(DDSHeaderDXT10) : 0);
+    u64 contentHash    = HashBytes64(AS_GetMemory(asset), asset->size) ^ (variant * 0x9e3779b97f4a7c15ull);
+    asset->contentHash = contentHash;
 
-    // Find the format
-    if (file->header.format.flags & PixelFormatFlagBits_FourCC)
+    TempArena temp  = ScratchStart(0, 0);
+    i32 candidateId = 0;
+    string candidatePath;
+    BeginMutex(&as_state->lock);
+    for (i32 i = as_state->contentHash.FirstInHash((i32)contentHash); i != -1; i = as_state->contentHash.NextInHash(i))
     {
-        if (file->header.format.fourCC == MakeFourCC('D', 'X', 'T', '1'))
+        AS_Asset *other = AS_GetAssetFromId(i);
+        if (other != asset && other->contentHash == contentHash && other->size == asset->size)
         {
-            format = Format::BC1_RGB_UNORM;
+            candidateId   = i;
+            candidatePath = PushStr8Copy(temp.arena, other->path);
+            break;
         }
-        else
+    }
+    EndMutex(&as_state->lock);
+
+    // The hash can collide, so the bytes are compared before aliasing. Against the file of the other asset, since
+    // some types fix up pointers in their payload once loaded.
+    b32 matches = false;
+    if (candidateId)
+    {
+        string data = platform.ReadEntireFile(temp.arena, candidatePath);
+        matches     = data.size == asset->size && MemoryCompare(data.str, AS_GetMemory(asset), asset->size) == 0;
+        if (!matches)
         {
-            Assert(0);
+            Printf("%S has the same hash as %S but different contents, loading it on its own\n", asset->path,
+                   candidatePath);
         }
     }
+
+    AS_Asset *canonical = 0;
+    BeginMutex(&as_state->lock);
+    // The other asset could have been hotloaded or freed while its file was read
+    AS_Asset *other = matches ? AS_GetAssetFromId(candidateId) : 0;
+    if (other && other->refCount > 0 && other->contentHash == contentHash && other->size == asset->size)
+    {
+        canonical = other;
+    }
+    if (canonical)
+    {
+        canonical->refCount++;
+        asset->canonicalId = canonical->id;
+        as_state->numDedupedAssets++;
+        as_state->dedupedBytes += asset->size;
+    }
     else
     {
-        Assert(0);
+        asset->refCount = 1;
+        as_state->contentHash.AddInHash((i32)contentHash, asset->id);
     }
+    EndMutex(&as_state->lock);
+    ScratchEnd(temp);
 
-    u8 *data = memory + offset;
+    if (canonical)
+    {
+        Printf("%S has the same contents as %S, %llu bytes saved (total: %llu assets, %llu bytes)\n", asset->path,
+               canonical->path, asset->size, as_state->numDedupedAssets, as_state->dedupedBytes);
+        AS_Free(asset);
+        AS_SetLoaded(asset);
+    }
+    return canonical != 0;
+}
 
-    TextureDesc bcDesc;
-    bcDesc.width        = file->header.width;
-    bcDesc.height       = file->header.height;
-    bcDesc.depth        = file->header.depth;
-    bcDesc.format       = format;
-    bcDesc.initialUsage = ResourceUsage_SampledImage;
-    bcDesc.futureUsages = ResourceUsage_Bindless;
-    device->CreateTexture(&asset->texture, bcDesc, data);
-    device->SetName(&asset->texture, (const char *)asset->path.str);
+// Detaches an alias from the asset that owns its payload.
+internal void AS_ReleaseAlias(AS_Asset *asset)
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    BeginMutex(&as_state->lock);
+    Assert(asset->canonicalId);
+    AS_Asset *canonical = AS_GetAssetFromId(asset->canonicalId);
+    canonical->refCount--;
+    Assert(canonical->refCount > 0);
+    asset->canonicalId = 0;
+    asset->contentHash = 0;
+    as_state->numDedupedAssets--;
+    as_state->dedupedBytes -= asset->size;
+    EndMutex(&as_state->lock);
 }
 
-internal void AS_UnloadAsset(AS_Asset *asset)
+// Must be called before the payload of a canonical asset is freed. Its aliases are detached and requeued so they
+// load from their own files.
+internal void AS_ReleaseAliases(AS_Asset *asset)
 {
-    switch (asset->type)
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    TempArena temp          = ScratchStart(0, 0);
+    string *paths           = 0;
+    u32 count               = 0;
+
+    BeginMutex(&as_state->lock);
+    if (asset->refCount != 0)
     {
-        case AS_Null: break;
-        case AS_Mesh: break;
-        case AS_Texture:
+        as_state->contentHash.RemoveFromHash((i32)asset->contentHash, asset->id);
+    }
+    if (asset->refCount > 1)
+    {
+        paths = PushArray(temp.arena, string, asset->refCount - 1);
+        i32 endOfList = as_state->slots.endOfList.load();
+        for (i32 i = 1; i < endOfList; i++)
         {
-            // R_DeleteTexture2D(node->texture.handle);
-            break;
+            AS_Asset *other = AS_GetAssetFromId(i);
+            if (other && other->canonicalId == asset->id)
+            {
+                other->canonicalId  = 0;
+                other->contentHash  = 0;
+                other->lastModified = 0;
+                other->status.store(AS_Status_Unloaded);
+                as_state->numDedupedAssets--;
+                as_state->dedupedBytes -= other->size;
+                AS_BeginLoadTrace(other);
+                paths[count++] = other->path;
+            }
         }
-        case AS_Skeleton: break;
-        case AS_Model: break;
-        default: Assert(!"Invalid asset type");
+        Assert(count == (u32)asset->refCount - 1);
+    }
+    asset->refCount    = 0;
+    asset->contentHash = 0;
+    EndMutex(&as_state->lock);
+
+    for (u32 i = 0; i < count; i++)
+    {
+        AS_EnqueueFile(paths[i]);
     }
+    ScratchEnd(temp);
 }
 
 //////////////////////////////
-// Handles
+// Statistics
 //
-internal AS_Asset *AS_GetAssetFromHandle(AS_Handle handle)
+
+global const char *asTypeNames[AS_Count] = {"null", "mesh", "texture", "font", "skeleton", "anim", "model"};
+global const char *asLoadPhaseNames[AS_LoadPhase_Count] = {"queued", "read", "decode", "upload"};
+
+// Called right before the asset's file is enqueued
+internal void AS_BeginLoadTrace(AS_Asset *asset)
 {
     AS_CacheState *as_state = engine->GetAssetCacheState();
-    // Assert(sizeof(handle) <= 16);
+    AS_StatsState *state    = &as_state->statsState;
 
-    AS_Asset *result = 0;
-    i32 index        = handle.i32[0];
+    u32 numLoads = asset->trace.numLoads;
+    MemoryZeroStruct(&asset->trace);
+    asset->trace.numLoads = numLoads;
+    asset->trace.active   = 1;
+    AS_BeginPhase(asset, AS_LoadPhase_Queued);
 
-    result = as_state->assets[index];
-    if (result->generation != handle.i32[1] || result->status.load() != AS_Status_Loaded)
+    TicketMutexScope(&state->mutex)
     {
-        result = 0;
+        if (state->stats.firstQueuedSeconds == 0.f)
+        {
+            state->stats.firstQueuedSeconds = platform.NowSeconds();
+        }
     }
-    return result;
 }
 
-internal AS_Asset *AS_AllocAsset(const string inPath, b8 queueFile)
+internal void AS_BeginPhase(AS_Asset *asset, AS_LoadPhase phase)
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    BeginMutex(&as_state->lock);
-
-    AS_Asset *asset = 0;
-    i32 hash        = HashFromString(inPath);
+    asset->trace.phaseStart[phase] = platform.StartCounter();
+}
 
-    as_state->assetCount++;
-    // If there is an asset on the free list, use that
+internal void AS_EndPhase(AS_Asset *asset, AS_LoadPhase phase)
+{
+    asset->trace.phaseMs[phase] = platform.GetMilliseconds(asset->trace.phaseStart[phase]);
+}
 
-    if (as_state->freeAssetCount != 0)
-    {
-        asset = as_state->assets[as_state->freeAssetList[--as_state->freeAssetCount]];
-        asset->generation += 1;
-        Assert(asset->memoryBlock == 0);
-    }
-    else
+internal u32 AS_GetHistogramBucket(f32 ms)
+{
+    u32 bucket  = 0;
+    f32 ceiling = AS_STATS_BUCKET_MIN_MS;
+    while (bucket < AS_STATS_BUCKET_COUNT - 1 && ms >= ceiling)
     {
-        i32 assetId               = as_state->assetEndOfList++;
-        as_state->assets[assetId] = PushStruct(as_state->arena, AS_Asset);
-        // NOTE: all strings will have a fixed backing buffer of 256 bytes.
-        asset           = as_state->assets[assetId];
-        asset->path.str = PushArray(as_state->arena, u8, MAX_OS_PATH);
-        StringCopy(&asset->path, inPath);
-        asset->id = assetId;
+        bucket++;
+        ceiling *= 2.f;
     }
-    as_state->fileHash.AddInHash(hash, asset->id);
-
-    EndMutex(&as_state->lock);
-
-    if (queueFile) AS_EnqueueFile(inPath);
-
-    return asset;
+    return bucket;
 }
 
-internal void AS_FreeAsset(AS_Handle handle)
+// Adds the trace to the histograms of the asset's type
+internal void AS_FinishLoadTrace(AS_Asset *asset)
 {
     AS_CacheState *as_state = engine->GetAssetCacheState();
-    BeginMutex(&as_state->lock);
-    AS_Asset *asset = AS_GetAssetFromHandle(handle);
-    if (asset)
+    AS_StatsState *state    = &as_state->statsState;
+    AS_LoadTrace *trace     = &asset->trace;
+    if (!trace->active) return;
+    trace->active = 0;
+    trace->numLoads++;
+
+    // Aliases never get decoded, they're counted as the type of the asset they share a payload with
+    AS_Type type = asset->type;
+    if (asset->canonicalId)
     {
-        as_state->assetCount--;
-        AS_Free(asset);
-        asset->lastModified = 0;
-        as_state->assetCount--;
+        type = AS_GetAssetFromId(asset->canonicalId)->type;
+    }
+    Assert(type < AS_Count);
 
-        i32 id = as_state->freeAssetCount++;
-        Assert(id >= 0);
-        as_state->freeAssetList[id] = asset->id;
+    TicketMutexScope(&state->mutex)
+    {
+        AS_TypeStats *typeStats = &state->stats.types[type];
+        typeStats->numLoads++;
+        typeStats->bytes += trace->bytes;
+        for (u32 phase = 0; phase < AS_LoadPhase_Count; phase++)
+        {
+            f32 ms = trace->phaseMs[phase];
+            if (trace->phaseStart[phase].counter == 0) continue;
+
+            AS_PhaseHistogram *histogram = &typeStats->phases[phase];
+            histogram->counts[AS_GetHistogramBucket(ms)]++;
+            histogram->samples++;
+            histogram->totalMs += ms;
+            histogram->maxMs = Max(histogram->maxMs, ms);
+        }
+        if (trace->phaseStart[AS_LoadPhase_Read].counter != 0)
+        {
+            state->stats.bytesRead += trace->bytes;
+            state->stats.readMs += trace->phaseMs[AS_LoadPhase_Read];
+        }
+        state->stats.lastLoadedSeconds = platform.NowSeconds();
     }
-    EndMutex(&as_state->lock);
 }
 
-internal AS_Handle AS_GetAsset(const string inPath, const b32 inLoadIfNotFound)
+// Textures are done when their copy to the gpu finishes, which is only known once the fence signals.
+internal void AS_BeginUploadTrace(AS_Asset *asset)
 {
     AS_CacheState *as_state = engine->GetAssetCacheState();
-    AS_Handle result        = {};
-    result.i32[0]           = -1;
+    AS_StatsState *state    = &as_state->statsState;
+    b32 added               = 0;
 
-    i32 hash = HashFromString(inPath);
-    BeginMutex(&as_state->lock);
-    for (i32 i = as_state->fileHash.FirstInHash(hash); i != -1; i = as_state->fileHash.NextInHash(i))
+    AS_BeginPhase(asset, AS_LoadPhase_Upload);
+    TicketMutexScope(&state->mutex)
     {
-        if (as_state->assets[i]->path == inPath)
+        if (state->numPendingUploads < AS_STATS_MAX_PENDING_UPLOADS)
         {
-            result.i32[0] = i;
-            result.i32[1] = as_state->assets[i]->generation;
+            state->pendingUploads[state->numPendingUploads++] = AS_GetHandle(asset);
+            added                                             = 1;
+        }
+    }
+    if (!added)
+    {
+        asset->trace.phaseStart[AS_LoadPhase_Upload] = {};
+        AS_FinishLoadTrace(asset);
+    }
+}
+
+// Called once a frame to finish the traces of textures whose upload completed
+internal void AS_UpdateLoadTraces()
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    AS_StatsState *state    = &as_state->statsState;
+    TempArena temp          = ScratchStart(0, 0);
+
+    AS_Asset **finished = PushArrayNoZero(temp.arena, AS_Asset *, AS_STATS_MAX_PENDING_UPLOADS);
+    u32 numFinished     = 0;
+    TicketMutexScope(&state->mutex)
+    {
+        for (u32 i = 0; i < state->numPendingUploads;)
+        {
+            AS_Asset *asset = AS_GetSlotAsset(state->pendingUploads[i]);
+            // Freed or reloaded in the meantime
+            if (asset == 0 || asset->status.load() != AS_Status_Loaded || !asset->trace.active)
+            {
+                state->pendingUploads[i] = state->pendingUploads[--state->numPendingUploads];
+            }
+            else if (device->IsLoaded(&asset->texture))
+            {
+                finished[numFinished++]  = asset;
+                state->pendingUploads[i] = state->pendingUploads[--state->numPendingUploads];
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+    for (u32 i = 0; i < numFinished; i++)
+    {
+        AS_EndPhase(finished[i], AS_LoadPhase_Upload);
+        AS_FinishLoadTrace(finished[i]);
+    }
+    ScratchEnd(temp);
+}
+
+internal AS_CacheStats AS_GetCacheStats()
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    AS_StatsState *state    = &as_state->statsState;
+    AS_CacheStats stats;
+    TicketMutexScope(&state->mutex)
+    {
+        stats = state->stats;
+    }
+    return stats;
+}
+
+// Writes the per type histograms and the trace of every loaded asset. The format is picked from the extension,
+// .csv only gets the per asset rows.
+internal b32 AS_DumpCacheStats(string filename)
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    TempArena temp          = ScratchStart(0, 0);
+    AS_CacheStats stats     = AS_GetCacheStats();
+
+    StringBuilder builder = {};
+    builder.arena         = temp.arena;
+
+    b32 csv       = GetFileExtension(filename) == Str8Lit("csv");
+    i32 endOfList = as_state->slots.endOfList.load();
+    if (csv)
+    {
+        PutLine(&builder, 0, "path,type,bytes,loads,queued_ms,read_ms,decode_ms,upload_ms");
+        for (i32 i = 1; i < endOfList; i++)
+        {
+            AS_Asset *asset = AS_GetAssetFromId(i);
+            if (asset == 0 || asset->trace.numLoads == 0) continue;
+            AS_LoadTrace *trace = &asset->trace;
+            PutLine(&builder, 0, "%S,%s,%llu,%u,%.3f,%.3f,%.3f,%.3f", asset->path, asTypeNames[asset->type],
+                    trace->bytes, trace->numLoads, trace->phaseMs[AS_LoadPhase_Queued],
+                    trace->phaseMs[AS_LoadPhase_Read], trace->phaseMs[AS_LoadPhase_Decode],
+                    trace->phaseMs[AS_LoadPhase_Upload]);
+        }
+    }
+    else
+    {
+        f64 throughput = stats.readMs > 0.0 ? (f64)stats.bytesRead / (stats.readMs / 1000.0) : 0.0;
+        PutLine(&builder, 0, "{");
+        PutLine(&builder, 1, "\"coldStartSeconds\": %.3f,", stats.lastLoadedSeconds - stats.firstQueuedSeconds);
+        PutLine(&builder, 1, "\"bytesRead\": %llu,", stats.bytesRead);
+        PutLine(&builder, 1, "\"readBytesPerSecond\": %.1f,", throughput);
+        PutLine(&builder, 1, "\"bucketMinMs\": %f,", AS_STATS_BUCKET_MIN_MS);
+        PutLine(&builder, 1, "\"types\": {");
+        b32 firstType = 1;
+        for (u32 type = 0; type < AS_Count; type++)
+        {
+            AS_TypeStats *typeStats = &stats.types[type];
+            if (typeStats->numLoads == 0) continue;
+            PutLine(&builder, 2, "%s\"%s\": {", firstType ? "" : ", ", asTypeNames[type]);
+            firstType = 0;
+            PutLine(&builder, 3, "\"loads\": %llu,", typeStats->numLoads);
+            PutLine(&builder, 3, "\"bytes\": %llu,", typeStats->bytes);
+            for (u32 phase = 0; phase < AS_LoadPhase_Count; phase++)
+            {
+                AS_PhaseHistogram *histogram = &typeStats->phases[phase];
+                f64 averageMs                = histogram->samples ? histogram->totalMs / histogram->samples : 0.0;
+
+                string counts = {};
+                for (u32 bucket = 0; bucket < AS_STATS_BUCKET_COUNT; bucket++)
+                {
+                    counts = PushStr8F(temp.arena, "%S%s%llu", counts, bucket ? ", " : "", histogram->counts[bucket]);
+                }
+                PutLine(&builder, 3, "\"%s\": {\"samples\": %llu, \"totalMs\": %.3f, \"averageMs\": %.3f, "
+                                     "\"maxMs\": %.3f, \"histogram\": [%S]}%s",
+                        asLoadPhaseNames[phase], histogram->samples, histogram->totalMs, averageMs, histogram->maxMs,
+                        counts, phase == AS_LoadPhase_Count - 1 ? "" : ",");
+            }
+            PutLine(&builder, 2, "}");
+        }
+        PutLine(&builder, 1, "},");
+        PutLine(&builder, 1, "\"assets\": [");
+        b32 firstAsset = 1;
+        for (i32 i = 1; i < endOfList; i++)
+        {
+            AS_Asset *asset = AS_GetAssetFromId(i);
+            if (asset == 0 || asset->trace.numLoads == 0) continue;
+            AS_LoadTrace *trace = &asset->trace;
+            PutLine(&builder, 2,
+                    "%s{\"path\": \"%S\", \"type\": \"%s\", \"bytes\": %llu, \"loads\": %u, \"queuedMs\": %.3f, "
+                    "\"readMs\": %.3f, \"decodeMs\": %.3f, \"uploadMs\": %.3f}",
+                    firstAsset ? "" : ", ", asset->path, asTypeNames[asset->type], trace->bytes, trace->numLoads,
+                    trace->phaseMs[AS_LoadPhase_Queued], trace->phaseMs[AS_LoadPhase_Read],
+                    trace->phaseMs[AS_LoadPhase_Decode], trace->phaseMs[AS_LoadPhase_Upload]);
+            firstAsset = 0;
+        }
+        PutLine(&builder, 1, "]");
+        PutLine(&builder, 0, "}");
+    }
+
+    b32 result = WriteEntireFile(&builder, filename);
+    ScratchEnd(temp);
+    return result;
+}
+
+//////////////////////////////
+// DDS loading
+//
+
+internal void LoadDDS(AS_Asset *asset)
+{
+    Format format = Format::Null;
+
+    u8 *memory    = AS_GetMemory(asset);
+    DDSFile *file = (DDSFile *)memory;
+    Assert(file->magic == MakeFourCC('D', 'D', 'S', ' '));
+
+    b8 usesDXT10Header = false;
+    if ((file->header.format.flags & PixelFormatFlagBits_FourCC) && (file->header.format.fourCC == MakeFourCC('D', 'X', '1', '0')))
+    {
+        usesDXT10Header = true;
+    }
+
+    u64 offset = sizeof(DDSFile) + (usesDXT10Header ? sizeof(DDSHeaderDXT10) : 0);
+
+    // Find the format
+    if (usesDXT10Header)
+    {
+        DDSHeaderDXT10 *dx10Header = (DDSHeaderDXT10 *)(memory + sizeof(DDSFile));
+        Assert(dx10Header->resourceDimension == ResourceDimension_Texture2D && dx10Header->arraySize == 1);
+        switch (dx10Header->dxgiFormat)
+        {
+            case DXGI_FORMAT_BC1_UNORM: format = Format::BC1_RGB_UNORM; break;
+            case DXGI_FORMAT_BC1_UNORM_SRGB: format = Format::BC1_RGB_SRGB; break;
+            case DXGI_FORMAT_BC3_UNORM: format = Format::BC3_RGBA_UNORM; break;
+            case DXGI_FORMAT_BC3_UNORM_SRGB: format = Format::BC3_RGBA_SRGB; break;
+            case DXGI_FORMAT_BC4_UNORM: format = Format::BC4_R_UNORM; break;
+            case DXGI_FORMAT_BC5_UNORM: format = Format::BC5_RG_UNORM; break;
+            case DXGI_FORMAT_BC7_UNORM: format = Format::BC7_RGBA_UNORM; break;
+            case DXGI_FORMAT_BC7_UNORM_SRGB: format = Format::BC7_RGBA_SRGB; break;
+            default: Assert(0);
+        }
+    }
+    else if (file->header.format.flags & PixelFormatFlagBits_FourCC)
+    {
+        u32 fourCC = file->header.format.fourCC;
+        if (fourCC == MakeFourCC('D', 'X', 'T', '1'))
+        {
+            format = Format::BC1_RGB_UNORM;
+        }
+        else if (fourCC == MakeFourCC('D', 'X', 'T', '5'))
+        {
+            format = Format::BC3_RGBA_UNORM;
+        }
+        else if (fourCC == MakeFourCC('A', 'T', 'I', '1') || fourCC == MakeFourCC('B', 'C', '4', 'U'))
+        {
+            format = Format::BC4_R_UNORM;
+        }
+        else if (fourCC == MakeFourCC('A', 'T', 'I', '2') || fourCC == MakeFourCC('B', 'C', '5', 'U'))
+        {
+            format = Format::BC5_RG_UNORM;
+        }
+        else
+        {
+            Assert(0);
+        }
+    }
+    else
+    {
+        Assert(0);
+    }
+
+    u8 *data = memory + offset;
+
+    TextureDesc bcDesc;
+    bcDesc.width        = file->header.width;
+    bcDesc.height       = file->header.height;
+    bcDesc.depth        = Max(1u, file->header.depth);
+    bcDesc.numMips      = Max(1u, file->header.mipMapCount);
+    bcDesc.format       = format;
+    bcDesc.initialUsage = ResourceUsage_SampledImage;
+    bcDesc.futureUsages = ResourceUsage_Bindless;
+
+    // Levels are tightly packed after the headers
+    Assert(offset + GetTextureSize(bcDesc) <= asset->size);
+    device->CreateTexture(&asset->texture, bcDesc, data);
+    device->SetName(&asset->texture, (const char *)asset->path.str);
+}
+
+internal void AS_UnloadAsset(AS_Asset *asset)
+{
+    switch (asset->type)
+    {
+        case AS_Null: break;
+        case AS_Mesh: break;
+        case AS_Texture:
+        {
+            // R_DeleteTexture2D(node->texture.handle);
             break;
         }
+        case AS_Skeleton: break;
+        case AS_Model: break;
+        default: Assert(!"Invalid asset type");
     }
+}
+
+//////////////////////////////
+// Handles
+//
+internal AS_Slot *AS_GetSlot(i32 index)
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    AS_Slot *result         = 0;
+    if (index >= 0 && index < AS_MAX_ASSETS)
+    {
+        AS_Slot *page = as_state->slots.pages[index >> AS_SLOT_PAGE_SIZE_LOG2].load(std::memory_order_acquire);
+        if (page)
+        {
+            result = &page[index & (AS_SLOT_PAGE_SIZE - 1)];
+        }
+    }
+    return result;
+}
+
+internal AS_Asset *AS_GetAssetFromId(i32 id)
+{
+    AS_Slot *slot    = AS_GetSlot(id);
+    AS_Asset *result = slot ? &slot->asset : 0;
+    return result;
+}
+
+internal i32 AS_AllocSlot()
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    AS_SlotMap *map         = &as_state->slots;
+
+    // Pop from the free list
+    u64 head = map->freeHead.load(std::memory_order_acquire);
+    while (head & 0xffffffff)
+    {
+        i32 index     = (i32)(head & 0xffffffff) - 1;
+        AS_Slot *slot = AS_GetSlot(index);
+        u64 newHead   = (((head >> 32) + 1) << 32) | slot->nextFree.load(std::memory_order_relaxed);
+        if (map->freeHead.compare_exchange_weak(head, newHead, std::memory_order_acq_rel))
+        {
+            return index;
+        }
+    }
+
+    // Otherwise take a new slot, allocating the page if it doesn't exist
+    i32 index = map->endOfList.fetch_add(1);
+    Assert(index < AS_MAX_ASSETS);
+    u32 pageIndex = index >> AS_SLOT_PAGE_SIZE_LOG2;
+    AS_Slot *page = map->pages[pageIndex].load(std::memory_order_acquire);
+    if (page == 0)
+    {
+        // NOTE: memory from the os is zeroed
+        AS_Slot *newPage = (AS_Slot *)platform.Alloc(sizeof(AS_Slot) * AS_SLOT_PAGE_SIZE);
+        if (map->pages[pageIndex].compare_exchange_strong(page, newPage, std::memory_order_acq_rel))
+        {
+            page = newPage;
+        }
+        else
+        {
+            platform.Release(newPage);
+        }
+    }
+    page[index & (AS_SLOT_PAGE_SIZE - 1)].asset.id = index;
+    return index;
+}
+
+internal void AS_FreeSlot(i32 index)
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    AS_SlotMap *map         = &as_state->slots;
+    AS_Slot *slot           = AS_GetSlot(index);
+    Assert(slot && index != 0);
+
+    slot->generation.fetch_add(1, std::memory_order_release);
+
+    u64 head = map->freeHead.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        slot->nextFree.store((u32)(head & 0xffffffff), std::memory_order_relaxed);
+        u64 newHead = (head & 0xffffffff00000000ull) | (u64)(index + 1);
+        if (map->freeHead.compare_exchange_weak(head, newHead, std::memory_order_release))
+        {
+            break;
+        }
+    }
+}
+
+internal AS_Handle AS_GetHandle(AS_Asset *asset)
+{
+    AS_Handle result = {};
+    result.i32[0]    = asset->id;
+    result.i32[1]    = (i32)AS_GetSlot(asset->id)->generation.load(std::memory_order_acquire);
+    return result;
+}
+
+// Returns the asset in the slot if the handle is still valid, regardless of whether it's loaded.
+// NOTE: the slot can still be freed after this returns. Lifetimes have to be managed by the caller.
+internal AS_Asset *AS_GetSlotAsset(AS_Handle handle)
+{
+    AS_Slot *slot    = AS_GetSlot(handle.i32[0]);
+    AS_Asset *result = 0;
+    if (slot && slot->generation.load(std::memory_order_acquire) == (u32)handle.i32[1])
+    {
+        result = &slot->asset;
+    }
+    return result;
+}
+
+internal AS_Asset *AS_GetAssetFromHandle(AS_Handle handle)
+{
+    AS_Asset *result = AS_GetSlotAsset(handle);
+    if (result == 0)
+    {
+        return 0;
+    }
+    // Deduplicated assets use the payload of the canonical asset
+    if (result->canonicalId)
+    {
+        result = AS_GetAssetFromId(result->canonicalId);
+    }
+    if (result->status.load() != AS_Status_Loaded)
+    {
+        result = 0;
+    }
+    return result;
+}
+
+internal AS_Asset *AS_AllocAsset(const string inPath, b8 queueFile)
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+
+    i32 assetId     = AS_AllocSlot();
+    AS_Slot *slot   = AS_GetSlot(assetId);
+    AS_Asset *asset = &slot->asset;
+    Assert(asset->memoryBlock == 0 && asset->canonicalId == 0 && asset->refCount == 0);
+    // A hotload can flag the slot while it's being freed
+    asset->reloadPending.store(false);
+    as_state->assetCount.fetch_add(1);
+
+    // NOTE: all strings will have a fixed backing buffer of 256 bytes.
+    Assert(inPath.size < MAX_OS_PATH);
+    asset->path.str = slot->pathBuffer;
+    StringCopy(&asset->path, inPath);
+    slot->pathBuffer[asset->path.size] = 0;
+
+    i32 hash = HashFromString(inPath);
+    BeginMutex(&as_state->lock);
+    as_state->fileHash.AddInHash(hash, asset->id);
+    EndMutex(&as_state->lock);
+
+    if (queueFile)
+    {
+        AS_BeginLoadTrace(asset);
+        AS_EnqueueFile(inPath);
+    }
+
+    return asset;
+}
+
+// Returns true for the one caller that frees the asset. Other frees of the same handle, or of a stale one, return
+// false.
+internal b32 AS_FreeAsset(AS_Handle handle)
+{
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    AS_Slot *slot           = AS_GetSlot(handle.i32[0]);
+    if (slot == 0 || slot->asset.status.load() != AS_Status_Loaded)
+    {
+        return false;
+    }
+
+    // Whoever moves the generation on owns the free. The handle stops resolving from here on, so concurrent frees and
+    // lookups of it fail instead of seeing a half freed asset.
+    u32 generation = (u32)handle.i32[1];
+    if (!slot->generation.compare_exchange_strong(generation, generation + 1, std::memory_order_acq_rel))
+    {
+        return false;
+    }
+
+    // Waits for a compaction or hotload that is moving or reloading the payload
+    AS_Asset *asset = &slot->asset;
+    for (u32 loaded = AS_Status_Loaded; !asset->status.compare_exchange_weak(loaded, AS_Status_Freeing);
+         loaded     = AS_Status_Loaded)
+    {
+        _mm_pause();
+    }
+
+    if (asset->canonicalId)
+    {
+        AS_ReleaseAlias(asset);
+    }
+    else
+    {
+        AS_ReleaseAliases(asset);
+        AS_Free(asset);
+    }
+
+    asset->lastModified = 0;
+    asset->reloadPending.store(false);
+    asset->status.store(AS_Status_Unloaded);
+    BeginMutex(&as_state->lock);
+    as_state->fileHash.RemoveFromHash(HashFromString(asset->path), asset->id);
     EndMutex(&as_state->lock);
 
+    as_state->assetCount.fetch_sub(1);
+    AS_FreeSlot(asset->id);
+    return true;
+}
+
+internal AS_Handle AS_GetAsset(const string inPath, const b32 inLoadIfNotFound)
+{
+    AS_Handle result = {};
+    result.i32[0]    = -1;
+
+    i32 assetId = AS_FindAssetId(inPath);
+    if (assetId != -1)
+    {
+        result = AS_GetHandle(AS_GetAssetFromId(assetId));
+    }
     // Unloaded
-    if (result.i32[0] == -1 && inLoadIfNotFound)
+    else if (inLoadIfNotFound)
     {
-        // TODO: growth strategy?
-        Assert(as_state->assetCount < as_state->assetCapacity);
         AS_Asset *asset = AS_AllocAsset(inPath);
-        result.i32[0]   = asset->id;
-        result.i32[1]   = asset->generation;
+        result          = AS_GetHandle(asset);
     }
     return result;
 }
+
+#if AS_SLOT_MAP_STRESS_TEST
+internal void AS_SlotMapStressTest()
+{
+    const u32 numJobs       = 64;
+    const u32 numIterations = 4096;
+    const u32 maxLive       = 16;
+
+    std::atomic<u64> numAllocs   = 0;
+    std::atomic<u64> numFailures = 0;
+
+    jobsystem::Counter counter = {};
+    jobsystem::KickJobs(&counter, numJobs, 1, [&](jobsystem::JobArgs args) {
+        AS_Handle live[maxLive];
+        u32 liveCount = 0;
+        u64 rng       = 0x9e3779b97f4a7c15ull * (args.jobId + 1);
+        for (u32 i = 0; i < numIterations; i++)
+        {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+
+            // Tag the slot with the job and iteration so stale handles can be detected
+            if (liveCount == 0 || (liveCount < maxLive && (rng & 1)))
+            {
+                i32 id            = AS_AllocSlot();
+                AS_Asset *asset   = AS_GetAssetFromId(id);
+                asset->size       = ((u64)args.jobId << 32) | i;
+                live[liveCount++] = AS_GetHandle(asset);
+                numAllocs.fetch_add(1);
+            }
+            else
+            {
+                u32 index        = (u32)((rng >> 8) % liveCount);
+                AS_Handle handle = live[index];
+                AS_Asset *asset  = AS_GetSlotAsset(handle);
+                if (asset == 0 || (asset->size >> 32) != args.jobId)
+                {
+                    numFailures.fetch_add(1);
+                    continue;
+                }
+                asset->size = 0;
+                AS_FreeSlot(handle.i32[0]);
+                live[index] = live[--liveCount];
+
+                // Freed handles should never resolve, even once the slot is reused
+                if (AS_GetSlotAsset(handle) != 0)
+                {
+                    numFailures.fetch_add(1);
+                }
+            }
+        }
+        for (u32 i = 0; i < liveCount; i++)
+        {
+            AS_GetAssetFromId(live[i].i32[0])->size = 0;
+            AS_FreeSlot(live[i].i32[0]);
+        }
+    });
+    jobsystem::WaitJobs(&counter);
+
+    // Half of the jobs free the same handles at once while the other half look them up. Exactly one free of each
+    // handle wins, and a freed handle never resolves again.
+    const u32 numShared    = 1024;
+    TempArena temp         = ScratchStart(0, 0);
+    AS_Handle *shared      = PushArrayNoZero(temp.arena, AS_Handle, numShared);
+    std::atomic<u32> *wins = PushArray(temp.arena, std::atomic<u32>, numShared);
+    for (u32 i = 0; i < numShared; i++)
+    {
+        AS_Asset *asset    = AS_AllocAsset(PushStr8F(temp.arena, "stress/%u", i), 0);
+        asset->memoryBlock = AS_Alloc(64, asset);
+        asset->size        = i;
+        asset->status.store(AS_Status_Loaded);
+        shared[i] = AS_GetHandle(asset);
+    }
+
+    jobsystem::Counter freeCounter = {};
+    jobsystem::KickJobs(&freeCounter, numJobs, 1, [&](jobsystem::JobArgs args) {
+        for (u32 n = 0; n < numShared; n++)
+        {
+            u32 i = (n + args.jobId * 37) % numShared;
+            if (args.jobId & 1)
+            {
+                AS_Asset *asset = AS_GetAssetFromHandle(shared[i]);
+                if (asset && asset->size != i)
+                {
+                    numFailures.fetch_add(1);
+                }
+            }
+            else if (AS_FreeAsset(shared[i]))
+            {
+                wins[i].fetch_add(1);
+            }
+        }
+    });
+    jobsystem::WaitJobs(&freeCounter);
+
+    u64 numSharedFrees = 0;
+    for (u32 i = 0; i < numShared; i++)
+    {
+        numSharedFrees += wins[i].load();
+        if (wins[i].load() != 1 || AS_GetSlotAsset(shared[i]) != 0)
+        {
+            numFailures.fetch_add(1);
+        }
+    }
+    ScratchEnd(temp);
+
+    AS_CacheState *as_state = engine->GetAssetCacheState();
+    Printf("Slot map stress test: %llu allocs, %llu frees of %u shared handles, %i slots used, %llu failures\n",
+           numAllocs.load(), numSharedFrees, numShared, as_state->slots.endOfList.load(), numFailures.load());
+    Assert(numFailures.load() == 0);
+}
+#endif
+
 internal Font *GetFont(AS_Handle handle)
 {
     AS_Asset *asset = AS_GetAssetFromHandle(handle);
@@ -1132,545 +1990,657 @@ inline b8 IsAnimNil(KeyframedAnimation *anim)
 }
 
 //////////////////////////////
-// B-tree memory allocation
+// TLSF memory allocation
 //
 
 // How this allocator works:
 //
 // Allocation
 //
-// 1. Every time an asset is allocated, a size is passed in and a buffer is returned. A b-tree is used to
-// keep track of previous allocations. The smallest memory block with an allocation size greater than the
-// requested memory size is retrieved. If such a memory block exists, then it is used for the next steps.
-// Otherwise, a new chunk of memory (w/ a size defined at startup) is used. This new chunk of memory is a "base
-// block."
+// 1. Free blocks are kept in segregated lists. The first level index is the highest set bit of the size, the
+// second level linearly subdivides that power of two range. Two bitmaps record which lists are non empty, so finding
+// a list with a block that is guaranteed to fit is two bit scans (the request size is rounded up to the next
+// second level class first). If nothing fits, a new pool is pushed from the arena.
 //
-// 2. Once a new block is obtained, the memory block is split if the remaining size in the memory block is
-// greater than the block size. A new block is created from these leftovers, and added to the b-tree.
+// 2. The block is split if the remainder is large enough, and the remainder goes back on a free list.
+//
+// 3. Small allocations first check a per thread cache of recently freed blocks, which skips the global lock.
 //
 // Free
 //
-// 1. When freeing a block, the next and previous nodes in the allocation chain are tested. If they are part of
-// the same chain (i.e they share a base block) and are freed, then they are combined with the block. This
-// block is then added to the b-tree.
+// 1. Blocks know their previous physical neighbor, and the next one is found using the size. Free neighbors are
+// removed from their lists and merged immediately, so two free blocks are never adjacent. Each pool ends with a zero
+// sized sentinel so merging never crosses pools.
+//
+// Compaction
+//
+// 1. AS_Compact walks the pools and slides used blocks down into the free block before them, which pushes the free
+// space up until it merges with the next hole. Only loaded assets whose payload has no outside pointers into it
+// can be moved (see AS_IsRelocatable). The asset's internal pointers are patched, and since everything else goes
+// through AS_Handle -> AS_Asset -> memoryBlock, nothing else needs to change.
+//
+// based on: http://www.gii.upv.es/tlsf/files/papers/ecrts04_tlsf.pdf
 
-// heavily inspired by: https://github.com/id-Software/DOOM-3-BFG/blob/master/neo/idlib/containers/BTree.h
-// and https://github.com/id-Software/DOOM-3-BFG/blob/1caba1979589971b5ed44e315d9ead30b278d8b4/neo/idlib/Heap.h
-internal AS_BTreeNode *AS_AllocNode()
+StaticAssert((sizeof(AS_MemoryBlockNode) & (AS_TLSF_ALIGN - 1)) == 0, MemoryBlockNodeAlign);
+StaticAssert((sizeof(AS_MemoryPool) & (AS_TLSF_ALIGN - 1)) == 0, MemoryPoolAlign);
+StaticAssert(AS_TLSF_FL_COUNT <= 32, FlBitmapSize);
+
+internal void AS_InitializeAllocator()
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    AS_BTree *tree          = &as_state->allocator.bTree;
-    AS_BTreeNode *newNode   = tree->free;
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
+    Arena *arena                        = ArenaAlloc(megabytes(128));
+    allocator->arena                    = arena;
+    allocator->poolSize                 = megabytes(32);
+    allocator->minBlockSize             = 256;
+    allocator->numThreadCaches          = platform.NumProcessors();
+    allocator->threadCaches             = PushArray(arena, AS_ThreadCache, allocator->numThreadCaches);
+}
 
-    if (newNode == 0)
+internal void AS_MappingInsert(u64 size, u32 *fl, u32 *sl)
+{
+    if (size < AS_TLSF_SMALL_BLOCK_SIZE)
     {
-        newNode = PushStruct(as_state->allocator.arena, AS_BTreeNode);
+        *fl = 0;
+        *sl = (u32)size / (u32)(AS_TLSF_SMALL_BLOCK_SIZE / AS_TLSF_SL_COUNT);
     }
     else
     {
-        StackPop(tree->free);
-        newNode->memoryBlock = 0;
-        newNode->key         = 0;
-        newNode->numChildren = 0;
-        newNode->parent      = 0;
-        newNode->next        = 0;
-        newNode->prev        = 0;
-        newNode->first       = 0;
-        newNode->last        = 0;
+        u32 highBit = GetHighestBit(size);
+        *sl         = (u32)(size >> (highBit - AS_TLSF_SL_COUNT_LOG2)) ^ AS_TLSF_SL_COUNT;
+        *fl         = highBit - (AS_TLSF_FL_SHIFT - 1);
     }
-    return newNode;
+    Assert(*fl < AS_TLSF_FL_COUNT && *sl < AS_TLSF_SL_COUNT);
 }
 
-internal void AS_FreeNode(AS_BTreeNode *node)
+// Rounds the size up to the next second level class, so that any block in the resulting list fits.
+internal void AS_MappingSearch(u64 size, u32 *fl, u32 *sl)
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    StackPush(as_state->allocator.bTree.free, node);
+    if (size >= AS_TLSF_SMALL_BLOCK_SIZE)
+    {
+        size += (1ull << (GetHighestBit(size) - AS_TLSF_SL_COUNT_LOG2)) - 1;
+    }
+    AS_MappingInsert(size, fl, sl);
 }
 
-// NOTE: All children of a node have a key <= to that of their parent. Only the leaves contain objects.
-// This simplifies the control flow complexity.
-internal AS_BTreeNode *AS_AddNode(AS_MemoryBlockNode *memNode)
+inline u32 AS_GetCacheBin(u32 fl, u32 sl)
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    AS_BTree *tree          = &as_state->allocator.bTree;
-    AS_BTreeNode *newNode   = 0;
+    u32 result = fl * AS_TLSF_SL_COUNT + sl;
+    return result;
+}
+
+internal u8 *AS_GetMemory(AS_MemoryBlockNode *node)
+{
+    u8 *result = (u8 *)(node) + sizeof(AS_MemoryBlockNode);
+    return result;
+}
 
-    // Assert(memNode->size < as_state->allocator.baseBlockSize);
+internal AS_MemoryBlockNode *AS_GetMemoryBlock(u8 *memory)
+{
+    AS_MemoryBlockNode *result = (AS_MemoryBlockNode *)memory - 1;
+    return result;
+}
 
-    // If the root is null, allocate
-    if (tree->root == 0)
-    {
-        tree->root = AS_AllocNode();
-    }
-    AS_BTreeNode *root = tree->root;
+internal u8 *AS_GetMemory(AS_Asset *asset)
+{
+    return AS_GetMemory(asset->memoryBlock);
+}
 
-    // If the root is full, add another level (shift level of all current nodes down by 1, so that
-    // memory blocks are found only in leaf nodes)
-    if (root->numChildren > tree->maxChildren)
-    {
-        newNode              = AS_AllocNode();
-        newNode->first       = root;
-        newNode->last        = root;
-        newNode->key         = root->key;
-        newNode->numChildren = 1;
-        root->parent         = newNode;
-        AS_SplitNode(root);
-        tree->root = newNode;
-    }
+internal AS_MemoryBlockNode *AS_GetNextPhysical(AS_MemoryBlockNode *block)
+{
+    Assert(!(block->flags & AS_BlockFlag_Sentinel));
+    AS_MemoryBlockNode *result = (AS_MemoryBlockNode *)(AS_GetMemory(block) + block->size);
+    return result;
+}
 
-    newNode              = AS_AllocNode();
-    newNode->memoryBlock = memNode;
-    i32 key              = memNode->size;
-    newNode->key         = key;
+// NOTE: the following functions must be called with the allocator mutex held
+internal void AS_InsertFreeBlock(AS_MemoryBlockNode *block)
+{
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
 
-    // How this works:
-    // 1. the keys of the children of a node are <= to the key of their parent
-    // Iterate down to leaf node
+    u32 fl, sl;
+    AS_MappingInsert(block->size, &fl, &sl);
 
-    AS_BTreeNode *child = 0;
-    for (AS_BTreeNode *node = tree->root; node->first != 0; node = child)
+    AS_MemoryBlockNode *head = allocator->freeLists[fl][sl];
+    block->flags             = AS_BlockFlag_Free;
+    block->owner             = 0;
+    block->prevFree          = 0;
+    block->nextFree          = head;
+    if (head)
     {
-        if (node->key < key)
-        {
-            node->key = key;
-        }
-        for (child = node->first; child->next != 0; child = child->next)
-        {
-            if (child->key >= key)
-            {
-                break;
-            }
-        }
-        if (child->memoryBlock)
-        {
-            if (child->key >= key)
-            {
-                // Add node before child
-                newNode->prev = child->prev;
-                newNode->next = child;
-                if (newNode->prev == 0)
-                {
-                    node->first = newNode;
-                }
-                else
-                {
-                    newNode->prev->next = newNode;
-                }
-                newNode->next->prev = newNode;
-            }
-            else
-            {
-                // Add node after child
-                newNode->prev = child;
-                newNode->next = child->next;
-                if (newNode->next == 0)
-                {
-                    node->last = newNode;
-                }
-                else
-                {
-                    newNode->next->prev = newNode;
-                }
-                newNode->prev->next = newNode;
-            }
-            newNode->parent = node;
-            node->numChildren++;
+        head->prevFree = block;
+    }
+    allocator->freeLists[fl][sl] = block;
+    allocator->flBitmap |= (1u << fl);
+    allocator->slBitmap[fl] |= (1u << sl);
 
-#if 0
+    allocator->freeBlocks++;
+    allocator->freeBlockMemory += block->size;
+}
 
-            // TODO: not sure if this is correct. need some way of visualizing this tree
-            if (node != root && node->numChildren > tree->maxChildren)
-            {
-                AS_SplitNode(node);
-                if (node->prev->key >= node->prev->last->key)
-                {
-                    node->prev->key = node->prev->last->key;
-                }
-            }
-#endif
+internal void AS_RemoveFreeBlock(AS_MemoryBlockNode *block)
+{
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
+    Assert(block->flags & AS_BlockFlag_Free);
 
-            return newNode;
-        }
-#if 1
-        if (child->numChildren > tree->maxChildren)
+    u32 fl, sl;
+    AS_MappingInsert(block->size, &fl, &sl);
+
+    if (block->prevFree)
+    {
+        block->prevFree->nextFree = block->nextFree;
+    }
+    else
+    {
+        Assert(allocator->freeLists[fl][sl] == block);
+        allocator->freeLists[fl][sl] = block->nextFree;
+        if (block->nextFree == 0)
         {
-            AS_SplitNode(child);
-            if (child->prev->key >= key)
+            allocator->slBitmap[fl] &= ~(1u << sl);
+            if (allocator->slBitmap[fl] == 0)
             {
-                child = child->prev;
+                allocator->flBitmap &= ~(1u << fl);
             }
         }
-#endif
     }
+    if (block->nextFree)
+    {
+        block->nextFree->prevFree = block->prevFree;
+    }
+    block->nextFree = 0;
+    block->prevFree = 0;
+    block->flags &= ~AS_BlockFlag_Free;
 
-    Assert(root->numChildren == 0);
-    newNode->parent = root;
-    root->first     = newNode;
-    root->last      = newNode;
-    root->numChildren++;
-    return newNode;
+    allocator->freeBlocks--;
+    allocator->freeBlockMemory -= block->size;
 }
 
-internal void AS_RemoveNode(AS_BTreeNode *node)
+internal AS_MemoryBlockNode *AS_FindFreeBlock(u64 size)
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    Assert(node->memoryBlock != 0);
-    // Unlink from parent
-    if (node->prev)
-    {
-        node->prev->next = node->next;
-    }
-    else
-    {
-        node->parent->first = node->next;
-    }
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
 
-    if (node->next)
-    {
-        node->next->prev = node->prev;
-    }
-    else
-    {
-        node->parent->last = node->prev;
-    }
-    node->parent->numChildren--;
+    u32 fl, sl;
+    AS_MappingSearch(size, &fl, &sl);
 
-    AS_BTreeNode *parent = 0;
-    AS_BTree *tree       = &as_state->allocator.bTree;
-    for (parent = node->parent; parent != tree->root && parent->numChildren < (tree->maxChildren + 1) / 2;
-         parent = parent->parent)
+    AS_MemoryBlockNode *result = 0;
+    u32 slMap                  = allocator->slBitmap[fl] & (u32)(~0ull << sl);
+    if (slMap == 0)
     {
-        if (parent->next)
-        {
-            parent = AS_MergeNodes(parent, parent->next);
-        }
-        else if (parent->prev)
-        {
-            parent = AS_MergeNodes(parent->prev, parent);
-        }
-        if (parent->key > parent->last->key)
-        {
-            parent->key = parent->last->key;
-        }
-        if (parent->numChildren > tree->maxChildren)
+        u32 flMap = allocator->flBitmap & (u32)(~0ull << (fl + 1));
+        if (flMap == 0)
         {
-            // Splitting the node will make the parent's parent have at least 2 children
-            AS_SplitNode(parent);
-            break;
+            return result;
         }
+        fl    = GetLowestSetBit(flMap);
+        slMap = allocator->slBitmap[fl];
+        Assert(slMap);
     }
+    sl     = GetLowestSetBit(slMap);
+    result = allocator->freeLists[fl][sl];
+    Assert(result && result->size >= size);
+    return result;
+}
 
-    for (; parent != 0 && parent->last != 0; parent = parent->parent)
-    {
-        if (parent->key > parent->last->key)
-        {
-            parent->key = parent->last->key;
-        }
-    }
-    AS_FreeNode(node);
-    if (tree->root->numChildren == 1 && tree->root->memoryBlock == 0)
-    {
-        AS_BTreeNode *oldRoot     = tree->root;
-        tree->root->first->parent = 0;
-        tree->root                = tree->root->first;
-        AS_FreeNode(oldRoot);
-    }
+internal AS_MemoryPool *AS_AddPool(u64 size)
+{
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
+
+    // Pool header, the block, and the sentinel
+    u64 poolSize = Max(allocator->poolSize, size + sizeof(AS_MemoryPool) + 2 * sizeof(AS_MemoryBlockNode));
+    poolSize     = AlignPow2(poolSize, AS_TLSF_ALIGN);
+
+    u8 *memory          = PushArrayNoZero(allocator->arena, u8, poolSize + AS_TLSF_ALIGN);
+    AS_MemoryPool *pool = (AS_MemoryPool *)AlignPow2((u64)memory, AS_TLSF_ALIGN);
+    pool->next          = 0;
+    pool->size          = poolSize;
+
+    AS_MemoryBlockNode *block = (AS_MemoryBlockNode *)(pool + 1);
+    block->prevPhysical       = 0;
+    block->size               = poolSize - sizeof(AS_MemoryPool) - 2 * sizeof(AS_MemoryBlockNode);
+    pool->first               = block;
+
+    AS_MemoryBlockNode *sentinel = AS_GetNextPhysical(block);
+    sentinel->prevPhysical       = block;
+    sentinel->nextFree           = 0;
+    sentinel->prevFree           = 0;
+    sentinel->owner              = 0;
+    sentinel->size               = 0;
+    sentinel->flags              = AS_BlockFlag_Sentinel;
+
+    QueuePush(allocator->firstPool, allocator->lastPool, pool);
+    allocator->pools++;
+    allocator->poolMemory += poolSize;
+
+    AS_InsertFreeBlock(block);
+    return pool;
 }
 
-internal void AS_SplitNode(AS_BTreeNode *node)
+// Merges the block with its free physical neighbors. Returns the merged block, which is not on a free list.
+internal AS_MemoryBlockNode *AS_MergeFreeNeighbors(AS_MemoryBlockNode *block)
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    AS_BTreeNode *newNode   = AS_AllocNode();
-    newNode->parent         = node->parent;
-    AS_BTreeNode *child     = node->first;
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
 
-    Assert(node->parent->numChildren < as_state->allocator.bTree.maxChildren);
+    AS_MemoryBlockNode *next = AS_GetNextPhysical(block);
+    if (next->flags & AS_BlockFlag_Free)
+    {
+        AS_RemoveFreeBlock(next);
+        block->size += sizeof(AS_MemoryBlockNode) + next->size;
+        AS_GetNextPhysical(block)->prevPhysical = block;
+        allocator->numMerges++;
+    }
 
-    for (i32 i = 0; i < node->numChildren; i += 2)
+    AS_MemoryBlockNode *prev = block->prevPhysical;
+    if (prev && (prev->flags & AS_BlockFlag_Free))
     {
-        child->parent = newNode;
-        child         = child->next;
+        AS_RemoveFreeBlock(prev);
+        prev->size += sizeof(AS_MemoryBlockNode) + block->size;
+        AS_GetNextPhysical(prev)->prevPhysical = prev;
+        allocator->numMerges++;
+        block = prev;
     }
+    return block;
+}
 
-    // All nodes before the current child node are now children of the newnode.
-    newNode->key         = child->prev->key;
-    newNode->numChildren = (node->numChildren + 1) / 2;
-    newNode->next        = node;
-    newNode->prev        = node->prev;
-    newNode->first       = node->first;
-    newNode->last        = child->prev;
+internal void AS_FreeLocked(AS_MemoryBlockNode *block)
+{
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
 
-    child->prev->next = 0;
-    child->prev       = 0;
+    block->flags = 0;
+    block->owner = 0;
+    block        = AS_MergeFreeNeighbors(block);
+    AS_InsertFreeBlock(block);
 
-    if (node->prev)
-    {
-        node->prev->next = newNode;
-    }
-    else
+    if (!(AS_GetNextPhysical(block)->flags & AS_BlockFlag_Sentinel))
     {
-        node->parent->first = newNode;
+        allocator->compactionPending = true;
     }
-    node->prev  = newNode;
-    node->first = child;
-    node->numChildren -= newNode->numChildren;
-    Assert(node->numChildren <= as_state->allocator.bTree.maxChildren);
-
-    node->parent->numChildren++;
 }
 
-internal AS_BTreeNode *AS_MergeNodes(AS_BTreeNode *node1, AS_BTreeNode *node2)
+internal AS_MemoryBlockNode *AS_Alloc(u64 size, AS_Asset *owner)
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    Assert(node1->parent == node2->parent);
-    Assert(node1->next == node2 && node2->prev == node1);
-    Assert(node1->memoryBlock == 0 && node2->memoryBlock == 0);
-    Assert(node1->numChildren <= (as_state->allocator.bTree.maxChildren + 1) / 2 &&
-           node2->numChildren <= (as_state->allocator.bTree.maxChildren + 1) / 2);
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
+    u64 alignedSize                     = Max(AlignPow2(size, AS_TLSF_ALIGN), AS_TLSF_ALIGN);
+    Assert(alignedSize < AS_TLSF_MAX_ALLOC);
 
-    AS_BTreeNode *child = 0;
-    for (child = node1->first; child->next != 0; child = child->next)
+    AS_MemoryBlockNode *memoryBlock = 0;
+
+    // Try the thread cache first
+    if (alignedSize < AS_CACHE_MAX_SIZE)
     {
-        child->parent = node2;
+        u32 fl, sl;
+        AS_MappingSearch(alignedSize, &fl, &sl);
+        u32 bin = AS_GetCacheBin(fl, sl);
+        if (bin < AS_CACHE_BIN_COUNT)
+        {
+            AS_ThreadCache *cache = &allocator->threadCaches[GetThreadIndex() % allocator->numThreadCaches];
+            TicketMutexScope(&cache->mutex)
+            {
+                memoryBlock = cache->bins[bin];
+                if (memoryBlock)
+                {
+                    Assert(memoryBlock->flags & AS_BlockFlag_Cached);
+                    cache->bins[bin] = memoryBlock->nextFree;
+                    cache->counts[bin]--;
+                    cache->cachedBlocks--;
+                    cache->cachedMemory -= memoryBlock->size;
+                }
+            }
+            if (memoryBlock)
+            {
+                Assert(memoryBlock->size >= alignedSize);
+                memoryBlock->flags    = 0;
+                memoryBlock->nextFree = 0;
+                memoryBlock->owner    = owner;
+
+                BeginTicketMutex(&allocator->ticketMutex);
+                allocator->numAllocs++;
+                allocator->numCacheHits++;
+                EndTicketMutex(&allocator->ticketMutex);
+                return memoryBlock;
+            }
+        }
     }
 
-    child->parent     = node2;
-    child->next       = node2->first;
-    child->next->prev = child;
-    node2->first      = node1->first;
-    node2->prev       = node1->prev;
-    node2->parent->numChildren--;
-    node2->numChildren += node1->numChildren;
-
-    if (node1->prev)
+    BeginTicketMutex(&allocator->ticketMutex);
+    memoryBlock = AS_FindFreeBlock(alignedSize);
+    if (memoryBlock == 0)
     {
-        node1->prev->next = node2;
+        AS_AddPool(alignedSize);
+        memoryBlock = AS_FindFreeBlock(alignedSize);
     }
-    else
+    Assert(memoryBlock);
+    AS_RemoveFreeBlock(memoryBlock);
+
+    // Split the block if it's larger than the allocation size
+    if (memoryBlock->size >= alignedSize + sizeof(AS_MemoryBlockNode) + allocator->minBlockSize)
     {
-        node1->parent->first = node2;
+        AS_MemoryBlockNode *newBlock = (AS_MemoryBlockNode *)(AS_GetMemory(memoryBlock) + alignedSize);
+        newBlock->size               = memoryBlock->size - alignedSize - sizeof(AS_MemoryBlockNode);
+        newBlock->prevPhysical       = memoryBlock;
+        memoryBlock->size            = alignedSize;
+
+        AS_GetNextPhysical(newBlock)->prevPhysical = newBlock;
+        AS_InsertFreeBlock(newBlock);
+        allocator->numSplits++;
     }
 
-    AS_FreeNode(node1);
-    return node2;
+    memoryBlock->flags = 0;
+    memoryBlock->owner = owner;
+    allocator->numAllocs++;
+    allocator->usedBlocks++;
+    allocator->usedBlockMemory += memoryBlock->size;
+    EndTicketMutex(&allocator->ticketMutex);
+
+    return memoryBlock;
 }
 
-internal AS_BTreeNode *AS_FindMemoryBlock(i32 size)
+internal void AS_Free(AS_MemoryBlockNode *memoryBlock)
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    AS_BTreeNode *root      = as_state->allocator.bTree.root;
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
+    Assert(memoryBlock->flags == 0);
 
-    AS_BTreeNode *result = 0;
-    if (root != 0)
+    // Small blocks go to the thread cache. They still count as used memory until the cache is drained.
+    if (memoryBlock->size < AS_CACHE_MAX_SIZE)
     {
-        for (AS_BTreeNode *node = root->first; node != 0; node = node->first)
+        u32 fl, sl;
+        AS_MappingInsert(memoryBlock->size, &fl, &sl);
+        u32 bin = AS_GetCacheBin(fl, sl);
+
+        b32 cached            = false;
+        AS_ThreadCache *cache = &allocator->threadCaches[GetThreadIndex() % allocator->numThreadCaches];
+        TicketMutexScope(&cache->mutex)
         {
-            while (node->next != 0)
-            {
-                if (node->key >= size)
-                {
-                    break;
-                }
-                node = node->next;
-            }
-            if (node->memoryBlock)
+            if (bin < AS_CACHE_BIN_COUNT && cache->counts[bin] < AS_CACHE_BLOCKS_PER_BIN)
             {
-                if (node->key >= size)
-                {
-                    result = node;
-                }
-                break;
+                memoryBlock->flags    = AS_BlockFlag_Cached;
+                memoryBlock->owner    = 0;
+                memoryBlock->nextFree = cache->bins[bin];
+                cache->bins[bin]      = memoryBlock;
+                cache->counts[bin]++;
+                cache->cachedBlocks++;
+                cache->cachedMemory += memoryBlock->size;
+                cached = true;
             }
         }
+        if (cached)
+        {
+            BeginTicketMutex(&allocator->ticketMutex);
+            allocator->numFrees++;
+            EndTicketMutex(&allocator->ticketMutex);
+            return;
+        }
     }
-    return result;
+
+    BeginTicketMutex(&allocator->ticketMutex);
+    allocator->numFrees++;
+    allocator->usedBlocks--;
+    allocator->usedBlockMemory -= memoryBlock->size;
+    AS_FreeLocked(memoryBlock);
+    EndTicketMutex(&allocator->ticketMutex);
 }
 
-internal void AS_InitializeAllocator()
+internal void AS_Free(AS_Asset *asset)
 {
-    AS_CacheState *as_state               = engine->GetAssetCacheState();
-    Arena *arena                          = ArenaAlloc(megabytes(128));
-    as_state->allocator.arena             = arena;
-    as_state->allocator.bTree.root        = PushStruct(arena, AS_BTreeNode);
-    as_state->allocator.bTree.maxChildren = 4;
-    as_state->allocator.baseBlockSize     = megabytes(2);
-    as_state->allocator.minBlockSize      = kilobytes(4);
+    AS_Free(asset->memoryBlock);
+    asset->memoryBlock = 0;
 }
 
-internal u8 *AS_GetMemory(AS_MemoryBlockNode *node)
+internal void AS_Free(void **ptr)
 {
-    u8 *result = (u8 *)(node) + sizeof(AS_MemoryBlockNode);
-    return result;
+    AS_MemoryBlockNode *node = (AS_MemoryBlockNode *)(*ptr) - 1;
+    AS_Free(node);
+    *ptr = 0;
 }
 
-internal AS_MemoryBlockNode *AS_GetMemoryBlock(u8 *memory)
+//////////////////////////////
+// Compaction
+//
+
+// Assets can only be moved if nothing outside of the asset points into its memory.
+internal b32 AS_IsRelocatable(AS_Asset *asset)
 {
-    AS_MemoryBlockNode *result = (AS_MemoryBlockNode *)memory - 1;
+    b32 result = false;
+    switch (asset->type)
+    {
+        // Uploaded to the gpu, the file data is no longer referenced
+        case AS_Texture:
+        // Pointers are all internal to the file
+        case AS_Anim: result = true; break;
+        // Scene meshes/skeletons point into the file, and stb_truetype keeps pointers into the font
+        case AS_Model:
+        case AS_Skeleton:
+        case AS_Font:
+        default: result = false; break;
+    }
     return result;
 }
 
-internal u8 *AS_GetMemory(AS_Asset *asset)
+internal void AS_RelocateAsset(AS_Asset *asset, u8 *oldMemory, u8 *newMemory)
 {
-    return AS_GetMemory(asset->memoryBlock);
+    switch (asset->type)
+    {
+        case AS_Anim:
+        {
+            KeyframedAnimation *anim = &asset->anim;
+            anim->boneChannels       = (BoneChannel *)(newMemory + ((u8 *)anim->boneChannels - oldMemory));
+            anim->groups             = (AnimationGroupFormat *)(newMemory + ((u8 *)anim->groups - oldMemory));
+            anim->sampleData         = newMemory + (anim->sampleData - oldMemory);
+            anim->rootMotion         = (AnimationRootMotion *)(newMemory + ((u8 *)anim->rootMotion - oldMemory));
+            anim->events             = (AnimationEvent *)(newMemory + ((u8 *)anim->events - oldMemory));
+            for (u32 i = 0; i < anim->numNodes; i++)
+            {
+                BoneChannel *boneChannel = &anim->boneChannels[i];
+                boneChannel->name.str    = newMemory + (boneChannel->name.str - oldMemory);
+            }
+            for (u32 i = 0; i < anim->numEvents; i++)
+            {
+                AnimationEvent *event = &anim->events[i];
+                event->name.str       = newMemory + (event->name.str - oldMemory);
+            }
+        }
+        break;
+        default: break;
+    }
 }
 
-internal AS_MemoryBlockNode *AS_Alloc(i32 size)
+// Moves the contents of block into the free block physically before it. The free space ends up after the block
+// and is merged with its next neighbor. Returns the new location of the block.
+internal AS_MemoryBlockNode *AS_SlideBlock(AS_MemoryBlockNode *prev, AS_MemoryBlockNode *block)
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    BeginTicketMutex(&as_state->allocator.ticketMutex);
-    i32 alignedSize                     = AlignPow2(size, 16);
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
     AS_DynamicBlockAllocator *allocator = &as_state->allocator;
-    allocator->usedBlocks++;
-    allocator->usedBlockMemory += alignedSize;
-    allocator->numAllocs++;
-    AS_BTreeNode *node = AS_FindMemoryBlock(size);
+    Assert((prev->flags & AS_BlockFlag_Free) && block->prevPhysical == prev && block->flags == 0);
+
+    AS_RemoveFreeBlock(prev);
+
+    u64 freeSize             = prev->size;
+    u64 usedSize             = block->size;
+    AS_Asset *owner          = block->owner;
+    AS_MemoryBlockNode *next = AS_GetNextPhysical(block);
+
+    // NOTE: the block header is overwritten by the move
+    memmove(AS_GetMemory(prev), AS_GetMemory(block), usedSize);
+
+    AS_MemoryBlockNode *newBlock = prev;
+    newBlock->size               = usedSize;
+    newBlock->flags              = 0;
+    newBlock->owner              = owner;
+
+    AS_MemoryBlockNode *freeBlock = AS_GetNextPhysical(newBlock);
+    freeBlock->prevPhysical       = newBlock;
+    freeBlock->size               = freeSize;
+    freeBlock->flags              = 0;
+    next->prevPhysical            = freeBlock;
+    freeBlock                     = AS_MergeFreeNeighbors(freeBlock);
+    AS_InsertFreeBlock(freeBlock);
+
+    allocator->numRelocations++;
+    allocator->relocatedMemory += usedSize;
+    return newBlock;
+}
 
-    AS_MemoryBlockNode *memoryBlock = 0;
-    // Use an existing memory block for the allocation. Split it to prevent excessive leaks.
-    if (node)
-    {
-        memoryBlock = node->memoryBlock;
-        AS_RemoveNode(node);
-        memoryBlock->node = 0;
-        allocator->freeBlocks--;
-        allocator->freeBlockMemory -= memoryBlock->size;
-    }
-    // Create an entirely separate block.
-    else
+// Returns the blocks in the per thread caches to the free lists, since they would otherwise pin memory.
+internal void AS_DrainThreadCaches()
+{
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
+    for (u32 i = 0; i < allocator->numThreadCaches; i++)
     {
-        i32 newSize              = Max(allocator->baseBlockSize, alignedSize + (i32)sizeof(AS_MemoryBlockNode));
-        memoryBlock              = (AS_MemoryBlockNode *)PushArray(allocator->arena, u8, newSize);
-        memoryBlock->isBaseBlock = true;
-        memoryBlock->size        = newSize - (i32)sizeof(AS_MemoryBlockNode);
-        memoryBlock->next        = 0;
-        memoryBlock->prev        = allocator->last;
-        Assert(memoryBlock->next == 0 && memoryBlock->node == 0);
-        if (memoryBlock->prev)
-        {
-            memoryBlock->prev->next = memoryBlock;
-        }
-        else
-        {
-            allocator->first = memoryBlock;
-        }
-        allocator->last   = memoryBlock;
-        memoryBlock->node = 0;
-        allocator->baseBlocks++;
-        allocator->baseBlockMemory += newSize;
-    }
-
-    // Split the newly allocated block if it's larger than the allocation size
-    if ((i32)(memoryBlock->size - alignedSize - sizeof(AS_MemoryBlockNode)) > allocator->minBlockSize)
-    {
-        allocator->numResizes++;
-        AS_MemoryBlockNode *newBlock =
-            (AS_MemoryBlockNode *)((u8 *)(memoryBlock) + alignedSize + (i32)sizeof(AS_MemoryBlockNode));
-        newBlock->isBaseBlock = 0;
-        newBlock->size        = memoryBlock->size - alignedSize - (i32)sizeof(AS_MemoryBlockNode);
-        Assert(newBlock->size > allocator->minBlockSize);
-        newBlock->prev = memoryBlock;
-        newBlock->next = memoryBlock->next;
-        newBlock->node = 0;
-
-        if (newBlock->next)
+        AS_ThreadCache *cache = &allocator->threadCaches[i];
+        TicketMutexScope(&cache->mutex)
         {
-            newBlock->next->prev = newBlock;
+            TicketMutexScope(&allocator->ticketMutex)
+            {
+                for (u32 bin = 0; bin < AS_CACHE_BIN_COUNT; bin++)
+                {
+                    AS_MemoryBlockNode *block = cache->bins[bin];
+                    while (block)
+                    {
+                        AS_MemoryBlockNode *nextBlock = block->nextFree;
+                        block->nextFree               = 0;
+                        allocator->usedBlocks--;
+                        allocator->usedBlockMemory -= block->size;
+                        AS_FreeLocked(block);
+                        block = nextBlock;
+                    }
+                    cache->bins[bin]   = 0;
+                    cache->counts[bin] = 0;
+                }
+                cache->cachedBlocks = 0;
+                cache->cachedMemory = 0;
+            }
         }
-        else
+    }
+}
+
+// Incremental compaction. Moves at most budget bytes (or a single block if it is larger than the budget).
+// NOTE: must be called when no one is reading asset memory directly, e.g. at the start of the frame.
+internal void AS_Compact(u64 budget)
+{
+    TIMED_FUNCTION();
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
+    AS_DynamicBlockAllocator *allocator = &as_state->allocator;
+    if (!allocator->compactionPending) return;
+
+    AS_DrainThreadCaches();
+
+    u64 moved       = 0;
+    b32 finished    = true;
+    b32 outOfBudget = false;
+    BeginTicketMutex(&allocator->ticketMutex);
+    for (AS_MemoryPool *pool = allocator->firstPool; pool != 0 && !outOfBudget; pool = pool->next)
+    {
+        for (AS_MemoryBlockNode *block = pool->first; !(block->flags & AS_BlockFlag_Sentinel);
+             block                     = AS_GetNextPhysical(block))
         {
-            allocator->last = newBlock;
-        }
+            AS_MemoryBlockNode *prev = block->prevPhysical;
+            if (block->flags != 0 || prev == 0 || !(prev->flags & AS_BlockFlag_Free)) continue;
 
-        memoryBlock->size = alignedSize;
-        memoryBlock->next = newBlock;
+            AS_Asset *asset = block->owner;
+            if (asset == 0 || !AS_IsRelocatable(asset))
+            {
+                continue;
+            }
+            if (moved != 0 && moved + block->size > budget)
+            {
+                outOfBudget = true;
+                finished    = false;
+                break;
+            }
+            // Keep the asset from being hotloaded/freed while it's moving
+            u32 loaded = AS_Status_Loaded;
+            if (!asset->status.compare_exchange_strong(loaded, AS_Status_Queued))
+            {
+                finished = false;
+                continue;
+            }
+            Assert(asset->memoryBlock == block);
 
-        allocator->freeBlocks++;
-        allocator->freeBlockMemory += alignedSize;
+            u8 *oldMemory      = AS_GetMemory(block);
+            block              = AS_SlideBlock(prev, block);
+            asset->memoryBlock = block;
+            AS_RelocateAsset(asset, oldMemory, AS_GetMemory(block));
+            AS_SetLoaded(asset);
 
-        EndTicketMutex(&as_state->allocator.ticketMutex);
-        AS_Free(newBlock);
-        BeginTicketMutex(&as_state->allocator.ticketMutex);
+            moved += block->size;
+        }
     }
-    EndTicketMutex(&as_state->allocator.ticketMutex);
-    return memoryBlock;
+    if (finished)
+    {
+        allocator->compactionPending = false;
+    }
+    EndTicketMutex(&allocator->ticketMutex);
 }
 
-internal void AS_Free(AS_MemoryBlockNode *memoryBlock)
+internal AS_AllocatorStats AS_GetAllocatorStats()
 {
-    AS_CacheState *as_state = engine->GetAssetCacheState();
-    BeginTicketMutex(&as_state->allocator.ticketMutex);
-    Assert(memoryBlock->node == 0);
-    Assert(memoryBlock->isBaseBlock == 0 || memoryBlock->isBaseBlock == 1);
-    // Merge the next node if it's free and part of the same contiguous chain
+    AS_CacheState *as_state             = engine->GetAssetCacheState();
     AS_DynamicBlockAllocator *allocator = &as_state->allocator;
-    allocator->numFrees++;
-    allocator->usedBlocks--;
-    allocator->usedBlockMemory -= memoryBlock->size;
 
-    AS_MemoryBlockNode *next = memoryBlock->next;
-    if (next != 0 && !next->isBaseBlock && next->node != 0)
+    AS_AllocatorStats stats = {};
+    for (u32 i = 0; i < allocator->numThreadCaches; i++)
     {
-        Assert(next->node->key == next->size);
-        AS_RemoveNode(next->node);
-        next->node = 0;
-        allocator->freeBlocks--;
-        allocator->freeBlockMemory -= next->size;
-
-        memoryBlock->size = memoryBlock->size + sizeof(AS_MemoryBlockNode) + next->size;
-        memoryBlock->next = next->next;
-        if (next->next)
+        AS_ThreadCache *cache = &allocator->threadCaches[i];
+        TicketMutexScope(&cache->mutex)
         {
-            next->next->prev = memoryBlock;
-        }
-        else
-        {
-            allocator->last = next;
+            stats.cachedBlocks += cache->cachedBlocks;
+            stats.cachedMemory += cache->cachedMemory;
         }
     }
 
-    // Merge the previous node if it's free and part of the same contiguous chain
-    AS_MemoryBlockNode *prev = memoryBlock->prev;
-    if (prev != 0 && !memoryBlock->isBaseBlock && prev->node != 0)
+    TicketMutexScope(&allocator->ticketMutex)
     {
-        AS_RemoveNode(prev->node);
-        prev->node = 0;
-        allocator->freeBlocks--;
-        allocator->freeBlockMemory -= next->size;
-
-        prev->size = prev->size + sizeof(AS_MemoryBlockNode) + memoryBlock->size;
-        prev->next = memoryBlock->next;
-        if (memoryBlock->next)
+        stats.pools           = allocator->pools;
+        stats.poolMemory      = allocator->poolMemory;
+        stats.usedBlocks      = allocator->usedBlocks - stats.cachedBlocks;
+        stats.usedBlockMemory = allocator->usedBlockMemory - stats.cachedMemory;
+        stats.freeBlocks      = allocator->freeBlocks;
+        stats.freeBlockMemory = allocator->freeBlockMemory;
+        stats.numAllocs       = allocator->numAllocs;
+        stats.numFrees        = allocator->numFrees;
+        stats.numSplits       = allocator->numSplits;
+        stats.numMerges       = allocator->numMerges;
+        stats.numCacheHits    = allocator->numCacheHits;
+        stats.numRelocations  = allocator->numRelocations;
+        stats.relocatedMemory = allocator->relocatedMemory;
+
+        // The largest block is in the highest non empty list
+        if (allocator->flBitmap)
         {
-            memoryBlock->next->prev = prev;
-        }
-        else
-        {
-            allocator->last = prev;
+            u32 fl = GetHighestBit(allocator->flBitmap);
+            u32 sl = GetHighestBit(allocator->slBitmap[fl]);
+            for (AS_MemoryBlockNode *block = allocator->freeLists[fl][sl]; block != 0; block = block->nextFree)
+            {
+                stats.largestFreeBlock = Max(stats.largestFreeBlock, block->size);
+            }
         }
-        // Add the three combined blocks to the free b-tree
-        AS_AddNode(prev);
-        allocator->freeBlocks++;
-        allocator->freeBlockMemory += prev->size;
     }
-    else
+    if (stats.freeBlockMemory)
     {
-        // Add the two combined blocks to the free b-tree
-        AS_AddNode(memoryBlock);
-        allocator->freeBlocks++;
-        allocator->freeBlockMemory += memoryBlock->size;
+        stats.fragmentation = 1.f - (f32)((f64)stats.largestFreeBlock / (f64)stats.freeBlockMemory);
     }
-    EndTicketMutex(&as_state->allocator.ticketMutex);
-}
-
-internal void AS_Free(AS_Asset *asset)
-{
-    AS_Free(asset->memoryBlock);
-    asset->memoryBlock = 0;
+    return stats;
 }
 
-internal void AS_Free(void **ptr)
+internal void AS_PrintAllocatorStats()
 {
-    AS_MemoryBlockNode *node = (AS_MemoryBlockNode *)(*ptr) - 1;
-    AS_Free(node);
-    *ptr = 0;
+    AS_AllocatorStats stats = AS_GetAllocatorStats();
+    Printf("Asset allocator:\n");
+    Printf("\tPools: %llu (%llu bytes)\n", stats.pools, stats.poolMemory);
+    Printf("\tUsed: %llu blocks (%llu bytes)\n", stats.usedBlocks, stats.usedBlockMemory);
+    Printf("\tFree: %llu blocks (%llu bytes), largest: %llu bytes\n", stats.freeBlocks, stats.freeBlockMemory,
+           stats.largestFreeBlock);
+    Printf("\tCached: %llu blocks (%llu bytes)\n", stats.cachedBlocks, stats.cachedMemory);
+    Printf("\tFragmentation: %.3f\n", stats.fragmentation);
+    Printf("\tAllocs: %llu, Frees: %llu, Splits: %llu, Merges: %llu, Cache hits: %llu\n", stats.numAllocs,
+           stats.numFrees, stats.numSplits, stats.numMerges, stats.numCacheHits);
+    Printf("\tRelocations: %llu (%llu bytes)\n", stats.numRelocations, stats.relocatedMemory);
 }
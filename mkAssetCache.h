@@ -40,6 +40,21 @@ struct AS_Thread
     OS_Handle handle;
 };
 
+//////////////////////////////
+// Hotloading
+//
+
+// Editors usually write a file several times when saving. A change is only acted on after no new notifications have
+// arrived for the file during this window.
+#define AS_HOTLOAD_DEBOUNCE_SECONDS 0.1f
+#define AS_HOTLOAD_MAX_PENDING      256
+
+struct AS_HotloadRequest
+{
+    i32 assetId;
+    f32 deadline;
+};
+
 // #if 0
 // struct AS_Stripe
 // {
@@ -102,36 +117,65 @@ struct AS_HashMap
 //////////////////////////////
 // Memory management
 //
-struct AS_MemoryBlockNode;
-struct AS_BTreeNode
-{
-    AS_BTreeNode *parent;
-    AS_BTreeNode *next;
-    AS_BTreeNode *prev;
-    AS_BTreeNode *first;
-    AS_BTreeNode *last;
-
-    AS_MemoryBlockNode *memoryBlock;
-    i32 key;
-    i32 numChildren;
-};
 
-struct AS_BTree
+// Two level segregated fit. The first level splits sizes into power of two classes, the second level linearly
+// subdivides each class. Sizes below AS_TLSF_SMALL_BLOCK_SIZE all live in first level 0.
+#define AS_TLSF_ALIGN_LOG2       4
+#define AS_TLSF_ALIGN            (1ull << AS_TLSF_ALIGN_LOG2)
+#define AS_TLSF_SL_COUNT_LOG2    5
+#define AS_TLSF_SL_COUNT         (1u << AS_TLSF_SL_COUNT_LOG2)
+#define AS_TLSF_FL_SHIFT         (AS_TLSF_SL_COUNT_LOG2 + AS_TLSF_ALIGN_LOG2)
+#define AS_TLSF_FL_COUNT         32
+#define AS_TLSF_SMALL_BLOCK_SIZE (1ull << AS_TLSF_FL_SHIFT)
+// 1 TiB
+#define AS_TLSF_MAX_ALLOC (1ull << (AS_TLSF_FL_COUNT + AS_TLSF_FL_SHIFT - 1))
+
+// Per thread caches only hold blocks smaller than this
+#define AS_CACHE_MAX_SIZE       kilobytes(64)
+#define AS_CACHE_BIN_COUNT      (8 * AS_TLSF_SL_COUNT)
+#define AS_CACHE_BLOCKS_PER_BIN 4
+
+enum AS_MemoryBlockFlags
 {
-    AS_BTreeNode *root;
-    AS_BTreeNode *free;
-    i32 maxChildren;
+    AS_BlockFlag_Free     = (1 << 0),
+    AS_BlockFlag_Cached   = (1 << 1),
+    AS_BlockFlag_Sentinel = (1 << 2),
 };
 
 struct AS_MemoryBlockNode
 {
-    AS_MemoryBlockNode *next;
-    AS_MemoryBlockNode *prev;
-    AS_BTreeNode *node;
+    // Physical neighbor, used for merging. The next physical block is found using the size.
+    AS_MemoryBlockNode *prevPhysical;
+
+    // Only valid when the block is free/cached
+    AS_MemoryBlockNode *nextFree;
+    AS_MemoryBlockNode *prevFree;
+
+    // Asset that owns the block. Compaction moves the block and patches the asset, so nothing outside of the
+    // asset should hold a raw pointer to the memory.
+    AS_Asset *owner;
 
     // This is the size of the allocation excluding the header
-    i32 size;
-    b8 isBaseBlock;
+    u64 size;
+    u32 flags;
+    u32 pad;
+};
+
+struct AS_MemoryPool
+{
+    AS_MemoryPool *next;
+    AS_MemoryBlockNode *first;
+    u64 size;
+    u64 pad;
+};
+
+struct AS_ThreadCache
+{
+    TicketMutex mutex;
+    AS_MemoryBlockNode *bins[AS_CACHE_BIN_COUNT];
+    u32 counts[AS_CACHE_BIN_COUNT];
+    u64 cachedBlocks;
+    u64 cachedMemory;
 };
 
 struct AS_DynamicBlockAllocator
@@ -139,23 +183,165 @@ struct AS_DynamicBlockAllocator
     Arena *arena;
 
     TicketMutex ticketMutex;
-    AS_MemoryBlockNode *first;
-    AS_MemoryBlockNode *last;
-    AS_BTree bTree;
+    u32 flBitmap;
+    u32 slBitmap[AS_TLSF_FL_COUNT];
+    AS_MemoryBlockNode *freeLists[AS_TLSF_FL_COUNT][AS_TLSF_SL_COUNT];
+
+    AS_MemoryPool *firstPool;
+    AS_MemoryPool *lastPool;
+
+    AS_ThreadCache *threadCaches;
+    u32 numThreadCaches;
 
-    i32 baseBlockSize;
-    i32 minBlockSize;
+    u64 poolSize;
+    u64 minBlockSize;
+
+    // Set when a free leaves a hole before a used block, cleared once a compaction pass finds nothing to move
+    b32 compactionPending;
 
     // stats
-    i32 freeBlocks;
-    i32 freeBlockMemory;
-    i32 usedBlocks;
-    i32 usedBlockMemory;
-    i32 baseBlocks;
-    i32 baseBlockMemory;
-    i32 numAllocs;
-    i32 numFrees;
-    i32 numResizes;
+    u64 freeBlocks;
+    u64 freeBlockMemory;
+    u64 usedBlocks;
+    u64 usedBlockMemory;
+    u64 pools;
+    u64 poolMemory;
+    u64 numAllocs;
+    u64 numFrees;
+    u64 numSplits;
+    u64 numMerges;
+    u64 numCacheHits;
+    u64 numRelocations;
+    u64 relocatedMemory;
+};
+
+struct AS_AllocatorStats
+{
+    u64 pools;
+    u64 poolMemory;
+    u64 usedBlocks;
+    u64 usedBlockMemory;
+    u64 freeBlocks;
+    u64 freeBlockMemory;
+    u64 largestFreeBlock;
+    u64 cachedBlocks;
+    u64 cachedMemory;
+
+    // 0 when all free memory is one contiguous block, approaches 1 as it gets split into smaller pieces
+    f32 fragmentation;
+
+    u64 numAllocs;
+    u64 numFrees;
+    u64 numSplits;
+    u64 numMerges;
+    u64 numCacheHits;
+    u64 numRelocations;
+    u64 relocatedMemory;
+};
+
+//////////////////////////////
+// Handle table
+//
+
+// Assets live in pages of slots. Pages are never moved or freed, so a slot pointer stays valid forever and lookups
+// don't need a lock. A handle is the slot index + the slot generation at the time of allocation.
+#define AS_SLOT_PAGE_SIZE_LOG2 8
+#define AS_SLOT_PAGE_SIZE      (1 << AS_SLOT_PAGE_SIZE_LOG2)
+#define AS_SLOT_MAX_PAGES      256
+#define AS_MAX_ASSETS          (AS_SLOT_PAGE_SIZE * AS_SLOT_MAX_PAGES)
+
+// NOTE: hammers the slot map and AS_FreeAsset from the job system on startup
+#ifndef AS_SLOT_MAP_STRESS_TEST
+#define AS_SLOT_MAP_STRESS_TEST 0
+#endif
+
+struct AS_Slot;
+struct AS_SlotMap
+{
+    std::atomic<AS_Slot *> pages[AS_SLOT_MAX_PAGES];
+
+    // Free list head. Low 32 bits are the slot index + 1 (0 = empty), high 32 bits are a counter that's bumped on
+    // every pop to avoid ABA.
+    std::atomic<u64> freeHead;
+
+    // Slots below this have been handed out at least once
+    std::atomic<i32> endOfList;
+};
+
+//////////////////////////////
+// Statistics
+//
+
+enum AS_Type
+{
+    AS_Null,
+    AS_Mesh,
+    AS_Texture,
+    AS_Font,
+    AS_Skeleton,
+    AS_Anim,
+    AS_Model,
+    AS_Count,
+};
+
+enum AS_LoadPhase
+{
+    AS_LoadPhase_Queued, // Enqueued, waiting for the scanner thread
+    AS_LoadPhase_Read,   // Reading the file
+    AS_LoadPhase_Decode, // Parsing/decoding on the job system (stbi, LoadDDS, model parse)
+    AS_LoadPhase_Upload, // Waiting for the gpu copy to finish. Only tracked for textures.
+    AS_LoadPhase_Count,
+};
+
+// Log2 buckets. Bucket 0 is < AS_STATS_BUCKET_MIN_MS, the last bucket holds everything >= ~1 second.
+#define AS_STATS_BUCKET_COUNT        16
+#define AS_STATS_BUCKET_MIN_MS       (1.f / 16.f)
+#define AS_STATS_MAX_PENDING_UPLOADS 1024
+
+struct AS_LoadTrace
+{
+    PerformanceCounter phaseStart[AS_LoadPhase_Count];
+    f32 phaseMs[AS_LoadPhase_Count];
+    u64 bytes;
+    u32 numLoads;
+    b32 active;
+};
+
+struct AS_PhaseHistogram
+{
+    u64 counts[AS_STATS_BUCKET_COUNT];
+    u64 samples;
+    f64 totalMs;
+    f32 maxMs;
+};
+
+struct AS_TypeStats
+{
+    AS_PhaseHistogram phases[AS_LoadPhase_Count];
+    u64 numLoads;
+    u64 bytes;
+};
+
+struct AS_CacheStats
+{
+    AS_TypeStats types[AS_Count];
+
+    // Scanner thread throughput
+    u64 bytesRead;
+    f64 readMs;
+
+    // Wall clock from the first enqueue to the last finished load
+    f32 firstQueuedSeconds;
+    f32 lastLoadedSeconds;
+};
+
+struct AS_StatsState
+{
+    TicketMutex mutex;
+    AS_CacheStats stats;
+
+    AS_Handle pendingUploads[AS_STATS_MAX_PENDING_UPLOADS];
+    u32 numPendingUploads;
 };
 
 //////////////////////////////
@@ -189,20 +375,18 @@ struct AS_CacheState
     //     i32 numStripes;
     // #endif
 
-    // TODO: should this be an array of pointers?. this would make it so that reallocations could be possible
-    // without compromising pointer integrity
-    AS_Asset **assets;
-    i32 assetCapacity;
-    i32 assetCount;
-    i32 assetEndOfList;
-
-    // free list, only for assets that have been allocated then deallocated
-    i32 *freeAssetList;
-    i32 freeAssetCount;
+    AS_SlotMap slots;
+    std::atomic<i32> assetCount;
 
     // inspired by idHashIndex
+    // NOTE: only the path -> asset hash is protected by the lock, handle lookups are lock free
     HashIndex fileHash;
 
+    // Content hash -> asset that owns the payload. Files with identical contents share one loaded asset.
+    HashIndex contentHash;
+    u64 numDedupedAssets;
+    u64 dedupedBytes;
+
     // Tag Maps for assets
     AS_TagMap tagMap;
 
@@ -218,19 +402,9 @@ struct AS_CacheState
 
     AS_DynamicBlockAllocator allocator;
 
-    Mutex lock;
-};
+    AS_StatsState statsState;
 
-enum AS_Type
-{
-    AS_Null,
-    AS_Mesh,
-    AS_Texture,
-    AS_Font,
-    AS_Skeleton,
-    AS_Anim,
-    AS_Model,
-    AS_Count,
+    Mutex lock;
 };
 
 enum AS_Status
@@ -238,6 +412,8 @@ enum AS_Status
     AS_Status_Unloaded,
     AS_Status_Queued,
     AS_Status_Loaded,
+    // Taken by the one AS_FreeAsset that owns the free, keeps compaction and hotloading away from the payload
+    AS_Status_Freeing,
 };
 
 struct Font
@@ -264,10 +440,21 @@ struct AS_Asset
     u64 lastModified;
     string path;
     std::atomic<u32> status;
+    // A hotload arrived while the asset was loading or being moved. It's requeued once the asset is loaded, see
+    // AS_SetLoaded.
+    std::atomic<b32> reloadPending;
 
-    // TODO: intrusive. may be bad? idk
+    // Index of the slot
     i32 id;
-    i32 generation;
+
+    // Deduplication. If canonicalId != 0, this asset has no payload of its own and handles resolve to the
+    // canonical asset. refCount is the number of assets sharing the canonical payload (including itself).
+    u64 contentHash;
+    i32 canonicalId;
+    i32 refCount;
+
+    // Timing of the most recent load
+    AS_LoadTrace trace;
 
     // Asset type
     AS_MemoryBlockNode *memoryBlock;
@@ -284,6 +471,19 @@ struct AS_Asset
     ~AS_Asset() {} // TODO: ?!?!?!?!?!?!?!?!??!?!
 };
 
+struct AS_Slot
+{
+    AS_Asset asset;
+
+    // Incremented when the slot is freed, which invalidates all outstanding handles
+    std::atomic<u32> generation;
+
+    // Free list link, slot index + 1
+    std::atomic<u32> nextFree;
+
+    u8 pathBuffer[MAX_OS_PATH];
+};
+
 internal void AS_Init();
 internal u64 RingRead(u8 *base, u64 ringSize, u64 readPos, void *dest, u64 destSize);
 internal u64 RingWrite(u8 *base, u64 ringSize, u64 writePos, void *src, u64 srcSize);
@@ -294,10 +494,27 @@ internal b32 AS_EnqueueFile(string path);
 internal string AS_DequeueFile(Arena *arena);
 
 THREAD_ENTRY_POINT(AS_EntryPoint);
-internal void AS_HotloadEntryPoint(void *p);
+THREAD_ENTRY_POINT(AS_HotloadEntryPoint);
+internal i32 AS_FindAssetId(string path);
+internal void AS_HotloadAsset(i32 assetId);
+internal void AS_SetLoaded(AS_Asset *asset);
 internal void AS_LoadAsset(AS_Asset *asset);
 internal void AS_UnloadAsset(AS_Asset *asset);
 
+internal b32 AS_IsSRGBTexture(string path);
+internal b32 AS_DedupeAsset(AS_Asset *asset);
+internal void AS_ReleaseAlias(AS_Asset *asset);
+internal void AS_ReleaseAliases(AS_Asset *asset);
+
+internal void AS_BeginLoadTrace(AS_Asset *asset);
+internal void AS_BeginPhase(AS_Asset *asset, AS_LoadPhase phase);
+internal void AS_EndPhase(AS_Asset *asset, AS_LoadPhase phase);
+internal void AS_FinishLoadTrace(AS_Asset *asset);
+internal void AS_BeginUploadTrace(AS_Asset *asset);
+internal void AS_UpdateLoadTraces();
+internal AS_CacheStats AS_GetCacheStats();
+internal b32 AS_DumpCacheStats(string filename);
+
 //////////////////////////////
 // Handles
 //
@@ -307,10 +524,21 @@ global readonly graphics::Texture textureNil;
 global readonly KeyframedAnimation animNil;
 global readonly Font fontNil;
 
+internal AS_Slot *AS_GetSlot(i32 index);
+internal AS_Asset *AS_GetAssetFromId(i32 id);
+internal i32 AS_AllocSlot();
+internal void AS_FreeSlot(i32 index);
+internal AS_Handle AS_GetHandle(AS_Asset *asset);
+internal AS_Asset *AS_GetSlotAsset(AS_Handle handle);
+#if AS_SLOT_MAP_STRESS_TEST
+internal void AS_SlotMapStressTest();
+#endif
+
 internal AS_Asset *AS_AllocAsset(const string inPath, b8 queueFile = 1);
 internal Font *GetFont(AS_Handle handle);
 internal AS_Asset *AS_GetAssetFromHandle(AS_Handle handle);
 internal AS_Handle AS_GetAsset(const string inPath, const b32 inLoadIfNotFound = 1);
+internal AS_Handle AS_GetTextureAsset(Arena *arena, string textureName);
 internal LoadedSkeleton *GetSkeleton(AS_Handle handle);
 // internal LoadedSkeleton *GetSkeletonFromModel(AS_Handle handle);
 internal KeyframedAnimation *GetAnim(AS_Handle handle);
@@ -326,25 +554,31 @@ inline b8 IsFontNil(Font *font)
 }
 
 //////////////////////////////
-// B tree
+// TLSF memory allocation
 //
 
 // Main functions
-internal AS_MemoryBlockNode *AS_Alloc(i32 size);
+internal AS_MemoryBlockNode *AS_Alloc(u64 size, AS_Asset *owner = 0);
 internal void AS_Free(AS_Asset *asset);
 internal void AS_Free(void **ptr);
 internal u8 *AS_GetMemory(AS_Asset *asset);
+internal void AS_Compact(u64 budget);
+internal AS_AllocatorStats AS_GetAllocatorStats();
+internal void AS_PrintAllocatorStats();
 
 // Helpers
 internal void AS_InitializeAllocator();
 internal void AS_Free(AS_MemoryBlockNode *memoryBlock);
-internal AS_BTreeNode *AS_AllocNode();
-internal AS_BTreeNode *AS_AddNode(AS_MemoryBlockNode *memNode);
-internal void AS_RemoveNode(AS_BTreeNode *node);
-internal void AS_SplitNode(AS_BTreeNode *node);
-internal AS_BTreeNode *AS_MergeNodes(AS_BTreeNode *node1, AS_BTreeNode *node2);
-internal AS_BTreeNode *AS_FindMemoryBlock(i32 size);
+internal void AS_MappingInsert(u64 size, u32 *fl, u32 *sl);
+internal void AS_MappingSearch(u64 size, u32 *fl, u32 *sl);
+internal void AS_InsertFreeBlock(AS_MemoryBlockNode *block);
+internal void AS_RemoveFreeBlock(AS_MemoryBlockNode *block);
+internal AS_MemoryBlockNode *AS_FindFreeBlock(u64 size);
+internal AS_MemoryPool *AS_AddPool(u64 size);
+internal AS_MemoryBlockNode *AS_GetNextPhysical(AS_MemoryBlockNode *block);
 internal u8 *AS_GetMemory(AS_MemoryBlockNode *node);
+internal b32 AS_IsRelocatable(AS_Asset *asset);
+internal void AS_RelocateAsset(AS_Asset *asset, u8 *oldMemory, u8 *newMemory);
 
 internal void LoadDDS(AS_Asset *asset);
 
@@ -166,6 +166,15 @@ G_INIT(G_Init)
         gameScene->Init(sceneArena);
         // F_Init();
         D_Init();
+#if ANIMATION_REMAP_BENCHMARK
+        AnimationRemapBenchmark();
+#endif
+#if ANIMATION_SAMPLE_BENCHMARK
+        AnimationSampleBenchmark();
+#endif
+#if SKINNING_BENCHMARK
+        SkinningBenchmark();
+#endif
 
         G_State *g_state = PushStruct(permanentArena, G_State);
         engine->SetGameState(g_state);
@@ -202,15 +211,17 @@ G_INIT(G_Init)
 
             // g_state->numEntities = 3;
 
-            AS_Handle anim;
-            AnimationPlayer *aPlayer;
-            anim    = AS_GetAsset(Str8Lit("data/animations/Qishilong_attack01.anim"));
-            aPlayer = &g_state->mAnimPlayers[0];
-            StartLoopedAnimation(aPlayer, anim);
-
-            anim    = AS_GetAsset(Str8Lit("data/animations/Mon_BlackDragon31_Btl_Atk01.anim"));
-            aPlayer = &g_state->mAnimPlayers[1];
-            StartLoopedAnimation(aPlayer, anim);
+            // Skeletons are named after the model
+            G_State::StartupAnimation *startups = g_state->startupAnimations;
+            startups[0].skeletonSid             = AddSID(Str8Lit("dragon"));
+            startups[0].animation               = AS_GetAsset(Str8Lit("data/animations/Qishilong_attack01.anim"));
+            startups[1].skeletonSid             = AddSID(Str8Lit("hero"));
+            startups[1].animation = AS_GetAsset(Str8Lit("data/animations/Mon_BlackDragon31_Btl_Atk01.anim"));
+#if REST_POSE_TEST_SCENE
+            g_state->startupAnimationCount = 1;
+#else
+            g_state->startupAnimationCount = 2;
+#endif
         }
 
         // g_state->eva    = AS_GetAsset(Str8Lit("data/eva/Eva01.model"));
@@ -290,6 +301,43 @@ internal OS_Event *GetEventType(OS_Events *events, OS_EventType type)
     return result;
 }
 
+// Levels are allowed to be off by at most this many pixels
+const f32 lodErrorThreshold = 1.f;
+// Bones sampled per frame before animation updates of small instances are pushed to later frames, 0 is unlimited
+const u32 animationBoneBudget = 16384;
+
+// Picks the coarsest level of detail whose error projects to less than lodErrorThreshold pixels
+// Pixels covered by one unit of mesh space at the closest point of the bounds
+internal f32 GetMeshPixelsPerUnit(Mesh *mesh, Mat4 transform, RenderState *renderState, f32 screenHeight)
+{
+    Rect3 worldBounds = Transform(transform, mesh->bounds);
+    V3 center         = GetCenter(worldBounds);
+    f32 radius        = Length(worldBounds.maxP - center);
+    f32 meshRadius    = Length(mesh->bounds.maxP - GetCenter(mesh->bounds));
+    f32 scale         = meshRadius > 0.f ? radius / meshRadius : 1.f;
+
+    // The camera could be inside
+    f32 distance = Max(Length(center - renderState->camera.position) - radius, renderState->nearZ);
+    f32 result   = scale * screenHeight / (2.f * Tan(renderState->fov * 0.5f) * distance);
+    return result;
+}
+
+internal u32 SelectMeshLod(Mesh *mesh, Mat4 transform, RenderState *renderState, f32 screenHeight)
+{
+    f32 pixelsPerUnit = GetMeshPixelsPerUnit(mesh, transform, renderState, screenHeight);
+
+    u32 result = 0;
+    for (u32 lodIndex = mesh->numLods - 1; lodIndex > 0; lodIndex--)
+    {
+        if (mesh->lods[lodIndex].error * pixelsPerUnit <= lodErrorThreshold)
+        {
+            result = lodIndex;
+            break;
+        }
+    }
+    return result;
+}
+
 using namespace graphics;
 using namespace scene;
 // using namespace render;
@@ -301,11 +349,17 @@ DLL G_UPDATE(G_Update)
     RenderState *renderState = engine->GetRenderState();
     ArenaClear(g_state->frameArena);
 
+    // Fill the holes left behind by hotloading
+    AS_Compact(megabytes(4));
+    AS_UpdateLoadTraces();
+
     //////////////////////////////
     // Input
     //
 
     G_Input *playerController;
+    b32 logDagCut       = 0;
+    b32 logAnimationLod = 0;
     // TODO: move polling to a different frame?
     {
         I_PollInput();
@@ -351,6 +405,22 @@ DLL G_UPDATE(G_Update)
             }
         }
         playerController = newInput;
+
+        // Dump asset load timings
+        OS_Event *dumpEvent = GetKeyEvent(&events, OS_Key_F6);
+        if (dumpEvent && dumpEvent->type == OS_EventType_KeyPressed)
+        {
+            AS_DumpCacheStats(Str8Lit("asset_stats.json"));
+            AS_DumpCacheStats(Str8Lit("asset_stats.csv"));
+        }
+
+        // Log the cluster DAG cut of every mesh
+        OS_Event *dagEvent = GetKeyEvent(&events, OS_Key_F7);
+        logDagCut          = dagEvent && dagEvent->type == OS_EventType_KeyPressed;
+
+        // Log how much animation work the level of detail saved this frame
+        OS_Event *animationLodEvent = GetKeyEvent(&events, OS_Key_F8);
+        logAnimationLod             = animationLodEvent && animationLodEvent->type == OS_EventType_KeyPressed;
     }
 
     // RenderState *renderState = PushStruct(g_state->frameArena, RenderState);
@@ -546,12 +616,44 @@ DLL G_UPDATE(G_Update)
 
     // Process component system requests
 
+    // Start the startup animations on the first instance of their skeleton, the parent of its skinned meshes
+    for (MeshIter iter = gameScene->BeginMeshIter();
+         g_state->startupAnimationCount && !gameScene->End(&iter); gameScene->Next(&iter))
+    {
+        Entity entity                 = gameScene->GetEntity(&iter);
+        LoadedSkeleton *skeleton      = gameScene->skeletons.GetFromEntity(entity);
+        HierarchyComponent *hierarchy = gameScene->hierarchy.Get(entity);
+        if (!skeleton || !hierarchy || hierarchy->parent == 0 || gameScene->animations.Get(hierarchy->parent))
+        {
+            continue;
+        }
+        for (u32 i = 0; i < g_state->startupAnimationCount; i++)
+        {
+            G_State::StartupAnimation *startup = &g_state->startupAnimations[i];
+            if (startup->skeletonSid == skeleton->sid)
+            {
+                AnimationComponent *animation = gameScene->animations.Create(hierarchy->parent, skeleton->sid);
+                StartLoopedAnimation(&animation->layers[0], startup->animation);
+                *startup = g_state->startupAnimations[--g_state->startupAnimationCount];
+                break;
+            }
+        }
+    }
+
+    // Skeletons hold the rest pose for meshes outside of an animated instance, each instance skins into its own range
     for (SkeletonIter iter = gameScene->BeginSkelIter(); !gameScene->End(&iter); gameScene->Next(&iter))
     {
         LoadedSkeleton *skeleton = gameScene->Get(&iter);
         skeleton->skinningOffset = totalMatrixCount;
         totalMatrixCount += skeleton->count;
     }
+    for (u32 i = 0; i < gameScene->animations.GetTotal(); i++)
+    {
+        AnimationComponent *animation = gameScene->animations.GetFromIndex(i);
+        LoadedSkeleton *skeleton      = gameScene->skeletons.GetFromSid(animation->skeletonSid);
+        animation->skinningOffset     = totalMatrixCount;
+        totalMatrixCount += skeleton ? skeleton->count : 0;
+    }
 
     // TODO: this should probably be r_framealloced for the renderer backend to use
     // TODO: all children must be ensured to be after parents in hierarchycomponent
@@ -579,6 +681,7 @@ DLL G_UPDATE(G_Update)
     {
         Mesh *mesh = gameScene->Get(&iter);
         Assert(mesh->numSubsets >= 1);
+        // Upper bound, the levels of detail are selected later
         totalMeshClusterCount += mesh->clusterCount;
     }
     render::meshClusterCount = totalMeshClusterCount;
@@ -667,23 +770,105 @@ DLL G_UPDATE(G_Update)
     MeshGeometry *meshGeometryMappedData = (MeshGeometry *)meshGeometryUpload->mappedData;
     ShaderMaterial *materialMappedData   = (ShaderMaterial *)materialUpload->mappedData;
 
-    for (SkeletonIter iter = gameScene->BeginSkelIter(); !gameScene->End(&iter); gameScene->Next(&iter))
+    f32 screenHeight = platform.GetWindowDimension(shared->windowHandle).y;
+
+    // Animation. Loading, remapping and picking the level of detail happen here, then the layers are evaluated and
+    // skinned across the job threads. Each skeleton is also skinned in its rest pose for meshes outside of an animated
+    // instance.
     {
-        LoadedSkeleton *skeleton   = gameScene->Get(&iter);
-        AnimationTransform *tforms = PushArray(g_state->frameArena, AnimationTransform, skeleton->count);
+        u32 rangeId = TIMED_CPU_RANGE_NAME_BEGIN("Animation");
 
-        u32 globalIndex = iter.globalIndex;
-        PlayCurrentAnimation(&g_state->mAnimPlayers[globalIndex], dt, tforms);
-        SkinModelToAnimation(&g_state->mAnimPlayers[globalIndex], skeleton, tforms,
-                             skinningMappedData + skeleton->skinningOffset);
+        // Projected size of the animated instances, from the largest of their meshes
+        for (u32 i = 0; i < gameScene->animations.GetTotal(); i++)
+        {
+            gameScene->animations.GetFromIndex(i)->lod.pixelsPerUnit = 0.f;
+        }
+        for (MeshIter iter = gameScene->BeginMeshIter(); !gameScene->End(&iter); gameScene->Next(&iter))
+        {
+            Mesh *mesh                    = gameScene->Get(&iter);
+            Entity entity                 = gameScene->GetEntity(&iter);
+            LoadedSkeleton *skeleton      = gameScene->skeletons.GetFromEntity(entity);
+            AnimationComponent *animation = skeleton ? gameScene->GetAnimation(entity) : 0;
+            if (animation)
+            {
+                Mat4 transform               = frameTransforms[gameScene->transforms.GetIndex(entity)];
+                f32 pixelsPerUnit            = GetMeshPixelsPerUnit(mesh, transform, renderState, screenHeight);
+                animation->lod.pixelsPerUnit = Max(animation->lod.pixelsPerUnit, pixelsPerUnit);
+            }
+        }
 
-        Init(&skeleton->aabb);
-        for (u32 boneIndex = 0; boneIndex < skeleton->count; boneIndex++)
+        struct SkeletonUpdate
         {
-            V3 bonePos   = skinningMappedData[skeleton->skinningOffset + boneIndex] * -GetTranslation(skeleton->inverseBindPoses[boneIndex]);
-            Rect3 bounds = MakeRect3Center(bonePos, {1.f, 1.f, 1.f});
-            AddBounds(skeleton->aabb, bounds);
+            LoadedSkeleton *skeleton;
+            AnimationComponent *animation;
+        };
+        u32 skeletonCount       = gameScene->skeletons.GetTotal();
+        u32 animationCount      = gameScene->animations.GetTotal();
+        SkeletonUpdate *updates = PushArrayNoZero(g_state->frameArena, SkeletonUpdate, skeletonCount + animationCount);
+        AnimationLod **lods     = PushArrayNoZero(g_state->frameArena, AnimationLod *, animationCount);
+        u32 updateCount         = 0;
+        u32 lodCount            = 0;
+        for (SkeletonIter iter = gameScene->BeginSkelIter(); !gameScene->End(&iter); gameScene->Next(&iter))
+        {
+            LoadedSkeleton *skeleton = gameScene->Get(&iter);
+            PrepareSkeleton(gameScene->arena, skeleton);
+
+            SkeletonUpdate *update = &updates[updateCount++];
+            update->skeleton       = skeleton;
+            update->animation      = 0;
         }
+        for (u32 i = 0; i < animationCount; i++)
+        {
+            AnimationComponent *animation = gameScene->animations.GetFromIndex(i);
+            LoadedSkeleton *skeleton      = gameScene->skeletons.GetFromSid(animation->skeletonSid);
+            if (!skeleton)
+            {
+                continue;
+            }
+            PrepareAnimationLayers(gameScene->arena, skeleton, animation->layers, animation->layerCount);
+            UpdateAnimationLod(gameScene->arena, &animation->lod, skeleton, dt);
+            lods[lodCount++] = &animation->lod;
+
+            SkeletonUpdate *update = &updates[updateCount++];
+            update->skeleton       = skeleton;
+            update->animation      = animation;
+        }
+
+        AnimationLodStats lodStats;
+        ScheduleAnimationLods(lods, lodCount, animationBoneBudget, &lodStats);
+        if (logAnimationLod)
+        {
+            Printf("Animation LOD: %u instances, %u evaluated, %u throttled, %u deferred by the budget. %u of %u bones "
+                   "sampled (%.1f%% saved)\n",
+                   lodStats.instances, lodStats.evaluated, lodStats.throttled, lodStats.deferred, lodStats.bonesSampled,
+                   lodStats.bonesTotal,
+                   lodStats.bonesTotal ? 100.f * (1.f - (f32)lodStats.bonesSampled / lodStats.bonesTotal) : 0.f);
+        }
+
+        jobsystem::Counter counter = {};
+        jobsystem::KickJobs(&counter, updateCount, Max(1u, (updateCount + 63) / 64), [&](jobsystem::JobArgs args) {
+            SkeletonUpdate *update   = &updates[args.jobId];
+            LoadedSkeleton *skeleton = update->skeleton;
+
+            TempArena temp                = ScratchStart(0, 0);
+            AnimationPose pose            = PushPose(temp.arena, skeleton->count);
+            AnimationComponent *animation = update->animation;
+            if (animation)
+            {
+                EvaluateAnimationLod(skeleton, animation->layers, animation->layerCount, &animation->lod, &pose,
+                                     &animation->rootMotion);
+                SkinModelToAnimation(skeleton, &pose, skinningMappedData + animation->skinningOffset,
+                                     &animation->aabb);
+            }
+            else
+            {
+                EvaluateAnimationLayers(skeleton, 0, 0, dt, &pose);
+                SkinModelToAnimation(skeleton, &pose, skinningMappedData + skeleton->skinningOffset, &skeleton->aabb);
+            }
+            ScratchEnd(temp);
+        });
+        jobsystem::WaitJobs(&counter);
+        TIMED_RANGE_END(rangeId);
     }
 
     for (MaterialIter iter = gameScene->BeginMatIter(); !gameScene->End(&iter); gameScene->Next(&iter))
@@ -776,12 +961,46 @@ DLL G_UPDATE(G_Update)
         MeshParams *meshParams   = &meshParamsMappedData[mesh->meshIndex];
         meshParams->localToWorld = transform;
 
+        mesh->lodIndex = SelectMeshLod(mesh, transform, renderState, screenHeight);
+        Mesh::Lod *lod = &mesh->lods[mesh->lodIndex];
+
         meshParams->minP          = mesh->bounds.minP; // mesh space
         meshParams->maxP          = mesh->bounds.maxP;
-        meshParams->clusterOffset = mesh->clusterOffset;
-        meshParams->clusterCount  = mesh->clusterCount;
+        // Culls with the animated bounds. Skinned meshes read the float output of the skinning pass, so the bounds
+        // aren't needed to dequantize their positions.
+        LoadedSkeleton *skeleton = gameScene->skeletons.GetFromEntity(entity);
+        if (skeleton)
+        {
+            AnimationComponent *animation = gameScene->GetAnimation(entity);
+            Rect3 aabb                    = animation ? animation->aabb : skeleton->aabb;
+            if (aabb.minX <= aabb.maxX)
+            {
+                meshParams->minP = aabb.minP;
+                meshParams->maxP = aabb.maxP;
+            }
+        }
+        meshParams->clusterOffset = mesh->clusterOffset + lod->clusterStart;
+        meshParams->clusterCount  = lod->clusterCount;
+
+        totalClusterCount += lod->clusterCount;
 
-        totalClusterCount += mesh->clusterCount;
+        if (logDagCut && mesh->numDagNodes)
+        {
+            TempArena temp      = ScratchStart(0, 0);
+            u32 *cut            = PushArrayNoZero(temp.arena, u32, mesh->numDagNodes);
+            V3 viewPos          = Inverse(transform) * renderState->camera.position;
+            f32 projectionScale = screenHeight / (2.f * Tan(renderState->fov * 0.5f));
+            u32 cutCount        = SelectDagCut(mesh->dagNodes, mesh->numDagNodes, viewPos, projectionScale,
+                                               lodErrorThreshold, cut);
+            u32 triangleCount   = 0;
+            for (u32 cutIndex = 0; cutIndex < cutCount; cutIndex++)
+            {
+                triangleCount += mesh->clusters[mesh->dagNodes[cut[cutIndex]].clusterIndex].indexCount / 3;
+            }
+            Printf("Mesh %u: dag cut %u clusters, %u triangles (lod %u: %u clusters)\n", iter.globalIndex, cutCount,
+                   triangleCount, mesh->lodIndex, lod->clusterCount);
+            ScratchEnd(temp);
+        }
 
         MeshGeometry *geometry = &meshGeometryMappedData[mesh->meshIndex];
         geometry->vertexPos    = mesh->posDescriptor;
@@ -789,9 +1008,13 @@ DLL G_UPDATE(G_Update)
         geometry->vertexTan    = mesh->tanDescriptor;
         geometry->vertexUv     = mesh->vertexUvView.srvDescriptor;
         geometry->vertexInd    = mesh->indexView.srvDescriptor;
+        // Skinned meshes read the float output of the skinning pass
+        geometry->flags = HasFlags(mesh->flags, MeshFlags_Quantized) && !mesh->vertexBoneIdView.IsValid()
+                              ? MESH_GEOMETRY_QUANTIZED
+                              : 0;
     }
 
-    Assert(totalClusterCount == totalMeshClusterCount);
+    Assert(totalClusterCount <= totalMeshClusterCount);
     render::meshClusterCount = totalClusterCount;
 
     // DebugDrawSkeleton(g_state->model, transform1, skinningMappedData);
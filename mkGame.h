@@ -27,6 +27,11 @@
 
 #include "mkDebug.h"
 
+// Leaves the hero without an animation on startup, so its skinned meshes are drawn in the skeleton's rest pose
+#ifndef REST_POSE_TEST_SCENE
+#define REST_POSE_TEST_SCENE 0
+#endif
+
 //////////////////////////////
 // Input
 //
@@ -185,12 +190,20 @@ struct G_State
     EntitySlotNode *freeNode;
 
     game::Entity mEntities[4];
-    AnimationPlayer mAnimPlayers[4];
     // u32 numEntities;
 
     Mat4 mTransforms[4];
     u32 transformCount;
 
+    // Started on the first instance of the skeleton once its model has been merged into the scene
+    struct StartupAnimation
+    {
+        u32 skeletonSid;
+        AS_Handle animation;
+    };
+    StartupAnimation startupAnimations[4];
+    u32 startupAnimationCount;
+
     // AS_Handle model;
     // AS_Handle model2;
     // AS_Handle eva;
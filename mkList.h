@@ -331,7 +331,7 @@ struct HashIndex
         hashMask       = inHashSize - 1;
         hash           = new i32[inHashSize];
         MemorySet(hash, 0xff, sizeof(hash[0]) * hashSize);
-        indexChain = new i32[inHashSize];
+        indexChain = new i32[inChainSize];
         MemorySet(indexChain, 0xff, sizeof(indexChain[0]) * indexChainSize);
     }
 
@@ -372,7 +372,7 @@ struct HashIndex
         i32 slot   = key & hashMask;
         if (hash[slot] == index)
         {
-            hash[slot] = -1;
+            hash[slot] = indexChain[index];
             result     = 1;
         }
         else
@@ -2170,6 +2170,89 @@ inline f32 DecompressFloat(u32 a, f32 min, f32 max, u32 nBits)
     return result;
 }
 
+// Octahedral unit vector, two snorm16 (R16G16_SNORM)
+inline u32 EncodeOctahedral(V3 n)
+{
+    f32 length = Abs(n.x) + Abs(n.y) + Abs(n.z);
+    f32 x      = length == 0.f ? 0.f : n.x / length;
+    f32 y      = length == 0.f ? 0.f : n.y / length;
+    if (n.z < 0.f)
+    {
+        f32 oldX = x;
+        x        = (1.f - Abs(y)) * (x >= 0.f ? 1.f : -1.f);
+        y        = (1.f - Abs(oldX)) * (y >= 0.f ? 1.f : -1.f);
+    }
+    i16 qx     = (i16)Round(Clamp(x, -1.f, 1.f) * 32767.f);
+    i16 qy     = (i16)Round(Clamp(y, -1.f, 1.f) * 32767.f);
+    u32 result = (u32)(u16)qx | ((u32)(u16)qy << 16);
+    return result;
+}
+
+inline V3 DecodeOctahedral(u32 encoded)
+{
+    f32 x = Max((f32)(i16)(encoded & 0xffff) / 32767.f, -1.f);
+    f32 y = Max((f32)(i16)(encoded >> 16) / 32767.f, -1.f);
+    V3 n  = {x, y, 1.f - Abs(x) - Abs(y)};
+    f32 t = Max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return Normalize(n);
+}
+
+// IEEE half, rounded to nearest. Overflow goes to infinity, NaNs are not preserved.
+inline u16 FloatToHalf(f32 value)
+{
+    union
+    {
+        f32 f;
+        u32 u;
+    } bits;
+    bits.f       = value;
+    u32 sign     = (bits.u >> 16) & 0x8000;
+    i32 exponent = (i32)((bits.u >> 23) & 0xff) - 127 + 15;
+    u32 mantissa = bits.u & 0x7fffff;
+    if (exponent >= 31)
+    {
+        return (u16)(sign | 0x7c00);
+    }
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+        {
+            return (u16)sign;
+        }
+        mantissa |= 0x800000;
+        u32 shift  = (u32)(14 - exponent);
+        u32 result = mantissa >> shift;
+        result += (mantissa >> (shift - 1)) & 1;
+        return (u16)(sign | result);
+    }
+    // A carry out of the mantissa correctly bumps the exponent
+    u32 result = sign | ((u32)exponent << 10) | (mantissa >> 13);
+    result += (mantissa >> 12) & 1;
+    return (u16)result;
+}
+
+inline f32 HalfToFloat(u16 half)
+{
+    union
+    {
+        f32 f;
+        u32 u;
+    } bits;
+    u32 sign     = (u32)(half & 0x8000) << 16;
+    u32 exponent = (half >> 10) & 0x1f;
+    u32 mantissa = half & 0x3ff;
+    if (exponent == 0)
+    {
+        f32 result = (f32)mantissa * (1.f / 16777216.f);
+        return sign ? -result : result;
+    }
+    bits.u = exponent == 31 ? (sign | 0x7f800000 | (mantissa << 13))
+                            : (sign | ((exponent - 15 + 127) << 23) | (mantissa << 13));
+    return bits.f;
+}
+
 inline u32 GetHighestBit(u64 num)
 {
     if (num == 0) return 0;
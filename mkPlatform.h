@@ -57,6 +57,23 @@ struct OS_FileIter
     u8 memory[600];
 };
 
+// Changes reported by a directory watch. Paths are the watched path + the relative path of the file, with forward
+// slashes. Multiple notifications for the same file in one batch are coalesced into one.
+struct OS_FileChange
+{
+    OS_FileChange *next;
+    string path;
+};
+
+struct OS_FileChanges
+{
+    OS_FileChange *first;
+    OS_FileChange *last;
+    u32 count;
+    // Too many changes happened at once and some were dropped. Everything under the directory may have changed.
+    b32 overflow;
+};
+
 struct ThreadContext;
 #define THREAD_ENTRY_POINT(name) void name(void *ptr, ThreadContext *ctx)
 typedef THREAD_ENTRY_POINT(OS_ThreadFunction);
@@ -297,6 +314,13 @@ OS_FileIter OS_DirectoryIterStart(string path, OS_FileIterFlags flags);
 b32 OS_DirectoryIterNext(Arena *arena, OS_FileIter *input, OS_FileProperties *out);
 void OS_DirectoryIterEnd(OS_FileIter *input);
 
+//////////////////////////////
+// File watching
+//
+OS_Handle OS_WatchDirectory(string path);
+OS_FileChanges OS_WaitFileChanges(Arena *arena, OS_Handle watch, u32 timeoutMs);
+void OS_CloseDirectoryWatch(OS_Handle watch);
+
 string OS_GetBinaryDirectory();
 void OS_ToggleFullscreen(OS_Handle handle);
 b32 OS_WindowIsFocused(OS_Handle handle);
@@ -1065,6 +1065,111 @@ inline LoadedSkeleton *SkeletonManager::Get(SkeletonIter *iter)
     return skel;
 }
 
+//////////////////////////////
+// Animation
+//
+void AnimationManager::Init(Scene *inScene)
+{
+    parentScene        = inScene;
+    entityMap          = PushArray(parentScene->arena, AnimationSlot, numAnimationSlots);
+    freeSlotNodes      = 0;
+    chunks             = PushArray(parentScene->arena, AnimationChunkNode *, maxAnimationChunks);
+    numChunkNodes      = 0;
+    totalNumAnimations = 0;
+}
+
+AnimationManager::AnimationSlotNode *AnimationManager::GetSlotNode(Entity entity)
+{
+    AnimationSlot *slot      = &entityMap[entity & animationSlotMask];
+    AnimationSlotNode *found = 0;
+    for (AnimationSlotNode *node = slot->first; node != 0; node = node->next)
+    {
+        if (node->entity == entity)
+        {
+            found = node;
+            break;
+        }
+    }
+    return found;
+}
+
+AnimationComponent *AnimationManager::Create(Entity entity, u32 skeletonSid)
+{
+    Assert(entity != 0 && GetSlotNode(entity) == 0);
+    u32 index = totalNumAnimations++;
+    if ((index >> animationChunkShift) == numChunkNodes)
+    {
+        Assert(numChunkNodes < maxAnimationChunks);
+        chunks[numChunkNodes++] = PushStruct(parentScene->arena, AnimationChunkNode);
+    }
+
+    AnimationSlotNode *slotNode = freeSlotNodes;
+    if (slotNode)
+    {
+        StackPop(freeSlotNodes);
+    }
+    else
+    {
+        slotNode = PushStruct(parentScene->arena, AnimationSlotNode);
+    }
+    slotNode->entity    = entity;
+    slotNode->index     = index;
+    AnimationSlot *slot = &entityMap[entity & animationSlotMask];
+    QueuePush(slot->first, slot->last, slotNode);
+
+    AnimationComponent *component = GetFromIndex(index);
+    *component                    = {};
+    component->entity             = entity;
+    component->skeletonSid        = skeletonSid;
+    component->layerCount         = 1;
+    component->layers[0].weight   = 1.f;
+    return component;
+}
+
+b32 AnimationManager::Remove(Entity entity)
+{
+    AnimationSlot *slot     = &entityMap[entity & animationSlotMask];
+    AnimationSlotNode *prev = 0;
+    for (AnimationSlotNode *node = slot->first; node != 0; node = node->next)
+    {
+        if (node->entity == entity)
+        {
+            if (prev)
+            {
+                prev->next = node->next;
+            }
+            else
+            {
+                slot->first = node->next;
+            }
+            if (slot->last == node)
+            {
+                slot->last = prev;
+            }
+
+            // Keep the components packed
+            AnimationComponent *moved = GetFromIndex(totalNumAnimations - 1);
+            if (moved->entity != entity)
+            {
+                GetSlotNode(moved->entity)->index = node->index;
+                *GetFromIndex(node->index)        = *moved;
+            }
+            totalNumAnimations--;
+            StackPush(freeSlotNodes, node);
+            return 1;
+        }
+        prev = node;
+    }
+    return 0;
+}
+
+AnimationComponent *AnimationManager::Get(Entity entity)
+{
+    AnimationSlotNode *node    = GetSlotNode(entity);
+    AnimationComponent *result = node ? GetFromIndex(node->index) : 0;
+    return result;
+}
+
 //////////////////////////////
 // Component requests
 //
@@ -1190,6 +1295,7 @@ void Scene::Init(Arena *inArena)
     transforms.Init(this);
     hierarchy.Init(this);
     skeletons.Init(this);
+    animations.Init(this);
     sma.Init();
     requestRing.Init(inArena);
     entityGen = NULL_HANDLE + 1;
@@ -1251,11 +1357,7 @@ void Scene::Merge(Scene *other)
     for (MeshIter iter = other->BeginMeshIter(); !other->End(&iter); other->Next(&iter))
     {
         Mesh *mesh = other->Get(&iter);
-        for (u32 subsetIndex = 0; subsetIndex < mesh->numSubsets; subsetIndex++)
-        {
-            Mesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
-            totalClusterCount += (subset->indexCount + CLUSTER_SIZE * 3 - 1) / (CLUSTER_SIZE * 3);
-        }
+        totalClusterCount += mesh->numClusters;
     }
 
     Assert(numUploads[UploadType_MeshClusters] < ArrayLength(uploads[0]));
@@ -1276,53 +1378,61 @@ void Scene::Merge(Scene *other)
         *newMesh         = std::move(*mesh); // does this work?
 
         // Remap materials
-        // Upload subsets to gpu
+        u32 *materialIndices = PushArrayNoZero(temp.arena, u32, newMesh->numSubsets);
+        for (u32 subsetIndex = 0; subsetIndex < newMesh->numSubsets; subsetIndex++)
+        {
+            Mesh::MeshSubset *subset = &newMesh->subsets[subsetIndex];
+            MaterialComponent *mat   = other->materials.GetFromHandle(subset->materialHandle);
+            Assert(mat);
+            u32 sid               = mat->sid;
+            MaterialHandle handle = materials.GetHandle(sid);
+            Assert(materials.IsValidHandle(handle));
+            newMesh->subsets[subsetIndex].materialHandle = handle;
+            materialIndices[subsetIndex]                 = materials.GetIndex(handle);
+        }
+
+        // Upload clusters to gpu
         {
-            u32 numClusters = 0;
-            for (u32 subsetIndex = 0; subsetIndex < newMesh->numSubsets; subsetIndex++)
+            u32 numClusters = newMesh->numClusters;
+            for (u32 i = 0; i < numClusters; i++)
             {
-                Mesh::MeshSubset *subset = &newMesh->subsets[subsetIndex];
-                MaterialComponent *mat   = other->materials.GetFromHandle(subset->materialHandle);
-                Assert(mat);
-                u32 sid               = mat->sid;
-                MaterialHandle handle = materials.GetHandle(sid);
-                Assert(materials.IsValidHandle(handle));
-                newMesh->subsets[subsetIndex].materialHandle = handle;
-
-                // TODO: store this data in file
-                u32 totalIndexCount = subset->indexStart;
-                for (u32 indexIndex = 0; indexIndex < subset->indexCount; indexIndex += CLUSTER_SIZE * 3)
+                Mesh::Cluster *input = &newMesh->clusters[i];
+                MeshCluster *cluster = &meshClusters[clusterIndex++];
+                Assert(input->indexCount <= CLUSTER_SIZE * 3 && input->subsetIndex < newMesh->numSubsets);
+
+                cluster->meshIndex     = meshIndex;
+                cluster->indexOffset   = input->indexStart;
+                cluster->indexCount    = input->indexCount;
+                cluster->materialIndex = materialIndices[input->subsetIndex];
+                cluster->flags         = 0;
+
+                // Skinned vertices move, so the culler uses the animated bounds of the instance and doesn't cone cull.
+                // The bind pose bounds of the mesh are kept for the spheres.
+                if (newMesh->boneIds)
                 {
-                    u32 indexCount         = Min(CLUSTER_SIZE * 3, subset->indexCount - indexIndex);
-                    MeshCluster *cluster   = &meshClusters[clusterIndex++];
-                    cluster->minP          = {FLT_MAX, FLT_MAX, FLT_MAX};
-                    cluster->maxP          = {FLT_MIN, FLT_MIN, FLT_MIN};
-                    cluster->indexOffset   = totalIndexCount;
-                    cluster->indexCount    = indexCount;
-                    cluster->meshIndex     = meshIndex;
-                    cluster->materialIndex = materials.GetIndex(handle);
-                    cluster->minP          = {};
-                    cluster->maxP          = {};
-
-                    numClusters++;
-                    totalIndexCount += indexCount;
-
-#if 0
-                    for (u32 i = 0; i < CLUSTER_SIZE * 3; i++)
-                    {
-                        V3 pos          = newMesh->positions[indexIndex + i];
-                        cluster->minP.x = Min(cluster->minP.x, pos.x);
-                        cluster->minP.y = Min(cluster->minP.y, pos.y);
-                        cluster->minP.z = Min(cluster->minP.z, pos.z);
-                        cluster->maxP.x = Max(cluster->maxP.x, pos.x);
-                        cluster->maxP.y = Max(cluster->maxP.y, pos.y);
-                        cluster->maxP.z = Max(cluster->maxP.z, pos.z);
-                    }
-#endif
+                    cluster->flags        = MESH_CLUSTER_SKINNED;
+                    cluster->minP         = newMesh->bounds.minP;
+                    cluster->maxP         = newMesh->bounds.maxP;
+                    cluster->sphereCenter = GetCenter(newMesh->bounds);
+                    cluster->sphereRadius = Length(newMesh->bounds.maxP - cluster->sphereCenter);
+                    cluster->coneApex     = {};
+                    cluster->coneAxis     = {};
+                    cluster->coneCutoff   = 1.f;
+                }
+                else
+                {
+                    cluster->minP         = input->bounds.minP;
+                    cluster->maxP         = input->bounds.maxP;
+                    cluster->sphereCenter = input->sphereCenter;
+                    cluster->sphereRadius = input->sphereRadius;
+                    cluster->coneApex     = input->coneApex;
+                    cluster->coneAxis     = input->coneAxis;
+                    cluster->coneCutoff   = input->coneCutoff;
                 }
             }
+            // Every level of detail is uploaded, the full mesh has the most clusters
             newMesh->clusterOffset = meshes.totalNumClusters;
-            newMesh->clusterCount  = numClusters;
+            newMesh->clusterCount  = newMesh->lods[0].clusterCount;
             meshes.totalNumClusters += numClusters;
         }
         // Remap skeletons
@@ -697,6 +697,84 @@ struct SkeletonIter
     u32 globalIndex;
 };
 
+//////////////////////////////
+// Animation
+//
+
+// The animation layers playing on one instance of a model. Keyed by the entity of the instance, the parent of its
+// skinned meshes, so instances sharing a skeleton asset each have their own clips, times and skinning matrices.
+struct AnimationComponent
+{
+    Entity entity;
+    u32 skeletonSid;
+    AnimationLayer layers[ANIMATION_MAX_LAYERS];
+    u32 layerCount;
+    AnimationLod lod;
+    // Movement of the root during the last update, for gameplay to move the entity by. Not applied by the scene.
+    AnimationRootMotion rootMotion;
+    // Set each frame, see SkinModelToAnimation
+    u32 skinningOffset;
+    Rect3 aabb;
+};
+
+// Components are kept densely packed, removal swaps in the last one, so that updates can be split by index across
+// jobs.
+class AnimationManager
+{
+private:
+    static const u32 numAnimationsPerChunk = 256;
+    StaticAssert(IsPow2(numAnimationsPerChunk), AnimationChunksPow2);
+    static const u32 animationChunkMask  = numAnimationsPerChunk - 1;
+    static const u32 animationChunkShift = 8;
+
+    static const u32 maxAnimationChunks = 64;
+
+    static const u32 numAnimationSlots = 256;
+    StaticAssert(IsPow2(numAnimationSlots), AnimationSlotsPow2);
+    static const i32 animationSlotMask = numAnimationSlots - 1;
+
+    struct AnimationChunkNode
+    {
+        AnimationComponent animations[numAnimationsPerChunk];
+    };
+
+    struct AnimationSlotNode
+    {
+        Entity entity;
+        u32 index;
+        AnimationSlotNode *next;
+    };
+
+    struct AnimationSlot
+    {
+        AnimationSlotNode *first;
+        AnimationSlotNode *last;
+    };
+
+    AnimationSlot *entityMap;
+    AnimationSlotNode *freeSlotNodes;
+    AnimationChunkNode **chunks;
+    u32 numChunkNodes;
+    u32 totalNumAnimations;
+
+    AnimationSlotNode *GetSlotNode(Entity entity);
+
+public:
+    struct Scene *parentScene;
+    void Init(Scene *inScene);
+
+    AnimationComponent *Create(Entity entity, u32 skeletonSid);
+    b32 Remove(Entity entity);
+    AnimationComponent *Get(Entity entity);
+
+    inline AnimationComponent *GetFromIndex(u32 index)
+    {
+        Assert(index < totalNumAnimations);
+        return &chunks[index >> animationChunkShift]->animations[index & animationChunkMask];
+    }
+    inline u32 GetTotal() { return totalNumAnimations; }
+};
+
 //////////////////////////////
 // Component requests
 //
@@ -764,6 +842,7 @@ struct Scene
     TransformManager transforms;
     HierarchyManager hierarchy;
     SkeletonManager skeletons;
+    AnimationManager animations;
 
     //////////////////////////////
     // Materials
@@ -865,6 +944,22 @@ struct Scene
         return skeletons.Get(iter);
     }
 
+    //////////////////////////////
+    // Animation
+    //
+    // The animation of the instance that the entity belongs to, 0 if it isn't animated
+    inline AnimationComponent *GetAnimation(Entity entity)
+    {
+        AnimationComponent *result = 0;
+        for (Entity current = entity; current != 0 && !result;)
+        {
+            result                        = animations.Get(current);
+            HierarchyComponent *component = hierarchy.Get(current);
+            current                       = component ? component->parent : 0;
+        }
+        return result;
+    }
+
     Rect3 aabbs[256];
     u32 aabbCount = 0;
 
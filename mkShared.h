@@ -136,6 +136,15 @@ typedef OS_SET_THREAD_AFFINITY(os_set_thread_affinity);
 #define OS_LOAD_DLL(name) void name(OS_DLL *dll)
 typedef OS_LOAD_DLL(os_load_dll);
 
+#define OS_WATCH_DIRECTORY(name) OS_Handle name(string path)
+typedef OS_WATCH_DIRECTORY(os_watch_directory);
+
+#define OS_WAIT_FILE_CHANGES(name) OS_FileChanges name(Arena *arena, OS_Handle watch, u32 timeoutMs)
+typedef OS_WAIT_FILE_CHANGES(os_wait_file_changes);
+
+#define OS_CLOSE_DIRECTORY_WATCH(name) void name(OS_Handle watch)
+typedef OS_CLOSE_DIRECTORY_WATCH(os_close_directory_watch);
+
 struct PlatformApi
 {
     print_func *Printf;
@@ -175,6 +184,9 @@ struct PlatformApi
     os_load_dll *LoadDLL;
     os_load_dll *LoadDLLNoTemp;
     os_file_exists *FileExists;
+    os_watch_directory *WatchDirectory;
+    os_wait_file_changes *WaitFileChanges;
+    os_close_directory_watch *CloseDirectoryWatch;
 };
 extern PlatformApi platform;
 
@@ -218,6 +230,10 @@ inline PlatformApi GetPlatform()
     platform_.LoadDLL            = OS_LoadDLL;
     platform_.LoadDLLNoTemp      = OS_LoadDLLNoTemp;
     platform_.FileExists         = FileExists;
+
+    platform_.WatchDirectory      = OS_WatchDirectory;
+    platform_.WaitFileChanges     = OS_WaitFileChanges;
+    platform_.CloseDirectoryWatch = OS_CloseDirectoryWatch;
     return platform_;
 }
 
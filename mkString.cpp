@@ -447,6 +447,30 @@ internal u64 HashStruct_(void *ptr, u64 size)
     return result;
 }
 
+// 64 bit hash for large buffers (e.g. file contents). Consumes 8 bytes at a time.
+internal u64 HashBytes64(void *ptr, u64 size)
+{
+    const u64 prime = 0x100000001b3ull;
+    u64 result      = 0xcbf29ce484222325ull ^ size;
+    u8 *bytes       = (u8 *)ptr;
+    u64 i           = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        u64 word;
+        MemoryCopy(&word, bytes + i, sizeof(word));
+        result = (result ^ word) * prime;
+        result ^= result >> 29;
+    }
+    for (; i < size; i++)
+    {
+        result = (result ^ bytes[i]) * prime;
+    }
+    result ^= result >> 32;
+    result *= 0xd6e8feb86659fd93ull;
+    result ^= result >> 32;
+    return result;
+}
+
 //////////////////////////////
 // String reading
 //
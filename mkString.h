@@ -86,6 +86,7 @@ internal string Str8PathChopLastSlash(string string);
 //
 internal i32 HashFromString(string string);
 internal u64 HashStruct_(void *ptr, u64 size);
+internal u64 HashBytes64(void *ptr, u64 size);
 #define HashStruct(ptr) HashStruct_((ptr), sizeof(*(ptr)))
 
 //////////////////////////////
@@ -126,9 +126,11 @@ enum
 typedef u32 MeshFlags;
 enum
 {
-    MeshFlags_Valid   = 1 << 0,
-    MeshFlags_Skinned = 1 << 1,
-    MeshFlags_Uvs     = 1 << 2,
+    MeshFlags_Valid     = 1 << 0,
+    MeshFlags_Skinned   = 1 << 1,
+    MeshFlags_Uvs       = 1 << 2,
+    // Vertex streams are quantized, see Mesh
+    MeshFlags_Quantized = 1 << 3,
 };
 
 typedef u32 HierarchyFlag;
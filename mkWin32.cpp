@@ -399,6 +399,158 @@ void OS_DirectoryIterEnd(OS_FileIter *input)
     FindClose(iter->handle);
 }
 
+//////////////////////////////
+// File watching
+//
+b32 Win32_IssueFileWatch(Win32_FileWatch *watch)
+{
+    DWORD filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE;
+    b32 result   = ReadDirectoryChangesW(watch->directory, watch->buffer, sizeof(watch->buffer), TRUE, filter, 0,
+                                         &watch->overlapped, 0);
+    return result;
+}
+
+OS_WATCH_DIRECTORY(OS_WatchDirectory)
+{
+    OS_Handle result = {};
+    Assert(path.size + 1 < MAX_OS_PATH);
+    HANDLE directory = CreateFileA((char *)path.str, FILE_LIST_DIRECTORY,
+                                   FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING,
+                                   FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0);
+    if (directory == INVALID_HANDLE_VALUE)
+    {
+        Printf("Could not watch directory: %S\n", path);
+        return result;
+    }
+
+    Win32_FileWatch *watch = 0;
+    BeginTicketMutex(&win32State->mMutex);
+    watch = win32State->mFreeFileWatch;
+    if (watch)
+    {
+        StackPop(win32State->mFreeFileWatch);
+    }
+    else
+    {
+        watch = PushStructNoZero(win32State->mArena, Win32_FileWatch);
+    }
+    EndTicketMutex(&win32State->mMutex);
+
+    MemoryZeroStruct(&watch->overlapped);
+    watch->directory         = directory;
+    watch->overlapped.hEvent = CreateEventA(0, FALSE, FALSE, 0);
+    watch->next              = 0;
+    watch->path.str          = watch->pathBuffer;
+    watch->path.size         = path.size;
+    MemoryCopy(watch->pathBuffer, path.str, path.size);
+    // Reported paths are relative to the directory
+    if (path.size == 0 || (path.str[path.size - 1] != '/' && path.str[path.size - 1] != '\\'))
+    {
+        watch->pathBuffer[watch->path.size++] = '/';
+    }
+    for (u64 i = 0; i < watch->path.size; i++)
+    {
+        if (watch->pathBuffer[i] == '\\') watch->pathBuffer[i] = '/';
+    }
+    watch->pathBuffer[watch->path.size] = 0;
+
+    if (Win32_IssueFileWatch(watch))
+    {
+        result.handle = (u64)watch;
+    }
+    else
+    {
+        OS_CloseDirectoryWatch({(u64)watch});
+    }
+    return result;
+}
+
+OS_WAIT_FILE_CHANGES(OS_WaitFileChanges)
+{
+    OS_FileChanges result      = {};
+    Win32_FileWatch *fileWatch = (Win32_FileWatch *)watch.handle;
+    if (fileWatch == 0) return result;
+
+    DWORD wait = WaitForSingleObject(fileWatch->overlapped.hEvent, timeoutMs);
+    if (wait != WAIT_OBJECT_0) return result;
+
+    DWORD bytes = 0;
+    if (GetOverlappedResult(fileWatch->directory, &fileWatch->overlapped, &bytes, FALSE))
+    {
+        // NOTE: 0 bytes means the buffer overflowed and the changes were dropped
+        if (bytes == 0)
+        {
+            result.overflow = 1;
+        }
+        else
+        {
+            for (u8 *cursor = fileWatch->buffer;;)
+            {
+                FILE_NOTIFY_INFORMATION *info = (FILE_NOTIFY_INFORMATION *)cursor;
+                if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED ||
+                    info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+                {
+                    i32 wideLength = (i32)(info->FileNameLength / sizeof(WCHAR));
+                    i32 size       = WideCharToMultiByte(CP_UTF8, 0, info->FileName, wideLength, 0, 0, 0, 0);
+
+                    string path;
+                    path.size = fileWatch->path.size + size;
+                    path.str  = PushArrayNoZero(arena, u8, path.size + 1);
+                    MemoryCopy(path.str, fileWatch->path.str, fileWatch->path.size);
+                    char *dest = (char *)path.str + fileWatch->path.size;
+                    WideCharToMultiByte(CP_UTF8, 0, info->FileName, wideLength, dest, size, 0, 0);
+                    path.str[path.size] = 0;
+                    for (u64 i = fileWatch->path.size; i < path.size; i++)
+                    {
+                        if (path.str[i] == '\\') path.str[i] = '/';
+                    }
+
+                    // Coalesce, a single save usually generates several notifications
+                    b32 found = 0;
+                    for (OS_FileChange *change = result.first; change != 0; change = change->next)
+                    {
+                        if (change->path == path)
+                        {
+                            found = 1;
+                            break;
+                        }
+                    }
+                    if (!found)
+                    {
+                        OS_FileChange *change = PushStruct(arena, OS_FileChange);
+                        change->path          = path;
+                        QueuePush(result.first, result.last, change);
+                        result.count++;
+                    }
+                }
+                if (info->NextEntryOffset == 0) break;
+                cursor += info->NextEntryOffset;
+            }
+        }
+    }
+    if (!Win32_IssueFileWatch(fileWatch))
+    {
+        result.overflow = 1;
+    }
+    return result;
+}
+
+OS_CLOSE_DIRECTORY_WATCH(OS_CloseDirectoryWatch)
+{
+    Win32_FileWatch *fileWatch = (Win32_FileWatch *)watch.handle;
+    if (fileWatch == 0) return;
+
+    CancelIoEx(fileWatch->directory, &fileWatch->overlapped);
+    DWORD bytes = 0;
+    GetOverlappedResult(fileWatch->directory, &fileWatch->overlapped, &bytes, TRUE);
+    CloseHandle(fileWatch->overlapped.hEvent);
+    CloseHandle(fileWatch->directory);
+
+    BeginTicketMutex(&win32State->mMutex);
+    StackPush(win32State->mFreeFileWatch, fileWatch);
+    EndTicketMutex(&win32State->mMutex);
+}
+
 //////////////////////////////
 // Memory
 //
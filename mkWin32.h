@@ -39,10 +39,24 @@ struct Win32_FileIter
     WIN32_FIND_DATAA findData;
 };
 
+struct Win32_FileWatch
+{
+    HANDLE directory;
+    OVERLAPPED overlapped;
+    string path;
+    u8 pathBuffer[MAX_OS_PATH];
+
+    // Filled by ReadDirectoryChangesW, must be DWORD aligned
+    alignas(DWORD) u8 buffer[kilobytes(16)];
+
+    Win32_FileWatch *next;
+};
+
 struct Win32_State
 {
     Arena *mArena;
     Win32_Sync *mFreeSync;
+    Win32_FileWatch *mFreeFileWatch;
     i64 mPerformanceFrequency;
     b32 mGranularSleep;
 
@@ -66,6 +80,7 @@ void Win32_AddEvent(OS_Event event);
 OS_Event Win32_CreateKeyEvent(OS_Key key, b32 isDown);
 Win32_Sync *Win32_SyncAlloc(Win32_SyncType type);
 void Win32_SyncFree(Win32_Sync *sync);
+b32 Win32_IssueFileWatch(Win32_FileWatch *watch);
 
 //////////////////////////////
 // File information
@@ -0,0 +1,604 @@
+#include "./animation_compression.h"
+
+//////////////////////////////
+// Animation compression
+//
+// The clip stays uniformly sampled so that the runtime finds its two samples directly. Keys are reduced by lowering the
+// sample rate while the interpolated clip stays within half of the error bound, then every track of each group of four
+// channels gets the fewest bits that keep the clip within the rest of it.
+//
+// Error is measured the way skinning sees it. Points at shellDistance from a node along its axes are moved by the
+// object space transform of the node, which carries the error of every node above it. The error of the clip is the
+// largest distance between the points moved by the source and by the compressed transforms.
+
+// Tried in order before falling back to raw floats
+const u8 animationBitRates[]        = {0, 8, 16};
+const u32 animationMaxSampleDivisor = 8;
+
+enum AnimationTrack
+{
+    AnimationTrack_Translation,
+    AnimationTrack_Rotation,
+    AnimationTrack_Scale,
+    AnimationTrack_Count,
+};
+
+struct AnimationErrorState
+{
+    const AnimationCompressionInput *input;
+    // Nodes sorted parents first
+    u32 *order;
+    u32 numSamples;
+
+    // Object space transforms, [sample * nodeCount + node]
+    Mat4 *reference;
+    Mat4 *current;
+    Mat4 *trial;
+    // Local transforms of the channels, [sample * channelCount + channel]
+    AnimationTransform *currentLocals;
+    AnimationTransform *trialLocals;
+    // Nodes below the channels of the group being compressed
+    b8 *affected;
+};
+
+inline Mat4 ConvertAnimationTransform(const AnimationTransform *transform)
+{
+    Mat4 result = Translate4(transform->translation) * QuatToMatrix(transform->rotation) * Scale(transform->scale);
+    return result;
+}
+
+internal f32 GetShellError(const Mat4 &a, const Mat4 &b, f32 shellDistance)
+{
+    V3 translation = a.columns[3].xyz - b.columns[3].xyz;
+    f32 result     = 0.f;
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        V3 offset = translation + shellDistance * (a.columns[axis].xyz - b.columns[axis].xyz);
+        result    = Max(result, Length(offset));
+    }
+    return result;
+}
+
+internal void ComputeObjectTransforms(const AnimationCompressionInput *input, const u32 *order,
+                                      const AnimationTransform *locals, Mat4 *objects)
+{
+    for (u32 i = 0; i < input->nodeCount; i++)
+    {
+        u32 node   = order[i];
+        i32 parent = input->parents[node];
+        Mat4 local = node < input->channelCount ? ConvertAnimationTransform(&locals[node])
+                                                : input->restTransforms[node];
+        objects[node] = parent == -1 ? local : objects[parent] * local;
+    }
+}
+
+// Interpolates every channel of a uniformly sampled clip the same way the runtime sampler does
+internal void SampleUniformAnimation(const AnimationTransform *samples, u32 numSamples, u32 channelCount,
+                                     f32 sampleRate, f32 time, AnimationTransform *out)
+{
+    f32 sample   = Clamp(time * sampleRate, 0.f, (f32)(numSamples - 1));
+    u32 sample0  = (u32)sample;
+    u32 sample1  = Min(sample0 + 1, numSamples - 1);
+    f32 fraction = sample - (f32)sample0;
+    for (u32 channel = 0; channel < channelCount; channel++)
+    {
+        out[channel] = Lerp(samples[sample0 * channelCount + channel], samples[sample1 * channelCount + channel],
+                            fraction);
+    }
+}
+
+// Largest error of the clip at the source sample times
+internal f32 MeasureAnimationError(const AnimationCompressionInput *input, const u32 *order,
+                                   const AnimationTransform *samples, u32 numSamples, f32 sampleRate,
+                                   const Mat4 *sourceObjects)
+{
+    TempArena temp             = ScratchStart(0, 0);
+    AnimationTransform *locals = PushArrayNoZero(temp.arena, AnimationTransform, input->channelCount);
+    Mat4 *objects              = PushArrayNoZero(temp.arena, Mat4, input->nodeCount);
+
+    f32 result = 0.f;
+    for (u32 sampleIndex = 0; sampleIndex < input->sourceSampleCount; sampleIndex++)
+    {
+        f32 time = input->sourceSampleRate == 0.f ? 0.f : sampleIndex / input->sourceSampleRate;
+        SampleUniformAnimation(samples, numSamples, input->channelCount, sampleRate, time, locals);
+        ComputeObjectTransforms(input, order, locals, objects);
+        for (u32 node = 0; node < input->nodeCount; node++)
+        {
+            result = Max(result, GetShellError(objects[node], sourceObjects[sampleIndex * input->nodeCount + node],
+                                               input->shellDistance));
+        }
+    }
+    ScratchEnd(temp);
+    return result;
+}
+
+// Returns the largest component, which is dropped. The quaternion is negated if needed so that it's positive.
+internal u32 EncodeSmallestThree(Quat rotation, f32 *smallest)
+{
+    rotation    = Normalize(rotation);
+    u32 largest = 0;
+    for (u32 i = 1; i < 4; i++)
+    {
+        if (Abs(rotation.xyzw[i]) > Abs(rotation.xyzw[largest]))
+        {
+            largest = i;
+        }
+    }
+    f32 sign = rotation.xyzw[largest] < 0.f ? -1.f : 1.f;
+    u32 next = 0;
+    for (u32 i = 0; i < 4; i++)
+    {
+        if (i != largest)
+        {
+            smallest[next++] = rotation.xyzw[i] * sign;
+        }
+    }
+    return largest;
+}
+
+internal Quat DecodeSmallestThree(const f32 *smallest, u32 largest)
+{
+    Quat result;
+    f32 length = 0.f;
+    u32 next   = 0;
+    for (u32 i = 0; i < 4; i++)
+    {
+        if (i != largest)
+        {
+            result.xyzw[i] = smallest[next++];
+            length += result.xyzw[i] * result.xyzw[i];
+        }
+    }
+    result.xyzw[largest] = SquareRoot(Max(1.f - length, 0.f));
+    result               = Normalize(result);
+    return result;
+}
+
+// Components of a track as they're stored, padding lanes are the identity
+internal u32 GetAnimationTrackValues(const AnimationTransform *transform, u32 track, f32 *values)
+{
+    u32 largest = 3;
+    switch (track)
+    {
+        case AnimationTrack_Translation:
+        {
+            for (u32 i = 0; i < 3; i++)
+            {
+                values[i] = transform ? transform->translation[i] : 0.f;
+            }
+        }
+        break;
+        case AnimationTrack_Rotation:
+        {
+            Quat identity = {0.f, 0.f, 0.f, 1.f};
+            largest       = EncodeSmallestThree(transform ? transform->rotation : identity, values);
+        }
+        break;
+        case AnimationTrack_Scale:
+        {
+            for (u32 i = 0; i < 3; i++)
+            {
+                values[i] = transform ? transform->scale[i] : 1.f;
+            }
+        }
+        break;
+    }
+    return largest;
+}
+
+// Value the runtime decodes, matching its float operations
+internal f32 QuantizeAnimationValue(f32 value, f32 min, f32 extent, u32 bits, u32 *quantized)
+{
+    f32 result = value;
+    *quantized = 0;
+    if (bits == 0)
+    {
+        result = min;
+    }
+    else if (bits < 32)
+    {
+        *quantized = extent > 0.f ? CompressUnitFloat(Clamp((value - min) / extent, 0.f, 1.f), bits) : 0;
+        result     = (f32)*quantized * (1.f / (f32)((1u << bits) - 1)) * extent + min;
+    }
+    return result;
+}
+
+internal void GetAnimationTrackRange(AnimationGroupFormat *format, u32 track, f32 **min, f32 **extent)
+{
+    switch (track)
+    {
+        case AnimationTrack_Translation:
+        {
+            *min    = format->translationMin[0];
+            *extent = format->translationExtent[0];
+        }
+        break;
+        case AnimationTrack_Rotation:
+        {
+            *min    = format->rotationMin[0];
+            *extent = format->rotationExtent[0];
+        }
+        break;
+        default:
+        {
+            *min    = format->scaleMin[0];
+            *extent = format->scaleExtent[0];
+        }
+        break;
+    }
+}
+
+// Finds the range of the track over the clip and writes the decoded values into the trial locals. Fails when a
+// rotation can't be constant because its dropped component changes.
+internal b32 QuantizeAnimationTrack(AnimationErrorState *state, const AnimationTransform *samples,
+                                    AnimationGroupFormat *format, const i32 *laneChannels, u32 track, u32 bits)
+{
+    u32 channelCount = state->input->channelCount;
+    f32 *mins;
+    f32 *extents;
+    GetAnimationTrackRange(format, track, &mins, &extents);
+
+    for (u32 lane = 0; lane < ANIMATION_GROUP_SIZE; lane++)
+    {
+        i32 channel = laneChannels[lane];
+        f32 minValues[3];
+        f32 maxValues[3];
+        u32 largest = 0;
+        for (u32 sampleIndex = 0; sampleIndex < state->numSamples; sampleIndex++)
+        {
+            const AnimationTransform *transform = channel == -1 ? 0 : &samples[sampleIndex * channelCount + channel];
+            f32 values[3];
+            u32 sampleLargest = GetAnimationTrackValues(transform, track, values);
+            if (sampleIndex == 0)
+            {
+                largest = sampleLargest;
+            }
+            else if (bits == 0 && sampleLargest != largest)
+            {
+                return 0;
+            }
+            for (u32 i = 0; i < 3; i++)
+            {
+                minValues[i] = sampleIndex == 0 ? values[i] : Min(minValues[i], values[i]);
+                maxValues[i] = sampleIndex == 0 ? values[i] : Max(maxValues[i], values[i]);
+            }
+        }
+        for (u32 i = 0; i < 3; i++)
+        {
+            // Constant tracks decode to the middle of their range
+            mins[i * ANIMATION_GROUP_SIZE + lane] = bits == 0 ? (minValues[i] + maxValues[i]) * 0.5f : minValues[i];
+            extents[i * ANIMATION_GROUP_SIZE + lane] = bits == 0 ? 0.f : maxValues[i] - minValues[i];
+        }
+        if (track == AnimationTrack_Rotation && bits == 0)
+        {
+            format->rotationIndices = (u8)((format->rotationIndices & ~(3u << (2 * lane))) | (largest << (2 * lane)));
+        }
+        if (channel == -1)
+        {
+            continue;
+        }
+
+        for (u32 sampleIndex = 0; sampleIndex < state->numSamples; sampleIndex++)
+        {
+            f32 values[3];
+            u32 sampleLargest = GetAnimationTrackValues(&samples[sampleIndex * channelCount + channel], track, values);
+            for (u32 i = 0; i < 3; i++)
+            {
+                u32 quantized;
+                values[i] = QuantizeAnimationValue(values[i], mins[i * ANIMATION_GROUP_SIZE + lane],
+                                                   extents[i * ANIMATION_GROUP_SIZE + lane], bits, &quantized);
+            }
+            AnimationTransform *transform = &state->trialLocals[sampleIndex * channelCount + channel];
+            if (track == AnimationTrack_Translation)
+            {
+                transform->translation = MakeV3(values[0], values[1], values[2]);
+            }
+            else if (track == AnimationTrack_Rotation)
+            {
+                transform->rotation = DecodeSmallestThree(values, sampleLargest);
+            }
+            else
+            {
+                transform->scale = MakeV3(values[0], values[1], values[2]);
+            }
+        }
+    }
+    switch (track)
+    {
+        case AnimationTrack_Translation: format->translationBits = (u8)bits; break;
+        case AnimationTrack_Rotation: format->rotationBits = (u8)bits; break;
+        case AnimationTrack_Scale: format->scaleBits = (u8)bits; break;
+    }
+    return 1;
+}
+
+// Only the nodes below the group change, the others are already known to be within the bound
+internal b32 EvaluateAnimationTrial(AnimationErrorState *state, f32 maxError)
+{
+    const AnimationCompressionInput *input = state->input;
+    for (u32 sampleIndex = 0; sampleIndex < state->numSamples; sampleIndex++)
+    {
+        const AnimationTransform *locals = state->trialLocals + sampleIndex * input->channelCount;
+        Mat4 *current                    = state->current + sampleIndex * input->nodeCount;
+        Mat4 *trial                      = state->trial + sampleIndex * input->nodeCount;
+        Mat4 *reference                  = state->reference + sampleIndex * input->nodeCount;
+        for (u32 i = 0; i < input->nodeCount; i++)
+        {
+            u32 node = state->order[i];
+            if (!state->affected[node])
+            {
+                continue;
+            }
+            i32 parent = input->parents[node];
+            Mat4 local = node < input->channelCount ? ConvertAnimationTransform(&locals[node])
+                                                    : input->restTransforms[node];
+            if (parent != -1)
+            {
+                local = (state->affected[parent] ? trial[parent] : current[parent]) * local;
+            }
+            trial[node] = local;
+            if (GetShellError(trial[node], reference[node], input->shellDistance) > maxError)
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+internal void ResolveAnimationTrial(AnimationErrorState *state, const i32 *laneChannels, b32 accept)
+{
+    const AnimationCompressionInput *input = state->input;
+    for (u32 sampleIndex = 0; sampleIndex < state->numSamples; sampleIndex++)
+    {
+        for (u32 lane = 0; lane < ANIMATION_GROUP_SIZE; lane++)
+        {
+            if (laneChannels[lane] != -1)
+            {
+                u32 index = sampleIndex * input->channelCount + laneChannels[lane];
+                if (accept)
+                {
+                    state->currentLocals[index] = state->trialLocals[index];
+                }
+                else
+                {
+                    state->trialLocals[index] = state->currentLocals[index];
+                }
+            }
+        }
+        if (accept)
+        {
+            for (u32 node = 0; node < input->nodeCount; node++)
+            {
+                if (state->affected[node])
+                {
+                    u32 index             = sampleIndex * input->nodeCount + node;
+                    state->current[index] = state->trial[index];
+                }
+            }
+        }
+    }
+}
+
+internal u8 *PutAnimationTrack(u8 *out, const f32 values[3][ANIMATION_GROUP_SIZE], u32 bits, const f32 *mins,
+                               const f32 *extents)
+{
+    for (u32 i = 0; i < 3 * ANIMATION_GROUP_SIZE && bits; i++)
+    {
+        u32 quantized;
+        f32 value = QuantizeAnimationValue(values[i / ANIMATION_GROUP_SIZE][i % ANIMATION_GROUP_SIZE], mins[i],
+                                           extents[i], bits, &quantized);
+        if (bits == 32)
+        {
+            MemoryCopy(out, &value, sizeof(value));
+        }
+        else
+        {
+            MemoryCopy(out, &quantized, bits / 8);
+        }
+        out += bits / 8;
+    }
+    return out;
+}
+
+internal void CompressAnimation(Arena *arena, const AnimationCompressionInput *input, CompressedAnimation *out)
+{
+    TempArena temp   = ScratchStart(&arena, 1);
+    u32 channelCount = input->channelCount;
+    u32 nodeCount    = input->nodeCount;
+
+    // Parents first
+    u32 *order  = PushArrayNoZero(temp.arena, u32, nodeCount);
+    u32 *depths = PushArrayNoZero(temp.arena, u32, nodeCount);
+    for (u32 node = 0; node < nodeCount; node++)
+    {
+        order[node]  = node;
+        depths[node] = 0;
+        for (i32 parent = input->parents[node]; parent != -1; parent = input->parents[parent])
+        {
+            depths[node]++;
+        }
+    }
+    for (u32 i = 1; i < nodeCount; i++)
+    {
+        for (u32 j = i; j > 0 && depths[order[j - 1]] > depths[order[j]]; j--)
+        {
+            Swap(u32, order[j - 1], order[j]);
+        }
+    }
+
+    Mat4 *sourceObjects = PushArrayNoZero(temp.arena, Mat4, input->sourceSampleCount * nodeCount);
+    for (u32 sampleIndex = 0; sampleIndex < input->sourceSampleCount; sampleIndex++)
+    {
+        ComputeObjectTransforms(input, order, input->sourceSamples + sampleIndex * channelCount,
+                                sourceObjects + sampleIndex * nodeCount);
+    }
+
+    // Lowest sample rate whose interpolation stays within half of the bound
+    AnimationTransform *samples = input->sourceSamples;
+    u32 numSamples              = input->sourceSampleCount;
+    f32 sampleRate              = input->sourceSampleRate;
+    f32 sampleError             = 0.f;
+    for (u32 divisor = animationMaxSampleDivisor; divisor > 1 && input->duration > 0.f; divisor--)
+    {
+        u32 count = (u32)ceilf(input->duration * input->sourceSampleRate / divisor) + 1;
+        if (count >= input->sourceSampleCount)
+        {
+            continue;
+        }
+        f32 rate                    = (count - 1) / input->duration;
+        AnimationTransform *reduced = PushArrayNoZero(temp.arena, AnimationTransform, count * channelCount);
+        for (u32 sampleIndex = 0; sampleIndex < count; sampleIndex++)
+        {
+            SampleUniformAnimation(input->sourceSamples, input->sourceSampleCount, channelCount,
+                                   input->sourceSampleRate, sampleIndex / rate, reduced + sampleIndex * channelCount);
+        }
+        f32 error = MeasureAnimationError(input, order, reduced, count, rate, sourceObjects);
+        if (error <= input->maxError * 0.5f)
+        {
+            samples     = reduced;
+            numSamples  = count;
+            sampleRate  = rate;
+            sampleError = error;
+            break;
+        }
+    }
+
+    // Channels whose tracks are all constant, or all animated, end up in the same groups
+    u32 numGroups      = (channelCount + ANIMATION_GROUP_SIZE - 1) / ANIMATION_GROUP_SIZE;
+    u32 *channelOrder  = PushArrayNoZero(arena, u32, channelCount);
+    u32 *animatedMasks = PushArray(temp.arena, u32, channelCount);
+    for (u32 channel = 0; channel < channelCount; channel++)
+    {
+        channelOrder[channel] = channel;
+        AnimationTransform first = samples[channel];
+        for (u32 sampleIndex = 1; sampleIndex < numSamples; sampleIndex++)
+        {
+            AnimationTransform transform = samples[sampleIndex * channelCount + channel];
+            animatedMasks[channel] |= (transform.translation != first.translation) << AnimationTrack_Translation;
+            animatedMasks[channel] |= (transform.rotation != first.rotation) << AnimationTrack_Rotation;
+            animatedMasks[channel] |= (transform.scale != first.scale) << AnimationTrack_Scale;
+        }
+    }
+    for (u32 i = 1; i < channelCount; i++)
+    {
+        for (u32 j = i; j > 0 && animatedMasks[channelOrder[j - 1]] > animatedMasks[channelOrder[j]]; j--)
+        {
+            Swap(u32, channelOrder[j - 1], channelOrder[j]);
+        }
+    }
+
+    AnimationErrorState state = {};
+    state.input               = input;
+    state.order               = order;
+    state.numSamples          = numSamples;
+    state.reference           = PushArrayNoZero(temp.arena, Mat4, numSamples * nodeCount);
+    state.current             = PushArrayNoZero(temp.arena, Mat4, numSamples * nodeCount);
+    state.trial               = PushArrayNoZero(temp.arena, Mat4, numSamples * nodeCount);
+    state.currentLocals       = PushArrayNoZero(temp.arena, AnimationTransform, numSamples * channelCount);
+    state.trialLocals         = PushArrayNoZero(temp.arena, AnimationTransform, numSamples * channelCount);
+    state.affected            = PushArrayNoZero(temp.arena, b8, nodeCount);
+    for (u32 sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+    {
+        ComputeObjectTransforms(input, order, samples + sampleIndex * channelCount,
+                                state.reference + sampleIndex * nodeCount);
+    }
+    MemoryCopy(state.current, state.reference, sizeof(Mat4) * numSamples * nodeCount);
+    MemoryCopy(state.currentLocals, samples, sizeof(AnimationTransform) * numSamples * channelCount);
+    MemoryCopy(state.trialLocals, samples, sizeof(AnimationTransform) * numSamples * channelCount);
+
+    // Each track takes the fewest bits that keep the whole clip within the bound, given the tracks before it
+    f32 quantizationError        = input->maxError - sampleError;
+    AnimationGroupFormat *groups = PushArray(arena, AnimationGroupFormat, numGroups);
+    u32 sampleStride             = 0;
+    for (u32 groupIndex = 0; groupIndex < numGroups; groupIndex++)
+    {
+        AnimationGroupFormat *format = &groups[groupIndex];
+        i32 laneChannels[ANIMATION_GROUP_SIZE];
+        for (u32 lane = 0; lane < ANIMATION_GROUP_SIZE; lane++)
+        {
+            u32 position       = groupIndex * ANIMATION_GROUP_SIZE + lane;
+            laneChannels[lane] = position < channelCount ? (i32)channelOrder[position] : -1;
+        }
+        for (u32 i = 0; i < nodeCount; i++)
+        {
+            u32 node   = order[i];
+            b8 inGroup = 0;
+            for (u32 lane = 0; lane < ANIMATION_GROUP_SIZE; lane++)
+            {
+                inGroup |= laneChannels[lane] == (i32)node;
+            }
+            i32 parent           = input->parents[node];
+            state.affected[node] = inGroup || (parent != -1 && state.affected[parent]);
+        }
+
+        for (u32 track = 0; track < AnimationTrack_Count; track++)
+        {
+            b32 accepted = 0;
+            for (u32 rate = 0; rate < ArrayLength(animationBitRates) && !accepted; rate++)
+            {
+                u32 bits = animationBitRates[rate];
+                accepted = QuantizeAnimationTrack(&state, samples, format, laneChannels, track, bits) &&
+                           EvaluateAnimationTrial(&state, quantizationError);
+                ResolveAnimationTrial(&state, laneChannels, accepted);
+            }
+            if (!accepted)
+            {
+                QuantizeAnimationTrack(&state, samples, format, laneChannels, track, 32);
+                ResolveAnimationTrial(&state, laneChannels, 0);
+            }
+        }
+
+        format->offset = sampleStride;
+        sampleStride += GetAnimationTrackSize(format->translationBits) + GetAnimationTrackSize(format->rotationBits) +
+                        GetAnimationTrackSize(format->scaleBits) + (format->rotationBits ? 1 : 0);
+    }
+
+    u8 *sampleData = PushArrayNoZero(arena, u8, numSamples * sampleStride);
+    for (u32 sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+    {
+        for (u32 groupIndex = 0; groupIndex < numGroups; groupIndex++)
+        {
+            AnimationGroupFormat *format = &groups[groupIndex];
+            u8 *data                     = sampleData + sampleIndex * sampleStride + format->offset;
+            u32 bits[]                   = {format->translationBits, format->rotationBits, format->scaleBits};
+            for (u32 track = 0; track < AnimationTrack_Count; track++)
+            {
+                f32 values[3][ANIMATION_GROUP_SIZE];
+                u32 indices = 0;
+                for (u32 lane = 0; lane < ANIMATION_GROUP_SIZE; lane++)
+                {
+                    u32 position = groupIndex * ANIMATION_GROUP_SIZE + lane;
+                    const AnimationTransform *transform =
+                        position < channelCount ? &samples[sampleIndex * channelCount + channelOrder[position]] : 0;
+                    f32 laneValues[3];
+                    indices |= GetAnimationTrackValues(transform, track, laneValues) << (2 * lane);
+                    for (u32 i = 0; i < 3; i++)
+                    {
+                        values[i][lane] = laneValues[i];
+                    }
+                }
+                if (track == AnimationTrack_Rotation && bits[track])
+                {
+                    *data++ = (u8)indices;
+                }
+                f32 *mins;
+                f32 *extents;
+                GetAnimationTrackRange(format, track, &mins, &extents);
+                data = PutAnimationTrack(data, values, bits[track], mins, extents);
+            }
+        }
+    }
+
+    // The decoded samples are stored in channel order of the input
+    out->groups       = groups;
+    out->numGroups    = numGroups;
+    out->sampleData   = sampleData;
+    out->sampleStride = sampleStride;
+    out->numSamples   = numSamples;
+    out->sampleRate   = sampleRate;
+    out->channelOrder = channelOrder;
+    out->maxError     = MeasureAnimationError(input, order, state.currentLocals, numSamples, sampleRate, sourceObjects);
+    out->size         = numSamples * sampleStride + numGroups * sizeof(AnimationGroupFormat);
+    ScratchEnd(temp);
+}
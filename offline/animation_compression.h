@@ -0,0 +1,47 @@
+#ifndef ANIMATION_COMPRESSION_H
+#define ANIMATION_COMPRESSION_H
+
+//////////////////////////////
+// Animation compression
+//
+struct AnimationCompressionInput
+{
+    // Channels are the first channelCount nodes, the nodes above them that aren't animated follow
+    u32 channelCount;
+    u32 nodeCount;
+    // -1 for roots
+    i32 *parents;
+    // Local transform of the nodes past channelCount
+    Mat4 *restTransforms;
+
+    // Uniformly sampled clip, sample i of channel c is sourceSamples[i * channelCount + c]
+    AnimationTransform *sourceSamples;
+    u32 sourceSampleCount;
+    f32 sourceSampleRate;
+    f32 duration;
+
+    // Largest distance a skinned vertex at shellDistance from its bone may move, in model units
+    f32 maxError;
+    f32 shellDistance;
+};
+
+struct CompressedAnimation
+{
+    AnimationGroupFormat *groups;
+    u32 numGroups;
+    u8 *sampleData;
+    u32 sampleStride;
+    u32 numSamples;
+    f32 sampleRate;
+
+    // Input channel stored at every position, channels are sorted so that tracks that compress alike share groups
+    u32 *channelOrder;
+
+    // Measured against the source samples
+    f32 maxError;
+    u64 size;
+};
+
+internal void CompressAnimation(Arena *arena, const AnimationCompressionInput *input, CompressedAnimation *out);
+
+#endif
@@ -17,6 +17,11 @@
 #define CGLTF_IMPLEMENTATION
 #include "../third_party/cgltf.h"
 
+#include "./block_compress.cpp"
+#include "./mip_generation.cpp"
+#include "./build_cache.cpp"
+#include "./animation_compression.cpp"
+
 #include <unordered_map>
 #include <atomic>
 
@@ -24,23 +29,26 @@ Engine *engine;
 //////////////////////////////
 // Globals
 //
-global i32 skeletonVersionNumber     = 1;
-global i32 animationFileVersion      = 1;
-global const string textureDirectory = "data/textures/";
-global const string ddsDirectory     = "data/textures/dds/";
+global i32 skeletonVersionNumber       = 3;
+global i32 animationFileVersion        = 4;
+global const string textureDirectory   = "data/textures/";
+global const string ddsDirectory       = "data/textures/dds/";
+global BC_Quality textureQuality       = BC_Quality_Normal;
+global const string buildCacheFilename = "data\\build_cache.bin";
+global b32 quantizeVertices            = 1;
+// Rate that animations are resampled to, in samples per second
+global f32 animationSampleRate         = 30.f;
+// Largest distance a skinned vertex animationShellDistance away from its bone may move, in model units
+global f32 animationMaxError           = 0.0001f;
+global f32 animationShellDistance      = 0.03f;
 
 //////////////////////////////
 // DDS
 //
 using namespace graphics;
 
-struct ReadbackTexture
-{
-    Texture texture;
-    string name;
-};
-
-internal void WriteImageToDDS(Texture *input, string name)
+// Levels are written largest first, back to back after the headers
+internal void WriteImageToDDS(BC_Image *levels, u32 levelCount, string name)
 {
     TempArena temp        = ScratchStart(0, 0);
     StringBuilder builder = {};
@@ -51,32 +59,37 @@ internal void WriteImageToDDS(Texture *input, string name)
     file.magic   = MakeFourCC('D', 'D', 'S', ' ');
 
     file.header.size              = sizeof(DDSHeader);
-    file.header.width             = input->desc.width;
-    file.header.height            = input->desc.height;
-    file.header.mipMapCount       = input->desc.numMips;
-    file.header.depth             = input->desc.depth;
-    file.header.pitchOrLinearSize = 0; // unused
-    file.header.flags             = HeaderFlagBits_Caps | HeaderFlagBits_Width | HeaderFlagBits_Height | HeaderFlagBits_PixelFormat;
-    file.header.caps              = DDSCaps_Texture;
-
-    switch (input->desc.format)
+    file.header.width             = levels[0].width;
+    file.header.height            = levels[0].height;
+    file.header.mipMapCount       = levelCount;
+    file.header.depth             = 1;
+    file.header.pitchOrLinearSize = (u32)levels[0].size;
+    file.header.flags = HeaderFlagBits_Caps | HeaderFlagBits_Width | HeaderFlagBits_Height | HeaderFlagBits_PixelFormat |
+                        HeaderFlagBits_LinearSize | HeaderFlagBits_Mipmap;
+    file.header.caps = DDSCaps_Texture;
+    if (levelCount > 1)
     {
-        case Format::BC1_RGB_UNORM:
-        {
-            file.header.format.flags |= PixelFormatFlagBits_FourCC;
-            file.header.format.fourCC = MakeFourCC('D', 'X', 'T', '1');
-            file.header.flags |= HeaderFlagBits_LinearSize;
-            file.header.pitchOrLinearSize = Max(1, ((file.header.width + 3) / 4) * 8);
-        }
-        break;
-        default: Assert(0);
+        file.header.caps |= DDSCaps_Complex | DDSCaps_Mipmap;
     }
 
+    // Every format goes through the DX10 header, BC7 and the srgb formats don't have a FourCC
+    file.header.format.size = sizeof(PixelFormat);
+    file.header.format.flags |= PixelFormatFlagBits_FourCC;
+    file.header.format.fourCC = MakeFourCC('D', 'X', '1', '0');
+
+    DDSHeaderDXT10 dx10Header    = {};
+    dx10Header.dxgiFormat        = BC_GetDXGIFormat(levels[0].format, levels[0].srgb);
+    dx10Header.resourceDimension = ResourceDimension_Texture2D;
+    dx10Header.arraySize         = 1;
+
     PutPointerValue(&builder, &file);
+    PutPointerValue(&builder, &dx10Header);
 
     // Write the file contents
-    TextureMappedData *data = &input->mappedData;
-    Put(&builder, data->mappedData, data->size);
+    for (u32 level = 0; level < levelCount; level++)
+    {
+        Put(&builder, levels[level].data, levels[level].size);
+    }
 
     string outpath = PushStr8F(temp.arena, "%S%S.dds", ddsDirectory, RemoveFileExtension(name));
     if (!WriteEntireFile(&builder, outpath))
@@ -86,40 +99,342 @@ internal void WriteImageToDDS(Texture *input, string name)
     ScratchEnd(temp);
 }
 
+// Diffuse textures become BC7 (BC1/BC3 with the fast preset), normal maps BC5, height maps BC4 and metallic
+// roughness maps BC5 with roughness in r and metallic in g. Every texture gets a full mip chain, filtered in linear
+// space. Must be called from outside of a job. Returns the number of textures written, which are compacted to the
+// front of textures.
+internal u32 CompressTextures(InputTexture *textures, u32 count, BC_Quality quality)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    TempArena temp             = ScratchStart(0, 0);
+    PerformanceCounter counter = OS_StartCounter();
+
+    struct DecodedTexture
+    {
+        u8 *texData;
+        BC_Format format;
+        b32 srgb;
+    };
+    DecodedTexture *decoded = PushArray(temp.arena, DecodedTexture, count);
+    MipChain *chains        = PushArray(temp.arena, MipChain, count);
+
+    // Decode
+    jobsystem::Counter jobCounter = {};
+    u32 groupSize                 = Max(1u, (count + 63) / 64);
+    jobsystem::KickJobs(
+        &jobCounter, count, groupSize, [&](jobsystem::JobArgs args) {
+            InputTexture *texture = &textures[args.jobId];
+            DecodedTexture *out   = &decoded[args.jobId];
+            MipChain *chain       = &chains[args.jobId];
+
+            TempArena scratch  = ScratchStart(0, 0);
+            string path        = PushStr8F(scratch.arena, "%S%S", textureDirectory, texture->name);
+            string textureData = platform.ReadEntireFile(scratch.arena, path);
+            if (textureData.size == 0)
+            {
+                Printf("Could not read texture %S\n", texture->name);
+                ScratchEnd(scratch);
+                return;
+            }
+            i32 width, height, nComponents;
+            u8 *texData = stbi_load_from_memory(textureData.str, (i32)textureData.size, &width, &height, &nComponents, 4);
+            ScratchEnd(scratch);
+            Assert(texData);
+            u64 texelCount = (u64)width * height;
+
+            BC_Format format = BC_Format_BC7;
+            b32 srgb         = 0;
+            u32 flags        = 0;
+            switch (texture->type)
+            {
+                case TextureType_Diffuse:
+                {
+                    srgb  = 1;
+                    flags = MipFlags_SRGB;
+                    if (quality == BC_Quality_Fast)
+                    {
+                        format = BC_Format_BC1;
+                        for (u64 i = 0; i < texelCount; i++)
+                        {
+                            if (texData[i * 4 + 3] != 255)
+                            {
+                                format = BC_Format_BC3;
+                                break;
+                            }
+                        }
+                    }
+                }
+                break;
+                case TextureType_Normal:
+                {
+                    format = BC_Format_BC5;
+                    flags  = MipFlags_Normal;
+                }
+                break;
+                case TextureType_Height: format = BC_Format_BC4; break;
+                case TextureType_MR:
+                {
+                    format = BC_Format_BC5;
+                    for (u64 i = 0; i < texelCount; i++)
+                    {
+                        texData[i * 4 + 0] = texData[i * 4 + 1];
+                        texData[i * 4 + 1] = texData[i * 4 + 2];
+                    }
+                }
+                break;
+                default: Assert(0);
+            }
+
+            out->texData       = texData;
+            out->format        = format;
+            out->srgb          = srgb;
+            chain->rgba        = texData;
+            chain->width       = width;
+            chain->height      = height;
+            chain->flags       = flags;
+            chain->alphaCutoff = texture->alphaCutoff;
+        },
+        jobsystem::Priority::High);
+    jobsystem::WaitJobs(&jobCounter);
+
+    // Drop the textures that failed to load
+    u32 validCount = 0;
+    for (u32 i = 0; i < count; i++)
+    {
+        if (decoded[i].texData)
+        {
+            textures[validCount] = textures[i];
+            decoded[validCount]  = decoded[i];
+            chains[validCount++] = chains[i];
+        }
+    }
+    count = validCount;
+
+    GenerateMipChains(temp.arena, chains, count, quality == BC_Quality_Fast ? MipFilter_Box : MipFilter_Kaiser);
+
+    // Compress every level of every texture in one batch
+    u32 *levelOffsets = PushArrayNoZero(temp.arena, u32, count + 1);
+    levelOffsets[0]   = 0;
+    for (u32 i = 0; i < count; i++)
+    {
+        levelOffsets[i + 1] = levelOffsets[i] + chains[i].levelCount;
+    }
+    u32 totalLevels    = levelOffsets[count];
+    BC_Source *sources = PushArrayNoZero(temp.arena, BC_Source, totalLevels);
+    BC_Image *images   = PushArrayNoZero(temp.arena, BC_Image, totalLevels);
+    u64 totalTexels    = 0;
+    for (u32 i = 0; i < count; i++)
+    {
+        for (u32 level = 0; level < chains[i].levelCount; level++)
+        {
+            BC_Source *source = &sources[levelOffsets[i] + level];
+            source->rgba      = chains[i].levels[level];
+            source->width     = chains[i].levelWidths[level];
+            source->height    = chains[i].levelHeights[level];
+            source->format    = decoded[i].format;
+            source->srgb      = decoded[i].srgb;
+            totalTexels += (u64)source->width * source->height;
+        }
+    }
+    BC_CompressBatch(temp.arena, sources, totalLevels, quality, images);
+    f32 ms = OS_GetMilliseconds(counter);
+
+    // Report the top level error and write
+    groupSize = Max(1u, (count + 63) / 64);
+    jobsystem::KickJobs(
+        &jobCounter, count, groupSize, [&](jobsystem::JobArgs args) {
+            u32 i            = args.jobId;
+            BC_Image *levels = &images[levelOffsets[i]];
+            MipChain *chain  = &chains[i];
+
+            TempArena scratch = ScratchStart(0, 0);
+            u8 *decompressed  = PushArrayNoZero(scratch.arena, u8, (u64)chain->width * chain->height * 4);
+            BC_Decompress(&levels[0], decompressed);
+            f32 psnr = BC_ComputePSNR(decoded[i].format, chain->rgba, decompressed, chain->width, chain->height);
+            Printf("%S: %S %u x %u, %u mips, %f dB\n", textures[i].name, BC_GetFormatName(decoded[i].format),
+                   chain->width, chain->height, chain->levelCount, psnr);
+
+            WriteImageToDDS(levels, chain->levelCount, textures[i].name);
+            ScratchEnd(scratch);
+        },
+        jobsystem::Priority::High);
+    jobsystem::WaitJobs(&jobCounter);
+
+    Printf("Compressed %u textures in %f ms (%f MPix/s)\n", count, ms, (f32)totalTexels / (ms * 1000.f));
+    for (u32 i = 0; i < count; i++)
+    {
+        stbi_image_free(decoded[i].texData);
+    }
+    ScratchEnd(temp);
+    return count;
+}
+
+//////////////////////////////
+// Build cache
+//
+// Names are copied to the arena, they outlive the gltf
+internal u32 GatherTextures(Arena *arena, cgltf_data *data, InputTexture *textures)
+{
+    u32 count = 0;
+    for (size_t i = 0; i < data->materials_count; i++)
+    {
+        cgltf_material &gltfMaterial = data->materials[i];
+
+        auto AddTexture = [&](cgltf_texture_view &view, TextureType type) {
+            if (!view.texture)
+            {
+                return;
+            }
+            Assert(!view.texture->image->buffer_view);
+            string name = PathSkipLastSlash(Str8C(view.texture->image->uri));
+            for (u32 textureIndex = 0; textureIndex < count; textureIndex++)
+            {
+                if (textures[textureIndex].name == name)
+                {
+                    return;
+                }
+            }
+            InputTexture &texture = textures[count++];
+            texture.name          = PushStr8Copy(arena, name);
+            texture.type          = type;
+            if (type == TextureType_Diffuse && gltfMaterial.alpha_mode == cgltf_alpha_mode_mask)
+            {
+                texture.alphaCutoff = gltfMaterial.alpha_cutoff;
+            }
+        };
+
+        if (gltfMaterial.has_pbr_metallic_roughness)
+        {
+            AddTexture(gltfMaterial.pbr_metallic_roughness.base_color_texture, TextureType_Diffuse);
+            AddTexture(gltfMaterial.pbr_metallic_roughness.metallic_roughness_texture, TextureType_MR);
+        }
+        else if (gltfMaterial.has_pbr_specular_glossiness)
+        {
+            AddTexture(gltfMaterial.pbr_specular_glossiness.diffuse_texture, TextureType_Diffuse);
+        }
+        AddTexture(gltfMaterial.normal_texture, TextureType_Normal);
+    }
+    return count;
+}
+
+// The gltf, its buffers and the file format versions. The buffers must be loaded.
+internal u64 HashGltfInputs(cgltf_data *data, string gltfPath)
+{
+    u64 hash = CombineBuildHash(BUILD_CACHE_VERSION, skeletonVersionNumber);
+    hash     = CombineBuildHash(hash, animationFileVersion);
+    hash     = CombineBuildHash(hash, quantizeVertices);
+    hash     = CombineBuildHash(hash, (u64)animationSampleRate);
+    hash     = CombineBuildHash(hash, HashBytes64(&animationMaxError, sizeof(animationMaxError)));
+    hash     = CombineBuildHash(hash, HashBytes64(&animationShellDistance, sizeof(animationShellDistance)));
+    hash     = HashBuildInput(gltfPath, hash);
+    for (size_t i = 0; i < data->buffers_count; i++)
+    {
+        hash = CombineBuildHash(hash, HashBytes64(data->buffers[i].data, data->buffers[i].size));
+    }
+    return hash;
+}
+
+// Compresses the textures whose source image or settings changed since the last build, in batches whose estimated
+// memory fits in the budget. Must be called from outside of a job.
+internal void BuildTextures(BuildCache *cache, InputTexture *textures, u32 count, BC_Quality quality, u64 memoryBudget)
+{
+    TempArena temp  = ScratchStart(0, 0);
+    u64 *memoryUsed = PushArray(temp.arena, u64, count);
+
+    jobsystem::Counter counter = {};
+    u32 groupSize              = Max(1u, (count + 63) / 64);
+    jobsystem::KickJobs(
+        &counter, count, groupSize, [&](jobsystem::JobArgs args) {
+            InputTexture *texture = &textures[args.jobId];
+            u64 settings          = CombineBuildHash(BUILD_CACHE_VERSION, quality);
+            settings              = CombineBuildHash(settings, texture->type);
+            settings              = CombineBuildHash(settings, HashBytes64(&texture->alphaCutoff, sizeof(f32)));
+
+            TempArena scratch  = ScratchStart(0, 0);
+            string path        = PushStr8F(scratch.arena, "%S%S", textureDirectory, texture->name);
+            string textureData = platform.ReadEntireFile(scratch.arena, path);
+            texture->hash      = CombineBuildHash(settings, HashBytes64(textureData.str, textureData.size));
+
+            // The rgba source and its mips, the float filter buffers and the compressed levels
+            i32 width, height, nComponents;
+            if (stbi_info_from_memory(textureData.str, (i32)textureData.size, &width, &height, &nComponents))
+            {
+                memoryUsed[args.jobId] = (u64)width * height * 16;
+            }
+            ScratchEnd(scratch);
+        },
+        jobsystem::Priority::High);
+    jobsystem::WaitJobs(&counter);
+
+    u32 missCount = 0;
+    for (u32 i = 0; i < count; i++)
+    {
+        string path   = PushStr8F(temp.arena, "%S%S", textureDirectory, textures[i].name);
+        string output = PushStr8F(temp.arena, "%S%S.dds", ddsDirectory, RemoveFileExtension(textures[i].name));
+        if (!CheckBuildCache(cache, BuildCacheKind_Texture, path, textures[i].hash, &output, 1))
+        {
+            memoryUsed[missCount] = memoryUsed[i];
+            textures[missCount++] = textures[i];
+        }
+    }
+
+    for (u32 batchStart = 0; batchStart < missCount;)
+    {
+        u32 batchEnd    = batchStart;
+        u64 batchMemory = 0;
+        while (batchEnd < missCount && (batchEnd == batchStart || batchMemory + memoryUsed[batchEnd] <= memoryBudget))
+        {
+            batchMemory += memoryUsed[batchEnd++];
+        }
+
+        InputTexture *batch = textures + batchStart;
+        u32 writtenCount    = CompressTextures(batch, batchEnd - batchStart, quality);
+        for (u32 i = 0; i < writtenCount; i++)
+        {
+            string path = PushStr8F(temp.arena, "%S%S", textureDirectory, batch[i].name);
+            UpdateBuildCache(cache, path, batch[i].hash);
+        }
+        batchStart = batchEnd;
+    }
+    ScratchEnd(temp);
+}
+
 //////////////////////////////
 // Optimization
 //
 
 struct VertData
 {
-    i32 *triangleIndices;
-    i32 remainingTriangles;
-    i32 totalTriangles;
+    // The live triangles are [0, remainingTriangles)
+    u32 *triangleIndices;
+    u32 remainingTriangles;
 
     i32 cachePos;
     f32 score;
 };
 
-struct LRUCache
-{
-    LRUCache *next;
-    VertData *vert;
-    i32 vertIndex;
-};
-
-struct TriData
+struct VertexCacheStats
 {
-    f32 totalScore;
-    i32 vertIndices[3];
-    b8 added;
+    // Transformed vertices per triangle. 0.5 is the best case for a regular grid, 3 the worst case
+    f32 acmr;
+    // Transformed vertices per unique vertex. 1 is the best case
+    f32 atvr;
 };
 
 const f32 lastTriangleScore = 0.75f;
 const f32 cacheDecayPower   = 1.5f;
-const i32 cacheSize         = 32;
+const u32 cacheSize         = 32;
 const f32 valenceBoostPower = 0.5f;
 const f32 valenceBoostScale = 2.f;
 
+// FIFO cache size used to measure the ACMR/ATVR and to find the overdraw clusters
+const u32 fifoCacheSize = 16;
+// Clusters can be split as long as the ACMR of the split stays within this factor of the whole cluster
+const f32 overdrawThreshold = 1.05f;
+
 internal f32 CalculateVertexScore(VertData *data)
 {
     if (data->remainingTriangles == 0)
@@ -141,7 +456,7 @@ internal f32 CalculateVertexScore(VertData *data)
         }
         else
         {
-            Assert(cachePosition < cacheSize);
+            Assert(cachePosition < (i32)cacheSize);
             score = 1.f - (cachePosition - 3) * (1.f / (cacheSize - 3));
             score = Powf(score, cacheDecayPower);
         }
@@ -151,255 +466,421 @@ internal f32 CalculateVertexScore(VertData *data)
     return score;
 }
 
-// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
-internal void OptimizeMesh(InputMesh::MeshSubset *mesh)
+// A vertex is in the FIFO cache if fewer than fifoCacheSize vertices have been transformed since it was
+internal u32 UpdateVertexCache(u32 *tri, u32 *timestamps, u32 *timestamp)
 {
-    TempArena temp = ScratchStart(0, 0);
-
-    u32 numFaces = (mesh->indexCount) / 3;
+    u32 misses = 0;
+    for (u32 i = 0; i < 3; i++)
+    {
+        if (*timestamp - timestamps[tri[i]] > fifoCacheSize)
+        {
+            timestamps[tri[i]] = (*timestamp)++;
+            misses++;
+        }
+    }
+    return misses;
+}
 
-    // TODO: this over allocates. maybe have multiple meshes w/ multiple materials?
-    u32 numVertices = mesh->vertexCount;
+internal u32 SimulateVertexCache(u32 *indices, u32 indexCount, u32 vertexCount, u8 *outTriangleMisses = 0)
+{
+    TempArena temp  = ScratchStart(0, 0);
+    u32 *timestamps = PushArray(temp.arena, u32, vertexCount);
+    u32 timestamp   = fifoCacheSize + 1;
 
-    TriData *triData   = PushArray(temp.arena, TriData, numFaces);
-    VertData *vertData = PushArray(temp.arena, VertData, numVertices);
+    u32 misses = 0;
+    for (u32 i = 0; i < indexCount / 3; i++)
+    {
+        u32 triangleMisses = UpdateVertexCache(indices + 3 * i, timestamps, &timestamp);
+        if (outTriangleMisses)
+        {
+            outTriangleMisses[i] = (u8)triangleMisses;
+        }
+        misses += triangleMisses;
+    }
+    ScratchEnd(temp);
+    return misses;
+}
 
-    u32 index = 0;
+internal VertexCacheStats AnalyzeVertexCache(u32 *indices, u32 indexCount, u32 vertexCount)
+{
+    TempArena temp = ScratchStart(0, 0);
+    b8 *used       = PushArray(temp.arena, b8, vertexCount);
 
-    // Increment per-vertex triangle count
-    for (u32 i = 0; i < numFaces; i++)
+    // NOTE: some models have unused vertices, so only the referenced ones count
+    u32 uniqueVertices = 0;
+    for (u32 i = 0; i < indexCount; i++)
     {
-        TriData *tri = triData + i;
-
-        for (u32 j = 0; j < 3; j++)
+        if (!used[indices[i]])
         {
-            u32 idx             = mesh->indices[index++];
-            tri->vertIndices[j] = idx;
-            vertData[idx].remainingTriangles++;
+            used[indices[i]] = 1;
+            uniqueVertices++;
         }
     }
+    u32 misses = SimulateVertexCache(indices, indexCount, vertexCount);
 
-    // Find the score for each vertex, allocate per vertex triangle list
-    for (u32 i = 0; i < numVertices; i++)
+    VertexCacheStats stats = {};
+    stats.acmr             = indexCount ? misses / (indexCount / 3.f) : 0.f;
+    stats.atvr             = uniqueVertices ? misses / (f32)uniqueVertices : 0.f;
+    ScratchEnd(temp);
+    return stats;
+}
+
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+// Linear in the number of triangles: the LRU is a fixed size array, every vertex only keeps its live triangles, and dead
+// ends are resolved from a stack of recently used vertices before falling back to a scan that only moves forward.
+internal void OptimizeVertexCache(u32 *indices, u32 indexCount, u32 vertexCount)
+{
+    TempArena temp = ScratchStart(0, 0);
+
+    u32 numFaces       = indexCount / 3;
+    VertData *vertData = PushArray(temp.arena, VertData, vertexCount);
+
+    for (u32 i = 0; i < indexCount; i++)
     {
-        VertData *vert = &vertData[i];
-        // Assert(vert->remainingTriangles != 0);
-        vert->cachePos        = -1;
-        vert->triangleIndices = PushArray(temp.arena, i32, vert->remainingTriangles);
-        vert->score           = CalculateVertexScore(vert);
+        Assert(indices[i] < vertexCount);
+        vertData[indices[i]].remainingTriangles++;
     }
 
-    // Add triangles to vertex list
-    for (u32 i = 0; i < numFaces; i++)
+    // Allocate the per vertex triangle lists out of one array
+    u32 *triangleLists = PushArrayNoZero(temp.arena, u32, indexCount);
+    u32 offset         = 0;
+    for (u32 i = 0; i < vertexCount; i++)
     {
-        TriData *tri = triData + i;
-        for (u32 j = 0; j < 3; j++)
-        {
-            u32 idx                                       = tri->vertIndices[j];
-            VertData *vert                                = vertData + idx;
-            vert->triangleIndices[vert->totalTriangles++] = i;
-            tri->totalScore += vert->score;
-        }
+        VertData *vert        = &vertData[i];
+        vert->triangleIndices = triangleLists + offset;
+        vert->cachePos        = -1;
+        offset += vert->remainingTriangles;
+        vert->remainingTriangles = 0;
+    }
+    for (u32 i = 0; i < indexCount; i++)
+    {
+        VertData *vert                                    = &vertData[indices[i]];
+        vert->triangleIndices[vert->remainingTriangles++] = i / 3;
+    }
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        vertData[i].score = CalculateVertexScore(&vertData[i]);
     }
 
+    f32 *triScores = PushArrayNoZero(temp.arena, f32, numFaces);
+    b8 *triAdded   = PushArray(temp.arena, b8, numFaces);
+
     i32 bestTriangle = -1;
     f32 bestScore    = -1.f;
     for (u32 i = 0; i < numFaces; i++)
     {
-        triData[i].totalScore = vertData[triData[i].vertIndices[0]].score + vertData[triData[i].vertIndices[1]].score + vertData[triData[i].vertIndices[2]].score;
-        if (bestTriangle == -1 || triData[i].totalScore > bestScore)
+        u32 *tri     = indices + 3 * i;
+        triScores[i] = vertData[tri[0]].score + vertData[tri[1]].score + vertData[tri[2]].score;
+        if (triScores[i] > bestScore)
         {
-            bestScore    = triData[i].totalScore;
+            bestScore    = triScores[i];
             bestTriangle = i;
         }
     }
 
-    // Initialize LRU
-    // 3 extra temp nodes
-    LRUCache *nodes = PushArrayNoZero(temp.arena, LRUCache, cacheSize + 3);
-
-    LRUCache *freeList = 0;
-    LRUCache *lruHead  = 0;
+    // 3 extra entries for the vertices of the emitted triangle
+    u32 *cache     = PushArrayNoZero(temp.arena, u32, cacheSize + 3);
+    u32 *newCache  = PushArrayNoZero(temp.arena, u32, cacheSize + 3);
+    u32 cacheCount = 0;
 
-    for (i32 i = 0; i < cacheSize + 3; i++)
-    {
-        StackPush(freeList, nodes + i);
-    }
+    // Every vertex is pushed once per triangle, so this can't overflow
+    u32 *deadEndStack = PushArrayNoZero(temp.arena, u32, indexCount);
+    u32 deadEndCount  = 0;
+    u32 scanCursor    = 0;
 
     u32 *drawOrderList = PushArrayNoZero(temp.arena, u32, numFaces);
 
     for (u32 i = 0; i < numFaces; i++)
     {
+        // None of the cached vertices have live triangles
         if (bestTriangle == -1)
         {
-            bestTriangle = -1;
-            bestScore    = -1.f;
-            for (u32 j = 0; j < numFaces; j++)
+            bestScore = -1.f;
+            while (deadEndCount && bestTriangle == -1)
+            {
+                VertData *vert = &vertData[deadEndStack[--deadEndCount]];
+                for (u32 j = 0; j < vert->remainingTriangles; j++)
+                {
+                    u32 triIndex = vert->triangleIndices[j];
+                    if (triScores[triIndex] > bestScore)
+                    {
+                        bestScore    = triScores[triIndex];
+                        bestTriangle = triIndex;
+                    }
+                }
+            }
+            for (; bestTriangle == -1; scanCursor++)
             {
-                TriData *tri = triData + j;
-                if (!tri->added && tri->totalScore > bestScore)
+                Assert(scanCursor < numFaces);
+                if (!triAdded[scanCursor])
                 {
-                    bestScore    = tri->totalScore;
-                    bestTriangle = j;
+                    bestTriangle = scanCursor;
                 }
             }
         }
-        Assert(bestTriangle != -1);
-        drawOrderList[i] = bestTriangle;
-        TriData *tri     = triData + bestTriangle;
-        Assert(tri->added == 0);
-        tri->added = true;
-
-        // For each vertex in the best triangle, update num remaining triangles for the vert, update
-        // the per vertex remaining triangle list
+        Assert(!triAdded[bestTriangle]);
+        drawOrderList[i]       = bestTriangle;
+        triAdded[bestTriangle] = 1;
+
+        // Remove the triangle from the live list of each of its vertices, and move the vertices to the front of the
+        // cache
+        u32 *tri          = indices + 3 * bestTriangle;
+        u32 newCacheCount = 0;
         for (u32 j = 0; j < 3; j++)
         {
-            i32 vertIndex  = tri->vertIndices[j];
-            VertData *vert = vertData + vertIndex;
-            for (i32 k = 0; k < vert->totalTriangles; k++)
+            VertData *vert = &vertData[tri[j]];
+            for (u32 k = 0; k < vert->remainingTriangles; k++)
             {
-                if (vert->triangleIndices[k] == bestTriangle)
+                if (vert->triangleIndices[k] == (u32)bestTriangle)
                 {
-                    vert->triangleIndices[k] = -1;
+                    vert->triangleIndices[k] = vert->triangleIndices[--vert->remainingTriangles];
                     break;
                 }
             }
-            Assert(vert->remainingTriangles-- > 0);
+            deadEndStack[deadEndCount++] = tri[j];
 
-            // Move corresponding LRU node to the front
-            LRUCache *node = 0;
-            // If not in cache, allocate new node
-            if (vert->cachePos == -1)
+            // Degenerate triangles can repeat a vertex
+            b32 repeated = (j > 0 && tri[j] == tri[0]) || (j > 1 && tri[j] == tri[1]);
+            if (!repeated)
             {
-                node = freeList;
-                StackPop(freeList);
-                node->vert      = vert;
-                node->vertIndex = vertIndex;
-                StackPush(lruHead, node);
+                newCache[newCacheCount++] = tri[j];
             }
-            // Find node in cache
-            // TODO: use doubly linked list so vert can directly get its LRU node and then remove
-            // it?
-            else
+        }
+        for (u32 j = 0; j < cacheCount; j++)
+        {
+            u32 vertIndex = cache[j];
+            if (vertIndex != tri[0] && vertIndex != tri[1] && vertIndex != tri[2])
             {
-                node           = lruHead;
-                LRUCache *last = 0;
-                while (node->vertIndex != vertIndex)
-                {
-                    last = node;
-                    node = node->next;
-                }
-                if (node != lruHead)
-                {
-                    Assert(last);
-                    last->next = node->next;
-                    StackPush(lruHead, node);
-                }
+                newCache[newCacheCount++] = vertIndex;
             }
         }
-        // Iterate over LRU, update positions in cache,
-        LRUCache *node = lruHead;
-        LRUCache *last = 0;
-        u32 pos        = 0;
 
-        u32 triIndicesToUpdate[256];
-        u32 triIndicesToUpdateCount = 0;
+        // Evict the vertices that no longer fit
+        for (u32 j = cacheSize; j < newCacheCount; j++)
+        {
+            VertData *vert = &vertData[newCache[j]];
+            vert->cachePos = -1;
+            vert->score    = CalculateVertexScore(vert);
+        }
+        Swap(u32 *, cache, newCache);
+        cacheCount = Min(newCacheCount, cacheSize);
+        for (u32 j = 0; j < cacheCount; j++)
+        {
+            VertData *vert = &vertData[cache[j]];
+            vert->cachePos = j;
+            vert->score    = CalculateVertexScore(vert);
+        }
 
-        while (node != 0 && pos < cacheSize)
+        // Only triangles touching the cache change score, the best of those is emitted next
+        bestTriangle = -1;
+        bestScore    = -1.f;
+        for (u32 j = 0; j < cacheCount; j++)
         {
-            VertData *vert = node->vert;
-            vert->cachePos = pos++;
-            for (i32 j = 0; j < vert->totalTriangles; j++)
+            VertData *vert = &vertData[cache[j]];
+            for (u32 k = 0; k < vert->remainingTriangles; k++)
             {
-                u32 triIndex = vert->triangleIndices[j];
-                if (triIndex != -1 && !triData[triIndex].added)
+                u32 triIndex        = vert->triangleIndices[k];
+                u32 *other          = indices + 3 * triIndex;
+                triScores[triIndex] = vertData[other[0]].score + vertData[other[1]].score + vertData[other[2]].score;
+                if (triScores[triIndex] > bestScore)
                 {
-                    b8 repeated = 0;
-                    for (u32 count = 0; count < triIndicesToUpdateCount; count++)
-                    {
-                        if (triIndicesToUpdate[count] == triIndex)
-                        {
-                            repeated = 1;
-                            break;
-                        }
-                    }
-                    Assert(triIndicesToUpdateCount < ArrayLength(triIndicesToUpdate));
-                    if (!repeated)
-                    {
-                        triIndicesToUpdate[triIndicesToUpdateCount++] = triIndex;
-                    }
+                    bestScore    = triScores[triIndex];
+                    bestTriangle = triIndex;
                 }
             }
-            last        = node;
-            node        = node->next;
-            vert->score = CalculateVertexScore(vert);
         }
+    }
+
+    // Rewrite indices in the new order
+    u32 *newIndices = PushArrayNoZero(temp.arena, u32, indexCount);
+    for (u32 i = 0; i < numFaces; i++)
+    {
+        u32 *tri              = indices + 3 * drawOrderList[i];
+        newIndices[3 * i + 0] = tri[0];
+        newIndices[3 * i + 1] = tri[1];
+        newIndices[3 * i + 2] = tri[2];
+    }
+    MemoryCopy(indices, newIndices, sizeof(u32) * numFaces * 3);
+
+    ScratchEnd(temp);
+}
+
+// Stable LSD radix sort, smallest key first
+internal void RadixSort(Arena *arena, f32 *keys, u32 *order, u32 count)
+{
+    u32 *bits  = PushArrayNoZero(arena, u32, count);
+    u32 *other = PushArrayNoZero(arena, u32, count);
+    for (u32 i = 0; i < count; i++)
+    {
+        u32 key;
+        MemoryCopy(&key, &keys[i], sizeof(key));
+        // Make the unsigned order match the float order
+        bits[i]  = (key & 0x80000000) ? ~key : (key | 0x80000000);
+        order[i] = i;
+    }
+
+    u32 *src = order;
+    u32 *dst = other;
+    for (u32 shift = 0; shift < 32; shift += 8)
+    {
+        u32 counts[256] = {};
+        for (u32 i = 0; i < count; i++)
+        {
+            counts[(bits[src[i]] >> shift) & 0xff]++;
+        }
+        u32 total = 0;
+        for (u32 i = 0; i < ArrayLength(counts); i++)
+        {
+            u32 bucketCount = counts[i];
+            counts[i]       = total;
+            total += bucketCount;
+        }
+        for (u32 i = 0; i < count; i++)
+        {
+            dst[counts[(bits[src[i]] >> shift) & 0xff]++] = src[i];
+        }
+        Swap(u32 *, src, dst);
+    }
+    // Even number of passes, so the result is already in order
+    Assert(src == order);
+}
+
+// Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+// The cache optimized order is split into clusters where the cache is flushed, and where splitting keeps the ACMR
+// within overdrawThreshold. Clusters facing away from the center of the mesh are likely occluders, so they are drawn
+// first.
+internal void OptimizeOverdraw(u32 *indices, u32 indexCount, V3 *positions, u32 vertexCount)
+{
+    u32 numFaces = indexCount / 3;
+    if (numFaces == 0)
+    {
+        return;
+    }
+
+    TempArena temp = ScratchStart(0, 0);
+
+    // Hard boundaries, where every vertex of the triangle misses
+    u8 *triangleMisses = PushArrayNoZero(temp.arena, u8, numFaces);
+    SimulateVertexCache(indices, indexCount, vertexCount, triangleMisses);
+
+    u32 *hardStarts    = PushArrayNoZero(temp.arena, u32, numFaces + 1);
+    u32 hardStartCount = 0;
+    for (u32 i = 0; i < numFaces; i++)
+    {
+        if (i == 0 || triangleMisses[i] == 3)
+        {
+            hardStarts[hardStartCount++] = i;
+        }
+    }
+    hardStarts[hardStartCount] = numFaces;
+
+    // Soft boundaries, simulated from a cold cache at the start of every cluster
+    u32 *clusterStarts = PushArrayNoZero(temp.arena, u32, numFaces + 1);
+    u32 clusterCount   = 0;
+    u32 *timestamps    = PushArray(temp.arena, u32, vertexCount);
+    u32 timestamp      = fifoCacheSize + 1;
+    for (u32 hardIndex = 0; hardIndex < hardStartCount; hardIndex++)
+    {
+        u32 start = hardStarts[hardIndex];
+        u32 end   = hardStarts[hardIndex + 1];
 
-        // Remove extra nodes from cache
-        last->next = 0;
-        while (node != 0)
+        u32 clusterMisses = 0;
+        for (u32 i = start; i < end; i++)
         {
-            node->vert->cachePos = -1;
-            node->vert           = 0;
-            last                 = node;
-            node                 = node->next;
-            StackPush(freeList, last);
+            clusterMisses += triangleMisses[i];
         }
+        f32 clusterThreshold = overdrawThreshold * clusterMisses / (f32)(end - start);
 
-        // Of the newly added triangles, find the best one to add next
-        bestTriangle = -1;
-        bestScore    = -1.f;
-        for (u32 j = 0; j < triIndicesToUpdateCount; j++)
+        clusterStarts[clusterCount++] = start;
+        timestamp += fifoCacheSize + 1;
+        u32 runningMisses = 0;
+        u32 runningFaces  = 0;
+        for (u32 i = start; i < end; i++)
         {
-            u32 triIndex    = triIndicesToUpdate[j];
-            tri             = triData + triIndex;
-            tri->totalScore = 0;
-            for (u32 k = 0; k < 3; k++)
-            {
-                tri->totalScore += vertData[tri->vertIndices[k]].score;
-            }
-            if (tri->totalScore > bestScore)
+            runningMisses += UpdateVertexCache(indices + 3 * i, timestamps, &timestamp);
+            runningFaces++;
+            if (i + 1 < end && runningMisses <= clusterThreshold * runningFaces)
             {
-                bestTriangle = triIndex;
-                bestScore    = tri->totalScore;
+                clusterStarts[clusterCount++] = i + 1;
+                timestamp += fifoCacheSize + 1;
+                runningMisses = 0;
+                runningFaces  = 0;
             }
         }
     }
+    clusterStarts[clusterCount] = numFaces;
 
-    // Sanity checks
-    // {
-    //     for (u32 i = 0; i < numVertices; i++)
-    //     {
-    //         VertData *vert = vertData + i;
-    //         Assert(vert->remainingTriangles == 0);
-    //     }
-    //
-    //     u32 *test     = PushArray(temp.arena, u32, mesh->vertexCount);
-    //     u32 testCount = 0;
-    //     for (u32 i = 0; i < mesh->indexCount; i++)
-    //     {
-    //         u32 vertexIndex = mesh->indices[i];
-    //         if (test[vertexIndex] == 0)
-    //         {
-    //             testCount++;
-    //             test[vertexIndex] = 1;
-    //         }
-    //     }
-    //     Assert(testCount == mesh->vertexCount);
-    // }
-
-    // Rewrite indices in the new order
-    u32 idxCount = 0;
+    // Area weighted centroids and normals
+    V3 meshCentroid = {};
+    f32 meshArea    = 0.f;
     for (u32 i = 0; i < numFaces; i++)
     {
-        TriData *tri = triData + drawOrderList[i];
-        for (u32 j = 0; j < 3; j++)
+        V3 p0    = positions[indices[3 * i + 0]];
+        V3 p1    = positions[indices[3 * i + 1]];
+        V3 p2    = positions[indices[3 * i + 2]];
+        f32 area = Length(Cross(p1 - p0, p2 - p0));
+        meshCentroid += (p0 + p1 + p2) * (area / 3.f);
+        meshArea += area;
+    }
+    if (meshArea > 0.f)
+    {
+        meshCentroid = meshCentroid / meshArea;
+    }
+
+    f32 *sortKeys = PushArrayNoZero(temp.arena, f32, clusterCount);
+    for (u32 clusterIndex = 0; clusterIndex < clusterCount; clusterIndex++)
+    {
+        V3 centroid = {};
+        V3 normal   = {};
+        f32 area    = 0.f;
+        for (u32 i = clusterStarts[clusterIndex]; i < clusterStarts[clusterIndex + 1]; i++)
+        {
+            V3 p0        = positions[indices[3 * i + 0]];
+            V3 p1        = positions[indices[3 * i + 1]];
+            V3 p2        = positions[indices[3 * i + 2]];
+            V3 n         = Cross(p1 - p0, p2 - p0);
+            f32 faceArea = Length(n);
+            centroid += (p0 + p1 + p2) * (faceArea / 3.f);
+            normal += n;
+            area += faceArea;
+        }
+        f32 normalLength = Length(normal);
+        if (area > 0.f && normalLength > 0.f)
+        {
+            centroid = centroid / area;
+            // Negated so that the clusters facing out sort first
+            sortKeys[clusterIndex] = -Dot(centroid - meshCentroid, normal / normalLength);
+        }
+        else
         {
-            mesh->indices[idxCount++] = tri->vertIndices[j];
+            sortKeys[clusterIndex] = 0.f;
         }
     }
 
-    // Rearrange the vertices based on the order of the faces
+    u32 *clusterOrder = PushArrayNoZero(temp.arena, u32, clusterCount);
+    RadixSort(temp.arena, sortKeys, clusterOrder, clusterCount);
+
+    u32 *newIndices = PushArrayNoZero(temp.arena, u32, numFaces * 3);
+    u32 idxCount    = 0;
+    for (u32 i = 0; i < clusterCount; i++)
+    {
+        u32 clusterIndex = clusterOrder[i];
+        u32 start        = clusterStarts[clusterIndex];
+        u32 end          = clusterStarts[clusterIndex + 1];
+        MemoryCopy(newIndices + idxCount, indices + 3 * start, sizeof(u32) * 3 * (end - start));
+        idxCount += 3 * (end - start);
+    }
+    Assert(idxCount == numFaces * 3);
+    MemoryCopy(indices, newIndices, sizeof(u32) * idxCount);
+
+    ScratchEnd(temp);
+}
+
+// Rearrange the vertices based on the order of the faces
+internal void OptimizeVertexFetch(InputMesh::MeshSubset *mesh)
+{
+    TempArena temp = ScratchStart(0, 0);
+
     V3 *newPositions = PushArray(temp.arena, V3, mesh->vertexCount);
     V3 *newNormals   = PushArray(temp.arena, V3, mesh->vertexCount);
     V3 *newTangents  = PushArray(temp.arena, V3, mesh->vertexCount);
@@ -485,27 +966,663 @@ internal void OptimizeMesh(InputMesh::MeshSubset *mesh)
     ScratchEnd(temp);
 }
 
+// Reorders the triangles for the post transform cache and then for overdraw, and the vertices for fetch locality
+internal void OptimizeMesh(InputMesh::MeshSubset *mesh)
+{
+    VertexCacheStats before = AnalyzeVertexCache(mesh->indices, mesh->indexCount, mesh->vertexCount);
+
+    OptimizeVertexCache(mesh->indices, mesh->indexCount, mesh->vertexCount);
+    OptimizeOverdraw(mesh->indices, mesh->indexCount, mesh->positions, mesh->vertexCount);
+    OptimizeVertexFetch(mesh);
+
+    VertexCacheStats after = AnalyzeVertexCache(mesh->indices, mesh->indexCount, mesh->vertexCount);
+    Printf("Optimized %S (%u triangles): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", mesh->materialName,
+           mesh->indexCount / 3, before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
 //////////////////////////////
-// Mesh cluster
+// Vertex welding
 //
-//
-struct TriangleAdjacency
+struct WeldKey
 {
-    u32 *counts;
-    u32 *offsets;
-    u32 *data;
+    i32 position[3];
+    i32 normal[3];
+    i32 uv[2];
+    i32 tangent[3];
+    u32 boneIds[4];
+    i32 boneWeights[4];
 };
 
-struct Cone
+inline i32 QuantizeWeld(f32 value, f32 scale)
+{
+    return (i32)Round(value * scale);
+}
+
+// Merges the vertices whose attributes are equal after quantization, and drops the triangles that become
+// degenerate. The vertices are compacted in place in the order of their first use.
+internal void WeldVertices(InputMesh::MeshSubset *subset)
+{
+    TempArena temp = ScratchStart(0, 0);
+
+    u32 vertexCount = subset->vertexCount;
+    Rect3 bounds;
+    Init(&bounds);
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        AddBounds(bounds, subset->positions[i]);
+    }
+    V3 extent           = bounds.maxP - bounds.minP;
+    f32 maxExtent       = Max(extent.x, Max(extent.y, extent.z));
+    f32 positionScale   = maxExtent > 0.f ? (f32)(1 << 20) / maxExtent : 0.f;
+    const f32 unitScale = 1024.f;
+    const f32 uvScale   = 65536.f;
+
+    WeldKey *keys = PushArray(temp.arena, WeldKey, vertexCount);
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        WeldKey *key = &keys[i];
+        for (u32 axis = 0; axis < 3; axis++)
+        {
+            key->position[axis] = QuantizeWeld(subset->positions[i][axis] - bounds.minP[axis], positionScale);
+            key->normal[axis]   = QuantizeWeld(subset->normals[i][axis], unitScale);
+            if (subset->tangents)
+            {
+                key->tangent[axis] = QuantizeWeld(subset->tangents[i][axis], unitScale);
+            }
+        }
+        if (subset->uvs)
+        {
+            key->uv[0] = QuantizeWeld(subset->uvs[i].x, uvScale);
+            key->uv[1] = QuantizeWeld(subset->uvs[i].y, uvScale);
+        }
+        if (subset->boneIds)
+        {
+            for (u32 j = 0; j < 4; j++)
+            {
+                key->boneIds[j]     = subset->boneIds[i][j];
+                key->boneWeights[j] = QuantizeWeld(subset->boneWeights[i][j], unitScale);
+            }
+        }
+    }
+
+    // Hashed on position, normal and uv, the rest only has to compare equal
+    u32 hashSize   = (u32)GetNextPowerOfTwo(vertexCount * 2);
+    i32 *hashHeads = PushArrayNoZero(temp.arena, i32, hashSize);
+    i32 *hashNext  = PushArrayNoZero(temp.arena, i32, vertexCount);
+    u32 *remap     = PushArrayNoZero(temp.arena, u32, vertexCount);
+    MemorySet(hashHeads, 0xff, sizeof(hashHeads[0]) * hashSize);
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        u32 slot  = (u32)HashBytes64(&keys[i], Offset(WeldKey, tangent)) & (hashSize - 1);
+        i32 match = -1;
+        for (i32 j = hashHeads[slot]; j != -1; j = hashNext[j])
+        {
+            if (MemoryCompare(&keys[j], &keys[i], sizeof(WeldKey)) == 0)
+            {
+                match = j;
+                break;
+            }
+        }
+        if (match == -1)
+        {
+            remap[i]        = i;
+            hashNext[i]     = hashHeads[slot];
+            hashHeads[slot] = i;
+        }
+        else
+        {
+            remap[i] = remap[match];
+        }
+    }
+
+    u32 indexCount = 0;
+    for (u32 i = 0; i < subset->indexCount; i += 3)
+    {
+        u32 a = remap[subset->indices[i + 0]];
+        u32 b = remap[subset->indices[i + 1]];
+        u32 c = remap[subset->indices[i + 2]];
+        if (a != b && b != c && c != a)
+        {
+            subset->indices[indexCount++] = a;
+            subset->indices[indexCount++] = b;
+            subset->indices[indexCount++] = c;
+        }
+    }
+
+    // Compact the remaining vertices, a vertex only ever moves down
+    i32 *order = PushArrayNoZero(temp.arena, i32, vertexCount);
+    MemorySet(order, 0xff, sizeof(order[0]) * vertexCount);
+    u32 count = 0;
+    for (u32 i = 0; i < indexCount; i++)
+    {
+        u32 vertexIndex = subset->indices[i];
+        if (order[vertexIndex] == -1)
+        {
+            order[vertexIndex] = count++;
+        }
+        subset->indices[i] = order[vertexIndex];
+    }
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        if (order[i] == -1)
+        {
+            continue;
+        }
+        u32 newIndex                = order[i];
+        subset->positions[newIndex] = subset->positions[i];
+        subset->normals[newIndex]   = subset->normals[i];
+        if (subset->uvs)
+        {
+            subset->uvs[newIndex] = subset->uvs[i];
+        }
+        if (subset->tangents)
+        {
+            subset->tangents[newIndex] = subset->tangents[i];
+        }
+        if (subset->boneIds)
+        {
+            subset->boneIds[newIndex]     = subset->boneIds[i];
+            subset->boneWeights[newIndex] = subset->boneWeights[i];
+        }
+    }
+
+    subset->vertexCount = count;
+    subset->indexCount  = indexCount;
+    ScratchEnd(temp);
+}
+
+//////////////////////////////
+// Tangents
+//
+// Unit vector perpendicular to n, for vertices without a usable uv gradient
+internal V3 GetAnyTangent(V3 n)
+{
+    V3 axis   = Abs(n.x) < 0.9f ? V3{1.f, 0.f, 0.f} : V3{0.f, 1.f, 0.f};
+    V3 result = NormalizeOrZero(axis - n * Dot(n, axis));
+    return result;
+}
+
+// Copies the attribute into a larger array, split vertices duplicate their source
+template <typename T>
+internal T *SplitVertices(Arena *arena, T *values, u32 *splits, u32 vertexCount, u32 newVertexCount)
+{
+    if (!values)
+    {
+        return 0;
+    }
+    T *result = PushArrayNoZero(arena, T, newVertexCount);
+    MemoryCopy(result, values, sizeof(T) * vertexCount);
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        result[splits[i]] = values[i];
+    }
+    return result;
+}
+
+// Follows MikkTSpace: the per triangle tangent is projected onto the plane of each corner's normal and weighted by
+// the corner's angle. Triangles with mirrored uvs are accumulated separately, and vertices shared by both
+// orientations are split. Vertices must already be welded, so that equal vertices are smoothed together. Only the
+// tangent is stored, the bitangent is cross(n, t).
+internal void GenerateTangents(InputMesh::MeshSubset *subset, Arena *arena)
+{
+    u32 vertexCount = subset->vertexCount;
+    if (!subset->uvs)
+    {
+        subset->tangents = PushArrayNoZero(arena, V3, vertexCount);
+        for (u32 i = 0; i < vertexCount; i++)
+        {
+            subset->tangents[i] = GetAnyTangent(subset->normals[i]);
+        }
+        return;
+    }
+
+    TempArena temp    = ScratchStart(&arena, 1);
+    u32 triangleCount = subset->indexCount / 3;
+
+    // Two groups per vertex, orientation preserving triangles and mirrored ones
+    V3 *sums     = PushArray(temp.arena, V3, vertexCount * 2);
+    b8 *used     = PushArray(temp.arena, b8, vertexCount * 2);
+    b8 *mirrored = PushArrayNoZero(temp.arena, b8, triangleCount);
+    for (u32 triangleIndex = 0; triangleIndex < triangleCount; triangleIndex++)
+    {
+        u32 *tri = &subset->indices[3 * triangleIndex];
+        V3 p[3]  = {subset->positions[tri[0]], subset->positions[tri[1]], subset->positions[tri[2]]};
+        V2 uv[3] = {subset->uvs[tri[0]], subset->uvs[tri[1]], subset->uvs[tri[2]]};
+
+        V3 d1          = p[1] - p[0];
+        V3 d2          = p[2] - p[0];
+        V2 t1          = uv[1] - uv[0];
+        V2 t2          = uv[2] - uv[0];
+        f32 signedArea = t1.x * t2.y - t1.y * t2.x;
+        V3 os          = NormalizeOrZero(t2.y * d1 - t1.y * d2);
+
+        mirrored[triangleIndex] = signedArea < 0.f;
+        if (mirrored[triangleIndex])
+        {
+            os = -os;
+        }
+        for (u32 corner = 0; corner < 3; corner++)
+        {
+            u32 group   = 2 * tri[corner] + mirrored[triangleIndex];
+            used[group] = 1;
+            if (signedArea == 0.f)
+            {
+                continue;
+            }
+            V3 n      = subset->normals[tri[corner]];
+            V3 e1     = p[(corner + 1) % 3] - p[corner];
+            V3 e2     = p[(corner + 2) % 3] - p[corner];
+            e1        = NormalizeOrZero(e1 - n * Dot(n, e1));
+            e2        = NormalizeOrZero(e2 - n * Dot(n, e2));
+            f32 angle = acosf(Clamp(Dot(e1, e2), -1.f, 1.f));
+            sums[group] += angle * NormalizeOrZero(os - n * Dot(n, os));
+        }
+    }
+
+    // The mirrored group of a vertex used by both gets a copy of the vertex
+    u32 *splits    = PushArrayNoZero(temp.arena, u32, vertexCount);
+    u32 splitCount = 0;
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        splits[i] = (used[2 * i] && used[2 * i + 1]) ? vertexCount + splitCount++ : i;
+    }
+    u32 newVertexCount = vertexCount + splitCount;
+    if (splitCount)
+    {
+        subset->positions   = SplitVertices(arena, subset->positions, splits, vertexCount, newVertexCount);
+        subset->normals     = SplitVertices(arena, subset->normals, splits, vertexCount, newVertexCount);
+        subset->uvs         = SplitVertices(arena, subset->uvs, splits, vertexCount, newVertexCount);
+        subset->boneIds     = SplitVertices(arena, subset->boneIds, splits, vertexCount, newVertexCount);
+        subset->boneWeights = SplitVertices(arena, subset->boneWeights, splits, vertexCount, newVertexCount);
+        for (u32 triangleIndex = 0; triangleIndex < triangleCount; triangleIndex++)
+        {
+            if (mirrored[triangleIndex])
+            {
+                for (u32 corner = 0; corner < 3; corner++)
+                {
+                    u32 *index = &subset->indices[3 * triangleIndex + corner];
+                    *index     = splits[*index];
+                }
+            }
+        }
+    }
+
+    subset->tangents = PushArrayNoZero(arena, V3, newVertexCount);
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        V3 preserving = NormalizeOrZero(sums[2 * i]);
+        V3 flipped    = NormalizeOrZero(sums[2 * i + 1]);
+
+        subset->tangents[i] = used[2 * i] ? preserving : flipped;
+        if (splits[i] != i)
+        {
+            subset->tangents[splits[i]] = flipped;
+        }
+    }
+    for (u32 i = 0; i < newVertexCount; i++)
+    {
+        if (Dot(subset->tangents[i], subset->tangents[i]) == 0.f)
+        {
+            subset->tangents[i] = GetAnyTangent(subset->normals[i]);
+        }
+    }
+
+    subset->vertexCount = newVertexCount;
+    ScratchEnd(temp);
+}
+
+//////////////////////////////
+// Vertex quantization
+//
+struct QuantizationError
+{
+    // Mesh space
+    f32 position;
+    // Degrees
+    f32 normal;
+    f32 tangent;
+    f32 uv;
+    f32 boneWeight;
+};
+
+// One byte per weight, the largest one absorbs the rounding so that they still add up to 1
+internal u32 PackBoneWeights(V4 weights)
+{
+    i32 quantized[4];
+    i32 sum     = 0;
+    u32 largest = 0;
+    for (u32 i = 0; i < 4; i++)
+    {
+        quantized[i] = (i32)CompressUnitFloat(Clamp(weights[i], 0.f, 1.f), 8);
+        sum += quantized[i];
+        largest = weights[i] > weights[largest] ? i : largest;
+    }
+    quantized[largest] = Min(Max(quantized[largest] + 255 - sum, 0), 255);
+
+    u32 result = 0;
+    for (u32 i = 0; i < 4; i++)
+    {
+        result |= (u32)quantized[i] << (8 * i);
+    }
+    return result;
+}
+
+internal V3 QuantizeTo16Bits(V3 p, V3 minP, V3 extent, U16V4 *out)
+{
+    V3 result;
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        f32 unit            = extent[axis] > 0.f ? Clamp((p[axis] - minP[axis]) / extent[axis], 0.f, 1.f) : 0.f;
+        out->elements[axis] = (u16)CompressUnitFloat(unit, 16);
+        result[axis]        = minP[axis] + DecompressUnitFloat(out->elements[axis], 16) * extent[axis];
+    }
+    out->w = 0;
+    return result;
+}
+
+inline f32 GetAngleError(V3 original, V3 decoded)
+{
+    f32 result = Degrees(acosf(Clamp(Dot(NormalizeOrZero(original), decoded), -1.f, 1.f)));
+    return result;
+}
+
+// Writes the vertex streams in the layout of Mesh::quantizedPositions etc. Positions are relative to the mesh bounds,
+// which the shaders also use to decode them.
+internal QuantizationError PutQuantizedVertices(StringBuilder *builder, InputMesh *mesh)
+{
+    TempArena temp          = ScratchStart(&builder->arena, 1);
+    QuantizationError error = {};
+    V3 minP                 = mesh->bounds.minP;
+    V3 extent               = mesh->bounds.maxP - mesh->bounds.minP;
+
+    for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+    {
+        InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+        U16V4 *positions              = PushArrayNoZero(temp.arena, U16V4, subset->vertexCount);
+        for (u32 i = 0; i < subset->vertexCount; i++)
+        {
+            V3 decoded     = QuantizeTo16Bits(subset->positions[i], minP, extent, &positions[i]);
+            error.position = Max(error.position, Length(decoded - subset->positions[i]));
+        }
+        Put(builder, positions, sizeof(positions[0]) * subset->vertexCount);
+    }
+    for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+    {
+        InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+        u32 *normals                  = PushArrayNoZero(temp.arena, u32, subset->vertexCount);
+        for (u32 i = 0; i < subset->vertexCount; i++)
+        {
+            normals[i]   = EncodeOctahedral(subset->normals[i]);
+            error.normal = Max(error.normal, GetAngleError(subset->normals[i], DecodeOctahedral(normals[i])));
+        }
+        Put(builder, normals, sizeof(normals[0]) * subset->vertexCount);
+    }
+    for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+    {
+        InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+        u32 *tangents                 = PushArrayNoZero(temp.arena, u32, subset->vertexCount);
+        for (u32 i = 0; i < subset->vertexCount; i++)
+        {
+            tangents[i]   = EncodeOctahedral(subset->tangents[i]);
+            error.tangent = Max(error.tangent, GetAngleError(subset->tangents[i], DecodeOctahedral(tangents[i])));
+        }
+        Put(builder, tangents, sizeof(tangents[0]) * subset->vertexCount);
+    }
+    if (mesh->flags & MeshFlags_Uvs)
+    {
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+            Assert(subset->uvs);
+            u32 *uvs = PushArrayNoZero(temp.arena, u32, subset->vertexCount);
+            for (u32 i = 0; i < subset->vertexCount; i++)
+            {
+                u16 u    = FloatToHalf(subset->uvs[i].x);
+                u16 v    = FloatToHalf(subset->uvs[i].y);
+                uvs[i]   = (u32)u | ((u32)v << 16);
+                error.uv = Max(error.uv, Abs(HalfToFloat(u) - subset->uvs[i].x));
+                error.uv = Max(error.uv, Abs(HalfToFloat(v) - subset->uvs[i].y));
+            }
+            Put(builder, uvs, sizeof(uvs[0]) * subset->vertexCount);
+        }
+    }
+    if (mesh->flags & MeshFlags_Skinned)
+    {
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+            Assert(subset->boneIds && subset->boneWeights);
+            u32 *boneIds     = PushArrayNoZero(temp.arena, u32, subset->vertexCount);
+            u32 *boneWeights = PushArrayNoZero(temp.arena, u32, subset->vertexCount);
+            for (u32 i = 0; i < subset->vertexCount; i++)
+            {
+                boneIds[i]     = 0;
+                boneWeights[i] = PackBoneWeights(subset->boneWeights[i]);
+                for (u32 j = 0; j < 4; j++)
+                {
+                    Assert(subset->boneIds[i][j] < 256);
+                    boneIds[i] |= subset->boneIds[i][j] << (8 * j);
+                    f32 decoded      = DecompressUnitFloat((boneWeights[i] >> (8 * j)) & 0xff, 8);
+                    error.boneWeight = Max(error.boneWeight, Abs(decoded - subset->boneWeights[i][j]));
+                }
+            }
+            Put(builder, boneIds, sizeof(boneIds[0]) * subset->vertexCount);
+            Put(builder, boneWeights, sizeof(boneWeights[0]) * subset->vertexCount);
+        }
+    }
+    ScratchEnd(temp);
+    return error;
+}
+
+// Bone ids are a byte each when quantized
+internal b32 CanQuantizeMesh(InputMesh *mesh)
+{
+    if (!(mesh->flags & MeshFlags_Skinned))
+    {
+        return 1;
+    }
+    for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+    {
+        InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+        for (u32 i = 0; i < subset->vertexCount; i++)
+        {
+            for (u32 j = 0; j < 4; j++)
+            {
+                if (subset->boneIds[i][j] >= 256)
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+//////////////////////////////
+// Mesh cluster
+//
+//
+struct TriangleAdjacency
+{
+    u32 *counts;
+    u32 *offsets;
+    u32 *data;
+};
+
+struct Cone
 {
     V3 pos;
     V3 normal;
 };
 
-const u32 clusterTriangleCount = 256;
-internal void BuildCluster(InputMesh::MeshSubset *subset)
+// Triangle culling launches one thread per triangle of a cluster, so clusters can't exceed CLUSTER_SIZE triangles
+const u32 clusterTriangleCount = CLUSTER_SIZE;
+const u32 clusterVertexCount   = 256;
+const u32 kdTreeLeafSize       = 8;
+
+struct KDTreeNode
 {
-    TempArena temp = ScratchStart(0, 0);
+    f32 split;
+    // 3 for leaves
+    u32 axis;
+    // Interior nodes: index of the right child, the left child is the next node. Leaves: first item.
+    u32 index;
+    // Leaves only
+    u32 count;
+};
+
+// Splits the triangle centers at the mean of the axis with the largest extent
+internal u32 BuildKDTree(KDTreeNode *nodes, u32 *nodeCount, Cone *cones, u32 *items, u32 first, u32 count)
+{
+    u32 nodeIndex    = (*nodeCount)++;
+    KDTreeNode *node = &nodes[nodeIndex];
+    node->axis       = 3;
+    node->index      = first;
+    node->count      = count;
+    if (count <= kdTreeLeafSize)
+    {
+        return nodeIndex;
+    }
+
+    Rect3 bounds;
+    Init(&bounds);
+    V3 mean = {};
+    for (u32 i = first; i < first + count; i++)
+    {
+        V3 pos = cones[items[i]].pos;
+        AddBounds(bounds, pos);
+        mean += pos;
+    }
+    mean      = mean / (f32)count;
+    V3 extent = bounds.maxP - bounds.minP;
+    u32 axis  = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+    f32 split = mean.elements[axis];
+
+    u32 mid = first;
+    for (u32 i = first; i < first + count; i++)
+    {
+        if (cones[items[i]].pos.elements[axis] < split)
+        {
+            Swap(u32, items[mid], items[i]);
+            mid++;
+        }
+    }
+    // Every center is on one side (e.g. duplicate triangles), just keep the leaf
+    if (mid == first || mid == first + count)
+    {
+        return nodeIndex;
+    }
+
+    node->split = split;
+    node->axis  = axis;
+    BuildKDTree(nodes, nodeCount, cones, items, first, mid - first);
+    u32 right   = BuildKDTree(nodes, nodeCount, cones, items, mid, first + count - mid);
+    node        = &nodes[nodeIndex];
+    node->index = right;
+    return nodeIndex;
+}
+
+// Finds the closest triangle that isn't in a cluster yet. Used triangles are removed from the leaves as they're found.
+internal void KDTreeFindNearest(KDTreeNode *nodes, u32 nodeIndex, Cone *cones, u32 *items, b8 *used, V3 pos,
+                                u32 *outTriangle, f32 *outDistance)
+{
+    KDTreeNode *node = &nodes[nodeIndex];
+    if (node->axis == 3)
+    {
+        for (u32 i = 0; i < node->count;)
+        {
+            u32 triangle = items[node->index + i];
+            if (used[triangle])
+            {
+                items[node->index + i] = items[node->index + --node->count];
+                continue;
+            }
+            f32 distance = Length(cones[triangle].pos - pos);
+            if (distance < *outDistance)
+            {
+                *outTriangle = triangle;
+                *outDistance = distance;
+            }
+            i++;
+        }
+        return;
+    }
+
+    f32 delta   = pos.elements[node->axis] - node->split;
+    u32 nearest = delta < 0.f ? nodeIndex + 1 : node->index;
+    u32 other   = delta < 0.f ? node->index : nodeIndex + 1;
+    KDTreeFindNearest(nodes, nearest, cones, items, used, pos, outTriangle, outDistance);
+    if (Abs(delta) <= *outDistance)
+    {
+        KDTreeFindNearest(nodes, other, cones, items, used, pos, outTriangle, outDistance);
+    }
+}
+
+internal void ComputeClusterBounds(InputMesh::MeshSubset *subset, Cone *cones, u32 firstTriangle, u32 triangleCount,
+                                   Mesh::Cluster *cluster)
+{
+    Init(&cluster->bounds);
+    for (u32 i = firstTriangle * 3; i < (firstTriangle + triangleCount) * 3; i++)
+    {
+        AddBounds(cluster->bounds, subset->positions[subset->indices[i]]);
+    }
+    V3 center  = GetCenter(cluster->bounds);
+    f32 radius = 0.f;
+    for (u32 i = firstTriangle * 3; i < (firstTriangle + triangleCount) * 3; i++)
+    {
+        radius = Max(radius, Length(subset->positions[subset->indices[i]] - center));
+    }
+    cluster->sphereCenter = center;
+    cluster->sphereRadius = radius;
+
+    // Normal cone. Can't cull if the normals span more than ~84 degrees from the average.
+    cluster->coneApex   = center;
+    cluster->coneAxis   = {};
+    cluster->coneCutoff = 1.f;
+
+    V3 axis = {};
+    for (u32 i = firstTriangle; i < firstTriangle + triangleCount; i++)
+    {
+        axis += cones[i].normal;
+    }
+    f32 axisLength = Length(axis);
+    if (axisLength == 0.f)
+    {
+        return;
+    }
+    axis = axis / axisLength;
+
+    f32 minDot = 1.f;
+    for (u32 i = firstTriangle; i < firstTriangle + triangleCount; i++)
+    {
+        // Degenerate triangles can't be seen anyways
+        if (cones[i].normal == V3{}) continue;
+        minDot = Min(minDot, Dot(cones[i].normal, axis));
+    }
+    if (minDot <= 0.1f)
+    {
+        return;
+    }
+
+    // Move the apex back along the axis until it's behind the plane of every triangle
+    f32 maxT = 0.f;
+    for (u32 i = firstTriangle; i < firstTriangle + triangleCount; i++)
+    {
+        if (cones[i].normal == V3{}) continue;
+        f32 distance = Dot(center - cones[i].pos, cones[i].normal);
+        maxT         = Max(maxT, distance / Dot(axis, cones[i].normal));
+    }
+    cluster->coneApex   = center - axis * maxT;
+    cluster->coneAxis   = axis;
+    cluster->coneCutoff = SquareRoot(1.f - minDot * minDot);
+}
+
+// Greedily grows clusters over the triangle adjacency, preferring triangles that add the fewest new vertices and are
+// closest to the cluster in position and orientation. When nothing connected fits, the next cluster is seeded from
+// the nearest unused triangle in a k-d tree. Reorders the subset's indices so clusters are contiguous.
+internal void BuildCluster(InputMesh::MeshSubset *subset, Arena *arena)
+{
+    TempArena temp = ScratchStart(&arena, 1);
     TriangleAdjacency adjacency;
     u32 faceCount = subset->indexCount / 3;
     // Build vertex->triangle index adjacency list
@@ -575,80 +1692,2791 @@ internal void BuildCluster(InputMesh::MeshSubset *subset)
     Assert(faceCount != 0.f);
     f32 triangleAvgArea       = meshArea * 0.5f / faceCount;
     f32 clusterExpectedRadius = SquareRoot(triangleAvgArea * clusterTriangleCount) * 0.5f;
+    f32 invExpectedRadius     = clusterExpectedRadius == 0.f ? 0.f : 1.f / clusterExpectedRadius;
 
-    struct KDTreeNode
+    KDTreeNode *nodes = PushArrayNoZero(temp.arena, KDTreeNode, faceCount * 2);
+    u32 *items        = PushArrayNoZero(temp.arena, u32, faceCount);
+    u32 nodeCount     = 0;
+    for (u32 i = 0; i < faceCount; i++)
     {
-    };
-}
+        items[i] = i;
+    }
+    BuildKDTree(nodes, &nodeCount, cones, items, 0, faceCount);
+
+    // Live adjacency. Triangles are removed from the lists once they're in a cluster.
+    u32 *liveCounts = PushArrayNoZero(temp.arena, u32, subset->vertexCount);
+    MemoryCopy(liveCounts, adjacency.counts, sizeof(u32) * subset->vertexCount);
+
+    b8 *used              = PushArray(temp.arena, b8, faceCount);
+    u32 *triangleClusters = PushArrayNoZero(temp.arena, u32, faceCount);
+    u32 *clusterSizes     = PushArray(temp.arena, u32, faceCount);
+    // Cluster index + 1 of the last cluster the vertex was added to
+    u32 *vertexTags = PushArray(temp.arena, u32, subset->vertexCount);
+
+    u32 clusterVertices[clusterVertexCount];
+    u32 numVertices      = 0;
+    u32 numTriangles     = 0;
+    u32 numClusters      = 0;
+    V3 centerSum         = {};
+    V3 normalSum         = {};
+    V3 lastClusterCenter = cones[0].pos;
+
+    for (u32 emitted = 0; emitted < faceCount; emitted++)
+    {
+        u32 tag   = numClusters + 1;
+        V3 center = numTriangles ? centerSum / (f32)numTriangles : lastClusterCenter;
+        V3 normal = Length(normalSum) == 0.f ? V3{} : Normalize(normalSum);
+        u32 best  = ~0u;
+        u32 extra = 3;
+
+        // Pick the best triangle connected to the cluster
+        f32 bestScore = FLT_MAX;
+        for (u32 i = 0; i < numVertices; i++)
+        {
+            u32 vertex = clusterVertices[i];
+            for (u32 j = 0; j < liveCounts[vertex]; j++)
+            {
+                u32 triangle    = adjacency.data[adjacency.offsets[vertex] + j];
+                u32 newVertices = 0;
+                for (u32 k = 0; k < 3; k++)
+                {
+                    newVertices += vertexTags[subset->indices[triangle * 3 + k]] != tag;
+                }
+                if (numVertices + newVertices > clusterVertexCount) continue;
+
+                f32 score = Length(cones[triangle].pos - center) * invExpectedRadius +
+                            (1.f - Dot(cones[triangle].normal, normal));
+                if (newVertices < extra || (newVertices == extra && score < bestScore))
+                {
+                    best      = triangle;
+                    extra     = newVertices;
+                    bestScore = score;
+                }
+            }
+        }
+
+        // Nothing connected, continue from the closest triangle instead
+        if (best == ~0u)
+        {
+            f32 distance = FLT_MAX;
+            KDTreeFindNearest(nodes, 0, cones, items, used, center, &best, &distance);
+            Assert(best != ~0u);
+            extra = 0;
+            for (u32 k = 0; k < 3; k++)
+            {
+                extra += vertexTags[subset->indices[best * 3 + k]] != tag;
+            }
+        }
+
+        // Start a new cluster if the triangle doesn't fit
+        if (numTriangles == clusterTriangleCount || numVertices + extra > clusterVertexCount)
+        {
+            lastClusterCenter = centerSum / (f32)numTriangles;
+            numClusters++;
+            tag          = numClusters + 1;
+            numVertices  = 0;
+            numTriangles = 0;
+            centerSum    = {};
+            normalSum    = {};
+        }
+
+        // Add the triangle to the cluster
+        used[best]             = 1;
+        triangleClusters[best] = numClusters;
+        clusterSizes[numClusters]++;
+        numTriangles++;
+        centerSum += cones[best].pos;
+        normalSum += cones[best].normal;
+        for (u32 k = 0; k < 3; k++)
+        {
+            u32 vertex = subset->indices[best * 3 + k];
+            if (vertexTags[vertex] != tag)
+            {
+                vertexTags[vertex]             = tag;
+                clusterVertices[numVertices++] = vertex;
+            }
+
+            u32 *triangles = adjacency.data + adjacency.offsets[vertex];
+            for (u32 j = 0; j < liveCounts[vertex]; j++)
+            {
+                if (triangles[j] == best)
+                {
+                    triangles[j] = triangles[--liveCounts[vertex]];
+                    break;
+                }
+            }
+        }
+    }
+    numClusters++;
+
+    // Reorder the indices by cluster. Triangles keep their relative order within a cluster, so the vertex cache
+    // ordering from OptimizeMesh is mostly preserved.
+    u32 *clusterOffsets = PushArrayNoZero(temp.arena, u32, numClusters);
+    u32 offset          = 0;
+    for (u32 i = 0; i < numClusters; i++)
+    {
+        clusterOffsets[i] = offset;
+        offset += clusterSizes[i];
+    }
+    Assert(offset == faceCount);
+
+    u32 *newIndices = PushArrayNoZero(temp.arena, u32, faceCount * 3);
+    Cone *newCones  = PushArrayNoZero(temp.arena, Cone, faceCount);
+    for (u32 i = 0; i < faceCount; i++)
+    {
+        u32 newTriangle                 = clusterOffsets[triangleClusters[i]]++;
+        newIndices[newTriangle * 3 + 0] = subset->indices[i * 3 + 0];
+        newIndices[newTriangle * 3 + 1] = subset->indices[i * 3 + 1];
+        newIndices[newTriangle * 3 + 2] = subset->indices[i * 3 + 2];
+        newCones[newTriangle]           = cones[i];
+    }
+    MemoryCopy(subset->indices, newIndices, sizeof(u32) * faceCount * 3);
+
+    subset->clusterCount = numClusters;
+    subset->clusters     = PushArrayNoZero(arena, Mesh::Cluster, numClusters);
+    u32 firstTriangle    = 0;
+    for (u32 i = 0; i < numClusters; i++)
+    {
+        Mesh::Cluster *cluster = &subset->clusters[i];
+        Assert(clusterSizes[i] <= clusterTriangleCount);
+        ComputeClusterBounds(subset, newCones, firstTriangle, clusterSizes[i], cluster);
+        cluster->subsetIndex = 0;
+        cluster->indexStart  = firstTriangle * 3;
+        cluster->indexCount  = clusterSizes[i] * 3;
+        firstTriangle += clusterSizes[i];
+    }
+    ScratchEnd(temp);
+}
 
 //////////////////////////////
-// Bounds
+// Level of detail
 //
-internal void SkinModelToBindPose(Skeleton *skeleton, Mat4 *outFinalTransforms)
+
+// Every level targets this fraction of the triangles of the previous one
+const f32 lodReductionRatio = 0.5f;
+// Stop once a level can't get below this fraction of the previous one, or the previous one is already small
+const f32 lodMinReduction = 0.8f;
+const u32 lodMinTriangles = 64;
+// Collapses are rejected above this error, as a fraction of the largest extent of the subset
+const f32 lodMaxError = 0.05f;
+// Open boundaries get extra planes perpendicular to their triangles so they stay in place
+const f32 lodBorderWeight = 10.f;
+// Normal and uv differences are added to the cost, so collapses across attribute discontinuities happen last
+const f32 lodAttributeWeight = 0.001f;
+
+enum VertexKind : u8
 {
-    TempArena temp          = ScratchStart(0, 0);
-    Mat4 *transformToParent = PushArray(temp.arena, Mat4, skeleton->count);
-    i32 previousId          = -1;
+    VertexKind_Manifold,
+    // On an open boundary, can only collapse along the boundary
+    VertexKind_Border,
+    // Uv/normal seams and non manifold vertices
+    VertexKind_Locked,
+};
 
-    for (i32 id = 0; id < (i32)skeleton->count; id++)
+// Symmetric 4x4 matrix. The error of a point is the weighted mean of its squared distances to the accumulated planes,
+// so it stays a squared distance however large the triangles that contributed are.
+struct Quadric
+{
+    f32 a00, a11, a22;
+    f32 a01, a02, a12;
+    f32 b0, b1, b2;
+    f32 c;
+    // Sum of the plane weights
+    f32 w;
+};
+
+struct EdgeCollapse
+{
+    u32 from;
+    u32 to;
+    // Squared distance part of the cost, in the unit cube
+    f32 error;
+};
+
+internal void AddPlane(Quadric *q, V3 normal, f32 d, f32 weight)
+{
+    q->a00 += weight * normal.x * normal.x;
+    q->a11 += weight * normal.y * normal.y;
+    q->a22 += weight * normal.z * normal.z;
+    q->a01 += weight * normal.x * normal.y;
+    q->a02 += weight * normal.x * normal.z;
+    q->a12 += weight * normal.y * normal.z;
+    q->b0 += weight * normal.x * d;
+    q->b1 += weight * normal.y * d;
+    q->b2 += weight * normal.z * d;
+    q->c += weight * d * d;
+    q->w += weight;
+}
+
+internal void AddQuadric(Quadric *q, Quadric *other)
+{
+    q->a00 += other->a00;
+    q->a11 += other->a11;
+    q->a22 += other->a22;
+    q->a01 += other->a01;
+    q->a02 += other->a02;
+    q->a12 += other->a12;
+    q->b0 += other->b0;
+    q->b1 += other->b1;
+    q->b2 += other->b2;
+    q->c += other->c;
+    q->w += other->w;
+}
+
+internal f32 EvaluateQuadric(Quadric *q, V3 p)
+{
+    f32 result = q->a00 * p.x * p.x + q->a11 * p.y * p.y + q->a22 * p.z * p.z;
+    result += 2.f * (q->a01 * p.x * p.y + q->a02 * p.x * p.z + q->a12 * p.y * p.z);
+    result += 2.f * (q->b0 * p.x + q->b1 * p.y + q->b2 * p.z) + q->c;
+    result = q->w > 0.f ? result / q->w : 0.f;
+    // Can go slightly negative from rounding
+    return Max(result, 0.f);
+}
+
+// Triangles of each vertex. If remap is set, vertices are remapped first.
+internal TriangleAdjacency BuildTriangleAdjacency(Arena *arena, u32 *indices, u32 indexCount, u32 vertexCount, u32 *remap = 0)
+{
+    TriangleAdjacency adjacency;
+    adjacency.counts  = PushArray(arena, u32, vertexCount);
+    adjacency.offsets = PushArrayNoZero(arena, u32, vertexCount);
+    adjacency.data    = PushArrayNoZero(arena, u32, indexCount);
+
+    for (u32 i = 0; i < indexCount; i++)
     {
-        Mat4 parentTransform = skeleton->transformsToParent[id];
-        i32 parentId         = skeleton->parents[id];
-        if (parentId == -1)
+        u32 index = remap ? remap[indices[i]] : indices[i];
+        adjacency.counts[index]++;
+    }
+    u32 offset = 0;
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        adjacency.offsets[i] = offset;
+        offset += adjacency.counts[i];
+    }
+    for (u32 i = 0; i < indexCount; i++)
+    {
+        u32 index                                  = remap ? remap[indices[i]] : indices[i];
+        adjacency.data[adjacency.offsets[index]++] = i / 3;
+    }
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        adjacency.offsets[i] -= adjacency.counts[i];
+    }
+    return adjacency;
+}
+
+// Moving from onto to can't turn any of the remaining triangles of from around
+internal b32 HasTriangleFlips(TriangleAdjacency *adjacency, u32 *indices, V3 *positions, u32 from, u32 to)
+{
+    V3 p0 = positions[from];
+    V3 p1 = positions[to];
+    for (u32 i = 0; i < adjacency->counts[from]; i++)
+    {
+        u32 *tri   = indices + 3 * adjacency->data[adjacency->offsets[from] + i];
+        u32 corner = tri[0] == from ? 0 : (tri[1] == from ? 1 : 2);
+        u32 a      = tri[(corner + 1) % 3];
+        u32 b      = tri[(corner + 2) % 3];
+        // Removed by the collapse
+        if (a == to || b == to)
         {
-            transformToParent[id] = parentTransform;
+            continue;
         }
-        else
+        V3 oldNormal = Cross(positions[a] - p0, positions[b] - p0);
+        V3 newNormal = Cross(positions[a] - p1, positions[b] - p1);
+        if (Dot(oldNormal, newNormal) <= 0.f)
         {
-            Assert(!IsZero(transformToParent[parentId]));
-            transformToParent[id] = transformToParent[parentId] * parentTransform;
+            return 1;
         }
+    }
+    return 0;
+}
 
-        Assert(id > previousId);
-        previousId = id;
-        // TODO: there's probably a way of representing this in non matrix form somehow
-        outFinalTransforms[id] = transformToParent[id] * skeleton->inverseBindPoses[id];
+// Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics". Edges collapse onto one of their
+// vertices, so the result still indexes the vertices of the subset. Writes at most subset->indexCount indices, and
+// returns the count. outError is the mesh space distance from the subset. Vertices set in lockedVertices don't move.
+internal u32 SimplifyMesh(u32 *outIndices, InputMesh::MeshSubset *subset, u32 targetIndexCount, f32 *outError,
+                          b8 *lockedVertices = 0)
+{
+    TempArena temp = ScratchStart(0, 0);
+
+    u32 vertexCount = subset->vertexCount;
+    u32 indexCount  = subset->indexCount;
+    MemoryCopy(outIndices, subset->indices, sizeof(u32) * indexCount);
+
+    // Work in a unit cube so the error limit doesn't depend on the scale of the mesh
+    Rect3 bounds;
+    Init(&bounds);
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        AddBounds(bounds, subset->positions[i]);
+    }
+    V3 extent     = bounds.maxP - bounds.minP;
+    f32 maxExtent = Max(extent.x, Max(extent.y, extent.z));
+    f32 scale     = maxExtent > 0.f ? 1.f / maxExtent : 0.f;
+    V3 *positions = PushArrayNoZero(temp.arena, V3, vertexCount);
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        positions[i] = (subset->positions[i] - bounds.minP) * scale;
+    }
+
+    // Vertices at the same position (uv and normal seams) are welded into the first one for the topology
+    u32 *wedges      = PushArrayNoZero(temp.arena, u32, vertexCount);
+    u32 *wedgeCounts = PushArray(temp.arena, u32, vertexCount);
+    {
+        u32 hashSize   = (u32)GetNextPowerOfTwo(vertexCount * 2);
+        i32 *hashHeads = PushArrayNoZero(temp.arena, i32, hashSize);
+        i32 *hashNext  = PushArrayNoZero(temp.arena, i32, vertexCount);
+        MemorySet(hashHeads, 0xff, sizeof(hashHeads[0]) * hashSize);
+        for (u32 i = 0; i < vertexCount; i++)
+        {
+            u32 slot  = (u32)HashBytes64(&subset->positions[i], sizeof(V3)) & (hashSize - 1);
+            i32 match = -1;
+            for (i32 j = hashHeads[slot]; j != -1; j = hashNext[j])
+            {
+                if (subset->positions[j] == subset->positions[i])
+                {
+                    match = j;
+                    break;
+                }
+            }
+            if (match == -1)
+            {
+                wedges[i]       = i;
+                hashNext[i]     = hashHeads[slot];
+                hashHeads[slot] = i;
+            }
+            else
+            {
+                wedges[i] = (u32)match;
+            }
+            wedgeCounts[wedges[i]]++;
+        }
+    }
+
+    // Classify the welded vertices, and find the quadrics of their planes. An edge is on an open boundary if no
+    // triangle uses it in the opposite direction.
+    u32 faceCount     = indexCount / 3;
+    VertexKind *kinds = PushArray(temp.arena, VertexKind, vertexCount);
+    u32 *borderNext   = PushArrayNoZero(temp.arena, u32, vertexCount);
+    u32 *borderPrev   = PushArrayNoZero(temp.arena, u32, vertexCount);
+    Quadric *quadrics = PushArray(temp.arena, Quadric, vertexCount);
+    MemorySet(borderNext, 0xff, sizeof(borderNext[0]) * vertexCount);
+    MemorySet(borderPrev, 0xff, sizeof(borderPrev[0]) * vertexCount);
+    {
+        TriangleAdjacency adjacency = BuildTriangleAdjacency(temp.arena, outIndices, indexCount, vertexCount, wedges);
+        for (u32 i = 0; i < faceCount; i++)
+        {
+            u32 *tri = outIndices + 3 * i;
+            V3 p0    = positions[tri[0]];
+            V3 p1    = positions[tri[1]];
+            V3 p2    = positions[tri[2]];
+
+            V3 normal = Cross(p1 - p0, p2 - p0);
+            f32 area  = Length(normal);
+            if (area == 0.f)
+            {
+                continue;
+            }
+            normal = normal / area;
+            for (u32 j = 0; j < 3; j++)
+            {
+                AddPlane(&quadrics[wedges[tri[j]]], normal, -Dot(normal, p0), area);
+            }
+
+            for (u32 j = 0; j < 3; j++)
+            {
+                u32 a = wedges[tri[j]];
+                u32 b = wedges[tri[(j + 1) % 3]];
+                if (a == b)
+                {
+                    continue;
+                }
+                b32 open = 1;
+                for (u32 k = 0; k < adjacency.counts[b] && open; k++)
+                {
+                    u32 *other = outIndices + 3 * adjacency.data[adjacency.offsets[b] + k];
+                    for (u32 corner = 0; corner < 3; corner++)
+                    {
+                        if (wedges[other[corner]] == b && wedges[other[(corner + 1) % 3]] == a)
+                        {
+                            open = 0;
+                            break;
+                        }
+                    }
+                }
+                if (!open)
+                {
+                    continue;
+                }
+
+                // More than one boundary through a vertex is non manifold
+                kinds[a] = (borderNext[a] != ~0u && borderNext[a] != b) ? VertexKind_Locked : Max(kinds[a], VertexKind_Border);
+                kinds[b] = (borderPrev[b] != ~0u && borderPrev[b] != a) ? VertexKind_Locked : Max(kinds[b], VertexKind_Border);
+                borderNext[a] = b;
+                borderPrev[b] = a;
+
+                V3 edge          = positions[b] - positions[a];
+                f32 edgeLength   = Length(edge);
+                V3 borderNormal  = Cross(edge, normal);
+                f32 normalLength = Length(borderNormal);
+                if (normalLength > 0.f)
+                {
+                    borderNormal = borderNormal / normalLength;
+                    f32 weight   = edgeLength * edgeLength * lodBorderWeight;
+                    AddPlane(&quadrics[a], borderNormal, -Dot(borderNormal, positions[a]), weight);
+                    AddPlane(&quadrics[b], borderNormal, -Dot(borderNormal, positions[a]), weight);
+                }
+            }
+        }
+        for (u32 i = 0; i < vertexCount; i++)
+        {
+            if (wedgeCounts[i] > 1)
+            {
+                kinds[i] = VertexKind_Locked;
+            }
+            if (lockedVertices && lockedVertices[i])
+            {
+                kinds[wedges[i]] = VertexKind_Locked;
+            }
+        }
+    }
+
+    u32 *remap           = PushArrayNoZero(temp.arena, u32, vertexCount);
+    b8 *collapseLocked   = PushArrayNoZero(temp.arena, b8, vertexCount);
+    EdgeCollapse *edges  = PushArrayNoZero(temp.arena, EdgeCollapse, indexCount);
+    f32 *edgeCosts       = PushArrayNoZero(temp.arena, f32, indexCount);
+    u32 *edgeOrder       = PushArrayNoZero(temp.arena, u32, indexCount);
+    f32 maxErrorSq       = lodMaxError * lodMaxError;
+    f32 resultError      = 0.f;
+    u32 resultIndexCount = indexCount;
+
+    while (resultIndexCount > targetIndexCount)
+    {
+        TempArena passTemp = TempBegin(temp.arena);
+        faceCount          = resultIndexCount / 3;
+
+        // Pick the cheaper direction of every edge that can collapse
+        u32 edgeCount = 0;
+        for (u32 i = 0; i < resultIndexCount; i++)
+        {
+            u32 v0            = outIndices[i];
+            u32 v1            = outIndices[i - i % 3 + (i + 1) % 3];
+            EdgeCollapse best = {};
+            f32 bestCost      = -1.f;
+            for (u32 direction = 0; direction < 2; direction++)
+            {
+                u32 from = direction ? v1 : v0;
+                u32 to   = direction ? v0 : v1;
+                u32 wf   = wedges[from];
+                u32 wt   = wedges[to];
+                if (wf == wt || kinds[wf] == VertexKind_Locked)
+                {
+                    continue;
+                }
+                if (kinds[wf] == VertexKind_Border && borderNext[wf] != wt && borderPrev[wf] != wt)
+                {
+                    continue;
+                }
+
+                f32 error          = EvaluateQuadric(&quadrics[wf], positions[to]);
+                V3 normalDelta     = subset->normals[from] - subset->normals[to];
+                f32 attributeError = Dot(normalDelta, normalDelta);
+                if (subset->uvs)
+                {
+                    V2 uvDelta = subset->uvs[from] - subset->uvs[to];
+                    attributeError += Dot(uvDelta, uvDelta);
+                }
+                f32 cost = error + lodAttributeWeight * attributeError;
+                if (bestCost < 0.f || cost < bestCost)
+                {
+                    best.from  = from;
+                    best.to    = to;
+                    best.error = error;
+                    bestCost   = cost;
+                }
+            }
+            if (bestCost >= 0.f)
+            {
+                edgeCosts[edgeCount] = bestCost;
+                edges[edgeCount++]   = best;
+            }
+        }
+        if (edgeCount == 0)
+        {
+            TempEnd(passTemp);
+            break;
+        }
+        RadixSort(passTemp.arena, edgeCosts, edgeOrder, edgeCount);
+
+        TriangleAdjacency adjacency = BuildTriangleAdjacency(passTemp.arena, outIndices, resultIndexCount, vertexCount);
+        for (u32 i = 0; i < vertexCount; i++)
+        {
+            remap[i] = i;
+        }
+        MemoryZero(collapseLocked, sizeof(collapseLocked[0]) * vertexCount);
+
+        // Every collapse removes two triangles, or one on a boundary. Only one collapse per neighborhood per pass,
+        // so that the flip tests stay valid.
+        u32 goal          = Max(1u, (resultIndexCount - targetIndexCount) / 3);
+        u32 removed       = 0;
+        u32 collapseCount = 0;
+        for (u32 i = 0; i < edgeCount && removed < goal; i++)
+        {
+            EdgeCollapse *collapse = &edges[edgeOrder[i]];
+            if (collapse->error > maxErrorSq)
+            {
+                continue;
+            }
+            if (collapseLocked[collapse->from] || collapseLocked[collapse->to])
+            {
+                continue;
+            }
+            if (HasTriangleFlips(&adjacency, outIndices, positions, collapse->from, collapse->to))
+            {
+                continue;
+            }
+
+            for (u32 j = 0; j < adjacency.counts[collapse->from]; j++)
+            {
+                u32 *tri               = outIndices + 3 * adjacency.data[adjacency.offsets[collapse->from] + j];
+                collapseLocked[tri[0]] = 1;
+                collapseLocked[tri[1]] = 1;
+                collapseLocked[tri[2]] = 1;
+            }
+            collapseLocked[collapse->to] = 1;
+            remap[collapse->from]        = collapse->to;
+
+            u32 wf = wedges[collapse->from];
+            u32 wt = wedges[collapse->to];
+            AddQuadric(&quadrics[wt], &quadrics[wf]);
+            if (kinds[wf] == VertexKind_Border)
+            {
+                // Splice the vertex out of the boundary
+                if (borderNext[wf] == wt)
+                {
+                    borderPrev[wt] = borderPrev[wf];
+                    if (borderPrev[wf] != ~0u)
+                    {
+                        borderNext[borderPrev[wf]] = wt;
+                    }
+                }
+                else
+                {
+                    borderNext[wt] = borderNext[wf];
+                    if (borderNext[wf] != ~0u)
+                    {
+                        borderPrev[borderNext[wf]] = wt;
+                    }
+                }
+                removed += 1;
+            }
+            else
+            {
+                removed += 2;
+            }
+            resultError = Max(resultError, collapse->error);
+            collapseCount++;
+        }
+        TempEnd(passTemp);
+
+        if (collapseCount == 0)
+        {
+            break;
+        }
+
+        // Remap, dropping the triangles that collapsed
+        u32 newIndexCount = 0;
+        for (u32 i = 0; i < faceCount; i++)
+        {
+            u32 a = remap[outIndices[3 * i + 0]];
+            u32 b = remap[outIndices[3 * i + 1]];
+            u32 c = remap[outIndices[3 * i + 2]];
+            if (a != b && b != c && a != c)
+            {
+                outIndices[newIndexCount++] = a;
+                outIndices[newIndexCount++] = b;
+                outIndices[newIndexCount++] = c;
+            }
+        }
+        resultIndexCount = newIndexCount;
     }
+
+    *outError = SquareRoot(resultError) * maxExtent;
     ScratchEnd(temp);
+    return resultIndexCount;
 }
 
-struct LoadState
+// Distance from p to the closest point of the triangle. Ericson, "Real-Time Collision Detection", 5.1.5
+internal f32 DistanceToTriangle(V3 p, V3 a, V3 b, V3 c)
 {
-    std::unordered_map<cgltf_mesh *, i32> meshMap;
-    list<Mat4> transforms;
-    i32 count = 0;
-};
+    V3 ab  = b - a;
+    V3 ac  = c - a;
+    V3 ap  = p - a;
+    f32 d1 = Dot(ab, ap);
+    f32 d2 = Dot(ac, ap);
+    if (d1 <= 0.f && d2 <= 0.f)
+    {
+        return Length(ap);
+    }
+    V3 bp  = p - b;
+    f32 d3 = Dot(ab, bp);
+    f32 d4 = Dot(ac, bp);
+    if (d3 >= 0.f && d4 <= d3)
+    {
+        return Length(bp);
+    }
+    f32 vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+    {
+        return Length(p - (a + ab * (d1 / (d1 - d3))));
+    }
+    V3 cp  = p - c;
+    f32 d5 = Dot(ab, cp);
+    f32 d6 = Dot(ac, cp);
+    if (d6 >= 0.f && d5 <= d6)
+    {
+        return Length(cp);
+    }
+    f32 vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+    {
+        return Length(p - (a + ac * (d2 / (d2 - d6))));
+    }
+    f32 va = d3 * d6 - d5 * d4;
+    if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f)
+    {
+        return Length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+    }
+    f32 denom = 1.f / (va + vb + vc);
+    return Length(p - (a + ab * (vb * denom) + ac * (vc * denom)));
+}
+
+// Simplifies a tessellated dome at several scales, and checks that the reported error is a mesh space distance close
+// to the largest distance of the original vertices from the result
+internal b32 SimplifyMeshTest()
+{
+    TempArena temp = ScratchStart(0, 0);
+
+    const u32 gridSize = 48;
+    u32 vertexCount    = gridSize * gridSize;
+    u32 indexCount     = (gridSize - 1) * (gridSize - 1) * 6;
+    V3 *positions      = PushArrayNoZero(temp.arena, V3, vertexCount);
+    V3 *normals        = PushArrayNoZero(temp.arena, V3, vertexCount);
+    u32 *indices       = PushArrayNoZero(temp.arena, u32, indexCount);
+    u32 *simplified    = PushArrayNoZero(temp.arena, u32, indexCount);
+
+    u32 index = 0;
+    for (u32 y = 0; y < gridSize - 1; y++)
+    {
+        for (u32 x = 0; x < gridSize - 1; x++)
+        {
+            u32 corner       = y * gridSize + x;
+            indices[index++] = corner;
+            indices[index++] = corner + 1;
+            indices[index++] = corner + gridSize + 1;
+            indices[index++] = corner;
+            indices[index++] = corner + gridSize + 1;
+            indices[index++] = corner + gridSize;
+        }
+    }
+
+    b32 result             = 1;
+    const f32 scales[]     = {0.01f, 1.f, 100.f};
+    const f32 reductions[] = {0.5f, 0.25f, 0.1f};
+    for (u32 scaleIndex = 0; scaleIndex < ArrayLength(scales); scaleIndex++)
+    {
+        f32 scale = scales[scaleIndex];
+        for (u32 i = 0; i < vertexCount; i++)
+        {
+            f32 x        = (f32)(i % gridSize) / (gridSize - 1);
+            f32 y        = (f32)(i / gridSize) / (gridSize - 1);
+            positions[i] = V3{x, y, 0.2f * Sin(PI * x) * Sin(PI * y)} * scale;
+            normals[i]   = V3{0.f, 0.f, 1.f};
+        }
+        InputMesh::MeshSubset subset = {};
+        subset.positions             = positions;
+        subset.normals               = normals;
+        subset.indices               = indices;
+        subset.vertexCount           = vertexCount;
+        subset.indexCount            = indexCount;
+
+        for (u32 reductionIndex = 0; reductionIndex < ArrayLength(reductions); reductionIndex++)
+        {
+            u32 targetIndexCount = (u32)(indexCount / 3 * reductions[reductionIndex]) * 3;
+            f32 error;
+            u32 simplifiedCount = SimplifyMesh(simplified, &subset, targetIndexCount, &error);
+
+            f32 measured = 0.f;
+            for (u32 i = 0; i < vertexCount; i++)
+            {
+                f32 distance = FLT_MAX;
+                for (u32 tri = 0; tri < simplifiedCount; tri += 3)
+                {
+                    distance = Min(distance, DistanceToTriangle(positions[i], positions[simplified[tri]],
+                                                                positions[simplified[tri + 1]],
+                                                                positions[simplified[tri + 2]]));
+                }
+                measured = Max(measured, distance);
+            }
+
+            // The quadrics average the distance to the planes around a vertex, so they can't match the largest
+            // distance exactly, but they must be on the same scale
+            b32 passed = simplifiedCount < indexCount && error >= 0.5f * measured && error <= 2.f * measured;
+            Printf("Simplify scale %f, %u -> %u triangles: reported error %f, measured %f%s\n", scale, indexCount / 3,
+                   simplifiedCount / 3, error, measured, passed ? "" : " FAILED");
+            result &= passed;
+        }
+    }
+    ScratchEnd(temp);
+    return result;
+}
+
+// Each level is simplified from the full subset, so that its error is measured against it
+internal void BuildLods(InputMesh::MeshSubset *subset, Arena *arena)
+{
+    InputMesh::MeshSubset::Lod *lod = &subset->lods[0];
+    lod->indices                    = subset->indices;
+    lod->indexCount                 = subset->indexCount;
+    lod->clusters                   = subset->clusters;
+    lod->clusterCount               = subset->clusterCount;
+    lod->error                      = 0.f;
+    subset->lodCount                = 1;
+
+    f32 ratio = 1.f;
+    for (u32 lodIndex = 1; lodIndex < MESH_MAX_LODS; lodIndex++)
+    {
+        InputMesh::MeshSubset::Lod *prev = &subset->lods[lodIndex - 1];
+        if (prev->indexCount / 3 < lodMinTriangles)
+        {
+            break;
+        }
+
+        ratio *= lodReductionRatio;
+        u32 targetIndexCount = (u32)(subset->indexCount / 3 * ratio) * 3;
+        u32 *indices         = PushArrayNoZero(arena, u32, subset->indexCount);
+        f32 error;
+        u32 indexCount = SimplifyMesh(indices, subset, targetIndexCount, &error);
+        if (indexCount == 0 || indexCount > prev->indexCount * lodMinReduction)
+        {
+            break;
+        }
+        OptimizeVertexCache(indices, indexCount, subset->vertexCount);
+
+        // Clustered the same way as the full subset
+        InputMesh::MeshSubset lodSubset = *subset;
+        lodSubset.indices               = indices;
+        lodSubset.indexCount            = indexCount;
+        BuildCluster(&lodSubset, arena);
+
+        lod               = &subset->lods[lodIndex];
+        lod->indices      = indices;
+        lod->indexCount   = indexCount;
+        lod->clusters     = lodSubset.clusters;
+        lod->clusterCount = lodSubset.clusterCount;
+        lod->error        = Max(error, prev->error);
+        subset->lodCount++;
+
+        Printf("LOD %u of %S: %u triangles, error %f\n", lodIndex, subset->materialName, indexCount / 3, lod->error);
+    }
+}
+
+//////////////////////////////
+// Cluster DAG
+//
+
+// Number of clusters that are simplified together
+const u32 dagGroupSize = 4;
+// Every group is simplified to this fraction of its triangles, and is left as a root if it can't get below
+// dagMinReduction
+const f32 dagGroupReduction = 0.5f;
+const f32 dagMinReduction   = 0.85f;
+// Used for the cut statistics printed by the importer
+const f32 dagErrorThreshold = 1.f;
+
+// Greedily grows groups of up to dagGroupSize nodes, adding the node that shares the most vertices with the group.
+// outGroupMembers has nodeCount entries, outGroupOffsets nodeCount + 1.
+internal u32 GroupDagNodes(Arena *arena, u32 **nodeIndices, u32 *nodeIndexCounts, u32 nodeCount, u32 vertexCount,
+                           u32 *outGroupMembers, u32 *outGroupOffsets)
+{
+    TempArena temp = ScratchStart(&arena, 1);
+
+    // Nodes that use each vertex
+    u32 totalIndexCount = 0;
+    for (u32 i = 0; i < nodeCount; i++)
+    {
+        totalIndexCount += nodeIndexCounts[i];
+    }
+    u32 *counts  = PushArray(temp.arena, u32, vertexCount);
+    u32 *offsets = PushArrayNoZero(temp.arena, u32, vertexCount);
+    u32 *data    = PushArrayNoZero(temp.arena, u32, totalIndexCount);
+    for (u32 i = 0; i < nodeCount; i++)
+    {
+        for (u32 j = 0; j < nodeIndexCounts[i]; j++)
+        {
+            counts[nodeIndices[i][j]]++;
+        }
+    }
+    u32 offset = 0;
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        offsets[i] = offset;
+        offset += counts[i];
+    }
+    for (u32 i = 0; i < nodeCount; i++)
+    {
+        for (u32 j = 0; j < nodeIndexCounts[i]; j++)
+        {
+            u32 vertex              = nodeIndices[i][j];
+            data[offsets[vertex]++] = i;
+        }
+    }
+    for (u32 i = 0; i < vertexCount; i++)
+    {
+        offsets[i] -= counts[i];
+    }
+
+    b8 *grouped     = PushArray(temp.arena, b8, nodeCount);
+    u32 *shared     = PushArray(temp.arena, u32, nodeCount);
+    u32 *candidates = PushArrayNoZero(temp.arena, u32, nodeCount);
+
+    u32 groupCount  = 0;
+    u32 memberCount = 0;
+    for (u32 seed = 0; seed < nodeCount; seed++)
+    {
+        if (grouped[seed])
+        {
+            continue;
+        }
+        outGroupOffsets[groupCount++] = memberCount;
+
+        u32 current        = seed;
+        u32 candidateCount = 0;
+        for (u32 size = 0; size < dagGroupSize; size++)
+        {
+            grouped[current]               = 1;
+            outGroupMembers[memberCount++] = current;
+
+            // Count the vertices the new member shares with the nodes that aren't grouped yet
+            for (u32 i = 0; i < nodeIndexCounts[current]; i++)
+            {
+                u32 vertex = nodeIndices[current][i];
+                for (u32 j = 0; j < counts[vertex]; j++)
+                {
+                    u32 other = data[offsets[vertex] + j];
+                    if (!grouped[other] && shared[other]++ == 0)
+                    {
+                        candidates[candidateCount++] = other;
+                    }
+                }
+            }
+
+            u32 best       = ~0u;
+            u32 bestShared = 0;
+            for (u32 i = 0; i < candidateCount; i++)
+            {
+                u32 candidate = candidates[i];
+                if (!grouped[candidate] && shared[candidate] > bestShared)
+                {
+                    best       = candidate;
+                    bestShared = shared[candidate];
+                }
+            }
+            if (best == ~0u)
+            {
+                break;
+            }
+            current = best;
+        }
+        for (u32 i = 0; i < candidateCount; i++)
+        {
+            shared[candidates[i]] = 0;
+        }
+    }
+    outGroupOffsets[groupCount] = memberCount;
+
+    ScratchEnd(temp);
+    return groupCount;
+}
+
+// Nanite style continuous level of detail. The clusters of a level are grouped, every group is simplified with the
+// vertices it shares with other groups locked so the groups still line up, and the result is clustered again to make
+// the next level. Groups that don't simplify are carried into the next level as they are. Repeats until one node is
+// left or nothing simplifies. Errors are mesh space distances, see SimplifyMesh.
+internal void BuildClusterDag(InputMesh::MeshSubset *subset, Arena *arena)
+{
+    TempArena temp = ScratchStart(&arena, 1);
+
+    u32 leafCount           = subset->clusterCount;
+    u32 nodeCap             = 4 * leafCount + 64;
+    u32 indexCap            = 6 * subset->indexCount + 64;
+    Mesh::DagNode *nodes    = PushArrayNoZero(temp.arena, Mesh::DagNode, nodeCap);
+    Mesh::Cluster *clusters = PushArrayNoZero(temp.arena, Mesh::Cluster, nodeCap);
+    u32 *dagIndices         = PushArrayNoZero(temp.arena, u32, indexCap);
+    u32 nodeCount           = leafCount;
+    u32 dagIndexCount       = 0;
+
+    // Nodes of the level being grouped, and of the level made from it
+    u32 *levelNodes     = PushArrayNoZero(temp.arena, u32, nodeCap);
+    u32 *nextLevelNodes = PushArrayNoZero(temp.arena, u32, nodeCap);
+    u32 levelCount      = leafCount;
+    u32 levelIndex      = 0;
+
+    u32 *vertexGroups  = PushArrayNoZero(temp.arena, u32, subset->vertexCount);
+    b8 *lockedVertices = PushArrayNoZero(temp.arena, b8, subset->vertexCount);
+    u32 *localVertices = PushArrayNoZero(temp.arena, u32, subset->vertexCount);
+    MemorySet(localVertices, 0xff, sizeof(localVertices[0]) * subset->vertexCount);
+
+    for (u32 i = 0; i < leafCount; i++)
+    {
+        clusters[i]         = subset->clusters[i];
+        Mesh::DagNode *node = &nodes[i];
+        node->clusterIndex  = i;
+        node->lodCenter     = clusters[i].sphereCenter;
+        node->lodRadius     = clusters[i].sphereRadius;
+        node->lodError      = 0.f;
+        node->parentCenter  = clusters[i].sphereCenter;
+        node->parentRadius  = clusters[i].sphereRadius;
+        node->parentError   = FLT_MAX;
+        levelNodes[i]       = i;
+    }
+
+    while (levelCount > 1)
+    {
+        TempArena levelTemp = TempBegin(temp.arena);
+
+        // Leaves index the subset, the rest index the dag
+        u32 **nodeIndices    = PushArrayNoZero(levelTemp.arena, u32 *, levelCount);
+        u32 *nodeIndexCounts = PushArrayNoZero(levelTemp.arena, u32, levelCount);
+        for (u32 i = 0; i < levelCount; i++)
+        {
+            Mesh::Cluster *cluster = &clusters[levelNodes[i]];
+            u32 *indices           = levelNodes[i] < leafCount ? subset->indices : dagIndices;
+            nodeIndices[i]         = indices + cluster->indexStart;
+            nodeIndexCounts[i]     = cluster->indexCount;
+        }
+
+        u32 *groupMembers = PushArrayNoZero(levelTemp.arena, u32, levelCount);
+        u32 *groupOffsets = PushArrayNoZero(levelTemp.arena, u32, levelCount + 1);
+        u32 groupCount    = GroupDagNodes(levelTemp.arena, nodeIndices, nodeIndexCounts, levelCount, subset->vertexCount,
+                                          groupMembers, groupOffsets);
+
+        // Vertices on the boundary between groups are locked
+        MemorySet(vertexGroups, 0xff, sizeof(vertexGroups[0]) * subset->vertexCount);
+        MemoryZero(lockedVertices, sizeof(lockedVertices[0]) * subset->vertexCount);
+        for (u32 groupIndex = 0; groupIndex < groupCount; groupIndex++)
+        {
+            for (u32 i = groupOffsets[groupIndex]; i < groupOffsets[groupIndex + 1]; i++)
+            {
+                u32 member = groupMembers[i];
+                for (u32 j = 0; j < nodeIndexCounts[member]; j++)
+                {
+                    u32 vertex = nodeIndices[member][j];
+                    if (vertexGroups[vertex] == ~0u)
+                    {
+                        vertexGroups[vertex] = groupIndex;
+                    }
+                    else if (vertexGroups[vertex] != groupIndex)
+                    {
+                        lockedVertices[vertex] = 1;
+                    }
+                }
+            }
+        }
+
+        u32 nextLevelCount       = 0;
+        u32 simplifiedGroupCount = 0;
+        for (u32 groupIndex = 0; groupIndex < groupCount; groupIndex++)
+        {
+            TempArena groupTemp = TempBegin(levelTemp.arena);
+
+            // Compact the group into its own vertices
+            u32 groupIndexCount = 0;
+            for (u32 i = groupOffsets[groupIndex]; i < groupOffsets[groupIndex + 1]; i++)
+            {
+                groupIndexCount += nodeIndexCounts[groupMembers[i]];
+            }
+            u32 *groupIndices   = PushArrayNoZero(groupTemp.arena, u32, groupIndexCount);
+            u32 *globalVertices = PushArrayNoZero(groupTemp.arena, u32, groupIndexCount);
+            u32 localCount      = 0;
+            u32 index           = 0;
+            for (u32 i = groupOffsets[groupIndex]; i < groupOffsets[groupIndex + 1]; i++)
+            {
+                u32 member = groupMembers[i];
+                for (u32 j = 0; j < nodeIndexCounts[member]; j++)
+                {
+                    u32 vertex = nodeIndices[member][j];
+                    if (localVertices[vertex] == ~0u)
+                    {
+                        localVertices[vertex]        = localCount;
+                        globalVertices[localCount++] = vertex;
+                    }
+                    groupIndices[index++] = localVertices[vertex];
+                }
+            }
+
+            InputMesh::MeshSubset groupSubset = {};
+            groupSubset.positions             = PushArrayNoZero(groupTemp.arena, V3, localCount);
+            groupSubset.normals               = PushArrayNoZero(groupTemp.arena, V3, localCount);
+            groupSubset.uvs                   = subset->uvs ? PushArrayNoZero(groupTemp.arena, V2, localCount) : 0;
+            groupSubset.indices               = groupIndices;
+            groupSubset.indexCount            = groupIndexCount;
+            groupSubset.vertexCount           = localCount;
+            groupSubset.materialName          = subset->materialName;
+            b8 *groupLocked                   = PushArrayNoZero(groupTemp.arena, b8, localCount);
+            for (u32 i = 0; i < localCount; i++)
+            {
+                u32 vertex               = globalVertices[i];
+                groupSubset.positions[i] = subset->positions[vertex];
+                groupSubset.normals[i]   = subset->normals[vertex];
+                if (groupSubset.uvs)
+                {
+                    groupSubset.uvs[i] = subset->uvs[vertex];
+                }
+                groupLocked[i]        = lockedVertices[vertex];
+                localVertices[vertex] = ~0u;
+            }
+
+            u32 targetIndexCount = (u32)(groupIndexCount / 3 * dagGroupReduction) * 3;
+            u32 *simplified      = PushArrayNoZero(groupTemp.arena, u32, groupIndexCount);
+            f32 error;
+            u32 simplifiedCount = SimplifyMesh(simplified, &groupSubset, targetIndexCount, &error, groupLocked);
+            b32 simplifiedGroup = simplifiedCount != 0 && simplifiedCount <= groupIndexCount * dagMinReduction &&
+                                  dagIndexCount + simplifiedCount <= indexCap;
+            if (simplifiedGroup)
+            {
+                groupSubset.indices    = simplified;
+                groupSubset.indexCount = simplifiedCount;
+                BuildCluster(&groupSubset, groupTemp.arena);
+                simplifiedGroup = nodeCount + groupSubset.clusterCount <= nodeCap;
+            }
+            if (!simplifiedGroup)
+            {
+                // The members stay roots of the cut. They are grouped again with the next level, so the vertices they
+                // share with it are locked and the two still line up.
+                for (u32 i = groupOffsets[groupIndex]; i < groupOffsets[groupIndex + 1]; i++)
+                {
+                    nextLevelNodes[nextLevelCount++] = levelNodes[groupMembers[i]];
+                }
+                TempEnd(groupTemp);
+                continue;
+            }
+            simplifiedGroupCount++;
+
+            // The bounds of the group contain the bounds of its members, and its error is at least theirs
+            V3 center    = {};
+            u32 members  = groupOffsets[groupIndex + 1] - groupOffsets[groupIndex];
+            f32 maxError = error;
+            for (u32 i = groupOffsets[groupIndex]; i < groupOffsets[groupIndex + 1]; i++)
+            {
+                Mesh::DagNode *member = &nodes[levelNodes[groupMembers[i]]];
+                center += member->lodCenter;
+                maxError = Max(maxError, member->lodError);
+            }
+            center     = center / (f32)members;
+            f32 radius = 0.f;
+            for (u32 i = groupOffsets[groupIndex]; i < groupOffsets[groupIndex + 1]; i++)
+            {
+                Mesh::DagNode *member = &nodes[levelNodes[groupMembers[i]]];
+                radius                = Max(radius, Length(member->lodCenter - center) + member->lodRadius);
+            }
+            for (u32 i = groupOffsets[groupIndex]; i < groupOffsets[groupIndex + 1]; i++)
+            {
+                Mesh::DagNode *member = &nodes[levelNodes[groupMembers[i]]];
+                member->parentCenter  = center;
+                member->parentRadius  = radius;
+                member->parentError   = maxError;
+            }
+
+            for (u32 i = 0; i < groupSubset.clusterCount; i++)
+            {
+                Mesh::Cluster cluster = groupSubset.clusters[i];
+                for (u32 j = 0; j < cluster.indexCount; j++)
+                {
+                    dagIndices[dagIndexCount + j] = globalVertices[simplified[cluster.indexStart + j]];
+                }
+                cluster.indexStart  = dagIndexCount;
+                cluster.subsetIndex = 0;
+                dagIndexCount += cluster.indexCount;
+
+                clusters[nodeCount] = cluster;
+                Mesh::DagNode *node = &nodes[nodeCount];
+                node->clusterIndex  = nodeCount;
+                node->lodCenter     = center;
+                node->lodRadius     = radius;
+                node->lodError      = maxError;
+                node->parentCenter  = center;
+                node->parentRadius  = radius;
+                node->parentError   = FLT_MAX;
+
+                nextLevelNodes[nextLevelCount++] = nodeCount++;
+            }
+            TempEnd(groupTemp);
+        }
+        TempEnd(levelTemp);
+
+        if (simplifiedGroupCount == 0)
+        {
+            break;
+        }
+        Swap(u32 *, levelNodes, nextLevelNodes);
+        levelCount = nextLevelCount;
+        levelIndex++;
+    }
+
+    subset->dagNodeCount    = nodeCount;
+    subset->dagNodes        = PushArrayNoZero(arena, Mesh::DagNode, nodeCount);
+    subset->dagClusterCount = nodeCount - leafCount;
+    subset->dagClusters     = PushArrayNoZero(arena, Mesh::Cluster, subset->dagClusterCount);
+    subset->dagIndexCount   = dagIndexCount;
+    subset->dagIndices      = PushArrayNoZero(arena, u32, dagIndexCount);
+    MemoryCopy(subset->dagNodes, nodes, sizeof(nodes[0]) * nodeCount);
+    MemoryCopy(subset->dagClusters, clusters + leafCount, sizeof(clusters[0]) * subset->dagClusterCount);
+    MemoryCopy(subset->dagIndices, dagIndices, sizeof(dagIndices[0]) * dagIndexCount);
+
+    // Triangles in the cut from further and further away, at 1080p with a 45 degree field of view
+    Rect3 bounds;
+    Init(&bounds);
+    for (u32 i = 0; i < leafCount; i++)
+    {
+        AddBounds(bounds, clusters[i].bounds);
+    }
+    V3 center           = GetCenter(bounds);
+    f32 radius          = Length(bounds.maxP - center);
+    f32 projectionScale = 1080.f / (2.f * Tan(Radians(45.f) * 0.5f));
+    u32 *cut            = PushArrayNoZero(temp.arena, u32, nodeCount);
+    Printf("DAG of %S: %u nodes, %u levels\n", subset->materialName, nodeCount, levelIndex + 1);
+    for (f32 distance = 2.f; distance <= 512.f; distance *= 4.f)
+    {
+        V3 viewPos        = center + V3{0.f, -distance * radius, 0.f};
+        u32 cutCount      = SelectDagCut(nodes, nodeCount, viewPos, projectionScale, dagErrorThreshold, cut);
+        u32 triangleCount = 0;
+        for (u32 i = 0; i < cutCount; i++)
+        {
+            triangleCount += clusters[nodes[cut[i]].clusterIndex].indexCount / 3;
+        }
+        Printf("\tAt %.0fx the radius: %u clusters, %u triangles\n", distance, cutCount, triangleCount);
+    }
+
+    ScratchEnd(temp);
+}
+
+//////////////////////////////
+// Bounds
+//
+internal void SkinModelToBindPose(Skeleton *skeleton, Mat4 *outFinalTransforms)
+{
+    TempArena temp          = ScratchStart(0, 0);
+    Mat4 *transformToParent = PushArray(temp.arena, Mat4, skeleton->count);
+    i32 previousId          = -1;
+
+    for (i32 id = 0; id < (i32)skeleton->count; id++)
+    {
+        Mat4 parentTransform = skeleton->transformsToParent[id];
+        i32 parentId         = skeleton->parents[id];
+        if (parentId == -1)
+        {
+            transformToParent[id] = parentTransform;
+        }
+        else
+        {
+            Assert(!IsZero(transformToParent[parentId]));
+            transformToParent[id] = transformToParent[parentId] * parentTransform;
+        }
+
+        Assert(id > previousId);
+        previousId = id;
+        // TODO: there's probably a way of representing this in non matrix form somehow
+        outFinalTransforms[id] = transformToParent[id] * skeleton->inverseBindPoses[id];
+    }
+    ScratchEnd(temp);
+}
+
+struct LoadState
+{
+    std::unordered_map<cgltf_mesh *, i32> meshMap;
+    list<Mat4> transforms;
+    i32 count = 0;
+};
+
+// NOTE: fix this. some nodes aren't meshes :)
+internal void LoadNode(cgltf_node *node, LoadState *state)
+{
+    if (node->mesh)
+    {
+        auto it = state->meshMap.find(node->mesh);
+        if (it == state->meshMap.end())
+        {
+            state->meshMap[node->mesh] = state->count++;
+            Mat4 transform;
+            cgltf_node_transform_world(node, transform.elements[0]);
+            state->transforms.push_back(transform);
+            Assert(state->count == state->transforms.size());
+        }
+    }
+    for (u32 i = 0; i < node->children_count; i++)
+    {
+        LoadNode(node->children[i], state);
+    }
+}
+
+internal LoadState LoadNodes(cgltf_data *data)
+{
+    LoadState state;
+
+    for (u32 i = 0; i < data->nodes_count; i++)
+    {
+        LoadNode(&data->nodes[i], &state);
+    }
+    return state;
+}
+
+//////////////////////////////
+// Import pipeline
+//
+// The main thread is the only one kicking jobs. It moves a model to its next stage once the jobs of its current stage
+// are done, and only starts loading another model while the estimated memory in flight fits in the budget.
+enum ImportStage
+{
+    ImportStage_Parsed,     // json parsed, waiting on the memory budget
+    ImportStage_Loading,    // buffers loaded and hashed
+    ImportStage_Reading,    // materials, skeleton, animations and mesh attributes
+    ImportStage_Optimizing, // every subset
+    ImportStage_Writing,    // model and material files
+    ImportStage_Done,
+};
+
+struct ModelImport
+{
+    string fullPath;
+    string folderName;
+    Arena *arena;
+
+    cgltf_data *data;
+    Mat4 *meshTransforms;
+    u64 hash;
+    b32 upToDate;
+
+    // Size of the gltf buffers, the memory reserved in the budget and the memory actually used
+    u64 bufferSize;
+    u64 memoryEstimate;
+    u64 memoryUsed;
+
+    InputModel model;
+    InputMaterial *materials;
+    InputMesh::MeshSubset **subsets;
+    u32 *baseVertices;
+    u32 subsetCount;
+    // Per thread, hold the mesh data until the model is written
+    Arena *threadArenas[16];
+
+    InputTexture *textures;
+    u32 textureCount;
+
+    ImportStage stage;
+    jobsystem::Counter counter;
+};
+
+internal void ParseModel(ModelImport *modelImport)
+{
+    cgltf_options options = {};
+    cgltf_result result   = cgltf_parse_file(&options, (const char *)modelImport->fullPath.str, &modelImport->data);
+    Assert(result == cgltf_result_success);
+
+    cgltf_data *data          = modelImport->data;
+    modelImport->textures     = PushArray(modelImport->arena, InputTexture, data->materials_count * TextureType_Count);
+    modelImport->textureCount = GatherTextures(modelImport->arena, data, modelImport->textures);
+    for (size_t i = 0; i < data->buffers_count; i++)
+    {
+        modelImport->bufferSize += data->buffers[i].size;
+    }
+}
+
+// Loads and hashes the buffers, and finds the world transform of every mesh
+internal void LoadModel(ModelImport *modelImport)
+{
+    cgltf_data *data      = modelImport->data;
+    cgltf_options options = {};
+    cgltf_result result   = cgltf_load_buffers(&options, data, (const char *)modelImport->fullPath.str);
+    Assert(result == cgltf_result_success);
+
+    modelImport->hash = HashGltfInputs(data, modelImport->fullPath);
+
+    LoadState state             = LoadNodes(data);
+    modelImport->meshTransforms = PushArrayNoZero(modelImport->arena, Mat4, data->meshes_count);
+    for (size_t i = 0; i < data->meshes_count; i++)
+    {
+        modelImport->meshTransforms[i] = state.transforms[state.meshMap[&data->meshes[i]]];
+    }
+}
+
+internal void ReadMaterial(cgltf_material &gltfMaterial, InputMaterial &material)
+{
+    material.name = Str8C(gltfMaterial.name);
+
+    auto FindUri = [&material](cgltf_texture_view &view, TextureType type) {
+        if (view.texture)
+        {
+            if (view.texture->image->buffer_view)
+            {
+                Assert(0);
+            }
+            material.texture[type] = PathSkipLastSlash(Str8C(view.texture->image->uri));
+        }
+    };
+
+    if (gltfMaterial.has_pbr_metallic_roughness)
+    {
+        FindUri(gltfMaterial.pbr_metallic_roughness.base_color_texture, TextureType_Diffuse);
+        FindUri(gltfMaterial.pbr_metallic_roughness.metallic_roughness_texture, TextureType_MR);
+
+        material.metallicFactor  = gltfMaterial.pbr_metallic_roughness.metallic_factor;
+        material.roughnessFactor = gltfMaterial.pbr_metallic_roughness.roughness_factor;
+        for (i32 i = 0; i < 4; i++)
+        {
+            material.baseColor[i] = gltfMaterial.pbr_metallic_roughness.base_color_factor[i];
+        }
+    }
+    else if (gltfMaterial.has_pbr_specular_glossiness)
+    {
+        FindUri(gltfMaterial.pbr_specular_glossiness.diffuse_texture, TextureType_Diffuse);
+        material.roughnessFactor = 1 - gltfMaterial.pbr_specular_glossiness.glossiness_factor;
+        for (i32 i = 0; i < 4; i++)
+        {
+            material.baseColor[i] = gltfMaterial.pbr_specular_glossiness.diffuse_factor[i];
+        }
+    }
+
+    FindUri(gltfMaterial.normal_texture, TextureType_Normal);
+}
+
+internal void WriteMaterials(ModelImport *modelImport)
+{
+    TempArena temp           = ScratchStart(0, 0);
+    cgltf_data *data         = modelImport->data;
+    InputMaterial *materials = modelImport->materials;
+    string folderName        = modelImport->folderName;
+
+    // Build material file
+    StringBuilder builder = {};
+    builder.arena         = temp.arena;
+    PutLine(&builder, 0, "Num materials: %u\n", (u32)data->materials_count);
+    for (u32 i = 0; i < data->materials_count; i++)
+    {
+        InputMaterial &material = materials[i];
+        PutLine(&builder, 0, "Name: %S", material.name);
+        PutLine(&builder, 0, "{");
+
+        // Diffuse
+        if (material.texture[TextureType_Diffuse].size != 0)
+        {
+            PutLine(&builder, 1, "Diffuse: %S", material.texture[TextureType_Diffuse]);
+        }
+        // Base color rgba
+        if (material.baseColor != MakeV4(1))
+        {
+            PutLine(&builder, 1, "Color: %f %f %f %f", material.baseColor.r, material.baseColor.g, material.baseColor.b, material.baseColor.a);
+        }
+        // Normal
+        if (material.texture[TextureType_Normal].size != 0)
+        {
+            PutLine(&builder, 1, "Normal: %S", material.texture[TextureType_Normal]);
+        }
+        // Metallic roughness
+        if (material.texture[TextureType_MR].size != 0)
+        {
+            PutLine(&builder, 1, "MR Map: %S", material.texture[TextureType_MR]);
+        }
+        if (material.metallicFactor != 1.f)
+        {
+            PutLine(&builder, 1, "Metallic Factor: %f", material.metallicFactor);
+        }
+        if (material.roughnessFactor != 1.f)
+        {
+            PutLine(&builder, 1, "Roughness Factor: %f", material.roughnessFactor);
+        }
+        PutLine(&builder, 0, "}");
+    }
+
+    // Write to disk
+    string materialFilename = PushStr8F(temp.arena, "data\\materials\\%S.mtr", folderName);
+
+    b32 result = WriteEntireFile(&builder, materialFilename);
+    if (!result)
+    {
+        Printf("Unable to print material file: %S\n", materialFilename);
+        Assert(0);
+    }
+
+    ScratchEnd(temp);
+}
+
+internal u32 FindSkinJoint(cgltf_skin *skin, cgltf_node *node)
+{
+    for (u32 i = 0; i < (u32)skin->joints_count; i++)
+    {
+        if (skin->joints[i] == node)
+        {
+            return i;
+        }
+    }
+    return ~0u;
+}
+
+// The skin that deforms the mesh, meshes of files with a single skin don't have to be referenced by a skinned node
+internal cgltf_skin *FindMeshSkin(cgltf_data *data, cgltf_mesh *mesh)
+{
+    for (size_t i = 0; i < data->nodes_count; i++)
+    {
+        if (data->nodes[i].mesh == mesh && data->nodes[i].skin)
+        {
+            return data->nodes[i].skin;
+        }
+    }
+    Assert(data->skins_count == 1);
+    return &data->skins[0];
+}
+
+// Orders the joints so that parents come before their children, the runtime evaluates the hierarchy in one pass.
+// order[i] is the gltf joint stored at i and remap[j] is where gltf joint j is stored. Sorted skins keep their order.
+internal void SortSkinJoints(cgltf_skin *skin, u32 *order, u32 *remap)
+{
+    u32 count      = (u32)skin->joints_count;
+    TempArena temp = ScratchStart(0, 0);
+    u32 *ancestors = PushArrayNoZero(temp.arena, u32, count);
+    for (u32 i = 0; i < count; i++)
+    {
+        remap[i] = ~0u;
+    }
+
+    u32 orderCount = 0;
+    for (u32 jointIndex = 0; jointIndex < count; jointIndex++)
+    {
+        // Joints above this one that weren't placed yet go first
+        u32 ancestorCount = 0;
+        u32 index         = jointIndex;
+        while (index != ~0u && remap[index] == ~0u)
+        {
+            ancestors[ancestorCount++] = index;
+            index                      = FindSkinJoint(skin, skin->joints[index]->parent);
+        }
+        while (ancestorCount)
+        {
+            index               = ancestors[--ancestorCount];
+            remap[index]        = orderCount;
+            order[orderCount++] = index;
+        }
+    }
+    Assert(orderCount == count);
+    ScratchEnd(temp);
+}
+
+// Bind pose vertices of the meshes the skin deforms, in the space of every bone with weight on them
+internal void BuildBoneBounds(cgltf_data *data, cgltf_skin *skin, const u32 *remap, Skeleton *skeleton)
+{
+    for (u32 i = 0; i < skeleton->count; i++)
+    {
+        Init(&skeleton->boneBounds[i]);
+    }
+    for (size_t meshIndex = 0; meshIndex < data->meshes_count; meshIndex++)
+    {
+        cgltf_mesh *mesh = &data->meshes[meshIndex];
+        for (size_t primitiveIndex = 0; primitiveIndex < mesh->primitives_count; primitiveIndex++)
+        {
+            cgltf_primitive *primitive = &mesh->primitives[primitiveIndex];
+            cgltf_accessor *positions  = 0;
+            cgltf_accessor *joints     = 0;
+            cgltf_accessor *weights    = 0;
+            for (size_t attribIndex = 0; attribIndex < primitive->attributes_count; attribIndex++)
+            {
+                cgltf_attribute *attribute = &primitive->attributes[attribIndex];
+                if (Str8C(attribute->name) == Str8Lit("POSITION"))
+                {
+                    positions = attribute->data;
+                }
+                else if (Str8C(attribute->name) == Str8Lit("JOINTS_0"))
+                {
+                    joints = attribute->data;
+                }
+                else if (Str8C(attribute->name) == Str8Lit("WEIGHTS_0"))
+                {
+                    weights = attribute->data;
+                }
+            }
+            if (!positions || !joints || !weights || FindMeshSkin(data, mesh) != skin)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i < positions->count; i++)
+            {
+                V3 position;
+                UV4 boneIds;
+                V4 boneWeights;
+                cgltf_accessor_read_float(positions, i, position.elements, 3);
+                cgltf_accessor_read_uint(joints, i, boneIds.elements, 4);
+                cgltf_accessor_read_float(weights, i, boneWeights.elements, 4);
+                for (u32 j = 0; j < 4; j++)
+                {
+                    if (boneWeights.elements[j] > 0.f)
+                    {
+                        u32 bone = remap[boneIds.elements[j]];
+                        AddBounds(skeleton->boneBounds[bone], skeleton->inverseBindPoses[bone] * position);
+                    }
+                }
+            }
+        }
+    }
+}
+
+internal void WriteSkeleton(ModelImport *modelImport)
+{
+    cgltf_data *data  = modelImport->data;
+    string folderName = modelImport->folderName;
+
+    TempArena temp     = ScratchStart(0, 0);
+    Skeleton *skeleton = PushStruct(temp.arena, Skeleton);
+    for (size_t i = 0; i < data->skins_count; i++)
+    {
+        cgltf_skin &skin = data->skins[i];
+        skeleton->count  = skin.joints_count;
+
+        skeleton->inverseBindPoses   = PushArrayNoZero(temp.arena, Mat4, skeleton->count);
+        skeleton->names              = PushArrayNoZero(temp.arena, string, skeleton->count);
+        skeleton->parents            = PushArrayNoZero(temp.arena, i32, skeleton->count);
+        skeleton->transformsToParent = PushArrayNoZero(temp.arena, Mat4, skeleton->count);
+
+        u32 *order = PushArrayNoZero(temp.arena, u32, skeleton->count);
+        u32 *remap = PushArrayNoZero(temp.arena, u32, skeleton->count);
+        SortSkinJoints(&skin, order, remap);
+
+        for (u32 boneIndex = 0; boneIndex < skeleton->count; boneIndex++)
+        {
+            u32 jointIndex    = order[boneIndex];
+            cgltf_node *joint = skin.joints[jointIndex];
+            cgltf_accessor_read_float(skin.inverse_bind_matrices, jointIndex,
+                                      skeleton->inverseBindPoses[boneIndex].elements[0], 16);
+
+            u32 parentJointIndex = FindSkinJoint(&skin, joint->parent);
+            i32 parentBoneIndex  = parentJointIndex == ~0u ? -1 : (i32)remap[parentJointIndex];
+            Assert(parentBoneIndex < (i32)boneIndex);
+            if (parentBoneIndex == -1)
+            {
+                cgltf_node_transform_world(joint, skeleton->transformsToParent[boneIndex].elements[0]);
+            }
+            else
+            {
+                cgltf_node_transform_local(joint, skeleton->transformsToParent[boneIndex].elements[0]);
+            }
+            skeleton->names[boneIndex]   = Str8C(joint->name);
+            skeleton->parents[boneIndex] = parentBoneIndex;
+        }
+        skeleton->boneBounds = PushArrayNoZero(temp.arena, Rect3, skeleton->count);
+        BuildBoneBounds(data, &skin, remap, skeleton);
+
+        // Write the skeleton to file
+        StringBuilder builder = {};
+        builder.arena         = temp.arena;
+        Put(&builder, skeletonVersionNumber);
+        Put(&builder, skeleton->count);
+        Printf("Num bones: %u\n", skeleton->count);
+
+        u64 *stringDataOffsets = PushArrayNoZero(temp.arena, u64, skeleton->count);
+
+        u64 nameOffset = PutArray(&builder, skeleton->names, skeleton->count);
+        for (u32 i = 0; i < skeleton->count; i++)
+        {
+            string *name         = &skeleton->names[i];
+            stringDataOffsets[i] = Put(&builder, *name);
+        }
+
+        PutArray(&builder, skeleton->parents, skeleton->count);
+        PutArray(&builder, skeleton->inverseBindPoses, skeleton->count);
+        PutArray(&builder, skeleton->transformsToParent, skeleton->count);
+        PutArray(&builder, skeleton->boneBounds, skeleton->count);
+
+        string fileData = CombineBuilderNodes(&builder);
+        for (u32 i = 0; i < skeleton->count; i++)
+        {
+            ConvertPointerToOffset(fileData.str, nameOffset + Offset(string, str), stringDataOffsets[i]);
+            nameOffset += sizeof(string);
+        }
+
+        string skeletonFilename = PushStr8F(temp.arena, "data\\skeletons\\%S.skel", folderName);
+        b32 success             = platform.WriteFile(skeletonFilename, fileData.str, (u32)fileData.size);
+        // b32 success          = WriteEntireFile(&builder, skeletonFilename);
+        if (!success)
+        {
+            Printf("Failed to write file %S\n", skeletonFilename);
+            Assert(!"Failed");
+        }
+    }
+    ScratchEnd(temp);
+}
+
+internal void ReadMesh(ModelImport *modelImport, u32 meshIndex, Arena *arena)
+{
+    cgltf_data *data = modelImport->data;
+
+    // Get the vertex/index attribute data
+    //
+    cgltf_mesh *cgltfMesh = &data->meshes[meshIndex];
+    InputMesh *mesh       = &modelImport->model.meshes[meshIndex];
+
+    mesh->subsets = PushArray(arena, InputMesh::MeshSubset, cgltfMesh->primitives_count);
+
+    mesh->transform        = modelImport->meshTransforms[meshIndex];
+    mesh->totalVertexCount = 0;
+    mesh->totalIndexCount  = 0;
+    mesh->flags            = 0;
+    mesh->totalSubsets     = cgltfMesh->primitives_count;
+
+    Init(&mesh->bounds);
+
+    for (size_t primitiveIndex = 0; primitiveIndex < cgltfMesh->primitives_count; primitiveIndex++)
+    {
+        cgltf_primitive *primitive = &cgltfMesh->primitives[primitiveIndex];
+
+        InputMesh::MeshSubset *subset = &mesh->subsets[primitiveIndex];
+        if (primitive->material->name)
+        {
+            subset->materialName = primitive->material->name;
+        }
+        else
+        {
+            subset->materialName.size = 0;
+        }
+
+        subset->indexCount = primitive->indices->count;
+        subset->indices    = PushArrayNoZero(arena, u32, subset->indexCount);
+        for (size_t indexIndex = 0; indexIndex < primitive->indices->count; indexIndex++)
+        {
+            subset->indices[indexIndex] = cgltf_accessor_read_index(primitive->indices, indexIndex);
+        }
+
+        // Get the attributes
+        u32 vertexCount = 0;
+        for (size_t attribIndex = 0; attribIndex < primitive->attributes_count; attribIndex++)
+        {
+            cgltf_attribute *attribute = &primitive->attributes[attribIndex];
+            if (Str8C(attribute->name) == Str8Lit("POSITION"))
+            {
+                vertexCount         = attribute->data->count;
+                subset->vertexCount = vertexCount;
+                subset->positions   = PushArrayNoZero(arena, V3, vertexCount);
+
+                for (u32 i = 0; i < attribute->data->count; i++)
+                {
+                    cgltf_accessor_read_float(attribute->data, i, subset->positions[i].elements, 3);
+                }
+
+                Assert(attribute->data->has_max && attribute->data->has_min);
+                V3 minP;
+                minP.x = attribute->data->min[0];
+                minP.y = attribute->data->min[1];
+                minP.z = attribute->data->min[2];
+                AddBounds(mesh->bounds, minP);
+
+                V3 maxP;
+                maxP.x = attribute->data->max[0];
+                maxP.y = attribute->data->max[1];
+                maxP.z = attribute->data->max[2];
+                AddBounds(mesh->bounds, maxP);
+            }
+            else if (Str8C(attribute->name) == Str8Lit("NORMAL"))
+            {
+                subset->normals = PushArrayNoZero(arena, V3, vertexCount);
+                for (u32 i = 0; i < attribute->data->count; i++)
+                {
+                    cgltf_accessor_read_float(attribute->data, i, subset->normals[i].elements, 3);
+                }
+            }
+            else if (Str8C(attribute->name) == Str8Lit("TANGENT"))
+            {
+                subset->tangents = PushArrayNoZero(arena, V3, vertexCount);
+                for (u32 i = 0; i < attribute->data->count; i++)
+                {
+                    V4 tangent;
+                    cgltf_accessor_read_float(attribute->data, i, tangent.elements, 4);
+                    subset->tangents[i] = tangent.xyz;
+                }
+            }
+            else if (Str8C(attribute->name) == Str8Lit("TEXCOORD_0"))
+            {
+                mesh->flags |= MeshFlags_Uvs;
+                subset->uvs = PushArrayNoZero(arena, V2, vertexCount);
+                for (u32 i = 0; i < attribute->data->count; i++)
+                {
+                    cgltf_accessor_read_float(attribute->data, i, subset->uvs[i].elements, 2);
+                }
+            }
+            else if (Str8C(attribute->name) == Str8Lit("TEXCOORD_1"))
+            {
+                // mesh->flags |= MeshFLags_Uvs;
+                int x = 5;
+            }
+            else if (Str8C(attribute->name) == Str8Lit("JOINTS_0"))
+            {
+                vertexCount = attribute->data->count;
+                mesh->flags |= MeshFlags_Skinned;
+                subset->boneIds = PushArrayNoZero(arena, UV4, vertexCount);
+
+                // Bone ids index the skeleton, whose joints are sorted
+                TempArena temp   = ScratchStart(&arena, 1);
+                cgltf_skin *skin = FindMeshSkin(data, cgltfMesh);
+                u32 *order       = PushArrayNoZero(temp.arena, u32, skin->joints_count);
+                u32 *remap       = PushArrayNoZero(temp.arena, u32, skin->joints_count);
+                SortSkinJoints(skin, order, remap);
+                for (u32 i = 0; i < attribute->data->count; i++)
+                {
+                    cgltf_accessor_read_uint(attribute->data, i, subset->boneIds[i].elements, 4);
+                    for (u32 j = 0; j < 4; j++)
+                    {
+                        Assert(subset->boneIds[i].elements[j] < skin->joints_count);
+                        subset->boneIds[i].elements[j] = remap[subset->boneIds[i].elements[j]];
+                    }
+                }
+                ScratchEnd(temp);
+            }
+            else if (Str8C(attribute->name) == Str8Lit("WEIGHTS_0"))
+            {
+                subset->boneWeights = PushArrayNoZero(arena, V4, vertexCount);
+                for (u32 i = 0; i < attribute->data->count; i++)
+                {
+                    cgltf_accessor_read_float(attribute->data, i, subset->boneWeights[i].elements, 4);
+                }
+            }
+            else if (Str8C(attribute->name) == Str8Lit("COLOR_0"))
+            {
+                // TODO
+            }
+        }
+
+        Assert(subset->positions);
+        Assert(subset->normals);
+        WeldVertices(subset);
+        if (!subset->tangents)
+        {
+            GenerateTangents(subset, arena);
+        }
+        mesh->totalVertexCount += subset->vertexCount;
+        mesh->totalIndexCount += subset->indexCount;
+    }
+}
+
+// Indices are rebased on the vertices of the subsets before it in the mesh
+internal void OptimizeSubset(ModelImport *modelImport, u32 subsetIndex, Arena *arena)
+{
+    InputMesh::MeshSubset *subset = modelImport->subsets[subsetIndex];
+    OptimizeMesh(subset);
+    BuildCluster(subset, arena);
+    BuildLods(subset, arena);
+    BuildClusterDag(subset, arena);
+
+    u32 baseVertex = modelImport->baseVertices[subsetIndex];
+    for (u32 lodIndex = 0; lodIndex < subset->lodCount; lodIndex++)
+    {
+        InputMesh::MeshSubset::Lod *lod = &subset->lods[lodIndex];
+        for (u32 indexIndex = 0; indexIndex < lod->indexCount; indexIndex++)
+        {
+            lod->indices[indexIndex] += baseVertex;
+        }
+    }
+    for (u32 indexIndex = 0; indexIndex < subset->dagIndexCount; indexIndex++)
+    {
+        subset->dagIndices[indexIndex] += baseVertex;
+    }
+}
+
+internal void WriteModel(ModelImport *modelImport)
+{
+    TempArena temp    = ScratchStart(0, 0);
+    cgltf_data *data  = modelImport->data;
+    string folderName = modelImport->folderName;
+
+    StringBuilder builder = {};
+    builder.arena         = temp.arena;
+    Put(&builder, modelImport->model.numMeshes);
+    for (u32 meshIndex = 0; meshIndex < modelImport->model.numMeshes; meshIndex++)
+    {
+        InputMesh *mesh = &modelImport->model.meshes[meshIndex];
+
+        if (quantizeVertices && CanQuantizeMesh(mesh))
+        {
+            mesh->flags |= MeshFlags_Quantized;
+        }
+        Put(&builder, mesh->totalVertexCount);
+        Put(&builder, mesh->flags);
+        Put(&builder, mesh->totalSubsets);
+
+        u32 indexOffset = 0;
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+            PutPointerValue(&builder, &indexOffset);
+            PutPointerValue(&builder, &subset->indexCount);
+            MaterialHandle handle = {};
+            PutPointerValue(&builder, &handle);
+            indexOffset += subset->indexCount;
+        }
+
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+            PutU64(&builder, subset->materialName.size);
+            if (subset->materialName.size != 0)
+            {
+                Put(&builder, subset->materialName);
+            }
+        }
+
+        if (mesh->flags & MeshFlags_Quantized)
+        {
+            u64 floatStride = sizeof(V3) * 3;
+            floatStride += (mesh->flags & MeshFlags_Uvs) ? sizeof(V2) : 0;
+            floatStride += (mesh->flags & MeshFlags_Skinned) ? sizeof(UV4) + sizeof(V4) : 0;
+            u64 start = builder.totalSize;
+
+            QuantizationError error = PutQuantizedVertices(&builder, mesh);
+            V3 extent               = mesh->bounds.maxP - mesh->bounds.minP;
+            Printf("Quantized %S mesh %u: %llu -> %llu bytes. Max error: position %f (%f%% of the bounds), normal %f "
+                   "deg, tangent %f deg, uv %f, bone weight %f\n",
+                   folderName, meshIndex, floatStride * mesh->totalVertexCount, builder.totalSize - start, error.position,
+                   100.f * error.position / Max(Length(extent), 1e-8f), error.normal, error.tangent, error.uv,
+                   error.boneWeight);
+        }
+        else
+        {
+            // Positions
+            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+            {
+                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+                Assert(subset->positions);
+                Put(&builder, subset->positions, sizeof(subset->positions[0]) * subset->vertexCount);
+            }
+
+            // Normals
+            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+            {
+                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+                Assert(subset->normals);
+                Put(&builder, subset->normals, sizeof(subset->normals[0]) * subset->vertexCount);
+            }
+
+            // Tangents
+            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+            {
+                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+                Assert(subset->tangents);
+                Put(&builder, subset->tangents, sizeof(subset->tangents[0]) * subset->vertexCount);
+            }
+
+            // Uvs. (what if some subsets have uvs and some don't?)
+            if (mesh->flags & MeshFlags_Uvs)
+            {
+                for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+                {
+                    InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+                    Assert(subset->uvs);
+                    Put(&builder, subset->uvs, sizeof(subset->uvs[0]) * subset->vertexCount);
+                }
+            }
+
+            // Skinning data
+            if (mesh->flags & MeshFlags_Skinned)
+            {
+                for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+                {
+                    InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+                    Assert(subset->boneIds && subset->boneWeights);
+                    Put(&builder, subset->boneIds, sizeof(subset->boneIds[0]) * subset->vertexCount);
+                    Put(&builder, subset->boneWeights, sizeof(subset->boneWeights[0]) * subset->vertexCount);
+                }
+            }
+        }
+
+        // Levels of detail are written level by level. Subsets with fewer levels reuse their
+        // last one.
+        u32 numLods = 0;
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            numLods = Max(numLods, mesh->subsets[subsetIndex].lodCount);
+        }
+        u32 *lodIndexOffsets = PushArrayNoZero(temp.arena, u32, mesh->totalSubsets * MESH_MAX_LODS);
+        u32 totalIndexCount  = 0;
+        for (u32 lodIndex = 0; lodIndex < numLods; lodIndex++)
+        {
+            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+            {
+                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+                if (lodIndex < subset->lodCount)
+                {
+                    lodIndexOffsets[subsetIndex * MESH_MAX_LODS + lodIndex] = totalIndexCount;
+                    totalIndexCount += subset->lods[lodIndex].indexCount;
+                }
+            }
+        }
+        // Cluster DAG indices go after all levels of detail
+        u32 *dagIndexOffsets = PushArrayNoZero(temp.arena, u32, mesh->totalSubsets);
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            dagIndexOffsets[subsetIndex] = totalIndexCount;
+            totalIndexCount += mesh->subsets[subsetIndex].dagIndexCount;
+        }
+
+        // Finally indices
+        Put(&builder, totalIndexCount);
+        for (u32 lodIndex = 0; lodIndex < numLods; lodIndex++)
+        {
+            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+            {
+                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+                if (lodIndex < subset->lodCount)
+                {
+                    InputMesh::MeshSubset::Lod *lod = &subset->lods[lodIndex];
+                    Assert(lod->indices);
+                    Put(&builder, lod->indices, sizeof(lod->indices[0]) * lod->indexCount);
+                }
+            }
+        }
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+            if (subset->dagIndexCount)
+            {
+                Put(&builder, subset->dagIndices, sizeof(subset->dagIndices[0]) * subset->dagIndexCount);
+            }
+        }
+
+        // Clusters
+        Mesh::Lod lods[MESH_MAX_LODS] = {};
+        u32 totalClusterCount         = 0;
+        for (u32 lodIndex = 0; lodIndex < numLods; lodIndex++)
+        {
+            lods[lodIndex].clusterStart = totalClusterCount;
+            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+            {
+                InputMesh::MeshSubset *subset   = &mesh->subsets[subsetIndex];
+                InputMesh::MeshSubset::Lod *lod = &subset->lods[Min(lodIndex, subset->lodCount - 1)];
+                lods[lodIndex].clusterCount += lod->clusterCount;
+                lods[lodIndex].error = Max(lods[lodIndex].error, lod->error);
+            }
+            totalClusterCount += lods[lodIndex].clusterCount;
+        }
+        u32 *dagClusterOffsets = PushArrayNoZero(temp.arena, u32, mesh->totalSubsets);
+        u32 totalDagNodeCount  = 0;
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            dagClusterOffsets[subsetIndex] = totalClusterCount;
+            totalClusterCount += mesh->subsets[subsetIndex].dagClusterCount;
+            totalDagNodeCount += mesh->subsets[subsetIndex].dagNodeCount;
+        }
+        Put(&builder, totalClusterCount);
+        for (u32 lodIndex = 0; lodIndex < numLods; lodIndex++)
+        {
+            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+            {
+                InputMesh::MeshSubset *subset   = &mesh->subsets[subsetIndex];
+                u32 subsetLod                   = Min(lodIndex, subset->lodCount - 1);
+                InputMesh::MeshSubset::Lod *lod = &subset->lods[subsetLod];
+                for (u32 clusterIndex = 0; clusterIndex < lod->clusterCount; clusterIndex++)
+                {
+                    Mesh::Cluster cluster = lod->clusters[clusterIndex];
+                    cluster.subsetIndex   = subsetIndex;
+                    cluster.indexStart += lodIndexOffsets[subsetIndex * MESH_MAX_LODS + subsetLod];
+                    PutStruct(&builder, cluster);
+                }
+            }
+        }
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+            for (u32 clusterIndex = 0; clusterIndex < subset->dagClusterCount; clusterIndex++)
+            {
+                Mesh::Cluster cluster = subset->dagClusters[clusterIndex];
+                cluster.subsetIndex   = subsetIndex;
+                cluster.indexStart += dagIndexOffsets[subsetIndex];
+                PutStruct(&builder, cluster);
+            }
+        }
+        Put(&builder, numLods);
+        PutArray(&builder, lods, numLods);
+
+        // Cluster DAG nodes, with cluster indices remapped into the mesh cluster array. Leaves
+        // are the level 0 clusters.
+        Put(&builder, totalDagNodeCount);
+        u32 leafClusterOffset = 0;
+        for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+        {
+            InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
+            for (u32 nodeIndex = 0; nodeIndex < subset->dagNodeCount; nodeIndex++)
+            {
+                Mesh::DagNode node = subset->dagNodes[nodeIndex];
+                if (node.clusterIndex < subset->clusterCount)
+                {
+                    node.clusterIndex += leafClusterOffset;
+                }
+                else
+                {
+                    node.clusterIndex = dagClusterOffsets[subsetIndex] + node.clusterIndex - subset->clusterCount;
+                }
+                PutStruct(&builder, node);
+            }
+            leafClusterOffset += subset->clusterCount;
+        }
+
+        PutStruct(&builder, mesh->bounds);
+        PutStruct(&builder, mesh->transform);
+    }
+
+    if (data->skins_count != 0)
+    {
+        Assert(data->skins_count == 1);
+        PutU64(&builder, folderName.size);
+        Put(&builder, folderName);
+    }
+    else
+    {
+        PutU64(&builder, 0);
+    }
+    string modelFilename = PushStr8F(temp.arena, "data\\models\\%S.model", folderName);
+    b32 success          = WriteEntireFile(&builder, modelFilename);
+    if (!success)
+    {
+        Printf("Failed to write file %S\n", modelFilename);
+        Assert(0);
+    }
+}
+
+// Index of the last key at or before time, and how far time is towards the next one
+template <typename Key>
+internal u32 FindAnimationKey(Key *keys, u32 count, f32 time, f32 *fraction)
+{
+    u32 low  = 0;
+    u32 high = count - 1;
+    while (low < high)
+    {
+        u32 mid = (low + high + 1) / 2;
+        if (keys[mid].time <= time)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+    *fraction = 0.f;
+    if (low + 1 < count && keys[low + 1].time > keys[low].time)
+    {
+        *fraction = Clamp((time - keys[low].time) / (keys[low + 1].time - keys[low].time), 0.f, 1.f);
+    }
+    return low;
+}
+
+// Paths without keys keep the rest transform of the node
+internal AnimationTransform SampleBoneChannel(InputBoneChannel *boneChannel, f32 time)
+{
+    cgltf_node *node = boneChannel->node;
+    AnimationTransform result;
+    result.translation = {};
+    result.rotation    = {0.f, 0.f, 0.f, 1.f};
+    result.scale       = {1.f, 1.f, 1.f};
+    if (node->has_translation)
+    {
+        result.translation = MakeV3(node->translation[0], node->translation[1], node->translation[2]);
+    }
+    if (node->has_rotation)
+    {
+        result.rotation = {node->rotation[0], node->rotation[1], node->rotation[2], node->rotation[3]};
+    }
+    if (node->has_scale)
+    {
+        result.scale = MakeV3(node->scale[0], node->scale[1], node->scale[2]);
+    }
+
+    f32 fraction;
+    if (boneChannel->numPositionKeys)
+    {
+        AnimationPosition *keys = boneChannel->positions;
+        u32 key                 = FindAnimationKey(keys, boneChannel->numPositionKeys, time, &fraction);
+        u32 next                = Min(key + 1, boneChannel->numPositionKeys - 1);
+        result.translation      = Lerp(keys[key].position, keys[next].position, fraction);
+    }
+    if (boneChannel->numRotationKeys)
+    {
+        InputAnimationRotation *keys = boneChannel->rotations;
+        u32 key                      = FindAnimationKey(keys, boneChannel->numRotationKeys, time, &fraction);
+        u32 next                     = Min(key + 1, boneChannel->numRotationKeys - 1);
+        result.rotation              = Lerp(keys[key].rotation, keys[next].rotation, fraction);
+    }
+    if (boneChannel->numScalingKeys)
+    {
+        AnimationScale *keys = boneChannel->scales;
+        u32 key              = FindAnimationKey(keys, boneChannel->numScalingKeys, time, &fraction);
+        u32 next             = Min(key + 1, boneChannel->numScalingKeys - 1);
+        result.scale         = Lerp(keys[key].scale, keys[next].scale, fraction);
+    }
+    return result;
+}
+
+// Parsed from the extras of a gltf animation, e.g. {"rootMotion": true, "events": [{"time": 0.4, "name": "step"}]}.
+// Event times are in seconds from the start of the clip.
+struct AnimationExtras
+{
+    b32 rootMotion;
+    AnimationEvent *events;
+    u32 numEvents;
+};
+
+internal void ReadAnimationExtras(Arena *arena, cgltf_animation *anim, f32 duration, AnimationExtras *out)
+{
+    *out             = {};
+    const char *json = anim->extras.data;
+    if (!json)
+    {
+        return;
+    }
+    const u8 *chunk = (const u8 *)json;
+    size_t size     = strlen(json);
+
+    jsmn_parser parser;
+    jsmn_init(&parser);
+    i32 tokenCount = jsmn_parse(&parser, json, size, 0, 0);
+    if (tokenCount <= 0)
+    {
+        Printf("Animation %S has malformed extras\n", Str8C(anim->name));
+        return;
+    }
+    jsmntok_t *tokens = PushArrayNoZero(arena, jsmntok_t, tokenCount);
+    jsmn_init(&parser);
+    jsmn_parse(&parser, json, size, tokens, tokenCount);
+    if (tokens[0].type != JSMN_OBJECT)
+    {
+        return;
+    }
+
+    i32 i = 1;
+    for (i32 key = 0; key < tokens[0].size && i > 0; key++)
+    {
+        jsmntok_t *value = &tokens[i + 1];
+        if (cgltf_json_strcmp(&tokens[i], chunk, "rootMotion") == 0)
+        {
+            out->rootMotion = cgltf_json_to_bool(value, chunk);
+        }
+        else if (cgltf_json_strcmp(&tokens[i], chunk, "events") == 0 && value->type == JSMN_ARRAY)
+        {
+            out->events = PushArray(arena, AnimationEvent, value->size);
+            i32 j       = i + 2;
+            for (i32 element = 0; element < value->size && j > 0; element++)
+            {
+                AnimationEvent event = {};
+                i32 fieldCount       = tokens[j].type == JSMN_OBJECT ? tokens[j].size : 0;
+                i32 end              = cgltf_skip_json(tokens, j);
+                j++;
+                for (i32 field = 0; field < fieldCount && j > 0; field++)
+                {
+                    jsmntok_t *fieldValue = &tokens[j + 1];
+                    if (cgltf_json_strcmp(&tokens[j], chunk, "time") == 0)
+                    {
+                        event.time = cgltf_json_to_float(fieldValue, chunk);
+                    }
+                    else if (cgltf_json_strcmp(&tokens[j], chunk, "name") == 0 && fieldValue->type == JSMN_STRING)
+                    {
+                        string name = Str8((u8 *)chunk + fieldValue->start, fieldValue->end - fieldValue->start);
+                        event.name  = PushStr8Copy(arena, name);
+                    }
+                    j = cgltf_skip_json(tokens, j + 1);
+                }
+                j = end;
+
+                if (event.name.size == 0)
+                {
+                    Printf("Animation %S has an event without a name, skipping\n", Str8C(anim->name));
+                    continue;
+                }
+                event.time                    = Clamp(event.time, 0.f, duration);
+                event.sid                     = GetSID(event.name);
+                out->events[out->numEvents++] = event;
+            }
+        }
+        i = cgltf_skip_json(tokens, i + 1);
+    }
+
+    // Stored sorted by time, so that the events of a time range are found with a binary search
+    f32 *times = PushArrayNoZero(arena, f32, out->numEvents);
+    u32 *order = PushArrayNoZero(arena, u32, out->numEvents);
+    for (u32 e = 0; e < out->numEvents; e++)
+    {
+        times[e] = out->events[e].time;
+    }
+    RadixSort(arena, times, order, out->numEvents);
+    AnimationEvent *sorted = PushArrayNoZero(arena, AnimationEvent, out->numEvents);
+    for (u32 e = 0; e < out->numEvents; e++)
+    {
+        sorted[e] = out->events[order[e]];
+    }
+    out->events = sorted;
+}
+
+// Angle of the rotation about axis, the twist of the swing twist decomposition
+internal f32 GetTwistAngle(Quat rotation, V3 axis)
+{
+    f32 result = 2.f * atan2f(Dot(rotation.xyz, axis), rotation.w);
+    return result;
+}
+
+// The root channel is the one with the most animated descendants. Its movement along the ground and its turn about the
+// up axis are taken out of its samples, so that the clip plays in place, and returned as a model space track relative
+// to the first sample. The up axis is +Y in model space, the root keeps its height.
+internal AnimationRootMotion *ExtractRootMotion(Arena *arena, InputBoneChannel *boneChannels, u32 channelCount,
+                                                AnimationTransform *sourceSamples, u32 numSamples)
+{
+    TempArena temp    = ScratchStart(&arena, 1);
+    u32 *descendants  = PushArray(temp.arena, u32, channelCount);
+    i32 *topAncestors = PushArrayNoZero(temp.arena, i32, channelCount);
+    for (u32 c = 0; c < channelCount; c++)
+    {
+        topAncestors[c] = c;
+        for (cgltf_node *node = boneChannels[c].node->parent; node; node = node->parent)
+        {
+            for (u32 other = 0; other < channelCount; other++)
+            {
+                if (boneChannels[other].node == node)
+                {
+                    topAncestors[c] = other;
+                }
+            }
+        }
+        descendants[topAncestors[c]]++;
+    }
+    u32 root = 0;
+    for (u32 c = 1; c < channelCount; c++)
+    {
+        root = descendants[c] > descendants[root] ? c : root;
+    }
+    ScratchEnd(temp);
+
+    // The samples of the root are in the space of its parent
+    Mat4 parentTransform = Identity();
+    if (boneChannels[root].node->parent)
+    {
+        cgltf_node_transform_world(boneChannels[root].node->parent, parentTransform.elements[0]);
+    }
+    V3 up = NormalizeOrZero(Transform(Inverse(parentTransform), MakeV4(MakeV3(0.f, 1.f, 0.f), 0.f)).xyz);
+    // A mirroring parent turns the other way in model space
+    V3 parentX     = Transform(parentTransform, MakeV4(MakeV3(1.f, 0.f, 0.f), 0.f)).xyz;
+    V3 parentY     = Transform(parentTransform, MakeV4(MakeV3(0.f, 1.f, 0.f), 0.f)).xyz;
+    V3 parentZ     = Transform(parentTransform, MakeV4(MakeV3(0.f, 0.f, 1.f), 0.f)).xyz;
+    f32 handedness = Dot(Cross(parentX, parentY), parentZ) < 0.f ? -1.f : 1.f;
+
+    AnimationTransform *first = &sourceSamples[root];
+    V3 start                  = first->translation;
+    V3 pivot                  = start - Dot(start, up) * up;
+    f32 startYaw              = GetTwistAngle(first->rotation, up);
+    f32 previousYaw           = 0.f;
+
+    AnimationRootMotion *result = PushArrayNoZero(arena, AnimationRootMotion, numSamples);
+    for (u32 sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+    {
+        AnimationTransform *sample = &sourceSamples[sampleIndex * channelCount + root];
+        V3 offset                  = sample->translation - start;
+        V3 ground                  = offset - Dot(offset, up) * up;
+        f32 yaw                    = GetTwistAngle(sample->rotation, up) - startYaw;
+        while (yaw - previousYaw > PI)
+        {
+            yaw -= 2.f * PI;
+        }
+        while (yaw - previousYaw < -PI)
+        {
+            yaw += 2.f * PI;
+        }
+        previousYaw = yaw;
+
+        // Undoes the motion about the position of the root at the start of the clip
+        Quat unturn         = QuatFromAxisAngle(up, -yaw);
+        sample->rotation    = Normalize(unturn * sample->rotation);
+        sample->translation = pivot + QuatToMatrix(unturn) * (sample->translation - pivot - ground);
+
+        result[sampleIndex].translation = Transform(parentTransform, MakeV4(ground, 0.f)).xyz;
+        result[sampleIndex].yaw         = handedness * yaw;
+    }
+    return result;
+}
+
+internal void WriteAnimation(cgltf_data *data, u32 animationIndex)
+{
+    TempArena temp = ScratchStart(0, 0);
+
+    cgltf_animation &anim          = data->animations[animationIndex];
+    InputBoneChannel *boneChannels = PushArrayNoZero(temp.arena, InputBoneChannel, anim.channels_count);
+    u32 channelCount               = 0;
+    std::unordered_map<cgltf_node *, i32> animationNodeIndexMap;
+
+    f32 minTime       = FLT_MAX;
+    f32 maxTime       = -FLT_MAX;
+    const f32 epsilon = 0.000001f;
+
+    for (size_t channelIndex = 0; channelIndex < anim.channels_count; channelIndex++)
+    {
+        cgltf_animation_channel &channel = anim.channels[channelIndex];
+        auto it                          = animationNodeIndexMap.find(channel.target_node);
+        i32 animationNodeIndex           = -1;
+        if (it == animationNodeIndexMap.end())
+        {
+            animationNodeIndexMap[channel.target_node] = channelCount;
+            animationNodeIndex                         = channelCount;
+            InputBoneChannel &boneChannel              = boneChannels[channelCount];
+            boneChannel.name                           = Str8C(channel.target_node->name);
+            boneChannel.node                           = channel.target_node;
+            boneChannel.numPositionKeys                = 0;
+            boneChannel.numScalingKeys                 = 0;
+            boneChannel.numRotationKeys                = 0;
+
+            channelCount++;
+        }
+        else
+        {
+            animationNodeIndex = it->second;
+        }
+        InputBoneChannel &boneChannel      = boneChannels[animationNodeIndex];
+        minTime                            = Min(minTime, channel.sampler->input->min[0]);
+        maxTime                            = Max(maxTime, channel.sampler->input->max[0]);
+
+        // NOTE: subtracts the minimum time from the sample time, because
+        // sometimes the start time is really really late. also checks to
+        // see if all of the samples for position/scale/rotation are all
+        // roughly equal, and if so just store one copy otherwise store all
+        // of the copies
+        switch (channel.target_path)
+        {
+            case cgltf_animation_path_type_translation:
+            {
+                const u32 positionKeyCount = channel.sampler->output->count;
+                boneChannel.positions      = PushArrayNoZero(temp.arena, AnimationPosition, positionKeyCount);
+                b8 allEqual                = 1;
+                V3 firstPosition;
+                f32 firstTime;
+                Assert(cgltf_accessor_read_float(channel.sampler->input, 0, &firstTime, 1));
+                Assert(cgltf_accessor_read_float(channel.sampler->output, 0, firstPosition.elements, 3));
+
+                boneChannel.positions[0].time     = firstTime - channel.sampler->input->min[0];
+                boneChannel.positions[0].position = firstPosition;
+
+                // NOTE: have to loop over all of the elements first! :)
+                for (u32 i = 1; i < positionKeyCount; i++)
+                {
+                    V3 position;
+                    Assert(cgltf_accessor_read_float(channel.sampler->output, i, position.elements, 3));
+
+                    if (!AlmostEqual(position, firstPosition, epsilon))
+                    {
+                        allEqual = 0;
+                        break;
+                    }
+                }
+
+                if (!allEqual)
+                {
+                    for (u32 i = 1; i < positionKeyCount; i++)
+                    {
+                        f32 time;
+                        V3 position;
+                        Assert(cgltf_accessor_read_float(channel.sampler->input, i, &time, 1));
+                        Assert(cgltf_accessor_read_float(channel.sampler->output, i, position.elements, 3));
+                        boneChannel.positions[i].time     = time - channel.sampler->input->min[0];
+                        boneChannel.positions[i].position = position;
+
+                        if (boneChannel.positions[i].time != boneChannel.positions[i].time ||
+                            boneChannel.positions[i].position != boneChannel.positions[i].position)
+                        {
+                            Assert(0);
+                        }
+                    }
+                }
+
+                boneChannel.numPositionKeys = allEqual ? 1 : positionKeyCount;
+            }
+            break;
+            case cgltf_animation_path_type_rotation:
+            {
+                u32 rotationKeyCount  = channel.sampler->output->count;
+                boneChannel.rotations = PushArrayNoZero(temp.arena, InputAnimationRotation, rotationKeyCount);
+                b8 allEqual           = 1;
+
+                // First rotation/time
+                V4 firstRotation;
+                f32 firstTime;
+                Assert(cgltf_accessor_read_float(channel.sampler->input, 0, &firstTime, 1));
+                Assert(cgltf_accessor_read_float(channel.sampler->output, 0, firstRotation.elements, 4));
+                boneChannel.rotations[0].time          = firstTime - channel.sampler->input->min[0];
+                boneChannel.rotations[0].rotation.xyzw = firstRotation;
+
+                for (u32 i = 1; i < rotationKeyCount; i++)
+                {
+                    V4 rotation;
+                    Assert(cgltf_accessor_read_float(channel.sampler->output, i, rotation.elements, 4));
+                    if (!AlmostEqual(rotation, firstRotation, epsilon))
+                    {
+                        allEqual = 0;
+                        break;
+                    }
+                }
+
+                if (!allEqual)
+                {
+                    for (u32 i = 1; i < rotationKeyCount; i++)
+                    {
+                        f32 time;
+                        V4 rotation;
+                        Assert(cgltf_accessor_read_float(channel.sampler->input, i, &time, 1));
+                        Assert(cgltf_accessor_read_float(channel.sampler->output, i, rotation.elements, 4));
+                        boneChannel.rotations[i].time          = time - channel.sampler->input->min[0];
+                        boneChannel.rotations[i].rotation.xyzw = rotation;
+                    }
+                }
+                boneChannel.numRotationKeys = allEqual ? 1 : rotationKeyCount;
+            }
+            break;
+            case cgltf_animation_path_type_scale:
+            {
+                u32 scaleKeyCount  = channel.sampler->output->count;
+                boneChannel.scales = PushArrayNoZero(temp.arena, AnimationScale, scaleKeyCount);
+
+                b8 allEqual = 1;
+                V3 firstScale;
+                f32 firstTime;
+                Assert(cgltf_accessor_read_float(channel.sampler->input, 0, &firstTime, 1));
+                Assert(cgltf_accessor_read_float(channel.sampler->output, 0, firstScale.elements, 3));
+                boneChannel.scales[0].time  = firstTime - channel.sampler->input->min[0];
+                boneChannel.scales[0].scale = firstScale;
+
+                for (u32 i = 1; i < scaleKeyCount; i++)
+                {
+                    V3 scale;
+                    Assert(cgltf_accessor_read_float(channel.sampler->output, i, scale.elements, 3));
+                    if (!AlmostEqual(scale, firstScale, epsilon))
+                    {
+                        allEqual = 0;
+                        break;
+                    }
+                }
+
+                if (!allEqual)
+                {
+                    for (u32 i = 1; i < scaleKeyCount; i++)
+                    {
+                        f32 time;
+                        V3 scale;
+                        Assert(cgltf_accessor_read_float(channel.sampler->input, i, &time, 1));
+                        Assert(cgltf_accessor_read_float(channel.sampler->output, i, scale.elements, 3));
+                        boneChannel.scales[i].time  = time - channel.sampler->input->min[0];
+                        boneChannel.scales[i].scale = scale;
+                    }
+                }
+                boneChannel.numScalingKeys = allEqual ? 1 : scaleKeyCount;
+            }
+            break;
+        }
+    }
+
+    f32 duration = maxTime - minTime;
+    u64 numNodes = animationNodeIndexMap.size();
+    Assert(numNodes == channelCount);
+
+    // Resample every channel at the same times, then compress to the error bound
+    u32 numSamples = 1;
+    f32 sampleRate = 0.f;
+    if (duration > 0.f)
+    {
+        numSamples = (u32)ceilf(duration * animationSampleRate) + 1;
+        sampleRate = (numSamples - 1) / duration;
+    }
+    AnimationTransform *sourceSamples = PushArrayNoZero(temp.arena, AnimationTransform, numSamples * channelCount);
+    for (u32 sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+    {
+        f32 time = sampleRate == 0.f ? 0.f : sampleIndex / sampleRate;
+        for (u32 channelIndex = 0; channelIndex < channelCount; channelIndex++)
+        {
+            sourceSamples[sampleIndex * channelCount + channelIndex] =
+                SampleBoneChannel(&boneChannels[channelIndex], time);
+        }
+    }
+
+    AnimationExtras extras;
+    ReadAnimationExtras(temp.arena, &anim, duration, &extras);
+    AnimationRootMotion *rootMotion = 0;
+    u32 numRootMotionSamples        = 0;
+    if (extras.rootMotion && channelCount)
+    {
+        rootMotion           = ExtractRootMotion(temp.arena, boneChannels, channelCount, sourceSamples, numSamples);
+        numRootMotionSamples = numSamples;
+    }
+
+    // The error of a channel is measured through its parents, the ones that aren't animated keep their rest transform
+    u32 maxNodeCount     = (u32)data->nodes_count;
+    cgltf_node **nodes   = PushArrayNoZero(temp.arena, cgltf_node *, maxNodeCount);
+    i32 *parents         = PushArrayNoZero(temp.arena, i32, maxNodeCount);
+    Mat4 *restTransforms = PushArrayNoZero(temp.arena, Mat4, maxNodeCount);
+    u32 nodeCount        = channelCount;
+    for (u32 i = 0; i < channelCount; i++)
+    {
+        nodes[i] = boneChannels[i].node;
+    }
+    for (u32 i = 0; i < nodeCount; i++)
+    {
+        parents[i]         = -1;
+        cgltf_node *parent = nodes[i]->parent;
+        if (!parent)
+        {
+            continue;
+        }
+        auto it = animationNodeIndexMap.find(parent);
+        if (it == animationNodeIndexMap.end())
+        {
+            Assert(nodeCount < maxNodeCount);
+            animationNodeIndexMap[parent] = nodeCount;
+            nodes[nodeCount]              = parent;
+            cgltf_node_transform_local(parent, restTransforms[nodeCount].elements[0]);
+            parents[i] = nodeCount++;
+        }
+        else
+        {
+            parents[i] = it->second;
+        }
+    }
+
+    AnimationCompressionInput input = {};
+    input.channelCount              = channelCount;
+    input.nodeCount                 = nodeCount;
+    input.parents                   = parents;
+    input.restTransforms            = restTransforms;
+    input.sourceSamples             = sourceSamples;
+    input.sourceSampleCount         = numSamples;
+    input.sourceSampleRate          = sampleRate;
+    input.duration                  = duration;
+    input.maxError                  = animationMaxError;
+    input.shellDistance             = animationShellDistance;
+
+    CompressedAnimation compressed;
+    CompressAnimation(temp.arena, &input, &compressed);
+
+    u64 sourceSize = (u64)numSamples * channelCount * (sizeof(V3) * 2 + sizeof(Quat));
+    Printf("Animation %S: %u channels, %u samples at %.1f/s, %llu bytes from %llu (%.1f:1), max error %f\n",
+           Str8C(anim.name), channelCount, compressed.numSamples, compressed.sampleRate, compressed.size, sourceSize,
+           (f64)sourceSize / (f64)compressed.size, compressed.maxError);
+
+    // Write animation to file
+    TempArena temp2       = ScratchStart(&temp.arena, 1);
+    StringBuilder builder = {};
+    builder.arena         = temp2.arena;
+
+    Put(&builder, (u32)numNodes);
+    PutPointerValue(&builder, &duration);
+    Put(&builder, compressed.numSamples);
+    Put(&builder, compressed.numGroups);
+    PutPointerValue(&builder, &compressed.sampleRate);
+    Put(&builder, compressed.sampleStride);
+    Put(&builder, numRootMotionSamples);
+    PutPointerValue(&builder, &sampleRate);
+    Put(&builder, extras.numEvents);
+    u64 groupsWrite     = PutU64(&builder, 0);
+    u64 sampleDataWrite = PutU64(&builder, 0);
+    u64 rootMotionWrite = PutU64(&builder, 0);
+    u64 eventsWrite     = PutU64(&builder, 0);
+
+    // Channels are written in the order they were compressed in
+    BoneChannel *outChannels = PushArray(temp.arena, BoneChannel, numNodes);
+    for (u32 i = 0; i < numNodes; i++)
+    {
+        outChannels[i].name.size = boneChannels[compressed.channelOrder[i]].name.size;
+    }
+    u64 boneChannelWrite  = AppendArray(&builder, outChannels, numNodes);
+    u64 *stringDataWrites = PushArray(builder.arena, u64, numNodes);
+    for (u32 i = 0; i < numNodes; i++)
+    {
+        stringDataWrites[i] = Put(&builder, boneChannels[compressed.channelOrder[i]].name);
+    }
+    u64 groupsDataWrite = AppendArray(&builder, compressed.groups, compressed.numGroups);
+    u64 samplesWrite    = AppendArray(&builder, compressed.sampleData, compressed.numSamples * compressed.sampleStride);
+
+    u64 rootMotionDataWrite = AppendArray(&builder, rootMotion, numRootMotionSamples);
+
+    // Names follow the events
+    AnimationEvent *outEvents = PushArray(temp.arena, AnimationEvent, extras.numEvents);
+    for (u32 i = 0; i < extras.numEvents; i++)
+    {
+        outEvents[i].time      = extras.events[i].time;
+        outEvents[i].sid       = extras.events[i].sid;
+        outEvents[i].name.size = extras.events[i].name.size;
+    }
+    u64 eventsDataWrite  = AppendArray(&builder, outEvents, extras.numEvents);
+    u64 *eventNameWrites = PushArray(builder.arena, u64, extras.numEvents);
+    for (u32 i = 0; i < extras.numEvents; i++)
+    {
+        eventNameWrites[i] = Put(&builder, extras.events[i].name);
+    }
+
+    string result = CombineBuilderNodes(&builder);
+    ConvertPointerToOffset(result.str, groupsWrite, groupsDataWrite);
+    ConvertPointerToOffset(result.str, sampleDataWrite, samplesWrite);
+    ConvertPointerToOffset(result.str, rootMotionWrite, rootMotionDataWrite);
+    ConvertPointerToOffset(result.str, eventsWrite, eventsDataWrite);
+    for (u32 i = 0; i < extras.numEvents; i++)
+    {
+        ConvertPointerToOffset(result.str, eventsDataWrite + i * sizeof(AnimationEvent) + Offset(AnimationEvent, name) +
+                                                Offset(string, str),
+                               eventNameWrites[i]);
+    }
+    for (u32 i = 0; i < numNodes; i++)
+    {
+        ConvertPointerToOffset(result.str, boneChannelWrite + Offset(BoneChannel, name) + Offset(string, str),
+                               stringDataWrites[i]);
+        boneChannelWrite += sizeof(BoneChannel);
+    }
+
+    string animationFilename = PushStr8F(temp2.arena, "data\\animations\\%S.anim", Str8C(anim.name));
+    b32 success              = platform.WriteFile(animationFilename, result.str, (u32)result.size);
+    if (!success)
+    {
+        Printf("Failed to write file %S\n", animationFilename);
+        Assert(0);
+    }
+    ScratchEnd(temp2);
+    ScratchEnd(temp);
+}
 
-// NOTE: fix this. some nodes aren't meshes :)
-internal void LoadNode(cgltf_node *node, LoadState *state)
+internal void FinishImport(ModelImport *modelImport)
 {
-    if (node->mesh)
+    modelImport->memoryUsed = modelImport->bufferSize;
+    for (u32 i = 0; i < ArrayLength(modelImport->threadArenas); i++)
     {
-        auto it = state->meshMap.find(node->mesh);
-        if (it == state->meshMap.end())
+        if (modelImport->threadArenas[i])
         {
-            state->meshMap[node->mesh] = state->count++;
-            Mat4 transform;
-            cgltf_node_transform_world(node, transform.elements[0]);
-            state->transforms.push_back(transform);
-            Assert(state->count == state->transforms.size());
+            modelImport->memoryUsed += ArenaPos(modelImport->threadArenas[i]);
+            ArenaRelease(modelImport->threadArenas[i]);
         }
     }
-    for (u32 i = 0; i < node->children_count; i++)
-    {
-        LoadNode(node->children[i], state);
-    }
+    cgltf_free(modelImport->data);
+    modelImport->data  = 0;
+    modelImport->stage = ImportStage_Done;
 }
 
-internal LoadState LoadNodes(cgltf_data *data)
+// Kicks the jobs of the next stage once the ones of the current stage are done. Main thread only.
+internal void AdvanceImport(ModelImport *modelImport, BuildCache *cache)
 {
-    LoadState state;
-
-    for (u32 i = 0; i < data->nodes_count; i++)
+    cgltf_data *data = modelImport->data;
+    switch (modelImport->stage)
     {
-        LoadNode(&data->nodes[i], &state);
+        case ImportStage_Loading:
+        {
+            // Every file the import writes, so outputs deleted by hand are rebuilt. The textures are checked on their
+            // own.
+            string folderName      = modelImport->folderName;
+            string *outputs        = PushArrayNoZero(modelImport->arena, string, 3 + data->animations_count);
+            u32 outputCount        = 0;
+            outputs[outputCount++] = PushStr8F(modelImport->arena, "data\\models\\%S.model", folderName);
+            outputs[outputCount++] = PushStr8F(modelImport->arena, "data\\materials\\%S.mtr", folderName);
+            if (data->skins_count)
+            {
+                outputs[outputCount++] = PushStr8F(modelImport->arena, "data\\skeletons\\%S.skel", folderName);
+            }
+            for (u32 i = 0; i < data->animations_count; i++)
+            {
+                outputs[outputCount++] = PushStr8F(modelImport->arena, "data\\animations\\%S.anim",
+                                                   Str8C(data->animations[i].name));
+            }
+            if (CheckBuildCache(cache, BuildCacheKind_Model, modelImport->fullPath, modelImport->hash, outputs,
+                                outputCount))
+            {
+                modelImport->upToDate = 1;
+                FinishImport(modelImport);
+                break;
+            }
+            Printf("Processing %S\n", modelImport->fullPath);
+
+            modelImport->model.meshes    = PushArrayNoZero(modelImport->arena, InputMesh, data->meshes_count);
+            modelImport->model.numMeshes = (u32)data->meshes_count;
+            modelImport->materials       = PushArray(modelImport->arena, InputMaterial, data->materials_count);
+            for (u32 i = 0; i < ArrayLength(modelImport->threadArenas); i++)
+            {
+                modelImport->threadArenas[i] = ArenaAlloc();
+            }
+
+            // Keep the number of groups within the job queue
+            u32 materialCount  = (u32)data->materials_count;
+            u32 animationCount = (u32)data->animations_count;
+            u32 meshCount      = (u32)data->meshes_count;
+            jobsystem::KickJobs(
+                &modelImport->counter, materialCount, Max(1u, (materialCount + 63) / 64), [modelImport](jobsystem::JobArgs args) {
+                    ReadMaterial(modelImport->data->materials[args.jobId], modelImport->materials[args.jobId]);
+                });
+            jobsystem::KickJob(&modelImport->counter, [modelImport](jobsystem::JobArgs args) {
+                WriteSkeleton(modelImport);
+            });
+            jobsystem::KickJobs(
+                &modelImport->counter, animationCount, Max(1u, (animationCount + 63) / 64), [modelImport](jobsystem::JobArgs args) {
+                    WriteAnimation(modelImport->data, args.jobId);
+                });
+            jobsystem::KickJobs(
+                &modelImport->counter, meshCount, Max(1u, (meshCount + 63) / 64), [modelImport](jobsystem::JobArgs args) {
+                    ReadMesh(modelImport, args.jobId, modelImport->threadArenas[args.threadId]);
+                },
+                jobsystem::Priority::High);
+            modelImport->stage = ImportStage_Reading;
+        }
+        break;
+        case ImportStage_Reading:
+        {
+            // Optimize every subset in parallel, one mesh can have a lot of them
+            InputModel *model    = &modelImport->model;
+            u32 totalSubsetCount = 0;
+            for (u32 meshIndex = 0; meshIndex < model->numMeshes; meshIndex++)
+            {
+                totalSubsetCount += model->meshes[meshIndex].totalSubsets;
+            }
+            modelImport->subsets      = PushArrayNoZero(modelImport->arena, InputMesh::MeshSubset *, totalSubsetCount);
+            modelImport->baseVertices = PushArrayNoZero(modelImport->arena, u32, totalSubsetCount);
+            modelImport->subsetCount  = 0;
+            for (u32 meshIndex = 0; meshIndex < model->numMeshes; meshIndex++)
+            {
+                InputMesh *mesh = &model->meshes[meshIndex];
+                u32 baseVertex  = 0;
+                for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
+                {
+                    modelImport->subsets[modelImport->subsetCount]      = &mesh->subsets[subsetIndex];
+                    modelImport->baseVertices[modelImport->subsetCount] = baseVertex;
+                    baseVertex += mesh->subsets[subsetIndex].vertexCount;
+                    modelImport->subsetCount++;
+                }
+            }
+
+            jobsystem::KickJobs(
+                &modelImport->counter, totalSubsetCount, Max(1u, (totalSubsetCount + 63) / 64),
+                [modelImport](jobsystem::JobArgs args) {
+                    OptimizeSubset(modelImport, args.jobId, modelImport->threadArenas[args.threadId]);
+                },
+                jobsystem::Priority::High);
+            modelImport->stage = ImportStage_Optimizing;
+        }
+        break;
+        case ImportStage_Optimizing:
+        {
+            jobsystem::KickJob(
+                &modelImport->counter, [modelImport](jobsystem::JobArgs args) { WriteModel(modelImport); },
+                jobsystem::Priority::High);
+            jobsystem::KickJob(&modelImport->counter, [modelImport](jobsystem::JobArgs args) {
+                WriteMaterials(modelImport);
+            });
+            modelImport->stage = ImportStage_Writing;
+        }
+        break;
+        case ImportStage_Writing:
+        {
+            UpdateBuildCache(cache, modelImport->fullPath, modelImport->hash);
+            FinishImport(modelImport);
+        }
+        break;
+        default: Assert(0);
     }
-    return state;
 }
 
 PlatformApi platform;
@@ -667,34 +4495,47 @@ int main(int argc, char *argv[])
     OS_Init();
     jobsystem::InitializeJobsystem();
 
-    // Initialize compute shaders
-    mkGraphicsVulkan device(ValidationMode::Verbose, GPUDevicePreference::Discrete);
-    Shader bc1;
-    bc1.name  = "blockcompress_cs.hlsl";
-    bc1.stage = ShaderStage::Compute;
-
-    PipelineState bc1Pipeline;
-    PipelineStateDesc desc;
-
     TempArena scratch = ScratchStart(0, 0);
 
-    // Compile shaders
+    b32 rebuild      = 0;
+    u64 memoryBudget = gigabytes(2);
+    for (i32 i = 1; i < argc; i++)
     {
-        shadercompiler::InitShaderCompiler();
-        shadercompiler::CompileInput input;
-        input.shaderName = bc1.name;
-        input.stage      = bc1.stage;
-
-        shadercompiler::CompileOutput output;
-
-        u64 pos = ArenaPos(scratch.arena);
-        shadercompiler::CompileShader(scratch.arena, &input, &output);
-        device.CreateShader(&bc1, output.shaderData);
-        ArenaPopTo(scratch.arena, pos);
-
-        desc         = {};
-        desc.compute = &bc1;
-        device.CreateComputePipeline(&desc, &bc1Pipeline, "Block compress");
+        string arg = Str8C(argv[i]);
+        if (arg == Str8Lit("-fast"))
+        {
+            textureQuality = BC_Quality_Fast;
+        }
+        else if (arg == Str8Lit("-high"))
+        {
+            textureQuality = BC_Quality_High;
+        }
+        // Ignore the build cache
+        else if (arg == Str8Lit("-rebuild"))
+        {
+            rebuild = 1;
+        }
+        // Full float vertex streams
+        else if (arg == Str8Lit("-noquantize"))
+        {
+            quantizeVertices = 0;
+        }
+        // Memory in flight, in megabytes
+        else if (arg == Str8Lit("-budget") && i + 1 < argc)
+        {
+            memoryBudget = megabytes((u64)ConvertToUint(Str8C(argv[++i])));
+        }
+        // Block compression throughput and quality of one image
+        else if (arg == Str8Lit("-bench") && i + 1 < argc)
+        {
+            BC_Benchmark(Str8C(argv[i + 1]));
+            return 0;
+        }
+        // Checks the error SimplifyMesh reports against the deviation it measures on a known mesh
+        else if (arg == Str8Lit("-testsimplify"))
+        {
+            return SimplifyMeshTest() ? 0 : 1;
+        }
     }
 
     // JS_Init();
@@ -706,8 +4547,15 @@ int main(int argc, char *argv[])
 
     // Max asset size
     Arena *arena = ArenaAlloc(megabytes(4));
+
+    BuildCache buildCache;
+    LoadBuildCache(&buildCache, ArenaAlloc(), buildCacheFilename, rebuild);
     // JS_Counter counter = {};
 
+    PerformanceCounter importCounter = OS_StartCounter();
+
+    // Find every gltf
+    list<string> gltfPaths;
     string directories[1024];
     u32 size = 0;
     // TODO: Hardcoded
@@ -724,844 +4572,7 @@ int main(int argc, char *argv[])
             {
                 if (MatchString(GetFileExtension(props.name), Str8Lit("gltf"), MatchFlag_CaseInsensitive | MatchFlag_RightSideSloppy))
                 {
-                    string fullPath            = StrConcat(scratch.arena, directoryPath, props.name);
-                    jobsystem::Counter counter = {};
-
-                    string folderName = directoryPath;
-                    folderName.size -= 1;
-                    folderName = PathSkipLastSlash(folderName);
-
-                    cgltf_options options = {};
-                    cgltf_data *data      = 0;
-                    cgltf_result result   = cgltf_parse_file(&options, (const char *)fullPath.str, &data);
-                    Assert(result == cgltf_result_success);
-
-                    result = cgltf_load_buffers(&options, data, (const char *)fullPath.str);
-                    Assert(result == cgltf_result_success);
-
-                    LoadState state = LoadNodes(data);
-
-                    // Get all of the materials
-                    // TODO: MULTITHREAD
-                    jobsystem::KickJob(&counter, [&, data, folderName](jobsystem::JobArgs args) {
-                        TempArena temp           = ScratchStart(0, 0);
-                        InputMaterial *materials = PushArray(temp.arena, InputMaterial, data->materials_count);
-#ifdef BLOCK_COMPRESS
-                        CommandList cmd = device.BeginCommandList(QueueType_Compute);
-
-                        ReadbackTexture *readbackTextures = PushArrayNoZero(temp.arena, ReadbackTexture, data->materials_count);
-                        u32 numReadbackTextures           = 0;
-                        Texture uav;
-#endif
-                        for (size_t i = 0; i < data->materials_count; i++)
-                        {
-                            InputMaterial &material      = materials[i];
-                            cgltf_material &gltfMaterial = data->materials[i];
-
-                            material.name = Str8C(gltfMaterial.name);
-
-                            auto FindUri = [&material](cgltf_texture_view &view, TextureType type) {
-                                if (view.texture)
-                                {
-                                    if (view.texture->image->buffer_view)
-                                    {
-                                        Assert(0);
-                                    }
-                                    material.texture[type] = PathSkipLastSlash(Str8C(view.texture->image->uri));
-                                }
-                            };
-
-                            if (gltfMaterial.has_pbr_metallic_roughness)
-                            {
-                                FindUri(gltfMaterial.pbr_metallic_roughness.base_color_texture, TextureType_Diffuse);
-                                FindUri(gltfMaterial.pbr_metallic_roughness.metallic_roughness_texture, TextureType_MR);
-
-                                material.metallicFactor  = gltfMaterial.pbr_metallic_roughness.metallic_factor;
-                                material.roughnessFactor = gltfMaterial.pbr_metallic_roughness.roughness_factor;
-                                for (i32 i = 0; i < 4; i++)
-                                {
-                                    material.baseColor[i] = gltfMaterial.pbr_metallic_roughness.base_color_factor[i];
-                                }
-                            }
-                            else if (gltfMaterial.has_pbr_specular_glossiness)
-                            {
-                                FindUri(gltfMaterial.pbr_specular_glossiness.diffuse_texture, TextureType_Diffuse);
-                                material.roughnessFactor = 1 - gltfMaterial.pbr_specular_glossiness.glossiness_factor;
-                                for (i32 i = 0; i < 4; i++)
-                                {
-                                    material.baseColor[i] = gltfMaterial.pbr_specular_glossiness.diffuse_factor[i];
-                                }
-                            }
-
-                            FindUri(gltfMaterial.normal_texture, TextureType_Normal);
-
-#ifdef BLOCK_COMPRESS
-                            if (material.texture[TextureType_Diffuse].size != 0)
-                            {
-                                string textureName = material.texture[TextureType_Diffuse];
-                                string textureData = platform.ReadEntireFile(temp.arena, PushStr8F(temp.arena, "data/textures/%S", textureName));
-                                i32 width, height, nComponents;
-                                void *texData =
-                                    stbi_load_from_memory(textureData.str, textureData.size, &width, &height, &nComponents, 4);
-
-                                Format format   = Format::R8G8B8A8_SRGB;
-                                Format bcFormat = Format::BC1_RGB_UNORM;
-
-                                // Source uncompressed tex
-                                Assert(IsPow2(width) && IsPow2(height));
-                                Texture src;
-                                {
-                                    TextureDesc srcDesc;
-                                    srcDesc.width         = width;
-                                    srcDesc.height        = height;
-                                    srcDesc.format        = format;
-                                    srcDesc.mInitialUsage = ResourceUsage::SampledImage;
-                                    device.CreateTexture(&src, srcDesc, texData);
-                                    device.SetName(&src, "src");
-                                }
-
-                                // Destination uav
-                                u32 blockSize = GetBlockSize(bcFormat);
-                                {
-                                    TextureDesc dstDesc;
-                                    dstDesc.width         = src.desc.width / blockSize;
-                                    dstDesc.height        = src.desc.height / blockSize;
-                                    dstDesc.format        = Format::R32G32_UINT;
-                                    dstDesc.mInitialUsage = ResourceUsage::StorageImage;
-                                    dstDesc.mFutureUsages = ResourceUsage::TransferSrc;
-
-                                    if (!uav.IsValid() || uav.desc.width < dstDesc.width || uav.desc.height < dstDesc.height)
-                                    {
-                                        TextureDesc bcDesc = dstDesc;
-                                        bcDesc.width       = (u32)GetNextPowerOfTwo(dstDesc.width);
-                                        bcDesc.height      = (u32)GetNextPowerOfTwo(dstDesc.height);
-
-                                        device.CreateTexture(&uav, bcDesc, 0);
-                                        device.SetName(&uav, "UAV");
-                                    }
-                                }
-
-                                // Readback texture
-                                Texture *readback                          = &readbackTextures[numReadbackTextures].texture;
-                                readbackTextures[numReadbackTextures].name = textureName;
-                                numReadbackTextures++;
-                                {
-                                    TextureDesc readBackDesc;
-                                    readBackDesc.width  = width;
-                                    readBackDesc.height = height;
-                                    readBackDesc.format = bcFormat;
-                                    readBackDesc.mUsage = MemoryUsage::GPU_TO_CPU;
-
-                                    device.CreateTexture(readback, readBackDesc, 0);
-                                    device.SetName(readback, "Readback");
-                                }
-
-                                // Output block compression to intermediate texture
-                                device.BindCompute(&bc1Pipeline, cmd);
-                                device.BindResource(&uav, ResourceViewType::UAV, 0, cmd);
-                                device.BindResource(&src, ResourceViewType::SRV, 0, cmd);
-
-                                device.UpdateDescriptorSet(cmd);
-                                device.Dispatch(cmd, (src.desc.width + 7) / 8, (src.desc.height + 7) / 8, 1);
-                                device.DeleteTexture(&src);
-
-                                // Copy from uav to output
-                                {
-                                    GPUBarrier barrier = GPUBarrier::Image(&uav, ResourceUsage::StorageImage, ResourceUsage::TransferSrc);
-                                    device.Barrier(cmd, &barrier, 1);
-                                }
-
-                                Rect3U32 rect;
-                                rect.minX = 0;
-                                rect.minY = 0;
-                                rect.minZ = 0;
-                                rect.maxP = {src.desc.width / blockSize, src.desc.height / blockSize, src.desc.depth};
-
-                                device.CopyTexture(cmd, readback, &uav, &rect);
-
-                                // Transfer the block compressed texture to its initial format
-                                {
-                                    GPUBarrier barrier = GPUBarrier::Image(&uav, ResourceUsage::TransferSrc, ResourceUsage::StorageImage);
-                                    device.Barrier(cmd, &barrier, 1);
-                                }
-                            }
-#endif
-                        }
-
-#ifdef BLOCK_COMPRESS
-                        device.SubmitCommandLists();
-
-                        // Write the DDS files
-                        for (size_t i = 0; i < numReadbackTextures; i++)
-                        {
-                            ReadbackTexture *readback = &readbackTextures[i];
-                            WriteImageToDDS(&readback->texture, readback->name);
-                            device.DeleteTexture(&readback->texture);
-                        }
-#endif
-
-                        // Build material file
-                        StringBuilder builder = {};
-                        builder.arena         = temp.arena;
-                        PutLine(&builder, 0, "Num materials: %u\n", (u32)data->materials_count);
-                        for (u32 i = 0; i < data->materials_count; i++)
-                        {
-                            InputMaterial &material = materials[i];
-                            PutLine(&builder, 0, "Name: %S", material.name);
-                            PutLine(&builder, 0, "{");
-
-                            // Diffuse
-                            if (material.texture[TextureType_Diffuse].size != 0)
-                            {
-                                PutLine(&builder, 1, "Diffuse: %S", material.texture[TextureType_Diffuse]);
-                            }
-                            // Base color rgba
-                            if (material.baseColor != MakeV4(1))
-                            {
-                                PutLine(&builder, 1, "Color: %f %f %f %f", material.baseColor.r, material.baseColor.g, material.baseColor.b, material.baseColor.a);
-                            }
-                            // Normal
-                            if (material.texture[TextureType_Normal].size != 0)
-                            {
-                                PutLine(&builder, 1, "Normal: %S", material.texture[TextureType_Normal]);
-                            }
-                            // Metallic roughness
-                            if (material.texture[TextureType_MR].size != 0)
-                            {
-                                PutLine(&builder, 1, "MR Map: %S", material.texture[TextureType_MR]);
-                            }
-                            if (material.metallicFactor != 1.f)
-                            {
-                                PutLine(&builder, 1, "Metallic Factor: %f", material.metallicFactor);
-                            }
-                            if (material.roughnessFactor != 1.f)
-                            {
-                                PutLine(&builder, 1, "Roughness Factor: %f", material.roughnessFactor);
-                            }
-                            PutLine(&builder, 0, "}");
-                        }
-
-                        // Write to disk
-                        string materialFilename = PushStr8F(temp.arena, "data\\materials\\%S.mtr", folderName);
-
-                        b32 result = WriteEntireFile(&builder, materialFilename);
-                        if (!result)
-                        {
-                            Printf("Unable to print material file: %S\n", materialFilename);
-                            Assert(0);
-                        }
-
-                        ScratchEnd(temp);
-                    });
-
-                    // Write all of the models
-                    TempArena modelTemp = ScratchStart(&scratch.arena, 1);
-                    InputModel model;
-
-                    // Find total number of meshes
-                    InputMesh *meshes = PushArrayNoZero(modelTemp.arena, InputMesh, data->meshes_count);
-                    model.meshes      = meshes;
-                    model.numMeshes   = data->meshes_count;
-
-                    Arena *arenas[16];
-                    for (u32 i = 0; i < ArrayLength(arenas); i++)
-                    {
-                        arenas[i] = ArenaAlloc();
-                    }
-
-                    // Get any skeleton data
-                    jobsystem::KickJob(&counter, [data, folderName, modelTemp](jobsystem::JobArgs args) {
-                        TempArena temp     = ScratchStart(0, 0);
-                        Skeleton *skeleton = PushStruct(temp.arena, Skeleton);
-                        for (size_t i = 0; i < data->skins_count; i++)
-                        {
-                            cgltf_skin &skin = data->skins[i];
-                            skeleton->count  = skin.joints_count;
-
-                            std::unordered_map<cgltf_node *, i32> nodeToIndex;
-                            skeleton->inverseBindPoses   = PushArrayNoZero(temp.arena, Mat4, skeleton->count);
-                            skeleton->names              = PushArrayNoZero(temp.arena, string, skeleton->count);
-                            skeleton->parents            = PushArrayNoZero(temp.arena, i32, skeleton->count);
-                            skeleton->transformsToParent = PushArrayNoZero(temp.arena, Mat4, skeleton->count);
-
-                            for (size_t jointIndex = 0; jointIndex < skeleton->count; jointIndex++)
-                            {
-                                cgltf_node *joint = skin.joints[jointIndex];
-                                cgltf_accessor_read_float(skin.inverse_bind_matrices, jointIndex, skeleton->inverseBindPoses[jointIndex].elements[0], 16);
-                                if (jointIndex == 0)
-                                {
-                                    cgltf_node_transform_world(joint, skeleton->transformsToParent[jointIndex].elements[0]);
-                                }
-                                else
-                                {
-                                    cgltf_node_transform_local(joint, skeleton->transformsToParent[jointIndex].elements[0]);
-                                }
-                                skeleton->names[jointIndex] = Str8C(joint->name);
-
-                                auto it              = nodeToIndex.find(joint->parent);
-                                i32 parentJointIndex = -1;
-                                Assert(it == nodeToIndex.end() ? jointIndex == 0 : 1); // only the root node should have no parent
-                                if (it != nodeToIndex.end())
-                                {
-                                    parentJointIndex = it->second;
-                                }
-                                skeleton->parents[jointIndex] = parentJointIndex;
-                                nodeToIndex[joint]            = jointIndex;
-                            }
-
-                            // Write the skeleton to file
-                            StringBuilder builder = {};
-                            builder.arena         = temp.arena;
-                            Put(&builder, skeletonVersionNumber);
-                            Put(&builder, skeleton->count);
-                            Printf("Num bones: %u\n", skeleton->count);
-
-                            u64 *stringDataOffsets = PushArrayNoZero(temp.arena, u64, skeleton->count);
-
-                            u64 nameOffset = PutArray(&builder, skeleton->names, skeleton->count);
-                            for (u32 i = 0; i < skeleton->count; i++)
-                            {
-                                string *name         = &skeleton->names[i];
-                                stringDataOffsets[i] = Put(&builder, *name);
-                            }
-
-                            PutArray(&builder, skeleton->parents, skeleton->count);
-                            PutArray(&builder, skeleton->inverseBindPoses, skeleton->count);
-                            PutArray(&builder, skeleton->transformsToParent, skeleton->count);
-
-                            string fileData = CombineBuilderNodes(&builder);
-                            for (u32 i = 0; i < skeleton->count; i++)
-                            {
-                                ConvertPointerToOffset(fileData.str, nameOffset + Offset(string, str), stringDataOffsets[i]);
-                                nameOffset += sizeof(string);
-                            }
-
-                            string skeletonFilename = PushStr8F(temp.arena, "data\\skeletons\\%S.skel", folderName);
-                            b32 success             = platform.WriteFile(skeletonFilename, fileData.str, (u32)fileData.size);
-                            // b32 success             = WriteEntireFile(&builder, skeletonFilename);
-                            if (!success)
-                            {
-                                Printf("Failed to write file %S\n", skeletonFilename);
-                                Assert(!"Failed");
-                            }
-                        }
-                        ScratchEnd(temp);
-                    });
-
-                    jobsystem::KickJobs(
-                        &counter, data->meshes_count, 8, [&](jobsystem::JobArgs args) {
-                            // Get the vertex/index attribute data
-                            //
-                            Arena *arena          = arenas[args.threadId];
-                            cgltf_mesh *cgltfMesh = &data->meshes[args.jobId];
-                            InputMesh *mesh       = &meshes[args.jobId];
-
-                            mesh->subsets = PushArray(arena, InputMesh::MeshSubset, cgltfMesh->primitives_count);
-
-                            mesh->transform        = state.transforms[state.meshMap[cgltfMesh]];
-                            mesh->totalVertexCount = 0;
-                            mesh->totalIndexCount  = 0;
-                            mesh->flags            = 0;
-                            mesh->totalSubsets     = cgltfMesh->primitives_count;
-
-                            Init(&mesh->bounds);
-
-                            for (size_t primitiveIndex = 0; primitiveIndex < cgltfMesh->primitives_count; primitiveIndex++)
-                            {
-                                cgltf_primitive *primitive = &cgltfMesh->primitives[primitiveIndex];
-
-                                InputMesh::MeshSubset *subset = &mesh->subsets[primitiveIndex];
-                                if (primitive->material->name)
-                                {
-                                    subset->materialName = primitive->material->name;
-                                }
-                                else
-                                {
-                                    subset->materialName.size = 0;
-                                }
-
-                                u32 baseVertex     = mesh->totalVertexCount;
-                                subset->indexCount = primitive->indices->count;
-                                mesh->totalIndexCount += subset->indexCount;
-                                subset->indices = PushArrayNoZero(arena, u32, subset->indexCount);
-                                for (size_t indexIndex = 0; indexIndex < primitive->indices->count; indexIndex++)
-                                {
-                                    subset->indices[indexIndex] = cgltf_accessor_read_index(primitive->indices, indexIndex);
-                                }
-
-                                // Get the attributes
-                                u32 vertexCount = 0;
-                                for (size_t attribIndex = 0; attribIndex < primitive->attributes_count; attribIndex++)
-                                {
-                                    cgltf_attribute *attribute = &primitive->attributes[attribIndex];
-                                    if (Str8C(attribute->name) == Str8Lit("POSITION"))
-                                    {
-                                        vertexCount         = attribute->data->count;
-                                        subset->vertexCount = vertexCount;
-                                        mesh->totalVertexCount += vertexCount;
-                                        subset->positions = PushArrayNoZero(arena, V3, vertexCount);
-
-                                        for (u32 i = 0; i < attribute->data->count; i++)
-                                        {
-                                            cgltf_accessor_read_float(attribute->data, i, subset->positions[i].elements, 3);
-                                        }
-
-                                        Assert(attribute->data->has_max && attribute->data->has_min);
-                                        V3 minP;
-                                        minP.x = attribute->data->min[0];
-                                        minP.y = attribute->data->min[1];
-                                        minP.z = attribute->data->min[2];
-                                        AddBounds(mesh->bounds, minP);
-
-                                        V3 maxP;
-                                        maxP.x = attribute->data->max[0];
-                                        maxP.y = attribute->data->max[1];
-                                        maxP.z = attribute->data->max[2];
-                                        AddBounds(mesh->bounds, maxP);
-                                    }
-                                    else if (Str8C(attribute->name) == Str8Lit("NORMAL"))
-                                    {
-                                        subset->normals = PushArrayNoZero(arena, V3, vertexCount);
-                                        for (u32 i = 0; i < attribute->data->count; i++)
-                                        {
-                                            cgltf_accessor_read_float(attribute->data, i, subset->normals[i].elements, 3);
-                                        }
-                                    }
-                                    else if (Str8C(attribute->name) == Str8Lit("TANGENT"))
-                                    {
-                                        subset->tangents = PushArrayNoZero(arena, V3, vertexCount);
-                                        for (u32 i = 0; i < attribute->data->count; i++)
-                                        {
-                                            V4 tangent;
-                                            cgltf_accessor_read_float(attribute->data, i, tangent.elements, 4);
-                                            subset->tangents[i] = tangent.xyz;
-                                        }
-                                    }
-                                    else if (Str8C(attribute->name) == Str8Lit("TEXCOORD_0"))
-                                    {
-                                        mesh->flags |= MeshFlags_Uvs;
-                                        subset->uvs = PushArrayNoZero(arena, V2, vertexCount);
-                                        for (u32 i = 0; i < attribute->data->count; i++)
-                                        {
-                                            cgltf_accessor_read_float(attribute->data, i, subset->uvs[i].elements, 2);
-                                        }
-                                    }
-                                    else if (Str8C(attribute->name) == Str8Lit("TEXCOORD_1"))
-                                    {
-                                        // mesh->flags |= MeshFLags_Uvs;
-                                        int x = 5;
-                                    }
-                                    else if (Str8C(attribute->name) == Str8Lit("JOINTS_0"))
-                                    {
-                                        vertexCount = attribute->data->count;
-                                        mesh->flags |= MeshFlags_Skinned;
-                                        subset->boneIds = PushArrayNoZero(arena, UV4, vertexCount);
-                                        for (u32 i = 0; i < attribute->data->count; i++)
-                                        {
-                                            cgltf_accessor_read_uint(attribute->data, i, subset->boneIds[i].elements, 4);
-                                        }
-                                    }
-                                    else if (Str8C(attribute->name) == Str8Lit("WEIGHTS_0"))
-                                    {
-                                        subset->boneWeights = PushArrayNoZero(arena, V4, vertexCount);
-                                        for (u32 i = 0; i < attribute->data->count; i++)
-                                        {
-                                            cgltf_accessor_read_float(attribute->data, i, subset->boneWeights[i].elements, 4);
-                                        }
-                                    }
-                                    else if (Str8C(attribute->name) == Str8Lit("COLOR_0"))
-                                    {
-                                        // TODO
-                                    }
-                                }
-
-                                Assert(subset->positions);
-                                Assert(subset->normals);
-                                // TODO: I'm going to have to generate these, either using mikkt or manually
-                                Assert(subset->tangents);
-                                OptimizeMesh(subset);
-
-                                for (size_t indexIndex = 0; indexIndex < primitive->indices->count; indexIndex++)
-                                {
-                                    subset->indices[indexIndex] = subset->indices[indexIndex] + baseVertex;
-                                }
-                            }
-                        },
-                        jobsystem::Priority::High);
-
-                    // Write the whole model to file
-                    jobsystem::WaitJobs(&counter);
-
-                    jobsystem::KickJob(&counter, [&model, &modelTemp, data, folderName](jobsystem::JobArgs args) {
-                        StringBuilder builder = {};
-                        builder.arena         = modelTemp.arena;
-                        Put(&builder, model.numMeshes);
-                        for (u32 meshIndex = 0; meshIndex < model.numMeshes; meshIndex++)
-                        {
-                            InputMesh *mesh = &model.meshes[meshIndex];
-
-                            Put(&builder, mesh->totalVertexCount);
-                            Put(&builder, mesh->flags);
-                            Put(&builder, mesh->totalSubsets);
-
-                            u32 indexOffset = 0;
-                            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
-                            {
-                                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
-                                PutPointerValue(&builder, &indexOffset);
-                                PutPointerValue(&builder, &subset->indexCount);
-                                MaterialHandle handle = {};
-                                PutPointerValue(&builder, &handle);
-                                indexOffset += subset->indexCount;
-                            }
-
-                            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
-                            {
-                                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
-                                PutU64(&builder, subset->materialName.size);
-                                if (subset->materialName.size != 0)
-                                {
-                                    Put(&builder, subset->materialName);
-                                }
-                            }
-
-                            // Positions
-                            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
-                            {
-                                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
-                                Assert(subset->positions);
-                                Put(&builder, subset->positions, sizeof(subset->positions[0]) * subset->vertexCount);
-                            }
-
-                            // Normals
-                            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
-                            {
-                                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
-                                Assert(subset->normals);
-                                Put(&builder, subset->normals, sizeof(subset->normals[0]) * subset->vertexCount);
-                            }
-
-                            // Tangents
-                            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
-                            {
-                                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
-                                Assert(subset->tangents);
-                                Put(&builder, subset->tangents, sizeof(subset->tangents[0]) * subset->vertexCount);
-                            }
-
-                            // Uvs. (what if some subsets have uvs and some don't?)
-                            if (mesh->flags & MeshFlags_Uvs)
-                            {
-                                for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
-                                {
-                                    InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
-                                    Assert(subset->uvs);
-                                    Put(&builder, subset->uvs, sizeof(subset->uvs[0]) * subset->vertexCount);
-                                }
-                            }
-
-                            // Skinning data
-                            if (mesh->flags & MeshFlags_Skinned)
-                            {
-                                for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
-                                {
-                                    InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
-                                    Assert(subset->boneIds && subset->boneWeights);
-                                    Put(&builder, subset->boneIds, sizeof(subset->boneIds[0]) * subset->vertexCount);
-                                    Put(&builder, subset->boneWeights, sizeof(subset->boneWeights[0]) * subset->vertexCount);
-                                }
-                            }
-
-                            // Finally indices
-                            Put(&builder, mesh->totalIndexCount);
-                            for (u32 subsetIndex = 0; subsetIndex < mesh->totalSubsets; subsetIndex++)
-                            {
-                                InputMesh::MeshSubset *subset = &mesh->subsets[subsetIndex];
-                                Assert(subset->indices);
-                                Put(&builder, subset->indices, sizeof(subset->indices[0]) * subset->indexCount);
-                            }
-
-                            PutStruct(&builder, mesh->bounds);
-                            PutStruct(&builder, mesh->transform);
-                        }
-
-                        if (data->skins_count != 0)
-                        {
-                            Assert(data->skins_count == 1);
-                            PutU64(&builder, folderName.size);
-                            Put(&builder, folderName);
-                        }
-                        else
-                        {
-                            PutU64(&builder, 0);
-                        }
-                        string modelFilename = PushStr8F(modelTemp.arena, "data\\models\\%S.model", folderName);
-                        b32 success          = WriteEntireFile(&builder, modelFilename);
-                        if (!success)
-                        {
-                            Printf("Failed to write file %S\n", modelFilename);
-                            Assert(0);
-                        }
-
-                        ScratchEnd(modelTemp);
-                    });
-
-                    // Get any animations
-                    jobsystem::KickJobs(&counter, data->animations_count, 8, [data](jobsystem::JobArgs args) {
-                        TempArena temp = ScratchStart(0, 0);
-
-                        CompressedKeyframedAnimation *animation = PushStructNoZero(temp.arena, CompressedKeyframedAnimation);
-                        cgltf_animation &anim                   = data->animations[args.jobId];
-                        animation->boneChannels                 = PushArrayNoZero(temp.arena, CompressedBoneChannel, anim.channels_count);
-                        u32 channelCount                        = 0;
-                        std::unordered_map<cgltf_node *, i32> animationNodeIndexMap;
-
-                        f32 minTime       = FLT_MAX;
-                        f32 maxTime       = -FLT_MAX;
-                        const f32 epsilon = 0.000001f;
-
-                        for (size_t channelIndex = 0; channelIndex < anim.channels_count; channelIndex++)
-                        {
-                            cgltf_animation_channel &channel = anim.channels[channelIndex];
-                            auto it                          = animationNodeIndexMap.find(channel.target_node);
-                            i32 animationNodeIndex           = -1;
-                            if (it == animationNodeIndexMap.end())
-                            {
-                                animationNodeIndexMap[channel.target_node] = channelCount;
-                                animationNodeIndex                         = channelCount;
-                                CompressedBoneChannel &boneChannel         = animation->boneChannels[channelCount];
-                                boneChannel.name                           = Str8C(channel.target_node->name);
-                                boneChannel.numPositionKeys                = 0;
-                                boneChannel.numScalingKeys                 = 0;
-                                boneChannel.numRotationKeys                = 0;
-
-                                channelCount++;
-                            }
-                            else
-                            {
-                                animationNodeIndex = it->second;
-                            }
-                            CompressedBoneChannel &boneChannel = animation->boneChannels[animationNodeIndex];
-                            minTime                            = Min(minTime, channel.sampler->input->min[0]);
-                            maxTime                            = Max(maxTime, channel.sampler->input->max[0]);
-
-                            // NOTE: subtracts the minimum time from the sample time, because
-                            // sometimes the start time is really really late. also checks to
-                            // see if all of the samples for position/scale/rotation are all
-                            // roughly equal, and if so just store one copy otherwise store all
-                            // of the copies
-                            switch (channel.target_path)
-                            {
-                                case cgltf_animation_path_type_translation:
-                                {
-                                    const u32 positionKeyCount = channel.sampler->output->count;
-                                    boneChannel.positions      = PushArrayNoZero(temp.arena, AnimationPosition, positionKeyCount);
-                                    b8 allEqual                = 1;
-                                    V3 firstPosition;
-                                    f32 firstTime;
-                                    Assert(cgltf_accessor_read_float(channel.sampler->input, 0, &firstTime, 1));
-                                    Assert(cgltf_accessor_read_float(channel.sampler->output, 0, firstPosition.elements, 3));
-
-                                    boneChannel.positions[0].time     = firstTime - channel.sampler->input->min[0];
-                                    boneChannel.positions[0].position = firstPosition;
-
-                                    // NOTE: have to loop over all of the elements first! :)
-                                    for (u32 i = 1; i < positionKeyCount; i++)
-                                    {
-                                        V3 position;
-                                        Assert(cgltf_accessor_read_float(channel.sampler->output, i, position.elements, 3));
-
-                                        if (!AlmostEqual(position, firstPosition, epsilon))
-                                        {
-                                            allEqual = 0;
-                                            break;
-                                        }
-                                    }
-
-                                    if (!allEqual)
-                                    {
-                                        for (u32 i = 1; i < positionKeyCount; i++)
-                                        {
-                                            f32 time;
-                                            V3 position;
-                                            Assert(cgltf_accessor_read_float(channel.sampler->input, i, &time, 1));
-                                            Assert(cgltf_accessor_read_float(channel.sampler->output, i, position.elements, 3));
-                                            boneChannel.positions[i].time     = time - channel.sampler->input->min[0];
-                                            boneChannel.positions[i].position = position;
-
-                                            if (boneChannel.positions[i].time != boneChannel.positions[i].time ||
-                                                boneChannel.positions[i].position != boneChannel.positions[i].position)
-                                            {
-                                                Assert(0);
-                                            }
-                                        }
-                                    }
-
-                                    boneChannel.numPositionKeys = allEqual ? 1 : positionKeyCount;
-                                }
-                                break;
-                                case cgltf_animation_path_type_rotation:
-                                {
-                                    u32 rotationKeyCount  = channel.sampler->output->count;
-                                    boneChannel.rotations = PushArrayNoZero(temp.arena, CompressedAnimationRotation, rotationKeyCount);
-                                    b8 allEqual           = 1;
-
-                                    // First rotation/time
-                                    V4 firstRotation;
-                                    f32 firstTime;
-                                    Assert(cgltf_accessor_read_float(channel.sampler->input, 0, &firstTime, 1));
-                                    Assert(cgltf_accessor_read_float(channel.sampler->output, 0, firstRotation.elements, 4));
-                                    boneChannel.rotations[0].time = firstTime - channel.sampler->input->min[0];
-                                    for (u32 rotIndex = 0; rotIndex < 4; rotIndex++)
-                                    {
-                                        boneChannel.rotations[0].rotation[rotIndex] = CompressRotationChannel(firstRotation[rotIndex]);
-                                    }
-
-                                    for (u32 i = 1; i < rotationKeyCount; i++)
-                                    {
-                                        V4 rotation;
-                                        Assert(cgltf_accessor_read_float(channel.sampler->output, i, rotation.elements, 4));
-                                        if (!AlmostEqual(rotation, firstRotation, epsilon))
-                                        {
-                                            allEqual = 0;
-                                            break;
-                                        }
-                                    }
-
-                                    if (!allEqual)
-                                    {
-                                        for (u32 i = 1; i < rotationKeyCount; i++)
-                                        {
-                                            f32 time;
-                                            V4 rotation;
-                                            Assert(cgltf_accessor_read_float(channel.sampler->input, i, &time, 1));
-                                            Assert(cgltf_accessor_read_float(channel.sampler->output, i, rotation.elements, 4));
-                                            boneChannel.rotations[i].time = time - channel.sampler->input->min[0];
-                                            for (u32 rotIndex = 0; rotIndex < 4; rotIndex++)
-                                            {
-                                                boneChannel.rotations[i].rotation[rotIndex] = CompressRotationChannel(rotation[rotIndex]);
-                                            }
-                                        }
-                                    }
-                                    boneChannel.numRotationKeys = allEqual ? 1 : rotationKeyCount;
-                                }
-                                break;
-                                case cgltf_animation_path_type_scale:
-                                {
-                                    u32 scaleKeyCount  = channel.sampler->output->count;
-                                    boneChannel.scales = PushArrayNoZero(temp.arena, AnimationScale, scaleKeyCount);
-
-                                    b8 allEqual = 1;
-                                    V3 firstScale;
-                                    f32 firstTime;
-                                    Assert(cgltf_accessor_read_float(channel.sampler->input, 0, &firstTime, 1));
-                                    Assert(cgltf_accessor_read_float(channel.sampler->output, 0, firstScale.elements, 3));
-                                    boneChannel.scales[0].time  = firstTime - channel.sampler->input->min[0];
-                                    boneChannel.scales[0].scale = firstScale;
-
-                                    for (u32 i = 1; i < scaleKeyCount; i++)
-                                    {
-                                        V3 scale;
-                                        Assert(cgltf_accessor_read_float(channel.sampler->output, i, scale.elements, 3));
-                                        if (!AlmostEqual(scale, firstScale, epsilon))
-                                        {
-                                            allEqual = 0;
-                                            break;
-                                        }
-                                    }
-
-                                    if (!allEqual)
-                                    {
-                                        for (u32 i = 1; i < scaleKeyCount; i++)
-                                        {
-                                            f32 time;
-                                            V3 scale;
-                                            Assert(cgltf_accessor_read_float(channel.sampler->input, i, &time, 1));
-                                            Assert(cgltf_accessor_read_float(channel.sampler->output, i, scale.elements, 3));
-                                            boneChannel.scales[i].time  = time - channel.sampler->input->min[0];
-                                            boneChannel.scales[i].scale = scale;
-                                        }
-                                    }
-                                    boneChannel.numScalingKeys = allEqual ? 1 : scaleKeyCount;
-                                }
-                                break;
-                            }
-                        }
-
-                        AnimationPosition nullPosition = {};
-                        animation->duration            = maxTime - minTime;
-
-                        // Write animation to file
-                        TempArena temp2       = ScratchStart(&temp.arena, 1);
-                        StringBuilder builder = {};
-                        builder.arena         = temp2.arena;
-                        u64 numNodes          = animationNodeIndexMap.size();
-                        Assert(numNodes == channelCount);
-
-                        animation->numNodes = numNodes;
-
-                        Put(&builder, (u32)numNodes);
-                        PutPointerValue(&builder, &animation->duration);
-
-                        for (u32 i = 0; i < animation->numNodes; i++)
-                        {
-                            CompressedBoneChannel *boneChannel = animation->boneChannels + i;
-                            if (boneChannel->numPositionKeys == 0)
-                            {
-                                boneChannel->numPositionKeys = 1;
-                                boneChannel->positions       = &nullPosition;
-                            }
-                        }
-
-                        u64 boneChannelWrite = AppendArray(&builder, animation->boneChannels, animation->numNodes);
-
-                        u64 *stringDataWrites = PushArray(builder.arena, u64, animation->numNodes);
-                        u64 *positionWrites   = PushArray(builder.arena, u64, animation->numNodes);
-                        u64 *scalingWrites    = PushArray(builder.arena, u64, animation->numNodes);
-                        u64 *rotationWrites   = PushArray(builder.arena, u64, animation->numNodes);
-
-                        for (u32 i = 0; i < animation->numNodes; i++)
-                        {
-                            CompressedBoneChannel *boneChannel = animation->boneChannels + i;
-
-                            stringDataWrites[i] = Put(&builder, animation->boneChannels[i].name);
-                            positionWrites[i]   = AppendArray(&builder, boneChannel->positions, boneChannel->numPositionKeys);
-                            scalingWrites[i]    = AppendArray(&builder, boneChannel->scales, boneChannel->numScalingKeys);
-                            rotationWrites[i]   = AppendArray(&builder, boneChannel->rotations, boneChannel->numRotationKeys);
-                        }
-
-                        string result = CombineBuilderNodes(&builder);
-                        for (u32 i = 0; i < animation->numNodes; i++)
-                        {
-                            ConvertPointerToOffset(result.str, boneChannelWrite + Offset(CompressedBoneChannel, name) + Offset(string, str),
-                                                   stringDataWrites[i]);
-                            ConvertPointerToOffset(result.str, boneChannelWrite + Offset(CompressedBoneChannel, positions),
-                                                   positionWrites[i]);
-                            ConvertPointerToOffset(result.str, boneChannelWrite + Offset(CompressedBoneChannel, scales),
-                                                   scalingWrites[i]);
-                            ConvertPointerToOffset(result.str, boneChannelWrite + Offset(CompressedBoneChannel, rotations),
-                                                   rotationWrites[i]);
-                            boneChannelWrite += sizeof(CompressedBoneChannel);
-                        }
-
-                        string animationFilename = PushStr8F(temp2.arena, "data\\animations\\%S.anim", Str8C(anim.name));
-                        b32 success              = platform.WriteFile(animationFilename, result.str, (u32)result.size);
-                        if (!success)
-                        {
-                            Printf("Failed to write file %S\n", animationFilename);
-                            Assert(0);
-                        }
-                        ScratchEnd(temp2);
-                        ScratchEnd(temp);
-                    });
-
-                    jobsystem::WaitJobs(&counter);
-                    // Free
-                    cgltf_free(data);
-                    for (u32 i = 0; i < ArrayLength(arenas); i++)
-                    {
-                        ArenaRelease(arenas[i]);
-                    }
+                    gltfPaths.push_back(StrConcat(scratch.arena, directoryPath, props.name));
                 }
             }
             else
@@ -1573,5 +4584,128 @@ int main(int argc, char *argv[])
         }
         OS_DirectoryIterEnd(&fileIter);
     }
+
+    // Parse every gltf in parallel, the json is small compared to the buffers
+    u32 importCount      = (u32)gltfPaths.size();
+    ModelImport *imports = PushArray(scratch.arena, ModelImport, importCount);
+    u64 totalBufferSize  = 0;
+    for (u32 i = 0; i < importCount; i++)
+    {
+        ModelImport *modelImport = &imports[i];
+        modelImport->fullPath    = gltfPaths[i];
+        modelImport->arena       = ArenaAlloc();
+
+        // Models are named after their folder
+        string folderName       = PathSkipLastSlash(gltfPaths[i]);
+        folderName.str          = gltfPaths[i].str;
+        folderName.size         = gltfPaths[i].size - folderName.size - 1;
+        modelImport->folderName = PathSkipLastSlash(folderName);
+    }
+    {
+        jobsystem::Counter counter = {};
+        jobsystem::KickJobs(
+            &counter, importCount, Max(1u, (importCount + 63) / 64),
+            [imports](jobsystem::JobArgs args) { ParseModel(&imports[args.jobId]); }, jobsystem::Priority::High);
+        jobsystem::WaitJobs(&counter);
+    }
+
+    // Load models in directory order while they fit in the budget. At least one is always in flight. The estimate
+    // starts at a multiple of the buffer size and follows the worst ratio measured so far.
+    f32 memoryRatio    = 4.f;
+    u64 memoryInFlight = 0;
+    u64 peakMemory     = 0;
+    u32 nextImport     = 0;
+    u32 firstActive    = 0;
+    u32 doneCount      = 0;
+    u32 upToDateCount  = 0;
+    while (doneCount < importCount)
+    {
+        while (nextImport < importCount)
+        {
+            ModelImport *modelImport = &imports[nextImport];
+            u64 estimate             = (u64)(modelImport->bufferSize * memoryRatio);
+            if (memoryInFlight != 0 && memoryInFlight + estimate > memoryBudget)
+            {
+                break;
+            }
+            modelImport->memoryEstimate = estimate;
+            memoryInFlight += estimate;
+            peakMemory         = Max(peakMemory, memoryInFlight);
+            modelImport->stage = ImportStage_Loading;
+            jobsystem::KickJob(&modelImport->counter, [modelImport](jobsystem::JobArgs args) { LoadModel(modelImport); },
+                               jobsystem::Priority::High);
+            nextImport++;
+        }
+
+        b32 advanced = 0;
+        for (u32 i = firstActive; i < nextImport; i++)
+        {
+            ModelImport *modelImport = &imports[i];
+            if (modelImport->stage == ImportStage_Done || modelImport->counter.count.load() != 0)
+            {
+                continue;
+            }
+            advanced = 1;
+            AdvanceImport(modelImport, &buildCache);
+            if (modelImport->stage == ImportStage_Done)
+            {
+                doneCount++;
+                upToDateCount += modelImport->upToDate;
+                memoryInFlight -= modelImport->memoryEstimate;
+                if (!modelImport->upToDate && modelImport->bufferSize)
+                {
+                    memoryRatio = Max(memoryRatio, (f32)modelImport->memoryUsed / modelImport->bufferSize);
+                }
+                totalBufferSize += modelImport->bufferSize;
+            }
+        }
+        while (firstActive < nextImport && imports[firstActive].stage == ImportStage_Done)
+        {
+            firstActive++;
+        }
+        if (!advanced)
+        {
+            std::this_thread::yield();
+        }
+    }
+    f32 modelMs = OS_GetMilliseconds(importCounter);
+
+    // Compress the textures of every model at once, each one only once
+    u32 maxTextureCount = 0;
+    for (u32 i = 0; i < importCount; i++)
+    {
+        maxTextureCount += imports[i].textureCount;
+    }
+    InputTexture *textures = PushArrayNoZero(scratch.arena, InputTexture, maxTextureCount);
+    u32 textureCount       = 0;
+    for (u32 i = 0; i < importCount; i++)
+    {
+        for (u32 textureIndex = 0; textureIndex < imports[i].textureCount; textureIndex++)
+        {
+            InputTexture *texture = &imports[i].textures[textureIndex];
+            b32 found             = 0;
+            for (u32 j = 0; j < textureCount && !found; j++)
+            {
+                found = textures[j].name == texture->name;
+            }
+            if (!found)
+            {
+                textures[textureCount++] = *texture;
+            }
+        }
+    }
+    BuildTextures(&buildCache, textures, textureCount, textureQuality, memoryBudget);
+    f32 totalMs = OS_GetMilliseconds(importCounter);
+
+    Printf("Imported %u models (%u up to date) in %f ms, %f MB/s of gltf buffers, peak %f MB of %f MB budget\n",
+           importCount, upToDateCount, modelMs, totalBufferSize / (modelMs * 1000.f), (f32)peakMemory / megabytes(1),
+           (f32)memoryBudget / megabytes(1));
+    Printf("Checked %u textures, total %f ms\n", textureCount, totalMs);
+
+    for (u32 i = 0; i < importCount; i++)
+    {
+        ArenaRelease(imports[i].arena);
+    }
+    SaveBuildCache(&buildCache);
     ScratchEnd(scratch);
 }
@@ -13,6 +13,11 @@
 #include "../mkShared.h"
 #include "../render/mkGraphicsVulkan.h"
 #include "../mkShaderCompiler.h"
+#include "../shaders/ShaderInterop_Mesh.h"
+#include "./block_compress.h"
+#include "./mip_generation.h"
+#include "./build_cache.h"
+#include "./animation_compression.h"
 // #include "../third_party/assimp/Importer.hpp"
 // #include "../third_party/assimp/scene.h"
 // #include "../third_party/assimp/postprocess.h"
@@ -31,6 +36,8 @@ struct Skeleton
     i32 *parents;
     Mat4 *inverseBindPoses;
     Mat4 *transformsToParent;
+    // Bone space bounds of the vertices each bone moves, empty when it moves none
+    Rect3 *boneBounds;
     u32 count;
 };
 
@@ -47,6 +54,16 @@ struct InputMaterial
     V4 baseColor        = {1, 1, 1, 1};
 };
 
+struct InputTexture
+{
+    string name;
+    TextureType type;
+    // Alpha test threshold of masked materials, 0 otherwise
+    f32 alphaCutoff;
+    // Build cache key of the source image and the settings
+    u64 hash;
+};
+
 struct InputMesh
 {
     struct MeshSubset
@@ -62,6 +79,31 @@ struct InputMesh
         u32 vertexCount;
         u32 indexCount;
         string materialName;
+
+        // Indices are reordered so that each cluster is a contiguous run
+        Mesh::Cluster *clusters;
+        u32 clusterCount;
+
+        // lods[0] is the subset itself, the rest index into the same vertices
+        struct Lod
+        {
+            u32 *indices;
+            u32 indexCount;
+            Mesh::Cluster *clusters;
+            u32 clusterCount;
+            f32 error;
+        };
+        Lod lods[MESH_MAX_LODS];
+        u32 lodCount;
+
+        // Cluster DAG. The first clusterCount nodes are the clusters above, the rest are dagClusters, which index
+        // into dagIndices.
+        Mesh::DagNode *dagNodes;
+        u32 dagNodeCount;
+        Mesh::Cluster *dagClusters;
+        u32 dagClusterCount;
+        u32 *dagIndices;
+        u32 dagIndexCount;
     };
     MeshSubset *subsets;
 
@@ -93,35 +135,29 @@ struct InputModel
 // Animation
 //
 
-struct CompressedAnimationRotation
+struct InputAnimationRotation
 {
-    u16 rotation[4];
+    Quat rotation;
     f32 time;
 };
 
-struct CompressedBoneChannel
+// Keys as they are in the gltf, resampled uniformly when written
+struct InputBoneChannel
 {
     string name;
+    struct cgltf_node *node;
     AnimationPosition *positions;
     AnimationScale *scales;
-    CompressedAnimationRotation *rotations;
+    InputAnimationRotation *rotations;
 
     u32 numPositionKeys;
     u32 numScalingKeys;
     u32 numRotationKeys;
 };
 
-struct CompressedKeyframedAnimation
-{
-    CompressedBoneChannel *boneChannels;
-    u32 numNodes;
-
-    f32 duration;
-};
-
 //////////////////////////////
 // Job Data
 //
-internal void OptimizeMesh(InputMesh *mesh);
+internal void OptimizeMesh(InputMesh::MeshSubset *mesh);
 internal Rect3 GetMeshBounds(InputMesh *mesh);
 internal void SkinModelToBindPose(const InputModel *inModel, Mat4 *outFinalTransforms);
@@ -0,0 +1,1040 @@
+#include "./block_compress.h"
+
+//////////////////////////////
+// Block compression
+//
+// Every format works on 4x4 texel blocks. Blocks are loaded as SoA floats so palette searches run four texels at a
+// time. Endpoints start from the principal axis of the block and are refined with least squares on the chosen
+// indices; the quality preset decides how many refinement passes and endpoint candidates are tried.
+
+struct BC_Block
+{
+    // r, g, b, a
+    f32 channels[4][16];
+};
+
+struct BC_QualitySettings
+{
+    u32 axisIterations;
+    u32 refineIterations;
+    // BC4: also try the 6 value mode with explicit 0 and 255
+    b32 tryAltMode;
+    // BC4: search radius around the refined endpoints. BC1/BC7: passes of nudging each endpoint channel by one step.
+    i32 endpointSearch;
+    // BC7: try every p-bit combination instead of picking per endpoint
+    b32 searchPBits;
+};
+
+global const BC_QualitySettings bcQualitySettings[BC_Quality_Count] = {
+    {2, 0, 0, 0, 0}, // fast
+    {8, 1, 1, 0, 1}, // normal
+    {8, 3, 1, 2, 1}, // high
+};
+
+global const u32 bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+internal u32 BC_GetBlockBytes(BC_Format format)
+{
+    switch (format)
+    {
+        case BC_Format_BC1:
+        case BC_Format_BC4: return 8;
+        case BC_Format_BC3:
+        case BC_Format_BC5:
+        case BC_Format_BC7: return 16;
+        default: Assert(0); return 0;
+    }
+}
+
+internal string BC_GetFormatName(BC_Format format)
+{
+    switch (format)
+    {
+        case BC_Format_BC1: return Str8Lit("BC1");
+        case BC_Format_BC3: return Str8Lit("BC3");
+        case BC_Format_BC4: return Str8Lit("BC4");
+        case BC_Format_BC5: return Str8Lit("BC5");
+        case BC_Format_BC7: return Str8Lit("BC7");
+        default: Assert(0); return Str8Lit("");
+    }
+}
+
+internal DXGI_Format BC_GetDXGIFormat(BC_Format format, b32 srgb)
+{
+    switch (format)
+    {
+        case BC_Format_BC1: return srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+        case BC_Format_BC3: return srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+        case BC_Format_BC4: return DXGI_FORMAT_BC4_UNORM;
+        case BC_Format_BC5: return DXGI_FORMAT_BC5_UNORM;
+        case BC_Format_BC7: return srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+        default: Assert(0); return DXGI_FORMAT_UNKNOWN;
+    }
+}
+
+// Number of leading rgba channels the format stores
+internal u32 BC_GetChannelCount(BC_Format format)
+{
+    switch (format)
+    {
+        case BC_Format_BC1: return 3;
+        case BC_Format_BC4: return 1;
+        case BC_Format_BC5: return 2;
+        case BC_Format_BC3:
+        case BC_Format_BC7: return 4;
+        default: Assert(0); return 0;
+    }
+}
+
+internal void BC_LoadBlock(BC_Block *block, u8 *rgba, u32 stride)
+{
+    for (u32 y = 0; y < 4; y++)
+    {
+        u8 *row = rgba + y * stride;
+        for (u32 x = 0; x < 4; x++)
+        {
+            for (u32 c = 0; c < 4; c++)
+            {
+                block->channels[c][y * 4 + x] = (f32)row[x * 4 + c];
+            }
+        }
+    }
+}
+
+//////////////////////////////
+// Endpoint search
+//
+
+// Writes the closest palette entry of every texel to outIndices and returns the squared error of the block. Only
+// channels [firstChannel, firstChannel + channelCount) are compared.
+internal f32 BC_SelectIndices(BC_Block *block, u32 firstChannel, u32 channelCount, f32 (*palette)[4], u32 paletteCount,
+                              u8 *outIndices)
+{
+    f32 totalError = 0.f;
+    for (u32 texel = 0; texel < 16; texel += 4)
+    {
+        __m128 values[4];
+        for (u32 c = 0; c < channelCount; c++)
+        {
+            values[c] = _mm_loadu_ps(&block->channels[firstChannel + c][texel]);
+        }
+        __m128 bestError  = _mm_set1_ps(FLT_MAX);
+        __m128i bestIndex = _mm_setzero_si128();
+        for (u32 entry = 0; entry < paletteCount; entry++)
+        {
+            __m128 error = _mm_setzero_ps();
+            for (u32 c = 0; c < channelCount; c++)
+            {
+                __m128 diff = _mm_sub_ps(values[c], _mm_set1_ps(palette[entry][c]));
+                error       = _mm_add_ps(error, _mm_mul_ps(diff, diff));
+            }
+            __m128i less = _mm_castps_si128(_mm_cmplt_ps(error, bestError));
+            bestError    = _mm_min_ps(error, bestError);
+            bestIndex    = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi32(entry)), _mm_andnot_si128(less, bestIndex));
+        }
+        u32 indices[4];
+        f32 errors[4];
+        _mm_storeu_si128((__m128i *)indices, bestIndex);
+        _mm_storeu_ps(errors, bestError);
+        for (u32 i = 0; i < 4; i++)
+        {
+            outIndices[texel + i] = (u8)indices[i];
+            totalError += errors[i];
+        }
+    }
+    return totalError;
+}
+
+// Endpoints at the extremes of the block projected onto its principal axis
+internal void BC_FindEndpoints(BC_Block *block, u32 firstChannel, u32 channelCount, u32 iterations, f32 *outE0,
+                               f32 *outE1)
+{
+    f32 mean[4] = {};
+    f32 minV[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+    f32 maxV[4] = {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (u32 c = 0; c < channelCount; c++)
+    {
+        f32 *values = block->channels[firstChannel + c];
+        for (u32 i = 0; i < 16; i++)
+        {
+            mean[c] += values[i];
+            minV[c] = Min(minV[c], values[i]);
+            maxV[c] = Max(maxV[c], values[i]);
+        }
+        mean[c] /= 16.f;
+    }
+
+    f32 covariance[4][4] = {};
+    for (u32 i = 0; i < 16; i++)
+    {
+        f32 d[4];
+        for (u32 c = 0; c < channelCount; c++)
+        {
+            d[c] = block->channels[firstChannel + c][i] - mean[c];
+        }
+        for (u32 c0 = 0; c0 < channelCount; c0++)
+        {
+            for (u32 c1 = 0; c1 < channelCount; c1++)
+            {
+                covariance[c0][c1] += d[c0] * d[c1];
+            }
+        }
+    }
+
+    // Power iteration starting from the bounding box diagonal
+    f32 axis[4] = {};
+    for (u32 c = 0; c < channelCount; c++)
+    {
+        axis[c] = maxV[c] - minV[c];
+    }
+    for (u32 iteration = 0; iteration < iterations; iteration++)
+    {
+        f32 next[4] = {};
+        f32 length  = 0.f;
+        for (u32 c0 = 0; c0 < channelCount; c0++)
+        {
+            for (u32 c1 = 0; c1 < channelCount; c1++)
+            {
+                next[c0] += covariance[c0][c1] * axis[c1];
+            }
+            length = Max(length, Abs(next[c0]));
+        }
+        if (length < 1e-6f)
+        {
+            break;
+        }
+        for (u32 c = 0; c < channelCount; c++)
+        {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    f32 minT = FLT_MAX;
+    f32 maxT = -FLT_MAX;
+    f32 axisLengthSq = 0.f;
+    for (u32 c = 0; c < channelCount; c++)
+    {
+        axisLengthSq += axis[c] * axis[c];
+    }
+    if (axisLengthSq < 1e-12f)
+    {
+        for (u32 c = 0; c < channelCount; c++)
+        {
+            outE0[c] = mean[c];
+            outE1[c] = mean[c];
+        }
+        return;
+    }
+    for (u32 i = 0; i < 16; i++)
+    {
+        f32 t = 0.f;
+        for (u32 c = 0; c < channelCount; c++)
+        {
+            t += (block->channels[firstChannel + c][i] - mean[c]) * axis[c];
+        }
+        minT = Min(minT, t);
+        maxT = Max(maxT, t);
+    }
+    for (u32 c = 0; c < channelCount; c++)
+    {
+        outE0[c] = Clamp(mean[c] + axis[c] * maxT / axisLengthSq, 0.f, 255.f);
+        outE1[c] = Clamp(mean[c] + axis[c] * minT / axisLengthSq, 0.f, 255.f);
+    }
+}
+
+// Least squares endpoints for fixed indices. weights[index] is how much of e1 the palette entry uses. Returns false if
+// the system is singular (e.g. every texel uses the same entry).
+internal b32 BC_RefineEndpoints(BC_Block *block, u32 firstChannel, u32 channelCount, u8 *indices, f32 *weights,
+                                f32 *outE0, f32 *outE1)
+{
+    f32 a = 0.f, b = 0.f, c = 0.f;
+    f32 x0[4] = {};
+    f32 x1[4] = {};
+    for (u32 i = 0; i < 16; i++)
+    {
+        f32 w1 = weights[indices[i]];
+        f32 w0 = 1.f - w1;
+        a += w0 * w0;
+        b += w0 * w1;
+        c += w1 * w1;
+        for (u32 ch = 0; ch < channelCount; ch++)
+        {
+            f32 value = block->channels[firstChannel + ch][i];
+            x0[ch] += w0 * value;
+            x1[ch] += w1 * value;
+        }
+    }
+    f32 det = a * c - b * b;
+    if (Abs(det) < 1e-6f)
+    {
+        return false;
+    }
+    f32 invDet = 1.f / det;
+    for (u32 ch = 0; ch < channelCount; ch++)
+    {
+        outE0[ch] = Clamp((c * x0[ch] - b * x1[ch]) * invDet, 0.f, 255.f);
+        outE1[ch] = Clamp((a * x1[ch] - b * x0[ch]) * invDet, 0.f, 255.f);
+    }
+    return true;
+}
+
+//////////////////////////////
+// BC1
+//
+
+inline u16 BC_Quantize565(f32 *color)
+{
+    u32 r = (u32)(color[0] * (31.f / 255.f) + 0.5f);
+    u32 g = (u32)(color[1] * (63.f / 255.f) + 0.5f);
+    u32 b = (u32)(color[2] * (31.f / 255.f) + 0.5f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+inline void BC_Expand565(u16 color, u32 *out)
+{
+    u32 r  = (color >> 11) & 31;
+    u32 g  = (color >> 5) & 63;
+    u32 b  = color & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+// Palette as the decoder builds it. Only the 4 color mode (c0 > c1) is used by the encoder.
+internal void BC_BuildPaletteBC1(u16 c0, u16 c1, u32 (*outPalette)[4])
+{
+    BC_Expand565(c0, outPalette[0]);
+    BC_Expand565(c1, outPalette[1]);
+    for (u32 c = 0; c < 3; c++)
+    {
+        if (c0 > c1)
+        {
+            outPalette[2][c] = (2 * outPalette[0][c] + outPalette[1][c]) / 3;
+            outPalette[3][c] = (outPalette[0][c] + 2 * outPalette[1][c]) / 3;
+        }
+        else
+        {
+            outPalette[2][c] = (outPalette[0][c] + outPalette[1][c]) / 2;
+            outPalette[3][c] = 0;
+        }
+    }
+    outPalette[0][3] = outPalette[1][3] = outPalette[2][3] = 255;
+    outPalette[3][3]                                       = c0 > c1 ? 255 : 0;
+}
+
+internal f32 BC_EvaluateBC1(BC_Block *block, u16 c0, u16 c1, u8 *outIndices)
+{
+    u32 palette[4][4];
+    BC_BuildPaletteBC1(c0, c1, palette);
+    f32 paletteF[4][4];
+    for (u32 i = 0; i < 4; i++)
+    {
+        for (u32 c = 0; c < 4; c++)
+        {
+            paletteF[i][c] = (f32)palette[i][c];
+        }
+    }
+    // The equal endpoint case decodes as 3 colors + black, never pick black
+    return BC_SelectIndices(block, 0, 3, paletteF, c0 > c1 ? 4 : 3, outIndices);
+}
+
+internal void BC_EncodeBC1(BC_Block *block, BC_Quality quality, u8 *out)
+{
+    const BC_QualitySettings *settings = &bcQualitySettings[quality];
+    f32 weights[4]                     = {0.f, 1.f, 1.f / 3.f, 2.f / 3.f};
+
+    f32 e0[4], e1[4];
+    BC_FindEndpoints(block, 0, 3, settings->axisIterations, e0, e1);
+
+    u16 c0 = BC_Quantize565(e0);
+    u16 c1 = BC_Quantize565(e1);
+    if (c0 < c1)
+    {
+        Swap(u16, c0, c1);
+    }
+    u8 indices[16];
+    f32 bestError = BC_EvaluateBC1(block, c0, c1, indices);
+
+    for (u32 iteration = 0; iteration < settings->refineIterations; iteration++)
+    {
+        if (c0 == c1 || !BC_RefineEndpoints(block, 0, 3, indices, weights, e0, e1))
+        {
+            break;
+        }
+        u16 newC0 = BC_Quantize565(e0);
+        u16 newC1 = BC_Quantize565(e1);
+        if (newC0 < newC1)
+        {
+            Swap(u16, newC0, newC1);
+        }
+        if (newC0 == c0 && newC1 == c1)
+        {
+            break;
+        }
+        u8 newIndices[16];
+        f32 error = BC_EvaluateBC1(block, newC0, newC1, newIndices);
+        if (error >= bestError)
+        {
+            break;
+        }
+        bestError = error;
+        c0        = newC0;
+        c1        = newC1;
+        MemoryCopy(indices, newIndices, sizeof(indices));
+    }
+
+    const u32 shifts[3] = {11, 5, 0};
+    const u32 masks[3]  = {31, 63, 31};
+    for (i32 pass = 0; pass < settings->endpointSearch; pass++)
+    {
+        b32 improved = false;
+        for (u32 test = 0; test < 12; test++)
+        {
+            u32 channel = (test >> 2) % 3;
+            u16 *target = (test & 2) ? &c1 : &c0;
+            u32 value   = (*target >> shifts[channel]) & masks[channel];
+            if ((test & 1) ? value == masks[channel] : value == 0)
+            {
+                continue;
+            }
+            u16 saved = *target;
+            value     = (test & 1) ? value + 1 : value - 1;
+            *target   = (u16)((*target & ~(masks[channel] << shifts[channel])) | (value << shifts[channel]));
+            u8 newIndices[16];
+            f32 error = c0 > c1 ? BC_EvaluateBC1(block, c0, c1, newIndices) : FLT_MAX;
+            if (error < bestError)
+            {
+                bestError = error;
+                MemoryCopy(indices, newIndices, sizeof(indices));
+                improved = true;
+            }
+            else
+            {
+                *target = saved;
+            }
+        }
+        if (!improved)
+        {
+            break;
+        }
+    }
+
+    u32 packedIndices = 0;
+    for (u32 i = 0; i < 16; i++)
+    {
+        packedIndices |= (u32)indices[i] << (2 * i);
+    }
+    MemoryCopy(out + 0, &c0, sizeof(c0));
+    MemoryCopy(out + 2, &c1, sizeof(c1));
+    MemoryCopy(out + 4, &packedIndices, sizeof(packedIndices));
+}
+
+internal void BC_DecodeBC1(u8 *block, u8 *outRgba)
+{
+    u16 c0, c1;
+    u32 packedIndices;
+    MemoryCopy(&c0, block + 0, sizeof(c0));
+    MemoryCopy(&c1, block + 2, sizeof(c1));
+    MemoryCopy(&packedIndices, block + 4, sizeof(packedIndices));
+
+    u32 palette[4][4];
+    BC_BuildPaletteBC1(c0, c1, palette);
+    for (u32 i = 0; i < 16; i++)
+    {
+        u32 index = (packedIndices >> (2 * i)) & 3;
+        for (u32 c = 0; c < 4; c++)
+        {
+            outRgba[i * 4 + c] = (u8)palette[index][c];
+        }
+    }
+}
+
+//////////////////////////////
+// BC4
+//
+
+// a0 > a1 interpolates 8 values, otherwise 6 values + 0 and 255
+internal void BC_BuildPaletteBC4(u32 a0, u32 a1, u32 *outPalette)
+{
+    outPalette[0] = a0;
+    outPalette[1] = a1;
+    if (a0 > a1)
+    {
+        for (u32 i = 1; i < 7; i++)
+        {
+            outPalette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+        }
+    }
+    else
+    {
+        for (u32 i = 1; i < 5; i++)
+        {
+            outPalette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        }
+        outPalette[6] = 0;
+        outPalette[7] = 255;
+    }
+}
+
+internal f32 BC_EvaluateBC4(BC_Block *block, u32 channel, u32 a0, u32 a1, u8 *outIndices)
+{
+    u32 palette[8];
+    BC_BuildPaletteBC4(a0, a1, palette);
+    f32 paletteF[8][4];
+    for (u32 i = 0; i < 8; i++)
+    {
+        paletteF[i][0] = (f32)palette[i];
+    }
+    return BC_SelectIndices(block, channel, 1, paletteF, 8, outIndices);
+}
+
+internal void BC_EncodeBC4(BC_Block *block, u32 channel, BC_Quality quality, u8 *out)
+{
+    const BC_QualitySettings *settings = &bcQualitySettings[quality];
+    f32 *values                        = block->channels[channel];
+
+    f32 minV = 255.f, maxV = 0.f;
+    // Range without the values the 6 value mode represents exactly
+    f32 innerMin = 255.f, innerMax = 0.f;
+    for (u32 i = 0; i < 16; i++)
+    {
+        minV = Min(minV, values[i]);
+        maxV = Max(maxV, values[i]);
+        if (values[i] != 0.f && values[i] != 255.f)
+        {
+            innerMin = Min(innerMin, values[i]);
+            innerMax = Max(innerMax, values[i]);
+        }
+    }
+
+    u32 a0 = (u32)(maxV + 0.5f);
+    u32 a1 = (u32)(minV + 0.5f);
+    u8 indices[16];
+    f32 bestError = BC_EvaluateBC4(block, channel, a0, a1, indices);
+
+    // 8 value mode refinement, indices 0 and 1 are the endpoints, 2-7 interpolate from a0 to a1
+    f32 weights[8] = {0.f, 1.f, 1.f / 7.f, 2.f / 7.f, 3.f / 7.f, 4.f / 7.f, 5.f / 7.f, 6.f / 7.f};
+    for (u32 iteration = 0; iteration < settings->refineIterations && a0 > a1; iteration++)
+    {
+        f32 e0, e1;
+        if (!BC_RefineEndpoints(block, channel, 1, indices, weights, &e0, &e1))
+        {
+            break;
+        }
+        u32 newA0 = (u32)(e0 + 0.5f);
+        u32 newA1 = (u32)(e1 + 0.5f);
+        if (newA0 <= newA1 || (newA0 == a0 && newA1 == a1))
+        {
+            break;
+        }
+        u8 newIndices[16];
+        f32 error = BC_EvaluateBC4(block, channel, newA0, newA1, newIndices);
+        if (error >= bestError)
+        {
+            break;
+        }
+        bestError = error;
+        a0        = newA0;
+        a1        = newA1;
+        MemoryCopy(indices, newIndices, sizeof(indices));
+    }
+
+    if (settings->endpointSearch && a0 > a1)
+    {
+        i32 base0 = (i32)a0;
+        i32 base1 = (i32)a1;
+        for (i32 d0 = -settings->endpointSearch; d0 <= settings->endpointSearch; d0++)
+        {
+            for (i32 d1 = -settings->endpointSearch; d1 <= settings->endpointSearch; d1++)
+            {
+                i32 t0 = base0 + d0;
+                i32 t1 = base1 + d1;
+                if (t0 > 255 || t1 < 0 || t0 <= t1)
+                {
+                    continue;
+                }
+                u8 newIndices[16];
+                f32 error = BC_EvaluateBC4(block, channel, (u32)t0, (u32)t1, newIndices);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    a0        = (u32)t0;
+                    a1        = (u32)t1;
+                    MemoryCopy(indices, newIndices, sizeof(indices));
+                }
+            }
+        }
+    }
+
+    if (settings->tryAltMode && innerMin <= innerMax && bestError > 0.f)
+    {
+        u32 t0 = (u32)(innerMin + 0.5f);
+        u32 t1 = (u32)(innerMax + 0.5f);
+        u8 newIndices[16];
+        f32 error = BC_EvaluateBC4(block, channel, t0, t1, newIndices);
+        if (error < bestError)
+        {
+            bestError = error;
+            a0        = t0;
+            a1        = t1;
+            MemoryCopy(indices, newIndices, sizeof(indices));
+        }
+    }
+
+    u64 packed = (u64)a0 | ((u64)a1 << 8);
+    for (u32 i = 0; i < 16; i++)
+    {
+        packed |= (u64)indices[i] << (16 + 3 * i);
+    }
+    MemoryCopy(out, &packed, sizeof(packed));
+}
+
+internal void BC_DecodeBC4(u8 *block, u8 *outRgba, u32 channel)
+{
+    u64 packed;
+    MemoryCopy(&packed, block, sizeof(packed));
+    u32 palette[8];
+    BC_BuildPaletteBC4((u32)(packed & 0xff), (u32)((packed >> 8) & 0xff), palette);
+    for (u32 i = 0; i < 16; i++)
+    {
+        outRgba[i * 4 + channel] = (u8)palette[(packed >> (16 + 3 * i)) & 7];
+    }
+}
+
+//////////////////////////////
+// BC7
+//
+// Only mode 6 (one subset, 7 bit rgba endpoints + unique p-bit, 4 bit indices) is emitted. It handles alpha and
+// smooth gradients well and keeps the encoder small; the partitioned modes would help blocks with sharp edges.
+//
+
+struct BC_BitWriter
+{
+    u64 bits[2];
+    u32 pos;
+};
+
+inline void BC_WriteBits(BC_BitWriter *writer, u32 value, u32 count)
+{
+    for (u32 i = 0; i < count; i++, writer->pos++)
+    {
+        writer->bits[writer->pos >> 6] |= (u64)((value >> i) & 1) << (writer->pos & 63);
+    }
+}
+
+inline u32 BC_ReadBits(u64 *bits, u32 *pos, u32 count)
+{
+    u32 result = 0;
+    for (u32 i = 0; i < count; i++, (*pos)++)
+    {
+        result |= (u32)((bits[*pos >> 6] >> (*pos & 63)) & 1) << i;
+    }
+    return result;
+}
+
+// Quantizes to 7 bits with the given p-bit as the lowest bit of the 8 bit value
+inline void BC_QuantizeMode6(f32 *endpoint, u32 pBit, u32 *out)
+{
+    for (u32 c = 0; c < 4; c++)
+    {
+        i32 q  = (i32)((endpoint[c] - (f32)pBit) * 0.5f + 0.5f);
+        out[c] = (u32)Max(0, Min(q, 127));
+    }
+}
+
+internal f32 BC_EvaluateMode6(BC_Block *block, u32 *q0, u32 p0, u32 *q1, u32 p1, u8 *outIndices)
+{
+    f32 palette[16][4];
+    for (u32 c = 0; c < 4; c++)
+    {
+        u32 v0 = (q0[c] << 1) | p0;
+        u32 v1 = (q1[c] << 1) | p1;
+        for (u32 i = 0; i < 16; i++)
+        {
+            palette[i][c] = (f32)(((64 - bc7Weights4[i]) * v0 + bc7Weights4[i] * v1 + 32) >> 6);
+        }
+    }
+    return BC_SelectIndices(block, 0, 4, palette, 16, outIndices);
+}
+
+internal void BC_EncodeBC7(BC_Block *block, BC_Quality quality, u8 *out)
+{
+    const BC_QualitySettings *settings = &bcQualitySettings[quality];
+    f32 weights[16];
+    for (u32 i = 0; i < 16; i++)
+    {
+        weights[i] = bc7Weights4[i] / 64.f;
+    }
+
+    f32 e0[4], e1[4];
+    BC_FindEndpoints(block, 0, 4, settings->axisIterations, e0, e1);
+
+    u32 q0[4], q1[4], p0 = 0, p1 = 0;
+    u8 indices[16];
+    f32 bestError = FLT_MAX;
+
+    auto TryEndpoints = [&](f32 *t0, f32 *t1) {
+        b32 improved = false;
+        for (u32 pBits = 0; pBits < 4; pBits++)
+        {
+            u32 tp0 = pBits & 1;
+            u32 tp1 = pBits >> 1;
+            if (!settings->searchPBits)
+            {
+                // Round the p-bit from the average low bit of the endpoint
+                f32 sum0 = 0.f, sum1 = 0.f;
+                for (u32 c = 0; c < 4; c++)
+                {
+                    sum0 += t0[c];
+                    sum1 += t1[c];
+                }
+                if (tp0 != ((u32)(sum0 * 0.25f + 0.5f) & 1) || tp1 != ((u32)(sum1 * 0.25f + 0.5f) & 1))
+                {
+                    continue;
+                }
+            }
+            u32 tq0[4], tq1[4];
+            BC_QuantizeMode6(t0, tp0, tq0);
+            BC_QuantizeMode6(t1, tp1, tq1);
+            u8 newIndices[16];
+            f32 error = BC_EvaluateMode6(block, tq0, tp0, tq1, tp1, newIndices);
+            if (error < bestError)
+            {
+                bestError = error;
+                MemoryCopy(q0, tq0, sizeof(q0));
+                MemoryCopy(q1, tq1, sizeof(q1));
+                p0 = tp0;
+                p1 = tp1;
+                MemoryCopy(indices, newIndices, sizeof(indices));
+                improved = true;
+            }
+        }
+        return improved;
+    };
+
+    TryEndpoints(e0, e1);
+    for (u32 iteration = 0; iteration < settings->refineIterations; iteration++)
+    {
+        if (bestError == 0.f || !BC_RefineEndpoints(block, 0, 4, indices, weights, e0, e1) || !TryEndpoints(e0, e1))
+        {
+            break;
+        }
+    }
+
+    for (i32 pass = 0; pass < settings->endpointSearch && bestError > 0.f; pass++)
+    {
+        b32 improved = false;
+        for (u32 test = 0; test < 16; test++)
+        {
+            u32 *target = (test & 8) ? &q1[(test >> 1) & 3] : &q0[(test >> 1) & 3];
+            if ((test & 1) ? *target == 127 : *target == 0)
+            {
+                continue;
+            }
+            u32 saved = *target;
+            *target   = (test & 1) ? saved + 1 : saved - 1;
+            u8 newIndices[16];
+            f32 error = BC_EvaluateMode6(block, q0, p0, q1, p1, newIndices);
+            if (error < bestError)
+            {
+                bestError = error;
+                MemoryCopy(indices, newIndices, sizeof(indices));
+                improved = true;
+            }
+            else
+            {
+                *target = saved;
+            }
+        }
+        if (!improved)
+        {
+            break;
+        }
+    }
+
+    // The anchor texel's index is stored without its top bit
+    if (indices[0] & 8)
+    {
+        for (u32 c = 0; c < 4; c++)
+        {
+            Swap(u32, q0[c], q1[c]);
+        }
+        Swap(u32, p0, p1);
+        for (u32 i = 0; i < 16; i++)
+        {
+            indices[i] = 15 - indices[i];
+        }
+    }
+
+    BC_BitWriter writer = {};
+    BC_WriteBits(&writer, 1 << 6, 7);
+    for (u32 c = 0; c < 4; c++)
+    {
+        BC_WriteBits(&writer, q0[c], 7);
+        BC_WriteBits(&writer, q1[c], 7);
+    }
+    BC_WriteBits(&writer, p0, 1);
+    BC_WriteBits(&writer, p1, 1);
+    BC_WriteBits(&writer, indices[0], 3);
+    for (u32 i = 1; i < 16; i++)
+    {
+        BC_WriteBits(&writer, indices[i], 4);
+    }
+    Assert(writer.pos == 128);
+    MemoryCopy(out, writer.bits, 16);
+}
+
+internal void BC_DecodeBC7(u8 *block, u8 *outRgba)
+{
+    u64 bits[2];
+    MemoryCopy(bits, block, sizeof(bits));
+    u32 pos  = 0;
+    u32 mode = BC_ReadBits(bits, &pos, 7);
+    // Other modes are never written by the encoder
+    Assert(mode == (1 << 6));
+
+    u32 v0[4], v1[4];
+    for (u32 c = 0; c < 4; c++)
+    {
+        v0[c] = BC_ReadBits(bits, &pos, 7) << 1;
+        v1[c] = BC_ReadBits(bits, &pos, 7) << 1;
+    }
+    u32 p0 = BC_ReadBits(bits, &pos, 1);
+    u32 p1 = BC_ReadBits(bits, &pos, 1);
+    for (u32 i = 0; i < 16; i++)
+    {
+        u32 index = BC_ReadBits(bits, &pos, i == 0 ? 3 : 4);
+        u32 w     = bc7Weights4[index];
+        for (u32 c = 0; c < 4; c++)
+        {
+            outRgba[i * 4 + c] = (u8)(((64 - w) * (v0[c] | p0) + w * (v1[c] | p1) + 32) >> 6);
+        }
+    }
+}
+
+//////////////////////////////
+// Images
+//
+
+// rgba is a 4x4 block of texels with rows stride bytes apart
+internal void BC_EncodeBlock(BC_Format format, BC_Quality quality, u8 *rgba, u32 stride, u8 *out)
+{
+    BC_Block block;
+    BC_LoadBlock(&block, rgba, stride);
+    switch (format)
+    {
+        case BC_Format_BC1: BC_EncodeBC1(&block, quality, out); break;
+        case BC_Format_BC3:
+        {
+            BC_EncodeBC4(&block, 3, quality, out);
+            BC_EncodeBC1(&block, quality, out + 8);
+        }
+        break;
+        case BC_Format_BC4: BC_EncodeBC4(&block, 0, quality, out); break;
+        case BC_Format_BC5:
+        {
+            BC_EncodeBC4(&block, 0, quality, out);
+            BC_EncodeBC4(&block, 1, quality, out + 8);
+        }
+        break;
+        case BC_Format_BC7: BC_EncodeBC7(&block, quality, out); break;
+        default: Assert(0);
+    }
+}
+
+// Writes 16 rgba texels. Channels the format doesn't store are 0, alpha is 255.
+internal void BC_DecodeBlock(BC_Format format, u8 *block, u8 *outRgba)
+{
+    switch (format)
+    {
+        case BC_Format_BC1: BC_DecodeBC1(block, outRgba); break;
+        case BC_Format_BC3:
+        {
+            BC_DecodeBC1(block + 8, outRgba);
+            BC_DecodeBC4(block, outRgba, 3);
+        }
+        break;
+        case BC_Format_BC4:
+        case BC_Format_BC5:
+        {
+            MemorySet(outRgba, 0, 64);
+            BC_DecodeBC4(block, outRgba, 0);
+            if (format == BC_Format_BC5)
+            {
+                BC_DecodeBC4(block + 8, outRgba, 1);
+            }
+            for (u32 i = 0; i < 16; i++)
+            {
+                outRgba[i * 4 + 3] = 255;
+            }
+        }
+        break;
+        case BC_Format_BC7: BC_DecodeBC7(block, outRgba); break;
+        default: Assert(0);
+    }
+}
+
+// Compresses an rgba8 image on the job system, one job per row of blocks. Must be called from outside of a job.
+// Edge blocks of sizes that aren't multiples of 4 repeat the last row/column.
+internal void BC_CompressBatch(Arena *arena, BC_Source *sources, u32 count, BC_Quality quality, BC_Image *out)
+{
+    TempArena temp = ScratchStart(&arena, 1);
+    // Block rows of every source share one job dispatch, so small mips don't serialize
+    u32 *rowOffsets = PushArrayNoZero(temp.arena, u32, count + 1);
+    rowOffsets[0]   = 0;
+    for (u32 i = 0; i < count; i++)
+    {
+        BC_Source *source = &sources[i];
+        BC_Image *image   = &out[i];
+        *image            = {};
+        image->width      = source->width;
+        image->height     = source->height;
+        image->format     = source->format;
+        image->srgb       = source->srgb;
+
+        u32 blocksX       = (source->width + 3) / 4;
+        u32 blocksY       = (source->height + 3) / 4;
+        image->size       = (u64)blocksX * blocksY * BC_GetBlockBytes(source->format);
+        image->data       = PushArrayNoZero(arena, u8, image->size);
+        rowOffsets[i + 1] = rowOffsets[i] + blocksY;
+    }
+
+    u32 totalRows              = rowOffsets[count];
+    jobsystem::Counter counter = {};
+    // Keep the number of groups within the job queue
+    u32 groupSize = Max(1u, (totalRows + 63) / 64);
+    jobsystem::KickJobs(
+        &counter, totalRows, groupSize, [&](jobsystem::JobArgs args) {
+            u32 lo = 0;
+            u32 hi = count;
+            while (hi - lo > 1)
+            {
+                u32 mid = (lo + hi) / 2;
+                if (rowOffsets[mid] <= args.jobId) lo = mid;
+                else hi = mid;
+            }
+            BC_Source *source = &sources[lo];
+            u32 width         = source->width;
+            u32 height        = source->height;
+            u32 blockY        = args.jobId - rowOffsets[lo];
+            u32 blocksX       = (width + 3) / 4;
+            u32 blockBytes    = BC_GetBlockBytes(source->format);
+            u8 *dst           = out[lo].data + (u64)blockY * blocksX * blockBytes;
+            for (u32 blockX = 0; blockX < blocksX; blockX++)
+            {
+                u8 texels[64];
+                for (u32 y = 0; y < 4; y++)
+                {
+                    u32 srcY = Min(blockY * 4 + y, height - 1);
+                    for (u32 x = 0; x < 4; x++)
+                    {
+                        u32 srcX = Min(blockX * 4 + x, width - 1);
+                        MemoryCopy(&texels[(y * 4 + x) * 4], &source->rgba[((u64)srcY * width + srcX) * 4], 4);
+                    }
+                }
+                BC_EncodeBlock(source->format, quality, texels, 16, dst);
+                dst += blockBytes;
+            }
+        },
+        jobsystem::Priority::High);
+    jobsystem::WaitJobs(&counter);
+    ScratchEnd(temp);
+}
+
+internal BC_Image BC_Compress(Arena *arena, u8 *rgba, u32 width, u32 height, BC_Format format, BC_Quality quality,
+                              b32 srgb)
+{
+    BC_Source source = {};
+    source.rgba      = rgba;
+    source.width     = width;
+    source.height    = height;
+    source.format    = format;
+    source.srgb      = srgb;
+
+    BC_Image result;
+    BC_CompressBatch(arena, &source, 1, quality, &result);
+    return result;
+}
+
+internal void BC_Decompress(BC_Image *image, u8 *outRgba)
+{
+    u32 blocksX    = (image->width + 3) / 4;
+    u32 blocksY    = (image->height + 3) / 4;
+    u32 blockBytes = BC_GetBlockBytes(image->format);
+    for (u32 blockY = 0; blockY < blocksY; blockY++)
+    {
+        for (u32 blockX = 0; blockX < blocksX; blockX++)
+        {
+            u8 texels[64];
+            BC_DecodeBlock(image->format, image->data + ((u64)blockY * blocksX + blockX) * blockBytes, texels);
+            for (u32 y = 0; y < 4 && blockY * 4 + y < image->height; y++)
+            {
+                for (u32 x = 0; x < 4 && blockX * 4 + x < image->width; x++)
+                {
+                    MemoryCopy(&outRgba[((u64)(blockY * 4 + y) * image->width + blockX * 4 + x) * 4],
+                               &texels[(y * 4 + x) * 4], 4);
+                }
+            }
+        }
+    }
+}
+
+// Over the channels the format stores
+internal f32 BC_ComputePSNR(BC_Format format, u8 *a, u8 *b, u32 width, u32 height)
+{
+    u32 channelCount = BC_GetChannelCount(format);
+    u64 pixelCount   = (u64)width * height;
+    f64 sumSq        = 0.0;
+    for (u64 i = 0; i < pixelCount; i++)
+    {
+        for (u32 c = 0; c < channelCount; c++)
+        {
+            f64 diff = (f64)a[i * 4 + c] - (f64)b[i * 4 + c];
+            sumSq += diff * diff;
+        }
+    }
+    f64 mse = sumSq / (f64)(pixelCount * channelCount);
+    if (mse == 0.0)
+    {
+        return 99.f;
+    }
+    return (f32)(10.0 * log10(255.0 * 255.0 / mse));
+}
+
+// Encodes the image with every format and quality, printing throughput and PSNR
+internal void BC_Benchmark(string filename)
+{
+    TempArena temp = ScratchStart(0, 0);
+    string data    = platform.ReadEntireFile(temp.arena, filename);
+    if (data.size == 0)
+    {
+        Printf("Could not read %S\n", filename);
+        ScratchEnd(temp);
+        return;
+    }
+    i32 width, height, nComponents;
+    u8 *rgba = stbi_load_from_memory(data.str, (i32)data.size, &width, &height, &nComponents, 4);
+    Assert(rgba);
+
+    const char *qualityNames[BC_Quality_Count] = {"fast", "normal", "high"};
+    u8 *decoded                                = PushArrayNoZero(temp.arena, u8, (u64)width * height * 4);
+    Printf("%S: %u x %u\n", filename, width, height);
+    for (u32 format = 0; format < BC_Format_Count; format++)
+    {
+        for (u32 quality = 0; quality < BC_Quality_Count; quality++)
+        {
+            u64 pos                    = ArenaPos(temp.arena);
+            PerformanceCounter counter = OS_StartCounter();
+            BC_Image image = BC_Compress(temp.arena, rgba, width, height, (BC_Format)format, (BC_Quality)quality, 0);
+            f32 ms         = OS_GetMilliseconds(counter);
+
+            BC_Decompress(&image, decoded);
+            f32 psnr = BC_ComputePSNR((BC_Format)format, rgba, decoded, width, height);
+            Printf("    %S %s: %f dB, %f ms, %f MPix/s\n", BC_GetFormatName((BC_Format)format), qualityNames[quality],
+                   psnr, ms, (f32)width * height / (ms * 1000.f));
+            ArenaPopTo(temp.arena, pos);
+        }
+    }
+    stbi_image_free(rgba);
+    ScratchEnd(temp);
+}
@@ -0,0 +1,58 @@
+#ifndef BLOCK_COMPRESS_H
+#define BLOCK_COMPRESS_H
+
+//////////////////////////////
+// Block compression
+//
+enum BC_Format
+{
+    BC_Format_BC1, // rgb, 4 bpp
+    BC_Format_BC3, // rgb + interpolated alpha, 8 bpp
+    BC_Format_BC4, // r, 4 bpp
+    BC_Format_BC5, // rg, 8 bpp
+    BC_Format_BC7, // rgba, 8 bpp
+    BC_Format_Count,
+};
+
+enum BC_Quality
+{
+    BC_Quality_Fast,
+    BC_Quality_Normal,
+    BC_Quality_High,
+    BC_Quality_Count,
+};
+
+struct BC_Image
+{
+    u8 *data;
+    u64 size;
+    u32 width;
+    u32 height;
+    BC_Format format;
+    b32 srgb;
+};
+
+struct BC_Source
+{
+    u8 *rgba;
+    u32 width;
+    u32 height;
+    BC_Format format;
+    b32 srgb;
+};
+
+internal u32 BC_GetBlockBytes(BC_Format format);
+internal string BC_GetFormatName(BC_Format format);
+internal DXGI_Format BC_GetDXGIFormat(BC_Format format, b32 srgb);
+
+internal void BC_EncodeBlock(BC_Format format, BC_Quality quality, u8 *rgba, u32 stride, u8 *out);
+internal void BC_DecodeBlock(BC_Format format, u8 *block, u8 *outRgba);
+
+internal BC_Image BC_Compress(Arena *arena, u8 *rgba, u32 width, u32 height, BC_Format format, BC_Quality quality,
+                              b32 srgb);
+internal void BC_CompressBatch(Arena *arena, BC_Source *sources, u32 count, BC_Quality quality, BC_Image *out);
+internal void BC_Decompress(BC_Image *image, u8 *outRgba);
+internal f32 BC_ComputePSNR(BC_Format format, u8 *a, u8 *b, u32 width, u32 height);
+internal void BC_Benchmark(string filename);
+
+#endif
@@ -0,0 +1,193 @@
+//////////////////////////////
+// Build cache
+//
+#include "./build_cache.h"
+
+global const u32 buildCacheMagic     = MakeFourCC('B', 'L', 'D', 'C');
+global const u32 buildCacheSlotCount = BUILD_CACHE_MAX_ENTRIES * 2;
+
+internal u64 CombineBuildHash(u64 hash, u64 value)
+{
+    hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+// Hash of the file contents. Missing files hash to their size of 0, and their processing fails as usual.
+internal u64 HashBuildInput(string path, u64 seed)
+{
+    TempArena temp = ScratchStart(0, 0);
+    string data    = platform.ReadEntireFile(temp.arena, path);
+    u64 result     = CombineBuildHash(seed, HashBytes64(data.str, data.size));
+    ScratchEnd(temp);
+    return result;
+}
+
+internal u32 *FindBuildCacheSlot(BuildCache *cache, string path)
+{
+    u64 mask = buildCacheSlotCount - 1;
+    for (u64 slot = HashBytes64(path.str, path.size) & mask;; slot = (slot + 1) & mask)
+    {
+        u32 index = cache->slots[slot];
+        if (index == ~0u || cache->entries[index].path == path)
+        {
+            return &cache->slots[slot];
+        }
+    }
+}
+
+internal BuildCacheEntry *AddBuildCacheEntry(BuildCache *cache, string path, u64 hash)
+{
+    u32 *slot = FindBuildCacheSlot(cache, path);
+    if (*slot == ~0u)
+    {
+        Assert(cache->count < BUILD_CACHE_MAX_ENTRIES);
+        *slot                  = cache->count++;
+        BuildCacheEntry *entry = &cache->entries[*slot];
+        entry->path            = PushStr8Copy(cache->arena, path);
+    }
+    BuildCacheEntry *entry = &cache->entries[*slot];
+    entry->hash            = hash;
+    return entry;
+}
+
+// A missing or out of date cache file starts empty
+internal void LoadBuildCache(BuildCache *cache, Arena *arena, string filename, b32 rebuild)
+{
+    *cache          = {};
+    cache->arena    = arena;
+    cache->filename = PushStr8Copy(arena, filename);
+    cache->rebuild  = rebuild;
+    cache->entries  = PushArray(arena, BuildCacheEntry, BUILD_CACHE_MAX_ENTRIES);
+    cache->slots    = PushArrayNoZero(arena, u32, buildCacheSlotCount);
+    MemorySet(cache->slots, 0xff, sizeof(u32) * buildCacheSlotCount);
+
+    TempArena temp = ScratchStart(&arena, 1);
+    string data    = platform.ReadEntireFile(temp.arena, filename);
+    if (data.size < sizeof(u32) * 3)
+    {
+        ScratchEnd(temp);
+        return;
+    }
+
+    Tokenizer tokenizer;
+    tokenizer.input  = data;
+    tokenizer.cursor = tokenizer.input.str;
+
+    u32 magic, version, count;
+    GetPointerValue(&tokenizer, &magic);
+    GetPointerValue(&tokenizer, &version);
+    GetPointerValue(&tokenizer, &count);
+    if (magic != buildCacheMagic || version != BUILD_CACHE_VERSION)
+    {
+        Printf("Build cache %S is out of date, rebuilding everything\n", filename);
+        ScratchEnd(temp);
+        return;
+    }
+
+    // The file isn't written atomically, so a tool killed while saving leaves it truncated. Every read is checked
+    // against what's left, and a short or corrupt file is treated as empty.
+    b32 valid = count <= BUILD_CACHE_MAX_ENTRIES;
+    for (u32 i = 0; i < count && valid; i++)
+    {
+        u64 hash;
+        string path;
+        u64 remaining = data.size - (u64)(tokenizer.cursor - data.str);
+        if (remaining < sizeof(hash) + sizeof(path.size))
+        {
+            valid = 0;
+            break;
+        }
+        GetPointerValue(&tokenizer, &hash);
+        GetPointerValue(&tokenizer, &path.size);
+        remaining -= sizeof(hash) + sizeof(path.size);
+        if (path.size > remaining)
+        {
+            valid = 0;
+            break;
+        }
+        path.str = GetTokenCursor(&tokenizer, u8);
+        Advance(&tokenizer, (u32)path.size);
+        AddBuildCacheEntry(cache, path, hash);
+    }
+    if (!valid)
+    {
+        Printf("Build cache %S is corrupt, rebuilding everything\n", filename);
+        cache->count = 0;
+        MemoryZero(cache->entries, sizeof(BuildCacheEntry) * BUILD_CACHE_MAX_ENTRIES);
+        MemorySet(cache->slots, 0xff, sizeof(u32) * buildCacheSlotCount);
+    }
+    ScratchEnd(temp);
+}
+
+// Returns whether the outputs built from path are up to date, every one of them has to exist. Either way the entry is
+// kept when the cache is saved.
+internal b32 CheckBuildCache(BuildCache *cache, BuildCacheKind kind, string path, u64 hash, string *outputs,
+                             u32 outputCount)
+{
+    u32 index    = *FindBuildCacheSlot(cache, path);
+    b32 upToDate = !cache->rebuild && index != ~0u && cache->entries[index].hash == hash;
+    for (u32 i = 0; i < outputCount && upToDate; i++)
+    {
+        upToDate = platform.FileExists(outputs[i]);
+    }
+    if (index != ~0u)
+    {
+        cache->entries[index].visited = 1;
+    }
+
+    if (upToDate)
+    {
+        cache->hits[kind]++;
+    }
+    else
+    {
+        cache->misses[kind]++;
+    }
+    return upToDate;
+}
+
+// Call once the output was written
+internal void UpdateBuildCache(BuildCache *cache, string path, u64 hash)
+{
+    BuildCacheEntry *entry = AddBuildCacheEntry(cache, path, hash);
+    entry->visited         = 1;
+}
+
+// Entries that weren't checked this run belong to deleted inputs and are dropped
+internal void SaveBuildCache(BuildCache *cache)
+{
+    TempArena temp        = ScratchStart(&cache->arena, 1);
+    StringBuilder builder = {};
+    builder.arena         = temp.arena;
+
+    u32 count = 0;
+    for (u32 i = 0; i < cache->count; i++)
+    {
+        count += cache->entries[i].visited;
+    }
+    Put(&builder, buildCacheMagic);
+    Put(&builder, (u32)BUILD_CACHE_VERSION);
+    Put(&builder, count);
+    for (u32 i = 0; i < cache->count; i++)
+    {
+        BuildCacheEntry *entry = &cache->entries[i];
+        if (entry->visited)
+        {
+            PutPointerValue(&builder, &entry->hash);
+            PutPointerValue(&builder, &entry->path.size);
+            Put(&builder, entry->path);
+        }
+    }
+    if (!WriteEntireFile(&builder, cache->filename))
+    {
+        Printf("Could not write build cache %S\n", cache->filename);
+    }
+
+    const char *kindNames[] = {"Models", "Textures"};
+    for (u32 kind = 0; kind < BuildCacheKind_Count; kind++)
+    {
+        Printf("%s: %u up to date, %u rebuilt\n", kindNames[kind], cache->hits[kind], cache->misses[kind]);
+    }
+    Printf("Build cache: %u entries, %u stale entries dropped\n", count, cache->count - count);
+    ScratchEnd(temp);
+}
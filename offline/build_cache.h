@@ -0,0 +1,51 @@
+#ifndef BUILD_CACHE_H
+#define BUILD_CACHE_H
+
+//////////////////////////////
+// Build cache
+//
+// Bump whenever the output of the offline tool changes, every cached entry becomes a miss
+#define BUILD_CACHE_VERSION     2
+#define BUILD_CACHE_MAX_ENTRIES 4096
+
+enum BuildCacheKind
+{
+    BuildCacheKind_Model,
+    BuildCacheKind_Texture,
+    BuildCacheKind_Count,
+};
+
+struct BuildCacheEntry
+{
+    string path;
+    // Hash of the input bytes, its dependencies and the settings that produced the output
+    u64 hash;
+    b32 visited;
+};
+
+struct BuildCache
+{
+    Arena *arena;
+    string filename;
+
+    BuildCacheEntry *entries;
+    u32 count;
+    // Open addressing table of indices into entries, ~0u is empty
+    u32 *slots;
+
+    u32 hits[BuildCacheKind_Count];
+    u32 misses[BuildCacheKind_Count];
+    // Every check misses, the cache is still written at the end
+    b32 rebuild;
+};
+
+internal u64 CombineBuildHash(u64 hash, u64 value);
+internal u64 HashBuildInput(string path, u64 seed);
+
+internal void LoadBuildCache(BuildCache *cache, Arena *arena, string filename, b32 rebuild);
+internal b32 CheckBuildCache(BuildCache *cache, BuildCacheKind kind, string path, u64 hash, string *outputs,
+                             u32 outputCount);
+internal void UpdateBuildCache(BuildCache *cache, string path, u64 hash);
+internal void SaveBuildCache(BuildCache *cache);
+
+#endif
@@ -0,0 +1,384 @@
+#include "./mip_generation.h"
+
+//////////////////////////////
+// Mip generation
+//
+// Every level is filtered from the previous one with a separable filter, in linear space, with wrapping addressing
+// since most textures tile. Levels above 0 are kept as floats (two ping-pong buffers per chain) and converted back to
+// 8 bit once their alpha coverage scale is known.
+
+// Kaiser windowed sinc, support in destination texels
+const f32 mipKaiserWidth = 3.f;
+const f32 mipKaiserAlpha = 4.f;
+// Bins used to find the alpha test threshold that keeps the level 0 coverage
+const u32 mipCoverageBins = 4096;
+
+struct MipFilterTaps
+{
+    // First source texel of every destination texel, wraps around the edges
+    i32 *first;
+    // tapCount weights per destination texel
+    f32 *weights;
+    u32 tapCount;
+};
+
+struct MipChainState
+{
+    f32 *buffers[2];
+    MipFilterTaps tapsX;
+    MipFilterTaps tapsY;
+    f32 referenceCoverage;
+    f32 alphaScale;
+};
+
+internal u32 GetMipLevelCount(u32 width, u32 height)
+{
+    u32 result = 1;
+    for (u32 size = Max(width, height); size > 1; size >>= 1)
+    {
+        result++;
+    }
+    return Min(result, (u32)MAX_MIP_LEVELS);
+}
+
+// Modified bessel function of the first kind
+internal f32 BesselI0(f32 x)
+{
+    f32 result = 1.f;
+    f32 term   = 1.f;
+    f32 x2     = x * x * 0.25f;
+    for (u32 k = 1; k < 32; k++)
+    {
+        term *= x2 / (f32)(k * k);
+        result += term;
+        if (term < result * 1e-7f)
+        {
+            break;
+        }
+    }
+    return result;
+}
+
+internal f32 EvaluateMipFilter(MipFilter filter, f32 t)
+{
+    switch (filter)
+    {
+        case MipFilter_Box: return Abs(t) < 0.5f ? 1.f : 0.f;
+        case MipFilter_Kaiser:
+        {
+            if (Abs(t) >= mipKaiserWidth)
+            {
+                return 0.f;
+            }
+            f32 sinc   = t == 0.f ? 1.f : sinf(PI * t) / (PI * t);
+            f32 x      = t / mipKaiserWidth;
+            f32 window = BesselI0(mipKaiserAlpha * SquareRoot(1.f - x * x)) / BesselI0(mipKaiserAlpha);
+            return sinc * window;
+        }
+        default: Assert(0); return 0.f;
+    }
+}
+
+internal MipFilterTaps BuildMipFilterTaps(Arena *arena, MipFilter filter, u32 srcSize, u32 dstSize)
+{
+    f32 support = filter == MipFilter_Box ? 0.5f : mipKaiserWidth;
+    f32 scale   = (f32)srcSize / (f32)dstSize;
+
+    MipFilterTaps result;
+    result.tapCount = (u32)Floor(2.f * support * scale) + 2;
+    result.first    = PushArrayNoZero(arena, i32, dstSize);
+    result.weights  = PushArrayNoZero(arena, f32, dstSize * result.tapCount);
+    for (u32 dst = 0; dst < dstSize; dst++)
+    {
+        // Texel centers in source texels
+        f32 center        = ((f32)dst + 0.5f) * scale;
+        i32 first         = (i32)Floor(center - support * scale);
+        f32 *weights      = result.weights + dst * result.tapCount;
+        f32 total         = 0.f;
+        result.first[dst] = first;
+        for (u32 tap = 0; tap < result.tapCount; tap++)
+        {
+            f32 t        = ((f32)(first + (i32)tap) + 0.5f - center) / scale;
+            weights[tap] = EvaluateMipFilter(filter, t);
+            total += weights[tap];
+        }
+        for (u32 tap = 0; tap < result.tapCount; tap++)
+        {
+            weights[tap] /= total;
+        }
+    }
+    return result;
+}
+
+inline u32 WrapMipCoordinate(i32 coord, u32 size)
+{
+    i32 result = coord % (i32)size;
+    return (u32)(result < 0 ? result + (i32)size : result);
+}
+
+inline f32 SRGBToLinear(f32 value)
+{
+    return value <= 0.04045f ? value / 12.92f : Powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+inline f32 LinearToSRGB(f32 value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * Powf(value, 1.f / 2.4f) - 0.055f;
+}
+
+// Filters one row of level into the chain's float buffer. Level 1 reads the 8 bit source directly.
+internal void FilterMipRow(MipChain *chain, MipChainState *state, u32 level, u32 y, f32 *unorm8ToLinear)
+{
+    TempArena temp = ScratchStart(0, 0);
+    u32 srcWidth   = chain->levelWidths[level - 1];
+    u32 srcHeight  = chain->levelHeights[level - 1];
+    u32 dstWidth   = chain->levelWidths[level];
+    f32 *src       = state->buffers[level & 1];
+    f32 *dst       = state->buffers[(level - 1) & 1] + (u64)y * dstWidth * 4;
+
+    // Vertical pass into one row of source width
+    f32 *column    = PushArray(temp.arena, f32, srcWidth * 4);
+    f32 *converted = level == 1 ? PushArrayNoZero(temp.arena, f32, srcWidth * 4) : 0;
+    f32 *weightsY  = state->tapsY.weights + y * state->tapsY.tapCount;
+    for (u32 tap = 0; tap < state->tapsY.tapCount; tap++)
+    {
+        if (weightsY[tap] == 0.f)
+        {
+            continue;
+        }
+        u32 srcY = WrapMipCoordinate(state->tapsY.first[y] + (i32)tap, srcHeight);
+        f32 *row;
+        if (level == 1)
+        {
+            u8 *srcRow = chain->rgba + (u64)srcY * srcWidth * 4;
+            for (u32 i = 0; i < srcWidth * 4; i++)
+            {
+                converted[i] = unorm8ToLinear[((i & 3) == 3 ? 256 : 0) + srcRow[i]];
+            }
+            row = converted;
+        }
+        else
+        {
+            row = src + (u64)srcY * srcWidth * 4;
+        }
+        __m128 weight = _mm_set1_ps(weightsY[tap]);
+        for (u32 x = 0; x < srcWidth; x++)
+        {
+            __m128 value = _mm_add_ps(_mm_loadu_ps(column + x * 4), _mm_mul_ps(weight, _mm_loadu_ps(row + x * 4)));
+            _mm_storeu_ps(column + x * 4, value);
+        }
+    }
+
+    // Horizontal pass
+    __m128 zero = _mm_setzero_ps();
+    __m128 one  = _mm_set1_ps(1.f);
+    for (u32 x = 0; x < dstWidth; x++)
+    {
+        f32 *weightsX = state->tapsX.weights + x * state->tapsX.tapCount;
+        __m128 value  = _mm_setzero_ps();
+        for (u32 tap = 0; tap < state->tapsX.tapCount; tap++)
+        {
+            u32 srcX = WrapMipCoordinate(state->tapsX.first[x] + (i32)tap, srcWidth);
+            value    = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(weightsX[tap]), _mm_loadu_ps(column + srcX * 4)));
+        }
+        // The negative lobes ring past the range
+        value = _mm_min_ps(_mm_max_ps(value, zero), one);
+        _mm_storeu_ps(dst + x * 4, value);
+
+        if (chain->flags & MipFlags_Normal)
+        {
+            V3 normal  = {dst[x * 4 + 0] * 2.f - 1.f, dst[x * 4 + 1] * 2.f - 1.f, dst[x * 4 + 2] * 2.f - 1.f};
+            f32 length = Length(normal);
+            if (length > 1e-6f)
+            {
+                normal = normal / length;
+            }
+            else
+            {
+                normal = {0.f, 0.f, 1.f};
+            }
+            for (u32 c = 0; c < 3; c++)
+            {
+                dst[x * 4 + c] = normal.elements[c] * 0.5f + 0.5f;
+            }
+        }
+    }
+    ScratchEnd(temp);
+}
+
+// Scale for the alpha of level so that as many texels pass the alpha test as in level 0
+internal void ComputeAlphaScale(MipChain *chain, MipChainState *state, u32 level)
+{
+    state->alphaScale = 1.f;
+    if (chain->alphaCutoff <= 0.f || state->referenceCoverage <= 0.f || state->referenceCoverage >= 1.f)
+    {
+        return;
+    }
+    TempArena temp = ScratchStart(0, 0);
+    u32 *histogram = PushArray(temp.arena, u32, mipCoverageBins);
+    f32 *values    = state->buffers[(level - 1) & 1];
+    u64 texelCount = (u64)chain->levelWidths[level] * chain->levelHeights[level];
+    for (u64 i = 0; i < texelCount; i++)
+    {
+        u32 bin = Min((u32)(values[i * 4 + 3] * mipCoverageBins), mipCoverageBins - 1);
+        histogram[bin]++;
+    }
+    // Walk down from the top until the reference coverage is reached
+    u64 target = (u64)(state->referenceCoverage * texelCount + 0.5f);
+    u64 count  = 0;
+    u32 bin    = mipCoverageBins;
+    while (bin > 1 && count < target)
+    {
+        count += histogram[--bin];
+    }
+    f32 threshold     = Max((f32)bin / mipCoverageBins, 1.f / mipCoverageBins);
+    state->alphaScale = chain->alphaCutoff / threshold;
+    ScratchEnd(temp);
+}
+
+internal void ConvertMipRow(MipChain *chain, MipChainState *state, u32 level, u32 y)
+{
+    u32 width = chain->levelWidths[level];
+    f32 *src  = state->buffers[(level - 1) & 1] + (u64)y * width * 4;
+    u8 *dst   = chain->levels[level] + (u64)y * width * 4;
+    for (u32 x = 0; x < width; x++)
+    {
+        for (u32 c = 0; c < 3; c++)
+        {
+            f32 value      = src[x * 4 + c];
+            value          = (chain->flags & MipFlags_SRGB) ? LinearToSRGB(value) : value;
+            dst[x * 4 + c] = (u8)(Clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+        }
+        dst[x * 4 + 3] = (u8)(Clamp(src[x * 4 + 3] * state->alphaScale, 0.f, 1.f) * 255.f + 0.5f);
+    }
+}
+
+// Builds the full mip chain of every input. Rows of every chain's level are filtered in one batch of jobs, so must be
+// called from outside of a job.
+internal void GenerateMipChains(Arena *arena, MipChain *chains, u32 count, MipFilter filter)
+{
+    // 8 bit to linear, rgb then alpha
+    f32 unorm8ToLinear[512];
+    for (u32 i = 0; i < 256; i++)
+    {
+        unorm8ToLinear[i]       = i / 255.f;
+        unorm8ToLinear[256 + i] = i / 255.f;
+    }
+    f32 srgbToLinear[512];
+    for (u32 i = 0; i < 256; i++)
+    {
+        srgbToLinear[i]       = SRGBToLinear(i / 255.f);
+        srgbToLinear[256 + i] = i / 255.f;
+    }
+
+    MipChainState *states = PushArray(arena, MipChainState, count);
+    u32 maxLevelCount     = 0;
+    for (u32 chainIndex = 0; chainIndex < count; chainIndex++)
+    {
+        MipChain *chain        = &chains[chainIndex];
+        MipChainState *state   = &states[chainIndex];
+        chain->levelCount      = GetMipLevelCount(chain->width, chain->height);
+        chain->levels[0]       = chain->rgba;
+        chain->levelWidths[0]  = chain->width;
+        chain->levelHeights[0] = chain->height;
+        for (u32 level = 1; level < chain->levelCount; level++)
+        {
+            chain->levelWidths[level]  = Max(1u, chain->levelWidths[level - 1] / 2);
+            chain->levelHeights[level] = Max(1u, chain->levelHeights[level - 1] / 2);
+            chain->levels[level] =
+                PushArrayNoZero(arena, u8, (u64)chain->levelWidths[level] * chain->levelHeights[level] * 4);
+        }
+        maxLevelCount = Max(maxLevelCount, chain->levelCount);
+
+        // Odd levels go to buffers[0], even levels to buffers[1]
+        for (u32 level = 1; level < Min(chain->levelCount, 3u); level++)
+        {
+            state->buffers[(level - 1) & 1] =
+                PushArrayNoZero(arena, f32, (u64)chain->levelWidths[level] * chain->levelHeights[level] * 4);
+        }
+
+        if (chain->alphaCutoff > 0.f)
+        {
+            u64 texelCount = (u64)chain->width * chain->height;
+            u64 passed     = 0;
+            for (u64 i = 0; i < texelCount; i++)
+            {
+                passed += chain->rgba[i * 4 + 3] > chain->alphaCutoff * 255.f;
+            }
+            state->referenceCoverage = (f32)passed / texelCount;
+        }
+    }
+
+    u32 *rowChains = PushArrayNoZero(arena, u32, count);
+    u32 *rowStarts = PushArrayNoZero(arena, u32, count + 1);
+    for (u32 level = 1; level < maxLevelCount; level++)
+    {
+        // Chains that have this level, and the prefix sum of their rows
+        u32 levelChainCount = 0;
+        rowStarts[0]        = 0;
+        for (u32 chainIndex = 0; chainIndex < count; chainIndex++)
+        {
+            MipChain *chain = &chains[chainIndex];
+            if (level < chain->levelCount)
+            {
+                MipChainState *state = &states[chainIndex];
+                state->tapsX = BuildMipFilterTaps(arena, filter, chain->levelWidths[level - 1], chain->levelWidths[level]);
+                state->tapsY = BuildMipFilterTaps(arena, filter, chain->levelHeights[level - 1], chain->levelHeights[level]);
+                rowChains[levelChainCount]     = chainIndex;
+                rowStarts[levelChainCount + 1] = rowStarts[levelChainCount] + chain->levelHeights[level];
+                levelChainCount++;
+            }
+        }
+        u32 rowCount = rowStarts[levelChainCount];
+
+        auto FindRow = [&](u32 row, u32 *outY) {
+            u32 low  = 0;
+            u32 high = levelChainCount - 1;
+            while (low < high)
+            {
+                u32 mid = (low + high + 1) / 2;
+                if (rowStarts[mid] <= row)
+                {
+                    low = mid;
+                }
+                else
+                {
+                    high = mid - 1;
+                }
+            }
+            *outY = row - rowStarts[low];
+            return rowChains[low];
+        };
+
+        // Keep the number of groups within the job queue
+        jobsystem::Counter counter = {};
+        u32 groupSize              = Max(1u, (rowCount + 63) / 64);
+        jobsystem::KickJobs(
+            &counter, rowCount, groupSize, [&](jobsystem::JobArgs args) {
+                u32 y;
+                u32 chainIndex  = FindRow(args.jobId, &y);
+                MipChain *chain = &chains[chainIndex];
+                FilterMipRow(chain, &states[chainIndex], level, y,
+                             (chain->flags & MipFlags_SRGB) ? srgbToLinear : unorm8ToLinear);
+            },
+            jobsystem::Priority::High);
+        jobsystem::WaitJobs(&counter);
+
+        jobsystem::KickJobs(
+            &counter, levelChainCount, Max(1u, (levelChainCount + 63) / 64), [&](jobsystem::JobArgs args) {
+                u32 chainIndex = rowChains[args.jobId];
+                ComputeAlphaScale(&chains[chainIndex], &states[chainIndex], level);
+            },
+            jobsystem::Priority::High);
+        jobsystem::WaitJobs(&counter);
+
+        jobsystem::KickJobs(
+            &counter, rowCount, groupSize, [&](jobsystem::JobArgs args) {
+                u32 y;
+                u32 chainIndex = FindRow(args.jobId, &y);
+                ConvertMipRow(&chains[chainIndex], &states[chainIndex], level, y);
+            },
+            jobsystem::Priority::High);
+        jobsystem::WaitJobs(&counter);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef MIP_GENERATION_H
+#define MIP_GENERATION_H
+
+//////////////////////////////
+// Mip generation
+//
+#define MAX_MIP_LEVELS 16
+
+enum MipFilter
+{
+    MipFilter_Box,
+    MipFilter_Kaiser,
+};
+
+enum MipFlags
+{
+    MipFlags_SRGB   = 1 << 0, // rgb is srgb encoded, filtered in linear space
+    MipFlags_Normal = 1 << 1, // rgb is a unit vector remapped to [0, 1], renormalized every level
+};
+
+struct MipChain
+{
+    u8 *rgba;
+    u32 width;
+    u32 height;
+    u32 flags;
+    // Alpha test threshold whose coverage is preserved in every level. 0 filters alpha like any other channel.
+    f32 alphaCutoff;
+
+    // levels[0] is rgba
+    u8 *levels[MAX_MIP_LEVELS];
+    u32 levelWidths[MAX_MIP_LEVELS];
+    u32 levelHeights[MAX_MIP_LEVELS];
+    u32 levelCount;
+};
+
+internal u32 GetMipLevelCount(u32 width, u32 height);
+internal void GenerateMipChains(Arena *arena, MipChain *chains, u32 count, MipFilter filter);
+
+#endif
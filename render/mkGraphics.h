@@ -171,6 +171,11 @@ enum class Format
     R8G8_UNORM,
     R8G8B8A8_SRGB,
     R8G8B8A8_UNORM,
+    R8G8B8A8_UINT,
+
+    R16G16_SNORM,
+    R16G16_SFLOAT,
+    R16G16B16A16_UNORM,
 
     R32G32_SFLOAT,
     R32G32B32_SFLOAT,
@@ -182,6 +187,13 @@ enum class Format
     D24_UNORM_S8_UINT,
 
     BC1_RGB_UNORM,
+    BC1_RGB_SRGB,
+    BC3_RGBA_UNORM,
+    BC3_RGBA_SRGB,
+    BC4_R_UNORM,
+    BC5_RG_UNORM,
+    BC7_RGBA_UNORM,
+    BC7_RGBA_SRGB,
 
     Count,
 };
@@ -873,14 +885,22 @@ inline u32 GetFormatSize(Format format)
     switch (format)
     {
         case Format::BC1_RGB_UNORM:
+        case Format::BC1_RGB_SRGB:
+        case Format::BC4_R_UNORM:
         case Format::R32G32_UINT:
         case Format::R32G32_SFLOAT:
+        case Format::R16G16B16A16_UNORM:
         case Format::D32_SFLOAT_S8_UINT:
             return 8;
         case Format::R32G32B32_SFLOAT:
             return 12;
         case Format::R32G32B32A32_SFLOAT:
         case Format::R32G32B32A32_UINT:
+        case Format::BC3_RGBA_UNORM:
+        case Format::BC3_RGBA_SRGB:
+        case Format::BC5_RG_UNORM:
+        case Format::BC7_RGBA_UNORM:
+        case Format::BC7_RGBA_SRGB:
             return 16;
         case Format::B8G8R8_UNORM:
         case Format::B8G8R8_SRGB:
@@ -888,6 +908,9 @@ inline u32 GetFormatSize(Format format)
         case Format::R32_UINT:
         case Format::B8G8R8A8_UNORM:
         case Format::R8G8B8A8_UNORM:
+        case Format::R8G8B8A8_UINT:
+        case Format::R16G16_SNORM:
+        case Format::R16G16_SFLOAT:
         case Format::B8G8R8A8_SRGB:
         case Format::R8G8B8A8_SRGB:
         case Format::D24_UNORM_S8_UINT:
@@ -907,23 +930,41 @@ inline u32 GetBlockSize(Format format)
     switch (format)
     {
         case Format::BC1_RGB_UNORM:
+        case Format::BC1_RGB_SRGB:
+        case Format::BC3_RGBA_UNORM:
+        case Format::BC3_RGBA_SRGB:
+        case Format::BC4_R_UNORM:
+        case Format::BC5_RG_UNORM:
+        case Format::BC7_RGBA_UNORM:
+        case Format::BC7_RGBA_SRGB:
             return 4;
         default: return 1;
     }
 }
 
-inline u32 GetTextureSize(TextureDesc desc)
+// Block compressed levels round up to whole blocks
+inline u32 GetMipSize(TextureDesc desc, u32 mip)
 {
-    u32 size      = 0;
     u32 blockSize = GetBlockSize(desc.format);
     u32 stride    = GetFormatSize(desc.format);
-    const u32 x   = desc.width / blockSize;
-    const u32 y   = desc.height / blockSize;
+    u32 width     = Max(1u, desc.width >> mip);
+    u32 height    = Max(1u, desc.height >> mip);
+    const u32 x   = (width + blockSize - 1) / blockSize;
+    const u32 y   = (height + blockSize - 1) / blockSize;
+    return x * y * stride;
+}
+
+// All mips, tightly packed
+inline u32 GetTextureSize(TextureDesc desc)
+{
+    u32 size = 0;
 
-    Assert(desc.numMips == 1);
     Assert(desc.numLayers == 1);
     Assert(desc.depth == 1);
-    size += x * y * stride;
+    for (u32 mip = 0; mip < desc.numMips; mip++)
+    {
+        size += GetMipSize(desc, mip);
+    }
 
     return size;
 }
@@ -48,6 +48,11 @@ VkFormat ConvertFormat(Format value)
         case Format::R32G32_UINT: return VK_FORMAT_R32G32_UINT;
         case Format::R8G8B8A8_SRGB: return VK_FORMAT_R8G8B8A8_SRGB;
         case Format::R8G8B8A8_UNORM: return VK_FORMAT_R8G8B8A8_UNORM;
+        case Format::R8G8B8A8_UINT: return VK_FORMAT_R8G8B8A8_UINT;
+
+        case Format::R16G16_SNORM: return VK_FORMAT_R16G16_SNORM;
+        case Format::R16G16_SFLOAT: return VK_FORMAT_R16G16_SFLOAT;
+        case Format::R16G16B16A16_UNORM: return VK_FORMAT_R16G16B16A16_UNORM;
 
         case Format::R32G32_SFLOAT: return VK_FORMAT_R32G32_SFLOAT;
         case Format::R32G32B32_SFLOAT: return VK_FORMAT_R32G32B32_SFLOAT;
@@ -59,6 +64,13 @@ VkFormat ConvertFormat(Format value)
         case Format::D24_UNORM_S8_UINT: return VK_FORMAT_D24_UNORM_S8_UINT;
 
         case Format::BC1_RGB_UNORM: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case Format::BC1_RGB_SRGB: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case Format::BC3_RGBA_UNORM: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case Format::BC3_RGBA_SRGB: return VK_FORMAT_BC3_SRGB_BLOCK;
+        case Format::BC4_R_UNORM: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case Format::BC5_RG_UNORM: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case Format::BC7_RGBA_UNORM: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case Format::BC7_RGBA_SRGB: return VK_FORMAT_BC7_SRGB_BLOCK;
 
         default: Assert(0); return VK_FORMAT_UNDEFINED;
     }
@@ -2467,7 +2479,7 @@ void mkGraphicsVulkan::CreateTexture(Texture *outTexture, TextureDesc desc, void
     {
         TransferCommand cmd;
         void *mappedData = 0;
-        u64 texSize      = texVulk->allocation->GetSize();
+        u64 texSize      = GetTextureSize(desc);
         cmd              = Stage(texSize);
         mappedData       = cmd.ringAllocation->mappedData;
 
@@ -2491,17 +2503,24 @@ void mkGraphicsVulkan::CreateTexture(Texture *outTexture, TextureDesc desc, void
 
         if (cmd.IsValid())
         {
-            // Copy the contents of the staging buffer to the image
-            VkBufferImageCopy imageCopy               = {};
-            imageCopy.bufferOffset                    = cmd.ringAllocation->offset;
-            imageCopy.bufferRowLength                 = 0;
-            imageCopy.bufferImageHeight               = 0;
-            imageCopy.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageCopy.imageSubresource.mipLevel       = 0;
-            imageCopy.imageSubresource.baseArrayLayer = 0;
-            imageCopy.imageSubresource.layerCount     = 1;
-            imageCopy.imageOffset                     = {0, 0, 0};
-            imageCopy.imageExtent                     = {desc.width, desc.height, 1};
+            // Copy the contents of the staging buffer to the image, one region per mip
+            VkBufferImageCopy imageCopies[16] = {};
+            Assert(desc.numMips <= ArrayLength(imageCopies));
+            u64 bufferOffset = cmd.ringAllocation->offset;
+            for (u32 mip = 0; mip < desc.numMips; mip++)
+            {
+                VkBufferImageCopy &imageCopy              = imageCopies[mip];
+                imageCopy.bufferOffset                    = bufferOffset;
+                imageCopy.bufferRowLength                 = 0;
+                imageCopy.bufferImageHeight               = 0;
+                imageCopy.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+                imageCopy.imageSubresource.mipLevel       = mip;
+                imageCopy.imageSubresource.baseArrayLayer = 0;
+                imageCopy.imageSubresource.layerCount     = 1;
+                imageCopy.imageOffset                     = {0, 0, 0};
+                imageCopy.imageExtent                     = {Max(1u, desc.width >> mip), Max(1u, desc.height >> mip), 1};
+                bufferOffset += GetMipSize(desc, mip);
+            }
 
             // Layout transition to transfer destination before copying from the staging buffer
             VkImageMemoryBarrier2 barrier           = {};
@@ -2529,7 +2548,7 @@ void mkGraphicsVulkan::CreateTexture(Texture *outTexture, TextureDesc desc, void
 
             RingAllocator *ringAllocator = &stagingRingAllocators[cmd.ringAllocation->ringId];
             vkCmdCopyBufferToImage(cmd.cmdBuffer, ToInternal(&ringAllocator->transferRingBuffer)->buffer, texVulk->image,
-                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopy);
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, desc.numMips, imageCopies);
 
             // Transition to layout used in pipeline
             barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
@@ -1463,6 +1463,7 @@ internal void CullInstances(CommandList cmdList, bool isSecondPass)
         pc.nearZ                 = renderState->nearZ;
         pc.farZ                  = renderState->farZ;
         pc.meshClusterDescriptor = device->GetDescriptorIndex(&buffers[UploadType_MeshClusters], ResourceViewType::SRV);
+        pc.meshParamsDescriptor  = meshParamsDescriptor;
         device->BindCompute(&clusterCullPipeline, cmdList);
         device->PushConstants(cmdList, sizeof(pc), &pc);
         device->BindResource(&meshChunkBuffer, ResourceViewType::SRV, 0, cmdList);
@@ -1652,6 +1653,7 @@ internal void Render()
             GPUView view;
             view.worldToClip     = renderState->transform;
             view.prevWorldToClip = renderState->prevWorldToClip;
+            view.cameraPos       = renderState->camera.position;
             view.p22             = renderState->projection[2][2];
             view.p23             = renderState->projection[3][2];
             // view.prevP22         = renderState->prevP22;
@@ -1801,6 +1803,9 @@ internal void Render()
             LoadedSkeleton *skeleton = gameScene->skeletons.GetFromEntity(entity);
             if (skeleton)
             {
+                // Meshes of an animated instance skin with its matrices, the rest use the skeleton's rest pose
+                AnimationComponent *animation = gameScene->GetAnimation(entity);
+
                 pc.vertexPos        = mesh->vertexPosView.srvDescriptor;
                 pc.vertexNor        = mesh->vertexNorView.srvDescriptor;
                 pc.vertexTan        = mesh->vertexTanView.srvDescriptor;
@@ -1810,7 +1815,10 @@ internal void Render()
                 pc.soPos          = mesh->soPosView.uavDescriptor;
                 pc.soNor          = mesh->soNorView.uavDescriptor;
                 pc.soTan          = mesh->soTanView.uavDescriptor;
-                pc.skinningOffset = skeleton->skinningOffset;
+                pc.skinningOffset = animation ? animation->skinningOffset : skeleton->skinningOffset;
+                pc.quantized      = HasFlags(mesh->flags, MeshFlags_Quantized);
+                pc.positionMin    = MakeV4(mesh->bounds.minP, 0.f);
+                pc.positionExtent = MakeV4(mesh->bounds.maxP - mesh->bounds.minP, 0.f);
 
                 device->PushConstants(cmd, sizeof(pc), &pc);
                 device->Dispatch(cmd, (mesh->vertexCount + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE, 1, 1);
@@ -25,10 +25,15 @@ STRUCT(GPUView)
 {
     float4x4 worldToClip;
     float4x4 prevWorldToClip;
+    float3 cameraPos;
     float p22;
     float p23;
 };
 
+// Positions are unorm16 in the mesh bounds and normals/tangents are octahedral. Uvs, bone ids and weights
+// decode through their texel buffer format either way.
+#define MESH_GEOMETRY_QUANTIZED 1
+
 struct MeshGeometry
 {
     int vertexPos;
@@ -36,6 +41,7 @@ struct MeshGeometry
     int vertexTan;
     int vertexUv;
     int vertexInd;
+    uint flags;
 };
 
 struct MeshChunk
@@ -44,15 +50,26 @@ struct MeshChunk
     uint clusterOffset;
 };
 
+// Skinned clusters move with the pose. They are culled with the animated bounds of their instance in MeshParams.
+#define MESH_CLUSTER_SKINNED 1
+
+// Bounds and normal cone are in mesh space, see Mesh::Cluster
 struct MeshCluster
 {
     float3 minP;
     uint meshIndex;
     float3 maxP;
     uint indexOffset;
+    float3 sphereCenter;
+    float sphereRadius;
+    float3 coneApex;
+    float coneCutoff;
+    float3 coneAxis;
     uint indexCount;
     uint materialIndex;
-    uint2 _pad;
+    uint flags;
+    uint _pad1;
+    uint _pad2;
 };
 
 // an instance in a shader uses only one material, but in the cpu app code it can have multiple materials, so
@@ -75,6 +92,7 @@ struct DrawIndexedIndirectCommand
 
 #ifdef __cplusplus
 StaticAssert(sizeof(DrawIndexedIndirectCommand) == 20, IndirectStructSize);
+StaticAssert(sizeof(MeshCluster) == 96, MeshClusterSize);
 #endif
 
 UNIFORM(CascadeParams, CASCADE_PARAMS_BIND)
@@ -113,6 +131,12 @@ struct SkinningPushConstants
 
     int skinningOffset;
     int skinningBuffer;
+
+    // Source streams are MESH_GEOMETRY_QUANTIZED, positions are in the mesh bounds
+    uint quantized;
+    uint _pad0;
+    float4 positionMin;
+    float4 positionExtent;
 };
 
 #endif
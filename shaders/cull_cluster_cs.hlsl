@@ -33,13 +33,25 @@ void main(uint3 groupID : SV_GroupID, uint3 groupThreadID : SV_GroupThreadID)
     float4x4 mvp = mul(views[0].worldToClip, params.localToWorld);
 
     bool skip = false;
-    bool visible = true;
 
-    float4 aabb;
-    float minZ;
-    visible = true;
-    //visible = ProjectBoxAndFrustumCull(cluster.minP, cluster.maxP, mvp, push.nearZ, push.farZ,
-    //                                   push.isSecondPass, push.p22, push.p23, aabb, minZ);
+    float3 minP = cluster.minP;
+    float3 maxP = cluster.maxP;
+    if (cluster.flags & MESH_CLUSTER_SKINNED)
+    {
+        minP = params.minP;
+        maxP = params.maxP;
+    }
+    FrustumCullResults cullResults = ProjectBoxAndFrustumCull(minP, maxP, mvp,
+                                                              views[0].p22, views[0].p23, false);
+    bool visible = cullResults.isVisible;
+
+    // Normal cone backface culling. NOTE: assumes no non uniform scale in the mesh transform
+    if (visible && cluster.coneCutoff < 1.f)
+    {
+        float3 apex = mul(params.localToWorld, float4(cluster.coneApex, 1.f)).xyz;
+        float3 axis = normalize(mul(params.localToWorld, float4(cluster.coneAxis, 0.f)).xyz);
+        visible = dot(normalize(apex - views[0].cameraPos), axis) < cluster.coneCutoff;
+    }
 
     bool isClusterVisible = visible && !skip;
     uint clusterOffset;
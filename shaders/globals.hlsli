@@ -88,6 +88,26 @@ uint4 GetUint4(int descriptor, int vertexId)
     return result;
 }
 
+// See EncodeOctahedral
+float3 DecodeOctahedral(float2 e)
+{
+    float3 n = float3(e, 1 - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += select(n.xy >= 0, -t, t);
+    return normalize(n);
+}
+
+float3 GetPosition(int descriptor, int vertexId, bool quantized, float3 minP, float3 extent)
+{
+    float3 result = GetFloat3(descriptor, vertexId);
+    return quantized ? minP + result * extent : result;
+}
+
+float3 GetUnitVector(int descriptor, int vertexId, bool quantized)
+{
+    return quantized ? DecodeOctahedral(GetFloat2(descriptor, vertexId)) : GetFloat3(descriptor, vertexId);
+}
+
 float3 ApplySRGBCurve(float3 x)
 {
     return select(x < 0.0031308, 12.92 * x, 1.055 * pow(x, 1.0 / 2.4) - 0.055);
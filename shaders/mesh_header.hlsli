@@ -44,12 +44,13 @@ FragmentInput main(VertexInput input)
     MeshParams params = bindlessMeshParams[push.meshParamsDescriptor][cluster.meshIndex];
     MeshGeometry geo = bindlessMeshGeometry[push.geometryDescriptor][cluster.meshIndex];
 
-    float3 pos = GetFloat3(geo.vertexPos, input.vertexID);
+    bool quantized = (geo.flags & MESH_GEOMETRY_QUANTIZED) != 0;
+    float3 pos = GetPosition(geo.vertexPos, input.vertexID, quantized, params.minP, params.maxP - params.minP);
 
 #ifdef MESH_PASS
     float2 uv = GetFloat2(geo.vertexUv, input.vertexID);
-    float3 n = GetFloat3(geo.vertexNor, input.vertexID);
-    float3 tangent = GetFloat3(geo.vertexTan, input.vertexID);
+    float3 n = GetUnitVector(geo.vertexNor, input.vertexID, quantized);
+    float3 tangent = GetUnitVector(geo.vertexTan, input.vertexID, quantized);
 #endif
     float4 modelSpacePos = float4(pos, 1.0);
 #ifdef MESH_PASS
@@ -90,7 +91,9 @@ float4 main(FragmentInput fragment) : SV_Target
     }
     if (material.normal >= 0)
     {
-        normal = normalize(bindlessTextures[material.normal].Sample(samplerLinearWrap, fragment.uv).rgb * 2 - 1);
+        // Normal maps are BC5, z is reconstructed
+        float2 normalXY = bindlessTextures[material.normal].Sample(samplerLinearWrap, fragment.uv).rg * 2 - 1;
+        normal = float3(normalXY, sqrt(saturate(1 - dot(normalXY, normalXY))));
     }
     float viewZ = abs(fragment.viewFragZ);
 
@@ -20,9 +20,10 @@ void main(uint3 DTid : SV_DispatchThreadID)
 
     ByteAddressBuffer skinningBuffer = bindlessBuffers[push.skinningBuffer];
 
-    float3 pos = GetFloat3(push.vertexPos, vertexID);
-    float3 nor = GetFloat3(push.vertexNor, vertexID);
-    float3 tan = GetFloat3(push.vertexTan, vertexID);
+    bool quantized = push.quantized != 0;
+    float3 pos = GetPosition(push.vertexPos, vertexID, quantized, push.positionMin.xyz, push.positionExtent.xyz);
+    float3 nor = GetUnitVector(push.vertexNor, vertexID, quantized);
+    float3 tan = GetUnitVector(push.vertexTan, vertexID, quantized);
 
     uint4 boneIds = GetUint4(push.vertexBoneId, vertexID);
     float4 boneWeights = GetFloat4(push.vertexBoneWeight, vertexID);